@@ -5,6 +5,9 @@
 #include <iostream>
 #include <fstream>
 #include <cassert>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
 
 // ofx
 #include "ofxCore.h"
@@ -22,11 +25,16 @@
 #include "ofxhPluginCache.h"
 #include "ofxhHost.h"
 #include "ofxhImageEffectAPI.h"
+#include "ofxhTrace.h"
+#include "ofxhIPC.h"
+#include "ofxhRemoteEffect.h"
 
 // my host
 #include "hostDemoHostDescriptor.h"
 #include "hostDemoEffectInstance.h"
 #include "hostDemoClipInstance.h"
+#include "hostDemoFrameWriter.h"
+#include "hostDemoBatchRender.h"
    
 ////////////////////////////////////////////////////////////////////////////////
 // This example code can only work with the example 'invert' plugin built
@@ -43,32 +51,123 @@
 // It works by hard coding progressive PAL SD imagery to input and output clips,
 // the images are black going in (and should be white coming out of the plugin).
 //
-// There is no file io to work with this.
+// The only file io is writing the output frames, add -format ppm|pfm|raw
+// to pick the format, it defaults to binary ppm.
+//
+// Run it as
+//    hostDemo -batch <first> <last> [<framesInFlight>]
+// to render a frame range with several frames in flight, as the plugin's
+// thread safety allows, and report the throughput and per frame latency.
+//
+// Add -trace <file> to record every action and suite call as Chrome trace
+// event JSON in file, and print the latency of each action at the end.
+//
+// Add -cacheActions to cache the results of the region, identity and frame
+// range actions, and print the hit rates of the main instance at the end.
+//
+// Add -workers <n> to a batch render to render in n worker processes rather
+// than in the host, with images passed in shared memory. The workers are
+// this executable run again with -worker <fd>, which must come first.
+//
+// Run it as
+//    hostDemo -checkChanges
+// to check that telling the instance of a batch of param and clip changes
+// invalidates its action cache exactly once, and exit non zero if not.
+//
+// Run it as
+//    hostDemo -listen [<host>:]<port>
+// to be a render node, and add -connect <host>:<port>[,<host>:<port>...] to
+// a batch render on another machine to spread its frames over those nodes.
+// Images go over the network, so the nodes only need the plugins on their own
+// OFX_PLUGIN_PATH. A node listens on the loopback interface unless given a
+// host, 0.0.0.0 for every interface, and trusts whoever connects, so only
+// open it up on a trusted network. Add -tiles <n> to render a frame at a time instead, each
+// split into n tiles spread over the workers.
 
-void exportToPPM(const std::string& fname, MyHost::MyImage* im)
+/// write the trace out, if we were asked for one
+static void finishTrace(const char *traceFile)
 {
-  std::ofstream op(fname.c_str());
-  OfxRectI rod = im->getROD();
-  op << "P3" << "\t# FORMAT" << std::endl;
-  op << rod.x2 - rod.x1 << "\t#WIDTH" << std::endl;
-  op << rod.y2 - rod.y1 << "\t#HEIGHT" <<std::endl;
-  //This assumes 8-bit.
-  op << "255" << std::endl;
-  for (int y = rod.y1; y< rod.y2; ++y)
-  {
-    for (int x = rod.x1; x < rod.x2; ++x)
-    {
-      OfxRGBAColourB* pix = im->pixel(x,y);
-      if(pix)
-        op << (int)pix->r << " " << (int)pix->g << " " << (int)pix->b << " " << std::endl;
-      else
-        op << "0 0 0" << std::endl;
-    }
+  if(!traceFile)
+    return;
+  if(OFX::Host::Trace::writeChromeTrace(std::string(traceFile)))
+    std::cout << "Wrote trace to " << traceFile << std::endl;
+  else
+    std::cout << "Failed to write trace to " << traceFile << std::endl;
+  std::cout << "Latencies by plugin and action" << std::endl;
+  OFX::Host::Trace::printLatencySummary(std::cout);
+}
+
+/// how many times the instance's action cache is invalidated while doing something
+template <class F>
+static size_t countInvalidations(OFX::Host::ImageEffect::Instance &instance, F doIt)
+{
+  instance.getActionCache().resetStats();
+  doIt();
+  return instance.getActionCache().getStats().invalidations;
+}
+
+/// Tell the instance of changes to one param, then of a batch of changes to
+/// every param and clip, then of the same changes one at a time, and check
+/// each batch invalidates the action cache exactly once. Returns true if it
+/// passes.
+static bool checkBatchedChanges(OFX::Host::ImageEffect::Instance &instance)
+{
+  std::vector<std::string> params;
+  const std::list<OFX::Host::Param::Instance *> &paramList = instance.getParamList();
+  for(std::list<OFX::Host::Param::Instance *>::const_iterator it = paramList.begin(); it != paramList.end(); ++it)
+    params.push_back((*it)->getName());
+  std::vector<std::string> clips;
+  for(int i = 0; i < instance.getNClips(); ++i)
+    clips.push_back(instance.getNthClip(i)->getName());
+  if(params.empty() && clips.empty()) {
+    std::cout << "Nothing to change" << std::endl;
+    return false;
   }
+
+  bool wasEnabled = instance.getActionCache().isEnabled();
+  instance.getActionCache().setEnabled(true); // only counted when on
+
+  OfxPointD renderScale;
+  renderScale.x = renderScale.y = 1.0;
+  auto batch = [&](size_t nParams, size_t nClips) {
+    instance.beginChanges(kOfxChangeUserEdited, 0, renderScale);
+    for(size_t i = 0; i < nParams; ++i)
+      instance.paramChanged(params[i]);
+    for(size_t i = 0; i < nClips; ++i)
+      instance.clipChanged(clips[i]);
+    instance.endChanges();
+  };
+
+  size_t nOne = countInvalidations(instance, [&]() { batch(params.empty() ? 0 : 1, params.empty() ? 1 : 0); });
+  size_t nAll = countInvalidations(instance, [&]() { batch(params.size(), clips.size()); });
+  size_t nEach = countInvalidations(instance, [&]() {
+      for(size_t i = 0; i < params.size(); ++i)
+        instance.paramChanged(params[i]);
+      for(size_t i = 0; i < clips.size(); ++i)
+        instance.clipChanged(clips[i]);
+    });
+
+  instance.getActionCache().setEnabled(wasEnabled);
+
+  size_t nChanges = params.size() + clips.size();
+  std::cout << "Action cache invalidations, one change: " << nOne
+            << ", batch of " << nChanges << ": " << nAll
+            << ", " << nChanges << " unbatched: " << nEach << std::endl;
+  bool ok = nOne == 1 && nAll == 1 && nEach == nChanges;
+  std::cout << (ok ? "Batched changes check passed" : "Batched changes check FAILED") << std::endl;
+  return ok;
 }
 
 int main(int argc, char **argv) 
 {
+  // are we a worker process started by -workers
+  if(argc == 3 && strcmp(argv[1], "-worker") == 0)
+    return OFX::Host::ImageEffect::runWorker(atoi(argv[2]));
+
+  // or a render node waiting on hosts to -connect
+  if(argc == 3 && strcmp(argv[1], "-listen") == 0)
+    return OFX::Host::ImageEffect::serveWorkers(argv[2]);
+
   //_CrtSetBreakAlloc(3168);
 #ifdef _WIN32
   _CrtSetDbgFlag ( _CRTDBG_ALLOC_MEM_DF | _CRTDBG_LEAK_CHECK_DF );
@@ -76,6 +175,61 @@ int main(int argc, char **argv)
   // set the version label in the global cache
   OFX::Host::PluginCache::getPluginCache()->setCacheVersion("hostDemoV1");
 
+  // look for a batch render and output format on the command line
+  bool batch = false;
+  int batchFirst = 0, batchLast = 0;
+  unsigned int framesInFlight = std::thread::hardware_concurrency();
+  MyHost::OutputFormatEnum outputFormat = MyHost::eOutputPPM;
+  const char *traceFile = NULL;
+  bool cacheActions = false;
+  int nWorkers = 0;
+  std::vector<std::string> nodes;
+  unsigned int nTiles = 0;
+  bool checkChanges = false;
+  for(int i = 1; i < argc; ++i) {
+    if(strcmp(argv[i], "-batch") == 0 && i + 2 < argc) {
+      batch = true;
+      batchFirst = atoi(argv[++i]);
+      batchLast = atoi(argv[++i]);
+      if(i + 1 < argc && argv[i + 1][0] != '-')
+        framesInFlight = (unsigned int)atoi(argv[++i]);
+    }
+    else if(strcmp(argv[i], "-format") == 0 && i + 1 < argc) {
+      if(!MyHost::getOutputFormat(argv[++i], outputFormat))
+        std::cout << "unknown output format " << argv[i] << ", writing ppm" << std::endl;
+    }
+    else if(strcmp(argv[i], "-trace") == 0 && i + 1 < argc) {
+      traceFile = argv[++i];
+    }
+    else if(strcmp(argv[i], "-cacheActions") == 0) {
+      cacheActions = true;
+    }
+    else if(strcmp(argv[i], "-workers") == 0 && i + 1 < argc) {
+      nWorkers = atoi(argv[++i]);
+    }
+    else if(strcmp(argv[i], "-connect") == 0 && i + 1 < argc) {
+      std::string list = argv[++i];
+      for(size_t start = 0; start < list.size(); ) {
+        size_t comma = list.find(',', start);
+        if(comma == std::string::npos)
+          comma = list.size();
+        if(comma > start)
+          nodes.push_back(list.substr(start, comma - start));
+        start = comma + 1;
+      }
+    }
+    else if(strcmp(argv[i], "-tiles") == 0 && i + 1 < argc) {
+      nTiles = (unsigned int)atoi(argv[++i]);
+    }
+    else if(strcmp(argv[i], "-checkChanges") == 0) {
+      checkChanges = true;
+    }
+  }
+  if(framesInFlight == 0)
+    framesInFlight = 1;
+  if(traceFile)
+    OFX::Host::Trace::setEnabled(true);
+
   // create our derived image effect host which provides
   // a factory to make plugin instances and acts
   // as a description of the host application
@@ -100,7 +254,7 @@ int main(int argc, char **argv)
   of.close();
 
   // get the invert example plugin which uses the OFX C++ support code
-  OFX::Host::ImageEffect::ImageEffectPlugin* plugin = imageEffectPluginCache.getPluginById("net.sf.openfx:invertPlugin");
+  OFX::Host::ImageEffect::ImageEffectPlugin* plugin = imageEffectPluginCache.getPluginById("net.sf.openfx.invertPlugin");
 
   imageEffectPluginCache.dumpToStdOut();
 
@@ -110,10 +264,20 @@ int main(int argc, char **argv)
 
     std::unique_ptr<OFX::Host::ImageEffect::Instance> instance(plugin->createInstance(kOfxImageEffectContextFilter, NULL));
 
+    // describing the plugin in the filter context dirties the cache, flush it again so
+    // the next run can make the instance from the cache without describing it
+    if(OFX::Host::PluginCache::getPluginCache()->dirty()) {
+      std::ofstream cacheOut("hostDemoPluginCache.xml");
+      OFX::Host::PluginCache::getPluginCache()->writePluginCache(cacheOut);
+    }
+
     if(instance)
     {
         OfxStatus stat;
 
+      // do this first so the batch renderer's clones cache too
+      instance->getActionCache().setEnabled(cacheActions);
+
       // now we need to call the create instance action. Only call this once you have initialised all the params
       // and clips to their correct values. So if you are loading a saved plugin state, set up your params from
       // that state, _then_ call create instance.
@@ -124,6 +288,13 @@ int main(int argc, char **argv)
       // logic and caches away the components and depth on each clip.
       bool ok = instance->getClipPreferences();
       assert(ok);
+
+      if(checkChanges) {
+        bool passed = checkBatchedChanges(*instance);
+        instance.reset();
+        OFX::Host::PluginCache::clearPluginCache();
+        return passed ? 0 : 1;
+      }
       
       // current render scale of 1
       OfxPointD renderScale;
@@ -142,6 +313,42 @@ int main(int argc, char **argv)
       regionOfInterest.x2 = renderWindow.x2 * instance->getProjectPixelAspectRatio();
       regionOfInterest.y2 = 576;
       
+      if(batch) {
+        // start the workers, which rerun this executable
+        OFX::Host::IPC::WorkerPool workers;
+        if(!nodes.empty()) {
+          if(!workers.connect(nodes))
+            std::cout << "Failed to connect to the render nodes, rendering in process" << std::endl;
+        }
+        else if(nWorkers > 0) {
+          std::vector<std::string> command;
+          command.push_back("/proc/self/exe");
+          command.push_back("-worker");
+          if(workers.start(command, nWorkers))
+            MyHost::MyImage::setUseSharedMemory(true);
+          else
+            std::cout << "Failed to start the workers, rendering in process" << std::endl;
+        }
+
+        {
+          // the batch renderer's clones need to go before the instance does
+          MyHost::BatchRender batchRender(*instance, batchFirst, batchLast, 1.0, framesInFlight, outputFormat, "Output",
+                                          workers.getNumWorkers() > 0 ? &workers : NULL);
+          stat = batchRender.run(renderWindow, renderScale, nTiles);
+        }
+        if(workers.getNumWorkers() > 0)
+          std::cout << workers.getNumRestarts() << " workers restarted" << std::endl;
+        workers.shutdown();
+        if(cacheActions) {
+          std::cout << "Action cache" << std::endl;
+          instance->getActionCache().printStats(std::cout);
+        }
+        instance.reset();
+        OFX::Host::PluginCache::clearPluginCache();
+        finishTrace(traceFile);
+        return stat == kOfxStatOK ? 0 : 1;
+      }
+
       int numFramesToRender = OFXHOSTDEMOCLIPLENGTH;
 
       // say we are about to render a bunch of frames 
@@ -153,6 +360,9 @@ int main(int argc, char **argv)
       MyHost::MyClipInstance* outputClip = dynamic_cast<MyHost::MyClipInstance*>(instance->getClip("Output"));
       assert(outputClip);
 
+      // frames are written behind the renders on another thread
+      MyHost::FrameWriteQueue output(outputFormat, "Output");
+
       for(int t = 0; t <= numFramesToRender; ++t) 
       {
         // call get region of interest on each of the inputs
@@ -173,18 +383,27 @@ int main(int argc, char **argv)
         stat = instance->renderAction(t,kOfxImageFieldBoth,renderWindow, renderScale, /*sequential=*/true, /*interactive=*/false, /*draft=*/false);
         assert(stat == kOfxStatOK);
 
-        // get the output image buffer
+        // copy the output image buffer out and queue it for writing
         MyHost::MyImage *outputImage = outputClip->getOutputImage();
-
-        std::ostringstream ss;
-        ss << "Output." << t << ".ppm";
-        exportToPPM(ss.str(), outputImage);
+        MyHost::OutputFrame *outputFrame = new MyHost::OutputFrame;
+        if(outputFrame->copyFrom(*outputImage, t))
+          output.submit(outputFrame);
+        else
+          delete outputFrame;
       }
 
+      output.flush();
+
       instance->endRenderAction(0, numFramesToRender, 1.0, false, renderScale, /*sequential=*/true, /*interactive=*/false
                                 );
+
+      if(cacheActions) {
+        std::cout << "Action cache" << std::endl;
+        instance->getActionCache().printStats(std::cout);
+      }
     }
   }
   OFX::Host::PluginCache::clearPluginCache();
+  finishTrace(traceFile);
   return 0;
 }
@@ -0,0 +1,251 @@
+// Copyright OpenFX and contributors to the OpenFX project.
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <iostream>
+#include <cmath>
+#include <algorithm>
+#include <thread>
+
+// ofx
+#include "ofxCore.h"
+#include "ofxImageEffect.h"
+#include "ofxPixels.h"
+
+// ofx host
+#include "ofxhBinary.h"
+#include "ofxhPropertySuite.h"
+#include "ofxhClip.h"
+#include "ofxhParam.h"
+#include "ofxhMemory.h"
+#include "ofxhImageEffect.h"
+#include "ofxhPluginAPICache.h"
+#include "ofxhPluginCache.h"
+#include "ofxhHost.h"
+#include "ofxhImageEffectAPI.h"
+#include "ofxhRenderCoordinator.h"
+
+// my host
+#include "hostDemoHostDescriptor.h"
+#include "hostDemoEffectInstance.h"
+#include "hostDemoClipInstance.h"
+#include "hostDemoBatchRender.h"
+
+namespace MyHost {
+
+  /// print min/mean/max of a set of latencies in milliseconds
+  static void reportLatency(const char *label, const std::vector<double> &secs)
+  {
+    if(secs.empty())
+      return;
+
+    double lo = secs[0], hi = secs[0], sum = 0;
+    for(std::vector<double>::const_iterator it = secs.begin(); it != secs.end(); ++it) {
+      lo = std::min(lo, *it);
+      hi = std::max(hi, *it);
+      sum += *it;
+    }
+
+    std::cout << "  " << label << " latency (ms) min " << lo * 1000.0
+              << " mean " << sum * 1000.0 / secs.size()
+              << " max " << hi * 1000.0 << std::endl;
+  }
+
+  MyRenderScheduler::MyRenderScheduler(OFX::Host::ImageEffect::Instance &instance, unsigned int framesInFlight)
+    : OFX::Host::ImageEffect::RenderScheduler(instance, framesInFlight, framesInFlight ? framesInFlight - 1 : 0)
+  {
+  }
+
+  /// our params are all constants, so a fresh instance already matches
+  OfxStatus MyRenderScheduler::syncRenderClone(OFX::Host::ImageEffect::Instance &/*clone*/)
+  {
+    return kOfxStatOK;
+  }
+
+  BatchRender::BatchRender(OFX::Host::ImageEffect::Instance &instance,
+                           OfxTime first, OfxTime last, OfxTime step,
+                           unsigned int framesInFlight,
+                           OutputFormatEnum format,
+                           const std::string &fileStem,
+                           OFX::Host::IPC::WorkerPool *workers)
+    : _scheduler(instance, framesInFlight)
+    , _first(first)
+    , _last(last)
+    , _step(step > 0 ? step : 1)
+    , _queueSize(framesInFlight ? framesInFlight : 1)
+    , _output(format, fileStem, framesInFlight ? framesInFlight : 1, 4, this)
+    , _nextToWrite(0)
+    , _renderDone(false)
+  {
+    _scheduler.setWorkerPool(workers);
+
+    int nFrames = frameIndex(_last) + 1;
+    if(nFrames < 0)
+      nFrames = 0;
+    _started.resize(nFrames);
+    _renderLatency.resize(nFrames, 0.0);
+    _totalLatency.resize(nFrames, 0.0);
+    _written.resize(nFrames, 0);
+  }
+
+  BatchRender::~BatchRender()
+  {
+    for(std::map<int, OutputFrame *>::iterator it = _pending.begin(); it != _pending.end(); ++it)
+      delete it->second;
+  }
+
+  int BatchRender::frameIndex(OfxTime time) const
+  {
+    return int(std::floor((time - _first) / _step + 0.5));
+  }
+
+  /// frames are started in index order, so the index each thread sets is its own
+  void BatchRender::frameStarted(OfxTime time)
+  {
+    _started[frameIndex(time)] = Clock::now();
+  }
+
+  /// copy the frame out of the output clip, then hand it to the writer
+  void BatchRender::frameRendered(OFX::Host::ImageEffect::Instance &instance, OfxTime time, OfxStatus stat)
+  {
+    int index = frameIndex(time);
+    _renderLatency[index] = std::chrono::duration<double>(Clock::now() - _started[index]).count();
+
+    // copy it out now, the next render on this instance will overwrite it
+    OutputFrame *frame = new OutputFrame;
+    frame->time = time;
+    MyClipInstance *outputClip = dynamic_cast<MyClipInstance *>(instance.getClip("Output"));
+    MyImage *image = outputClip ? outputClip->getOutputImage() : NULL;
+    if(stat != kOfxStatOK || !image || !frame->copyFrom(*image, time))
+      frame->data.clear();
+
+    // don't wait for room here, we are still holding the instance
+    std::lock_guard<std::mutex> guard(_lock);
+    _pending[index] = frame;
+    _queueChanged.notify_all();
+  }
+
+  /// hold the render thread back if it has got too far ahead of the writer
+  void BatchRender::frameFinished(OfxTime time)
+  {
+    // The frame the writer wants next never waits, frames are started in
+    // order, and a thread waiting here holds no instance, so whoever is
+    // holding up the queue is always able to finish.
+    int index = frameIndex(time);
+    std::unique_lock<std::mutex> guard(_lock);
+    while(index - _nextToWrite >= int(_queueSize))
+      _queueChanged.wait(guard);
+  }
+
+  /// called on the write queue's thread as each frame hits the disk
+  void BatchRender::frameWritten(const OutputFrame &frame, bool ok)
+  {
+    int index = frameIndex(frame.time);
+    _totalLatency[index] = std::chrono::duration<double>(Clock::now() - _started[index]).count();
+    _written[index] = ok;
+    if(!ok)
+      std::cout << "Failed to write frame " << frame.time << std::endl;
+  }
+
+  void BatchRender::writeFrames()
+  {
+    while(true) {
+      OutputFrame *frame = NULL;
+      {
+        std::unique_lock<std::mutex> guard(_lock);
+        while(_pending.find(_nextToWrite) == _pending.end() && !_renderDone)
+          _queueChanged.wait(guard);
+
+        std::map<int, OutputFrame *>::iterator it = _pending.find(_nextToWrite);
+        if(it == _pending.end())
+          return; // rendering stopped and there is nothing left in order
+        frame = it->second;
+        _pending.erase(it);
+      }
+
+      // a failed render has nothing to save
+      if(frame->data.empty())
+        delete frame;
+      else
+        _output.submit(frame);
+
+      std::lock_guard<std::mutex> guard(_lock);
+      ++_nextToWrite;
+      _queueChanged.notify_all();
+    }
+  }
+
+  OfxStatus BatchRender::renderTiles(const OfxRectI &renderWindow, OfxPointD renderScale, unsigned int nTiles)
+  {
+    OfxStatus stat = _scheduler.beginSequenceRender(_first, _last, _step, false, renderScale, true, false);
+    if(stat != kOfxStatOK && stat != kOfxStatReplyDefault)
+      return stat;
+
+    stat = kOfxStatOK;
+    for(OfxTime t = _first; t <= _last && stat == kOfxStatOK; t += _step) {
+      frameStarted(t);
+      stat = _scheduler.renderTiled(t, kOfxImageFieldBoth, renderWindow, renderScale,
+                                    /*sequential=*/true, /*interactive=*/false, /*draft=*/false, nTiles);
+      frameRendered(_scheduler.getInstance(), t, stat);
+      frameFinished(t);
+    }
+
+    OfxStatus endStat = _scheduler.endSequenceRender();
+    if(stat == kOfxStatOK && endStat != kOfxStatOK && endStat != kOfxStatReplyDefault)
+      stat = endStat;
+    return stat;
+  }
+
+  OfxStatus BatchRender::run(const OfxRectI &renderWindow, OfxPointD renderScale, unsigned int nTiles)
+  {
+    std::cout << "Batch rendering frames " << _first << " to " << _last
+              << ", " << _scheduler.getFrameConcurrency() << " rendering at once, "
+              << _queueSize << " in flight" << std::endl;
+
+    Clock::time_point start = Clock::now();
+
+    std::thread writer(&BatchRender::writeFrames, this);
+
+    OfxStatus stat;
+    if(nTiles > 0)
+      stat = renderTiles(renderWindow, renderScale, nTiles);
+    else
+      stat = _scheduler.renderSequence(_first, _last, _step, kOfxImageFieldBoth,
+                                       renderWindow, renderScale,
+                                       /*interactive=*/false, /*draft=*/false, this);
+
+    {
+      std::lock_guard<std::mutex> guard(_lock);
+      _renderDone = true;
+      _queueChanged.notify_all();
+    }
+    writer.join();
+    _output.flush();
+    if(stat == kOfxStatOK && !_output.ok())
+      stat = kOfxStatFailed; // rendered fine but did not all reach the disk
+
+    double secs = std::chrono::duration<double>(Clock::now() - start).count();
+
+    // only frames that made it to disk count
+    std::vector<double> render, total;
+    for(size_t i = 0; i < _written.size(); ++i) {
+      if(_written[i]) {
+        render.push_back(_renderLatency[i]);
+        total.push_back(_totalLatency[i]);
+      }
+    }
+    int nWritten = int(render.size());
+
+    std::cout << "Batch render " << (stat == kOfxStatOK ? "succeeded" : "failed")
+              << ", " << nWritten << " frames in " << secs << "s, "
+              << (secs > 0 ? nWritten / secs : 0.0) << " frames/s" << std::endl;
+
+    reportLatency("render", render);
+    reportLatency("render to disk", total);
+
+    if(_scheduler.getCoordinator())
+      _scheduler.getCoordinator()->printStats(std::cout);
+
+    return stat;
+  }
+
+}
@@ -0,0 +1,94 @@
+// Copyright OpenFX and contributors to the OpenFX project.
+// SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef HOST_DEMO_BATCH_RENDER_H
+#define HOST_DEMO_BATCH_RENDER_H
+
+#include <map>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+#include "ofxhRenderScheduler.h"
+#include "hostDemoFrameWriter.h"
+
+namespace MyHost {
+
+  /// Our render scheduler. The demo params hold no state, so there is
+  /// nothing to copy onto a render clone, and cloning always succeeds.
+  class MyRenderScheduler : public OFX::Host::ImageEffect::RenderScheduler {
+  protected :
+    virtual OfxStatus syncRenderClone(OFX::Host::ImageEffect::Instance &clone);
+
+  public :
+    MyRenderScheduler(OFX::Host::ImageEffect::Instance &instance, unsigned int framesInFlight);
+  };
+
+  /// Renders a frame range with several frames in flight at once. As each
+  /// frame completes it is copied out of the output clip into a bounded
+  /// reorder queue, and a thread hands the frames to the write-behind
+  /// queue in frame order. Render threads block if they get too far ahead,
+  /// once they have given back the instance they rendered on.
+  class BatchRender : public OFX::Host::ImageEffect::RenderScheduler::FrameDoneI
+                    , public FrameWriteQueue::FrameWrittenI {
+  protected :
+    typedef std::chrono::steady_clock Clock;
+
+    MyRenderScheduler           _scheduler;
+    OfxTime                     _first, _last, _step;
+    unsigned int                _queueSize;         ///< most frames rendered but not yet handed to the writer
+    FrameWriteQueue             _output;            ///< writes the frames behind the renders
+
+    std::vector<Clock::time_point> _started;        ///< per frame, when its render started
+    std::vector<double>         _renderLatency;     ///< per frame, seconds from start to rendered
+    std::vector<double>         _totalLatency;      ///< per frame, seconds from start to written
+    std::vector<char>           _written;           ///< per frame, did it reach the disk
+
+    std::map<int, OutputFrame *> _pending;           ///< rendered frames keyed by index, waiting on the writer
+    int                         _nextToWrite;       ///< index of the next frame the writer wants
+    bool                        _renderDone;        ///< set once no more frames will be queued
+    std::mutex                  _lock;              ///< guards the queue
+    std::condition_variable     _queueChanged;      ///< signalled on any change to the queue
+
+    /// map a frame time to its index in the range
+    int frameIndex(OfxTime time) const;
+
+    /// hand frames to the write queue in order, run on its own thread
+    void writeFrames();
+
+    /// render the range a frame at a time, each split into tiles
+    OfxStatus renderTiles(const OfxRectI &renderWindow, OfxPointD renderScale, unsigned int nTiles);
+
+  public :
+    /// ctor,
+    ///   \arg instance - a created instance that has had its clip preferences run
+    ///   \arg first, last, step - the frame range to render
+    ///   \arg framesInFlight - most frames rendering or waiting to be written at once
+    ///   \arg format, fileStem - how and where to write the frames
+    ///   \arg workers - if set, render in these worker processes
+    BatchRender(OFX::Host::ImageEffect::Instance &instance,
+                OfxTime first, OfxTime last, OfxTime step,
+                unsigned int framesInFlight,
+                OutputFormatEnum format = eOutputPPM,
+                const std::string &fileStem = "Output",
+                OFX::Host::IPC::WorkerPool *workers = NULL);
+
+    virtual ~BatchRender();
+
+    /// Render and write the whole range, then print throughput and latency.
+    /// Given nTiles, frames are rendered one at a time, split into that many tiles.
+    OfxStatus run(const OfxRectI &renderWindow, OfxPointD renderScale, unsigned int nTiles = 0);
+
+    // overridden from FrameDoneI
+    virtual void frameStarted(OfxTime time);
+    virtual void frameRendered(OFX::Host::ImageEffect::Instance &instance, OfxTime time, OfxStatus stat);
+    virtual void frameFinished(OfxTime time);
+
+    // overridden from FrameWrittenI
+    virtual void frameWritten(const OutputFrame &frame, bool ok);
+  };
+
+}
+
+#endif // HOST_DEMO_BATCH_RENDER_H
@@ -23,6 +23,7 @@
 #include "ofxhPluginCache.h"
 #include "ofxhHost.h"
 #include "ofxhImageEffectAPI.h"
+#include "ofxhSharedMemory.h"
 
 // my host
 #include "hostDemoHostDescriptor.h"
@@ -117,13 +118,31 @@ namespace MyHost {
     }
   }
 
+  static bool gUseSharedMemory = false;
+
+  void MyImage::setUseSharedMemory(bool use)
+  {
+    gUseSharedMemory = use;
+  }
+
   /// images are always SD PAL progressive full res images for the purpose of this example only
   MyImage::MyImage(MyClipInstance &clip, OfxTime time, int view)
     : OFX::Host::ImageEffect::Image(clip) /// this ctor will set basic props on the image
     , _data(NULL)
+    , _shared(NULL)
   {
     // make some memory
-    _data = new OfxRGBAColourB[kPalSizeXPixels * kPalSizeYPixels] ; /// PAL SD RGBA
+    if(gUseSharedMemory) {
+      _shared = new OFX::Host::Memory::SharedBlock;
+      if(_shared->create(kPalSizeXPixels * kPalSizeYPixels * sizeof(OfxRGBAColourB)))
+        _data = (OfxRGBAColourB *) _shared->getPtr();
+      else {
+        delete _shared;
+        _shared = NULL;
+      }
+    }
+    if(!_data)
+      _data = new OfxRGBAColourB[kPalSizeXPixels * kPalSizeYPixels] ; /// PAL SD RGBA
     
     int fillValue = (int)(floor(255.0 * (time/OFXHOSTDEMOCLIPLENGTH))) & 0xff;
     OfxRGBAColourB color;
@@ -190,7 +209,10 @@ namespace MyHost {
 
   MyImage::~MyImage() 
   {
-    delete _data;
+    if(_shared)
+      delete _shared;
+    else
+      delete [] _data;
   }
 
   MyClipInstance::MyClipInstance(MyEffectInstance* effect, OFX::Host::ImageEffect::ClipDescriptor *desc)
@@ -328,6 +350,8 @@ namespace MyHost {
   OFX::Host::ImageEffect::Image* MyClipInstance::getImage(OfxTime time, const OfxRectD *optionalBounds)
   {
     if(_name == "Output") {
+      // the tiles of a frame fetch it at once
+      std::lock_guard<std::mutex> guard(_outputLock);
       if(!_outputImage) {
         // make a new ref counted image
         _outputImage = new MyImage(*this, 0);
@@ -4,8 +4,18 @@
 #ifndef HOST_DEMO_CLIP_INSTANCE_H
 #define HOST_DEMO_CLIP_INSTANCE_H
 
+#include <mutex>
+
 #define OFXHOSTDEMOCLIPLENGTH 1.0
 
+namespace OFX {
+  namespace Host {
+    namespace Memory {
+      class SharedBlock;
+    }
+  }
+}
+
 namespace MyHost {
 
   // foward
@@ -16,10 +26,15 @@ namespace MyHost {
   {
   protected :
     OfxRGBAColourB   *_data; // where we are keeping our image data
+    OFX::Host::Memory::SharedBlock *_shared; // or where it is if it is in shared memory
   public :
     explicit MyImage(MyClipInstance &clip, OfxTime t, int view = 0);
     OfxRGBAColourB* pixel(int x, int y) const;
     ~MyImage();
+
+    /// Make images in shared memory from now on, so renders in worker
+    /// processes can get at them without a copy.
+    static void setUseSharedMemory(bool use);
   };
 
   class MyClipInstance : public OFX::Host::ImageEffect::ClipInstance {
@@ -27,6 +42,7 @@ namespace MyHost {
     MyEffectInstance *_effect;
     std::string       _name;
     MyImage          *_outputImage; ///< only set for output clips
+    std::mutex        _outputLock;  ///< guards making it
 
   public:
     MyClipInstance(MyEffectInstance* effect, OFX::Host::ImageEffect::ClipDescriptor* desc);
@@ -35,6 +35,8 @@ namespace MyHost {
                                      const std::string& context) 
                                      : OFX::Host::ImageEffect::Instance(plugin,desc,context,false)
   {
+    // our clips make a fresh image for each fetch, so batched fetches can run at once
+    setImageFetchThreads(0);
   }
 
   // class member function implementation
@@ -156,6 +158,8 @@ namespace MyHost {
       return new MyInteger2DInstance(this,name,descriptor);
     else if(descriptor.getType()==kOfxParamTypePushButton)
       return new MyPushbuttonInstance(this,name,descriptor);
+    else if(descriptor.getType()==kOfxParamTypeCustom)
+      return new OFX::Host::Param::CustomInstance(descriptor,this);
     else if(descriptor.getType()==kOfxParamTypeGroup)
       return new OFX::Host::Param::GroupInstance(descriptor,this);
     else if(descriptor.getType()==kOfxParamTypePage)
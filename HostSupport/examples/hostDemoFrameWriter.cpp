@@ -0,0 +1,470 @@
+// Copyright OpenFX and contributors to the OpenFX project.
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+
+#ifdef _WIN32
+#include <cstdio>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sys/uio.h>
+#endif
+
+// ofx
+#include "ofxCore.h"
+#include "ofxImageEffect.h"
+#include "ofxPixels.h"
+
+// ofx host
+#include "ofxhBinary.h"
+#include "ofxhPropertySuite.h"
+#include "ofxhClip.h"
+#include "ofxhParam.h"
+#include "ofxhMemory.h"
+#include "ofxhImageEffect.h"
+
+// my host
+#include "hostDemoFrameWriter.h"
+
+namespace MyHost {
+
+  bool getOutputFormat(const std::string &name, OutputFormatEnum &format)
+  {
+    if(name == "ppm")
+      format = eOutputPPM;
+    else if(name == "pfm")
+      format = eOutputPFM;
+    else if(name == "raw")
+      format = eOutputRaw;
+    else
+      return false;
+    return true;
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  // OutputFrame
+
+  OutputFrame::OutputFrame()
+    : time(0)
+    , nComponents(0)
+    , bytesPerComponent(0)
+  {
+    bounds.x1 = bounds.y1 = bounds.x2 = bounds.y2 = 0;
+  }
+
+  bool OutputFrame::copyFrom(const OFX::Host::ImageEffect::Image &image, OfxTime t)
+  {
+    time = t;
+    bounds = image.getBounds();
+    depth = image.getStringProperty(kOfxImageEffectPropPixelDepth);
+    components = image.getStringProperty(kOfxImageEffectPropComponents);
+
+    if(depth == kOfxBitDepthByte)
+      bytesPerComponent = 1;
+    else if(depth == kOfxBitDepthShort || depth == kOfxBitDepthHalf)
+      bytesPerComponent = 2;
+    else if(depth == kOfxBitDepthFloat)
+      bytesPerComponent = 4;
+    else
+      return false;
+
+    if(components == kOfxImageComponentRGBA)
+      nComponents = 4;
+    else if(components == kOfxImageComponentRGB)
+      nComponents = 3;
+    else if(components == kOfxImageComponentAlpha)
+      nComponents = 1;
+    else
+      return false;
+
+    const unsigned char *src = (const unsigned char *) image.getPointerProperty(kOfxImagePropData);
+    int srcRowBytes = image.getIntProperty(kOfxImagePropRowBytes);
+    if(!src || width() <= 0 || height() <= 0)
+      return false;
+
+    // row bytes can be padded, or negative for images stored top down
+    int dstRowBytes = rowBytes();
+    data.resize(size_t(dstRowBytes) * height());
+    for(int y = 0; y < height(); ++y)
+      memcpy(&data[size_t(y) * dstRowBytes], src + std::ptrdiff_t(y) * srcRowBytes, dstRowBytes);
+
+    return true;
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  // encoding
+
+  /// get a component as a float, half isn't supported
+  static inline float componentToFloat(const OutputFrame &frame, const unsigned char *p)
+  {
+    switch(frame.bytesPerComponent) {
+    case 1 : return *p / 255.0f;
+    case 2 : { uint16_t v; memcpy(&v, p, 2); return v / 65535.0f; }
+    default : { float v; memcpy(&v, p, 4); return v; }
+    }
+  }
+
+  /// does this machine store floats little endian, PFM marks which it is in the header
+  static bool littleEndian()
+  {
+    const uint16_t one = 1;
+    return *(const unsigned char *) &one == 1;
+  }
+
+  /// binary P6, stored top row first
+  static bool encodePPM(const OutputFrame &frame, std::string &header, std::vector<unsigned char> &body)
+  {
+    if(frame.depth == kOfxBitDepthHalf)
+      return false;
+
+    std::ostringstream ss;
+    ss << "P6\n" << frame.width() << " " << frame.height() << "\n255\n";
+    header = ss.str();
+
+    int w = frame.width(), h = frame.height();
+    int pixelBytes = frame.nComponents * frame.bytesPerComponent;
+    body.resize(size_t(w) * h * 3);
+    unsigned char *dst = body.empty() ? NULL : &body[0];
+
+    for(int y = h - 1; y >= 0; --y) {
+      const unsigned char *src = &frame.data[size_t(y) * frame.rowBytes()];
+
+      // the common case, 8 bit RGB(A) straight through
+      if(frame.bytesPerComponent == 1 && frame.nComponents >= 3) {
+        for(int x = 0; x < w; ++x, src += pixelBytes, dst += 3) {
+          dst[0] = src[0]; dst[1] = src[1]; dst[2] = src[2];
+        }
+        continue;
+      }
+
+      for(int x = 0; x < w; ++x, src += pixelBytes) {
+        for(int c = 0; c < 3; ++c) {
+          int comp = frame.nComponents == 1 ? 0 : c;
+          float v = componentToFloat(frame, src + comp * frame.bytesPerComponent);
+          v = v < 0.0f ? 0.0f : (v > 1.0f ? 1.0f : v);
+          *dst++ = (unsigned char)(v * 255.0f + 0.5f);
+        }
+      }
+    }
+    return true;
+  }
+
+  /// PFM, stored bottom row first, which is how OFX images are laid out anyway
+  static bool encodePFM(const OutputFrame &frame, std::string &header, std::vector<unsigned char> &body)
+  {
+    if(frame.depth == kOfxBitDepthHalf)
+      return false;
+
+    int outComponents = frame.nComponents == 1 ? 1 : 3;
+
+    std::ostringstream ss;
+    ss << (outComponents == 1 ? "Pf\n" : "PF\n") << frame.width() << " " << frame.height() << "\n"
+       << (littleEndian() ? "-1.0" : "1.0") << "\n";
+    header = ss.str();
+
+    int w = frame.width(), h = frame.height();
+    int pixelBytes = frame.nComponents * frame.bytesPerComponent;
+    body.resize(size_t(w) * h * outComponents * sizeof(float));
+    float *dst = body.empty() ? NULL : (float *) &body[0];
+
+    for(int y = 0; y < h; ++y) {
+      const unsigned char *src = &frame.data[size_t(y) * frame.rowBytes()];
+      for(int x = 0; x < w; ++x, src += pixelBytes)
+        for(int c = 0; c < outComponents; ++c)
+          *dst++ = componentToFloat(frame, src + c * frame.bytesPerComponent);
+    }
+    return true;
+  }
+
+  /// raw planar, each component a plane at the frame's own depth, bottom row first, no header
+  static bool encodeRaw(const OutputFrame &frame, std::string &header, std::vector<unsigned char> &body)
+  {
+    header.clear();
+
+    int w = frame.width(), h = frame.height();
+    int bpc = frame.bytesPerComponent;
+    int pixelBytes = frame.nComponents * bpc;
+    size_t planeBytes = size_t(w) * h * bpc;
+    body.resize(planeBytes * frame.nComponents);
+
+    for(int c = 0; c < frame.nComponents; ++c) {
+      unsigned char *dst = &body[planeBytes * c];
+      for(int y = 0; y < h; ++y) {
+        const unsigned char *src = &frame.data[size_t(y) * frame.rowBytes()] + c * bpc;
+        if(bpc == 1) {
+          for(int x = 0; x < w; ++x, src += pixelBytes)
+            *dst++ = *src;
+        }
+        else {
+          for(int x = 0; x < w; ++x, src += pixelBytes, dst += bpc)
+            memcpy(dst, src, bpc);
+        }
+      }
+    }
+    return true;
+  }
+
+  bool encodeFrame(OutputFormatEnum format,
+                   const OutputFrame &frame,
+                   std::string &header,
+                   std::vector<unsigned char> &body)
+  {
+    if(frame.data.empty())
+      return false;
+
+    switch(format) {
+    case eOutputPPM : return encodePPM(frame, header, body);
+    case eOutputPFM : return encodePFM(frame, header, body);
+    case eOutputRaw : return encodeRaw(frame, header, body);
+    }
+    return false;
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  // FrameWriteQueue
+
+#ifndef _WIN32
+  /// write every byte in the vector of buffers, coping with short writes and IOV_MAX
+  static bool writeAll(int fd, std::vector<struct iovec> &iov)
+  {
+    size_t first = 0;
+    while(first < iov.size()) {
+      int n = int(std::min(iov.size() - first, size_t(IOV_MAX)));
+      ssize_t written = writev(fd, &iov[first], n);
+      if(written < 0)
+        return false;
+
+      // step over what went out
+      while(first < iov.size() && size_t(written) >= iov[first].iov_len) {
+        written -= iov[first].iov_len;
+        ++first;
+      }
+      if(written > 0) {
+        iov[first].iov_base = (char *) iov[first].iov_base + written;
+        iov[first].iov_len -= written;
+      }
+    }
+    return true;
+  }
+
+  /// add a buffer to a vector of buffers, skipping empty ones
+  static void addBuffer(std::vector<struct iovec> &iov, const void *data, size_t len)
+  {
+    if(len == 0)
+      return;
+    struct iovec v;
+    v.iov_base = const_cast<void *>(data);
+    v.iov_len = len;
+    iov.push_back(v);
+  }
+#endif
+
+  FrameWriteQueue::FrameWriteQueue(OutputFormatEnum format,
+                                   const std::string &fileStem,
+                                   unsigned int maxQueued,
+                                   unsigned int maxBatch,
+                                   FrameWrittenI *listener)
+    : _format(format)
+    , _fileStem(fileStem)
+    , _maxQueued(maxQueued ? maxQueued : 1)
+    , _maxBatch(maxBatch ? maxBatch : 1)
+    , _listener(listener)
+    , _inProgress(0)
+    , _stop(false)
+    , _failed(false)
+    , _rawFile(-1)
+  {
+    if(_format == eOutputRaw) {
+      std::string name = _fileStem + ".raw";
+#ifdef _WIN32
+      // truncate it, batches are appended below
+      std::ofstream truncate(name.c_str(), std::ios::binary);
+      _rawFile = truncate ? 0 : -1;
+#else
+      _rawFile = open(name.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+#endif
+      if(_rawFile < 0)
+        _failed = true;
+    }
+
+    _writer = std::thread(&FrameWriteQueue::writeFrames, this);
+  }
+
+  FrameWriteQueue::~FrameWriteQueue()
+  {
+    {
+      std::lock_guard<std::mutex> guard(_lock);
+      _stop = true;
+    }
+    _queueChanged.notify_all();
+    _writer.join();
+
+#ifndef _WIN32
+    if(_rawFile >= 0)
+      close(_rawFile);
+#endif
+  }
+
+  std::string FrameWriteQueue::fileName(const OutputFrame &frame) const
+  {
+    std::ostringstream ss;
+    ss << _fileStem << "." << frame.time << (_format == eOutputPFM ? ".pfm" : ".ppm");
+    return ss.str();
+  }
+
+  void FrameWriteQueue::submit(OutputFrame *frame)
+  {
+    {
+      std::unique_lock<std::mutex> guard(_lock);
+      while(_queue.size() >= _maxQueued)
+        _queueChanged.wait(guard);
+      _queue.push_back(frame);
+    }
+    _queueChanged.notify_all();
+  }
+
+  void FrameWriteQueue::flush()
+  {
+    std::unique_lock<std::mutex> guard(_lock);
+    while(!_queue.empty() || _inProgress)
+      _queueChanged.wait(guard);
+  }
+
+  bool FrameWriteQueue::ok()
+  {
+    std::lock_guard<std::mutex> guard(_lock);
+    return !_failed;
+  }
+
+#ifdef _WIN32
+  bool FrameWriteQueue::writeBatch(std::vector<Encoded> &batch)
+  {
+    bool ok = true;
+    for(size_t i = 0; i < batch.size(); ++i) {
+      if(!batch[i].ok)
+        continue;
+
+      std::ofstream op;
+      if(_format == eOutputRaw)
+        op.open((_fileStem + ".raw").c_str(), std::ios::binary | std::ios::app);
+      else
+        op.open(fileName(*batch[i].frame).c_str(), std::ios::binary);
+
+      op.write(batch[i].header.data(), batch[i].header.size());
+      if(!batch[i].body.empty())
+        op.write((const char *) &batch[i].body[0], batch[i].body.size());
+      op.close();
+
+      if(!op) {
+        batch[i].ok = false;
+        ok = false;
+      }
+    }
+    return ok;
+  }
+#else
+  bool FrameWriteQueue::writeBatch(std::vector<Encoded> &batch)
+  {
+    bool ok = true;
+
+    if(_format == eOutputRaw) {
+      // the whole batch goes out in one writev on the one file
+      std::vector<struct iovec> iov;
+      for(size_t i = 0; i < batch.size(); ++i) {
+        if(!batch[i].ok)
+          continue;
+        addBuffer(iov, batch[i].header.data(), batch[i].header.size());
+        addBuffer(iov, batch[i].body.empty() ? NULL : &batch[i].body[0], batch[i].body.size());
+      }
+
+      ok = _rawFile >= 0 && writeAll(_rawFile, iov) && fdatasync(_rawFile) == 0;
+      if(!ok)
+        for(size_t i = 0; i < batch.size(); ++i)
+          batch[i].ok = false;
+      return ok;
+    }
+
+    // one writev per file, then sync them all once everything is written
+    std::vector<int> files(batch.size(), -1);
+    for(size_t i = 0; i < batch.size(); ++i) {
+      if(!batch[i].ok)
+        continue;
+
+      files[i] = open(fileName(*batch[i].frame).c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+      std::vector<struct iovec> iov;
+      addBuffer(iov, batch[i].header.data(), batch[i].header.size());
+      addBuffer(iov, batch[i].body.empty() ? NULL : &batch[i].body[0], batch[i].body.size());
+      if(files[i] < 0 || !writeAll(files[i], iov))
+        batch[i].ok = false;
+    }
+
+    for(size_t i = 0; i < batch.size(); ++i) {
+      if(files[i] >= 0) {
+        if(fsync(files[i]) != 0)
+          batch[i].ok = false;
+        if(close(files[i]) != 0)
+          batch[i].ok = false;
+      }
+      // a frame whose file never opened still fails the batch
+      ok = ok && batch[i].ok;
+    }
+    return ok;
+  }
+#endif
+
+  void FrameWriteQueue::writeFrames()
+  {
+    while(true) {
+      std::vector<Encoded> batch;
+      {
+        std::unique_lock<std::mutex> guard(_lock);
+        while(_queue.empty() && !_stop)
+          _queueChanged.wait(guard);
+        if(_queue.empty())
+          return;
+
+        // take whatever has piled up while we were writing the last batch
+        while(!_queue.empty() && batch.size() < _maxBatch) {
+          Encoded enc;
+          enc.frame = _queue.front();
+          enc.ok = false;
+          batch.push_back(enc);
+          _queue.pop_front();
+        }
+        _inProgress = (unsigned int) batch.size();
+      }
+      _queueChanged.notify_all(); // there is room in the queue again
+
+      bool ok = true;
+      for(size_t i = 0; i < batch.size(); ++i) {
+        batch[i].ok = encodeFrame(_format, *batch[i].frame, batch[i].header, batch[i].body);
+        ok = ok && batch[i].ok;
+      }
+
+      if(!writeBatch(batch))
+        ok = false;
+
+      for(size_t i = 0; i < batch.size(); ++i) {
+        if(_listener)
+          _listener->frameWritten(*batch[i].frame, batch[i].ok);
+        delete batch[i].frame;
+      }
+
+      {
+        std::lock_guard<std::mutex> guard(_lock);
+        _inProgress = 0;
+        if(!ok)
+          _failed = true;
+      }
+      _queueChanged.notify_all();
+    }
+  }
+
+}
@@ -0,0 +1,131 @@
+// Copyright OpenFX and contributors to the OpenFX project.
+// SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef HOST_DEMO_FRAME_WRITER_H
+#define HOST_DEMO_FRAME_WRITER_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+namespace MyHost {
+
+  /// the file formats we can write output frames in
+  enum OutputFormatEnum {
+    eOutputPPM,     ///< binary P6, 8 bit RGB, one file per frame
+    eOutputPFM,     ///< PFM, 32 bit float RGB or grey, one file per frame
+    eOutputRaw      ///< raw planar at the image's own depth, every frame appended to one file
+  };
+
+  /// map "ppm", "pfm" or "raw" to a format, returns false if it isn't one of those
+  bool getOutputFormat(const std::string &name, OutputFormatEnum &format);
+
+  /// A copy of an output image waiting to be written. The pixels are
+  /// copied out of the image with one memcpy per row and packed, so
+  /// the image can be reused by the next render straight away.
+  struct OutputFrame {
+    OfxTime                    time;
+    OfxRectI                   bounds;
+    std::string                depth;        ///< a kOfxBitDepth*
+    std::string                components;   ///< a kOfxImageComponent*
+    int                        nComponents;
+    int                        bytesPerComponent;
+    std::vector<unsigned char> data;         ///< packed rows, bottom row first
+
+    OutputFrame();
+
+    /// copy the pixels of the image, returns false if the image can't be written
+    bool copyFrom(const OFX::Host::ImageEffect::Image &image, OfxTime time);
+
+    int width() const  { return bounds.x2 - bounds.x1; }
+    int height() const { return bounds.y2 - bounds.y1; }
+    int rowBytes() const { return width() * nComponents * bytesPerComponent; }
+  };
+
+  /// Encode a frame, the header and body are written out back to back.
+  /// Returns false if the frame's depth isn't supported by the format.
+  bool encodeFrame(OutputFormatEnum format,
+                   const OutputFrame &frame,
+                   std::string &header,
+                   std::vector<unsigned char> &body);
+
+  /// Writes frames on a write-behind thread, so that encoding and disk io
+  /// overlap with the next render. Frames queued together are written
+  /// in one batch, with a single writev per file (a single writev for the
+  /// whole batch for raw output) and one round of fsyncs at the end.
+  class FrameWriteQueue {
+  public :
+    /// Derive from this to be told when frames hit the disk. Called on the
+    /// writer thread.
+    class FrameWrittenI {
+    public :
+      virtual ~FrameWrittenI() {}
+      virtual void frameWritten(const OutputFrame &frame, bool ok) = 0;
+    };
+
+  protected :
+    /// a frame that has been encoded, ready for writing
+    struct Encoded {
+      OutputFrame               *frame;
+      std::string                header;
+      std::vector<unsigned char> body;
+      bool                       ok;
+    };
+
+    OutputFormatEnum           _format;
+    std::string                _fileStem;     ///< frames go to _fileStem.<time>.<ext>, or _fileStem.raw
+    unsigned int               _maxQueued;    ///< submit blocks once this many frames are waiting
+    unsigned int               _maxBatch;     ///< most frames written in one batch
+    FrameWrittenI             *_listener;
+
+    std::deque<OutputFrame *>  _queue;        ///< frames waiting for the writer
+    unsigned int               _inProgress;   ///< frames the writer has taken but not finished
+    bool                       _stop;
+    bool                       _failed;       ///< set if any write ever failed
+    std::mutex                 _lock;
+    std::condition_variable    _queueChanged;
+    std::thread                _writer;
+
+    int                        _rawFile;      ///< the file raw frames are appended to, or -1
+
+    /// the file name for a frame in one of the per frame formats
+    std::string fileName(const OutputFrame &frame) const;
+
+    /// write an encoded batch, returns false if any of it failed
+    bool writeBatch(std::vector<Encoded> &batch);
+
+    /// the writer thread's loop
+    void writeFrames();
+
+  public :
+    /// ctor,
+    ///   \arg format - what to write
+    ///   \arg fileStem - where to write it
+    ///   \arg maxQueued - frames that can be waiting before submit blocks
+    ///   \arg maxBatch - most frames to write in one writev/fsync cycle
+    ///   \arg listener - optionally told as each frame is written
+    FrameWriteQueue(OutputFormatEnum format,
+                    const std::string &fileStem,
+                    unsigned int maxQueued = 4,
+                    unsigned int maxBatch = 4,
+                    FrameWrittenI *listener = 0);
+
+    /// dtor, writes anything still queued
+    virtual ~FrameWriteQueue();
+
+    /// queue a frame for writing, we take ownership of it
+    void submit(OutputFrame *frame);
+
+    /// block until everything submitted has been written
+    void flush();
+
+    /// has every write so far succeeded
+    bool ok();
+  };
+
+}
+
+#endif // HOST_DEMO_FRAME_WRITER_H
@@ -0,0 +1,189 @@
+// Copyright OpenFX and contributors to the OpenFX project.
+// SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef OFXH_ACTION_CACHE_H
+#define OFXH_ACTION_CACHE_H
+
+#include <string>
+#include <map>
+#include <vector>
+#include <tuple>
+#include <mutex>
+#include <iosfwd>
+
+#include "ofxCore.h"
+
+namespace OFX {
+
+  namespace Host {
+
+    namespace ImageEffect {
+
+      // forward declare
+      class ClipInstance;
+
+      /// Remembers the results of an instance's region of definition, regions
+      /// of interest, is identity, frames needed and time domain actions, so
+      /// a host asking the same question several times, as a deep graph
+      /// does, only calls into the plugin once.
+      ///
+      /// Results are keyed by the action's arguments, time, render scale and
+      /// the rest, so animation is taken care of. The instance forgets them
+      /// all whenever a param or clip changes, clip preferences are run or
+      /// caches are purged. Results also depend on what is upstream of the
+      /// instance, which only the host knows about, so the host must call
+      /// invalidate when any input changes, or when it sets param values
+      /// without calling the instance changed action.
+      ///
+      /// It is off by default. All calls are locked, as with host frame
+      /// threading an instance can be asked by several render threads at once.
+      /// As the action runs outside the lock, a lookup hands back the cache's
+      /// generation, which is passed on to the matching set, so a result
+      /// worked out across an invalidate is dropped rather than kept.
+      class ActionCache {
+      public :
+        /// the actions cached
+        enum ActionEnum {
+          eRegionOfDefinition,
+          eRegionsOfInterest,
+          eIsIdentity,
+          eFramesNeeded,
+          eTimeDomain,
+          eNumActions
+        };
+
+        /// hit and miss counts for each action
+        struct Stats {
+          size_t hits[eNumActions];
+          size_t misses[eNumActions];
+          size_t invalidations;
+
+          Stats();
+
+          /// hits as a fraction of all lookups of an action, 0 if there were none
+          double getHitRate(ActionEnum action) const;
+        };
+
+        /// name of an action, as the kOfxImageEffectAction* it caches
+        static const char *getActionName(ActionEnum action);
+
+        /// the regions of interest, as returned by the instance
+        typedef std::map<ClipInstance *, OfxRectD> RoIMap;
+
+        /// the frames needed, as returned by the instance
+        typedef std::map<ClipInstance *, std::vector<OfxRangeD> > FramesMap;
+
+        /// bumped by each invalidate, to spot results from before it
+        typedef unsigned long Generation;
+
+      protected :
+        typedef std::tuple<double, double, double> RoDKey;                                            ///< time, render scale
+        typedef std::tuple<double, double, double, double, double, double, double> RoIKey;            ///< time, render scale, roi
+        typedef std::tuple<double, std::string, int, int, int, int, double, double> IdentityKey;     ///< time, field, window, render scale
+
+        struct RoDResult {
+          OfxStatus stat;
+          OfxRectD  rod;
+        };
+
+        struct RoIResult {
+          OfxStatus stat;
+          RoIMap    rois;
+        };
+
+        struct IdentityResult {
+          OfxStatus   stat;
+          OfxTime     time;
+          std::string clip;
+        };
+
+        struct FramesResult {
+          OfxStatus stat;
+          FramesMap frames;
+        };
+
+        bool                                  _enabled;
+        Generation                            _generation;     ///< bumped whenever results are forgotten
+        size_t                                _maxEntries;     ///< most results kept per action before they are all forgotten
+        std::map<RoDKey, RoDResult>           _rods;
+        std::map<RoIKey, RoIResult>           _rois;
+        std::map<IdentityKey, IdentityResult> _identities;
+        std::map<double, FramesResult>        _frames;
+        bool                                  _haveTimeDomain;
+        OfxStatus                             _timeDomainStat;
+        OfxRangeD                             _timeDomain;
+        Stats                                 _stats;
+        mutable std::mutex                    _lock;
+
+        /// count a lookup
+        bool count(ActionEnum action, bool hit);
+
+        /// can a result be kept, it must be worth keeping and not worked out before an invalidate
+        bool canKeep(OfxStatus stat, Generation generation) const;
+
+        /// forget everything in a map if it is full, so it can't grow without bound over a long timeline
+        template <class MAP>
+        void makeRoom(MAP &m)
+        {
+          if(m.size() >= _maxEntries)
+            m.clear();
+        }
+
+      private :
+        ActionCache(const ActionCache &);
+        ActionCache &operator=(const ActionCache &);
+
+      public :
+        ActionCache();
+
+        /// turn caching on or off, turning it off forgets everything
+        void setEnabled(bool v);
+
+        /// is caching on
+        bool isEnabled() const;
+
+        /// set the most results kept for each action, 1024 by default
+        void setMaxEntries(size_t n);
+
+        /// forget all results
+        void invalidate();
+
+        /// get the hit and miss counts so far
+        Stats getStats() const;
+
+        /// zero the hit and miss counts
+        void resetStats();
+
+        /// print a line per action of its hits, misses and hit rate
+        void printStats(std::ostream &os) const;
+
+        /// Look up a result, returning false if there is none, in which case
+        /// call the action then set the result, passing back the generation
+        /// the lookup returned. Only results with a status of kOfxStatOK or
+        /// kOfxStatReplyDefault, and from the current generation, are kept.
+        bool getRegionOfDefinition(OfxTime time, OfxPointD renderScale, OfxRectD &rod, OfxStatus &stat, Generation &generation);
+        void setRegionOfDefinition(OfxTime time, OfxPointD renderScale, const OfxRectD &rod, OfxStatus stat, Generation generation);
+
+        bool getRegionsOfInterest(OfxTime time, OfxPointD renderScale, const OfxRectD &roi, RoIMap &rois, OfxStatus &stat, Generation &generation);
+        void setRegionsOfInterest(OfxTime time, OfxPointD renderScale, const OfxRectD &roi, const RoIMap &rois, OfxStatus stat, Generation generation);
+
+        /// time is the time in, identityTime and clip what the action returned
+        bool getIsIdentity(OfxTime time, const std::string &field, const OfxRectI &renderWindow, OfxPointD renderScale,
+                           OfxTime &identityTime, std::string &clip, OfxStatus &stat, Generation &generation);
+        void setIsIdentity(OfxTime time, const std::string &field, const OfxRectI &renderWindow, OfxPointD renderScale,
+                           OfxTime identityTime, const std::string &clip, OfxStatus stat, Generation generation);
+
+        bool getFramesNeeded(OfxTime time, FramesMap &frames, OfxStatus &stat, Generation &generation);
+        void setFramesNeeded(OfxTime time, const FramesMap &frames, OfxStatus stat, Generation generation);
+
+        bool getTimeDomain(OfxRangeD &range, OfxStatus &stat, Generation &generation);
+        void setTimeDomain(const OfxRangeD &range, OfxStatus stat, Generation generation);
+      };
+
+    } // namespace ImageEffect
+
+  } // namespace Host
+
+} // namespace OFX
+
+#endif // OFXH_ACTION_CACHE_H
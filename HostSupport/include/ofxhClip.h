@@ -5,6 +5,8 @@
 #ifndef OFX_CLIP_H
 #define OFX_CLIP_H
 
+#include <atomic>
+
 #include "ofxImageEffect.h"
 #include "ofxhUtilities.h"
 
@@ -115,6 +117,9 @@ namespace OFX {
         /// is the clip an output clip
         bool isOutput() const {return  _isOutput;}
 
+        /// get the effect instance the clip belongs to
+        ImageEffect::Instance *getEffectInstance() const {return _effectInstance;}
+
         /// notify override properties
         virtual void notify(const std::string &name, bool isSingle, int indexOrN);
         
@@ -270,6 +275,31 @@ namespace OFX {
         /// override this to return the rod on the clip
         virtual OfxRectD getRegionOfDefinition(OfxTime time) const = 0;
 
+        /// Called on each image getImage returns to the plugin, to map it to
+        /// the depth and components negotiated by getClipPreferences. The
+        /// default runs the host conversion stage, see conformImageToClip,
+        /// which converts the requested bounds into a pooled buffer if the
+        /// image's depth and components properties differ from the clip's.
+        /// Takes over the caller's reference on image.
+        virtual ImageEffect::Image* conformImage(ImageEffect::Image *image, const OfxRectD *optionalBounds);
+
+        /// Called on each image getImage returns to the plugin, before
+        /// conformImage. If the clip extracts single fields and the image is
+        /// an interlaced frame, returns a FieldImage on the field wanted at
+        /// time, taking over the caller's reference on image. Otherwise
+        /// returns image as is. The field is the first temporal one, as given
+        /// by the clip's field order, if time's fractional part is under 0.5,
+        /// the second otherwise.
+        ///
+        /// Doubled field extraction needs each line twice, which a view can't
+        /// do, so is left to the host's getImage.
+        virtual ImageEffect::Image* extractField(ImageEffect::Image *image, OfxTime time);
+
+        /// Get the image the plugin is handed by clipGetImage, that is
+        /// getImage's image passed through extractField and conformImage.
+        /// Returns NULL if getImage does.
+        ImageEffect::Image* fetchImage(OfxTime time, const OfxRectD *optionalBounds);
+
         /// given the colour component, find the nearest set of supported colour components
         /// override this for extra wierd custom component depths
         virtual const std::string &findSupportedComp(const std::string &s) const;
@@ -281,7 +311,7 @@ namespace OFX {
       protected :
         /// called during ctors to get bits from the clip props into ours
         void getClipBits(ClipInstance& instance);
-        int _referenceCount; ///< reference count on this image
+        std::atomic<int> _referenceCount; ///< reference count on this image, tiles of a render may share it
 
       public:
         // default constructor
@@ -419,6 +449,30 @@ namespace OFX {
               std::string uniqueIdentifier);
       };
 
+      /// A view on a single field of an interlaced image. It is half the
+      /// height of the frame and points into the frame's pixels with twice
+      /// its row bytes, so no pixels are copied. Row y of the view is row 2y
+      /// of the frame for the lower field, row 2y+1 for the upper, and its
+      /// render scale in y is halved to match. The view holds a reference on
+      /// the frame till it is deleted.
+      class FieldImage : public Image {
+      protected :
+        Image &_frame; ///< the frame we are a view on
+
+      public :
+        /// make a view on field, one of kOfxImageFieldLower or kOfxImageFieldUpper, of frame
+        FieldImage(Image &frame, const std::string &field);
+
+        /// releases our reference on the frame
+        virtual ~FieldImage();
+
+        /// the frame we are a view on
+        Image &getFrame() {return _frame;}
+
+        /// the rows of a frame that are in a field, in the field's own coordinates
+        static void getFieldRows(int frameY1, int frameY2, const std::string &field, int &fieldY1, int &fieldY2);
+      };
+
 #   ifdef OFX_SUPPORTS_OPENGLRENDER
       /// instance of an OpenGL texture inside an image effect
       class Texture : public ImageBase {
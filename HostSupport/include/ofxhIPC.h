@@ -0,0 +1,294 @@
+// Copyright OpenFX and contributors to the OpenFX project.
+// SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef OFXH_IPC_H
+#define OFXH_IPC_H
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+
+#include "ofxCore.h"
+
+namespace OFX {
+
+  namespace Host {
+
+    namespace Property {
+      class Set;
+    }
+
+    namespace IPC {
+
+      /// A message passed between a host and its worker processes. It is a
+      /// type, a flat buffer of values written and read back in the same
+      /// order, and any file descriptors to pass over with it. Values are in
+      /// the byte order of the machine, as both ends are always on the one.
+      ///
+      /// Reading past the end, or a value of the wrong sort, clears ok, after
+      /// which every get returns a zero value.
+      class Message {
+      public :
+        /// type of the final reply to a call, other types are up to the caller
+        static const int kReply = 0;
+
+        /// the largest message a channel will receive, enough for a big float image
+        static const size_t kMaxSize = size_t(1) << 30;
+
+      protected :
+        int               _type;
+        std::string       _data;      ///< the values
+        size_t            _read;      ///< how far they have been read
+        std::vector<int>  _fds;       ///< descriptors to pass, or that were passed
+        size_t            _fdRead;    ///< how many have been taken
+        bool              _ownsFds;   ///< close any not taken on destruction, set on receive
+        bool              _ok;
+
+        friend class Channel;
+
+        /// take the next n raw bytes, NULL if there are not that many
+        const char *take(size_t n, char tag);
+
+        /// add raw bytes
+        void add(const void *v, size_t n, char tag);
+
+      private :
+        Message(const Message &);
+        Message &operator=(const Message &);
+
+      public :
+        explicit Message(int type = kReply);
+
+        /// closes any descriptors received but not taken
+        ~Message();
+
+        /// empty the message and give it a new type
+        void reset(int type);
+
+        int getType() const {return _type;}
+
+        /// have all gets so far succeeded
+        bool ok() const {return _ok;}
+
+        void putInt(int v);
+        void putDouble(double v);
+        void putString(const std::string &v);
+        void putBytes(const void *v, size_t n);
+
+        /// pass a descriptor, the caller keeps it and must keep it open till the message is sent
+        void putFd(int fd);
+
+        /// put every int, double and string property of a set, pointers can't be passed
+        void putProperties(const Property::Set &set);
+
+        int         getInt();
+        double      getDouble();
+        std::string getString();
+
+        /// copy out n bytes
+        void getBytes(void *v, size_t n);
+
+        /// take the next descriptor passed, the caller then owns it, -1 if there is none
+        int getFd();
+
+        /// set properties put by putProperties on a set, making any it doesn't have
+        void getProperties(Property::Set &set);
+      };
+
+      /// One end of a socket that messages are sent and received on, local
+      /// or TCP. Descriptors can only be passed over local sockets. Only
+      /// one thread may send and one receive at a time.
+      class Channel {
+      protected :
+        int _fd;
+
+      private :
+        Channel(const Channel &);
+        Channel &operator=(const Channel &);
+
+      public :
+        /// take over an already open socket
+        explicit Channel(int fd = -1);
+
+        /// closes the socket
+        ~Channel();
+
+        bool isOpen() const {return _fd >= 0;}
+        int  getFd() const {return _fd;}
+
+        void close();
+
+        /// send a message, false if the other end has gone
+        bool send(const Message &m);
+
+        /// wait for a message, false if the other end has gone
+        bool receive(Message &m);
+
+        /// make a connected pair of sockets
+        static bool makePair(int &a, int &b);
+
+        /// connect to a Listener at "host:port" over TCP, returning the socket or -1
+        static int connectTo(const std::string &address);
+      };
+
+      /// A TCP socket that workers on other machines wait for hosts on.
+      class Listener {
+      protected :
+        int _fd;
+
+      private :
+        Listener(const Listener &);
+        Listener &operator=(const Listener &);
+
+      public :
+        Listener();
+
+        /// closes the socket
+        ~Listener();
+
+        /// Listen on "[host:]port", port 0 picks a free one. The host
+        /// defaults to the loopback interface, 127.0.0.1, give 0.0.0.0 to
+        /// listen on every one. Hosts that connect aren't authenticated, so
+        /// only listen beyond the local machine on a network you trust.
+        bool listen(const std::string &address);
+
+        /// the port being listened on, -1 if not listening
+        int getPort() const;
+
+        /// wait for a host to connect, returning its socket or -1
+        int accept();
+
+        void close();
+      };
+
+      /// Derive from this to service the messages a worker sends back while
+      /// a call is in progress, such as a plugin fetching an image.
+      class CallbackI {
+      public :
+        virtual ~CallbackI() {}
+
+        /// handle a message from the worker, reply is sent back to it
+        virtual void callback(Message &request, Message &reply) = 0;
+      };
+
+      /// A pool of worker processes, each running one call at a time. A
+      /// worker is started by running a command with the descriptor of its
+      /// end of a channel appended to the arguments. The host's own
+      /// executable with a flag telling it to run as a worker is the usual
+      /// command.
+      ///
+      /// Alternatively a pool can connect to workers already running
+      /// elsewhere, listening for hosts over TCP. Images can't be passed in
+      /// shared memory to those, so callers need to check isLocal.
+      ///
+      /// If a worker dies during a call, the call fails, a fresh worker is
+      /// started or reconnected to in its place and the host carries on. A
+      /// worker that can't be replaced is dropped from the pool.
+      class WorkerPool {
+      protected :
+        struct Worker {
+          int          pid;       ///< of a process we started, 0 for a connected worker
+          Channel     *channel;   ///< NULL if the worker is gone for good
+          bool         busy;
+          std::string  address;   ///< of a connected worker
+        };
+
+        std::vector<std::string>  _command;
+        std::vector<Worker>       _workers;
+        bool                      _local;       ///< are the workers processes we started
+        size_t                    _nRestarts;   ///< number of workers that died and were replaced
+        std::mutex                _lock;        ///< guards the above
+        std::condition_variable   _idle;        ///< signalled as workers are released
+
+        /// start a process on a worker slot, or connect to its address
+        bool spawn(Worker &w);
+
+        /// wait for a worker's process to end, killing it if need be
+        void reap(Worker &w);
+
+        /// Reserve a worker, index is the one to wait for, or -1 for any.
+        /// Returns -1 if the one asked for, or every one, is gone.
+        int acquire(int index);
+
+        /// give a worker back, restarting it if it has died
+        void release(int index, bool died);
+
+        /// run a call on a reserved worker
+        OfxStatus callOn(int index, Message &request, Message &reply, CallbackI *callbacks);
+
+      private :
+        WorkerPool(const WorkerPool &);
+        WorkerPool &operator=(const WorkerPool &);
+
+      public :
+        WorkerPool();
+
+        /// stops the workers
+        virtual ~WorkerPool();
+
+        /// Start nWorkers processes running the command. The first entry of
+        /// the command is the executable, the rest its arguments.
+        bool start(const std::vector<std::string> &command, int nWorkers);
+
+        /// connect to a worker listening at each "host:port" in addresses
+        bool connect(const std::vector<std::string> &addresses);
+
+        /// close every channel and wait for the workers to exit
+        void shutdown();
+
+        /// how many workers there are, including any that are gone
+        int getNumWorkers();
+
+        /// can the workers map shared memory from this process
+        bool isLocal();
+
+        /// is a worker still in the pool
+        bool isAlive(int index);
+
+        /// the address of a connected worker, or empty
+        std::string getAddress(int index);
+
+        /// how many workers have died and been restarted
+        size_t getNumRestarts();
+
+        /// Send a request to the first idle worker and wait for its reply,
+        /// passing anything it sends before then to callbacks. Returns
+        /// kOfxStatOK if there was a reply, kOfxStatFailed if the worker
+        /// died and kOfxStatErrFatal if there are no workers.
+        OfxStatus call(Message &request, Message &reply, CallbackI *callbacks = 0);
+
+        /// as above, but on a particular worker, waiting for it if it is busy
+        OfxStatus call(int index, Message &request, Message &reply, CallbackI *callbacks = 0);
+
+        /// send a request to every worker in turn, ignoring the replies
+        void broadcast(Message &request);
+      };
+
+      /// The other end of the pool. Runs in a worker process, receiving
+      /// calls and sending replies and callbacks to the host.
+      class WorkerChannel {
+      protected :
+        Channel     _channel;
+        std::mutex  _lock;     ///< a plugin may call back on several threads
+
+      public :
+        explicit WorkerChannel(int fd);
+
+        /// wait for the next call, false once the host has gone
+        bool receive(Message &request);
+
+        /// send the final reply to a call
+        bool reply(const Message &reply);
+
+        /// call back to the host during a call and wait for its reply
+        bool callback(const Message &request, Message &reply);
+      };
+
+    } // namespace IPC
+
+  } // namespace Host
+
+} // namespace OFX
+
+#endif // OFXH_IPC_H
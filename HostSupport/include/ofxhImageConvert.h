@@ -0,0 +1,135 @@
+// Copyright OpenFX and contributors to the OpenFX project.
+// SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef OFXH_IMAGE_CONVERT_H
+#define OFXH_IMAGE_CONVERT_H
+
+#include <string>
+#include <map>
+#include <mutex>
+
+#include "ofxCore.h"
+#include "ofxImageEffect.h"
+
+#include "ofxhClip.h"
+
+namespace OFX {
+
+  namespace Host {
+
+    namespace ImageEffect {
+
+      /// A pool of pixel buffers, so that converting image after image of
+      /// the same size does not hit the allocator every time. Buffers are
+      /// kept by size, and the pool will hold on to at most a set number
+      /// of bytes of idle buffers. The host's caches of pixels take their
+      /// buffers from the same pool, so it accounts for all of them.
+      class ImageBufferPool {
+      protected :
+        std::multimap<size_t, void *> _free;        ///< idle buffers by size
+        size_t                        _freeBytes;   ///< bytes held in _free
+        size_t                        _maxFreeBytes;///< most we will hold on to
+        size_t                        _usedBytes;   ///< bytes acquired and not yet released
+        std::mutex                    _lock;
+
+      public :
+        explicit ImageBufferPool(size_t maxFreeBytes = size_t(256) << 20);
+
+        /// dtor, frees everything that is idle
+        ~ImageBufferPool();
+
+        /// the pool used by the host's conversion stage
+        static ImageBufferPool &getDefault();
+
+        /// get a buffer of exactly nBytes
+        void *acquire(size_t nBytes);
+
+        /// give a buffer from acquire back to the pool
+        void release(void *buffer, size_t nBytes);
+
+        /// bytes in buffers that have been acquired and not released
+        size_t getBytesInUse();
+
+        /// bytes in idle buffers
+        size_t getFreeBytes();
+
+        /// set the most bytes the pool will keep idle, trims if needed
+        void setMaxFreeBytes(size_t maxFreeBytes);
+
+        /// free everything that is idle
+        void trim();
+      };
+
+      /// An image holding the converted pixels of another image, in a
+      /// buffer from an ImageBufferPool, which it gives back on deletion.
+      class ConvertedImage : public Image {
+      protected :
+        ImageBufferPool &_pool;
+        void            *_buffer;
+        size_t           _bufferBytes;
+
+      public :
+        ConvertedImage(ClipInstance &clip,
+                       ImageBufferPool &pool,
+                       void *buffer,
+                       size_t bufferBytes,
+                       double renderScaleX,
+                       double renderScaleY,
+                       const OfxRectI &bounds,
+                       const OfxRectI &rod,
+                       int rowBytes,
+                       const std::string &field,
+                       const std::string &uniqueIdentifier);
+
+        virtual ~ConvertedImage();
+      };
+
+      /// bytes per component for one of the kOfxBitDepth* strings, 0 if not one we know
+      int getBytesPerComponent(const std::string &depth);
+
+      /// number of components for one of the kOfxImageComponent* strings, 0 if not one we know
+      int getComponentCount(const std::string &components);
+
+      /// Can pixels be converted between these depths and components.
+      /// Byte, short and float depths are supported, with RGBA, RGB and
+      /// alpha components. Half float is only supported as a no-op.
+      bool canConvertPixels(const std::string &srcDepth, const std::string &srcComponents,
+                            const std::string &dstDepth, const std::string &dstComponents);
+
+      /// Convert the pixels in window from one depth and set of components
+      /// to another. Data pointers point at the bottom left pixel of their
+      /// bounds, and window must be inside both. Component mapping is,
+      ///   - RGBA to RGB drops alpha, RGB to RGBA sets alpha to 1,
+      ///   - RGB(A) to alpha takes the alpha, which is 1 for RGB,
+      ///   - alpha to RGB(A) makes an image with black colour and the alpha.
+      /// Float is clamped to 0..1 when going to an integer depth.
+      /// Returns false if the conversion isn't supported.
+      bool convertPixels(const void *srcData, const OfxRectI &srcBounds, int srcRowBytes,
+                         const std::string &srcDepth, const std::string &srcComponents,
+                         void *dstData, const OfxRectI &dstBounds, int dstRowBytes,
+                         const std::string &dstDepth, const std::string &dstComponents,
+                         const OfxRectI &window);
+
+      /// The host's conversion stage. Given an image fetched from a clip by
+      /// ClipInstance::getImage, whose depth and components properties
+      /// describe the pixels it actually holds, return an image in the
+      /// clip's mapped depth and components as set by getClipPreferences.
+      ///
+      /// The image is returned as is if it already matches, has no pixel
+      /// data, or the conversion isn't supported. Otherwise only the pixels
+      /// inside optionalBounds (canonical coords, as passed to getImage)
+      /// are converted into a pooled buffer, and the reference on the
+      /// original image is released. The converted image's unique identifier
+      /// is the original's with the new depth and components appended.
+      Image *conformImageToClip(ClipInstance &clip,
+                                Image *image,
+                                const OfxRectD *optionalBounds,
+                                ImageBufferPool &pool = ImageBufferPool::getDefault());
+
+    } // namespace ImageEffect
+
+  } // namespace Host
+
+} // namespace OFX
+
+#endif // OFXH_IMAGE_CONVERT_H
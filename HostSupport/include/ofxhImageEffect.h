@@ -5,6 +5,8 @@
 #ifndef OFX_IMAGE_EFFECT_H
 #define OFX_IMAGE_EFFECT_H
 
+#include <set>
+
 #include "ofxCore.h"
 #include "ofxImageEffect.h"
 
@@ -15,6 +17,7 @@
 #include "ofxhParam.h"
 #include "ofxhMemory.h"
 #include "ofxhInteract.h"
+#include "ofxhActionCache.h"
 
 #ifdef _MSC_VER
 //Use visual studio extension
@@ -273,6 +276,15 @@ namespace OFX {
       /// a map used to specify needed frame ranges on set of clips
       typedef std::map<ClipInstance *, std::vector<OfxRangeD> > RangeMap;
 
+      /// an image asked for in a batch through the image fetch suite
+      struct ImageFetch {
+        ClipInstance   *clip;
+        OfxTime         time;
+        const OfxRectD *region;   ///< may be NULL
+        Image          *image;    ///< set by Instance::getImages, NULL if there is none
+        OfxStatus       status;   ///< set by Instance::getImages, as clipGetImage would return
+      };
+
       /// an image effect plugin instance.
       ///
       /// Client code needs to filling the pure virtuals in this.
@@ -297,6 +309,29 @@ namespace OFX {
         std::string                                   _outputPreMultiplication;  ///< set by clip prefs
         std::string                                   _outputFielding;  ///< set by clip prefs
         double                                        _outputFrameRate; ///< set by clip prefs
+        ActionCache                                   _actionCache; ///< results of the region, identity and frame range actions
+
+        /// changes collected between beginChanges and endChanges
+        unsigned                                      _changeDepth;       ///< nesting of beginChanges
+        std::string                                   _changeReason;      ///< of the outermost
+        OfxTime                                       _changeTime;
+        OfxPointD                                     _changeRenderScale;
+        std::set<std::string>                         _changedClips;
+        std::set<std::string>                         _changedParams;
+        std::set<std::string>                         _pluginChangedParams; ///< set by the plugin while changes are open
+        bool                                          _deliveringChanges; ///< are we sending changes to the plugin
+        unsigned int                                  _imageFetchThreads; ///< most images getImages makes at once
+
+        /// Send changes to the plugin in one instance changed bracket, clips
+        /// first, then params in the order they were described. Appends the
+        /// params sent to sent. Returns the first failing status.
+        OfxStatus deliverChanges(const std::string &why,
+                                 const std::set<std::string> &clips,
+                                 const std::set<std::string> &params,
+                                 std::vector<std::string> &sent);
+
+        /// call the frames needed action, or work out the default, filling in rangeMap
+        OfxStatus calcFramesNeeded(OfxTime time, RangeMap &rangeMap);
 
       public:        
         /// constructor based on clip descriptor
@@ -316,6 +351,12 @@ namespace OFX {
         /// get the descriptor for this instance
         const Descriptor &getDescriptor() const {return *_descriptor;}
 
+        /// Get the cache of the region of definition, regions of interest, is
+        /// identity, frames needed and time domain actions. It is off until the
+        /// host enables it, after which the host must invalidate it when
+        /// anything upstream of the instance changes.
+        ActionCache &getActionCache() {return _actionCache;}
+
         /// return the plugin this instance was created with
         OFX::Host::ImageEffect::ImageEffectPlugin*getPlugin() const { return _plugin; }
 
@@ -357,6 +398,18 @@ namespace OFX {
         /// are the clip preferences currently dirty
         bool areClipPrefsDirty() const {return _clipPrefsDirty;}
 
+        /// make the clip preferences action be run again before they are next needed
+        void setClipPrefsDirty() {_clipPrefsDirty = true;}
+
+        /// Take on clip preferences worked out before, say restored from a
+        /// snapshot of an instance connected the same way, rather than run
+        /// the action. The host sets each clip's depth and components itself.
+        void setClipPreferences(const std::string &outputFielding,
+                                const std::string &outputPremult,
+                                double outputFrameRate,
+                                bool continuousSamples,
+                                bool frameVarying);
+
         /// are all the non optional clips connected
         bool checkClipConnectionStatus() const;
 
@@ -415,6 +468,12 @@ namespace OFX {
 
         /// overridden from gethook,  get the virutals for viewport size, pixel scale, background colour
         virtual void getDoublePropertyN(const std::string &name, double *values, int count) const;
+
+        /// overridden from gethook, gets the plugin handle, which loads the binary if need be
+        virtual void *getPointerProperty(const std::string &name, int index) const;
+
+        /// overridden from gethook, gets the plugin handle, which loads the binary if need be
+        virtual void getPointerPropertyN(const std::string &name, void **values, int count) const;
         
         /// overridden from gethook, don't know what to do
         virtual void reset(const std::string &name);
@@ -524,6 +583,66 @@ namespace OFX {
 
         virtual OfxStatus endInstanceChangedAction(const std::string &why);
 
+        //
+        // batched changes
+        //
+        // A host changing many params at once, say loading a project or a
+        // preset, brackets them with beginChanges and endChanges and calls
+        // paramChanged or clipChanged for each. The plugin is then told of
+        // them all in a single begin/end instance changed bracket when the
+        // outermost endChanges is called, each param once however many
+        // times it changed. The action cache is invalidated once, after the
+        // last bracket is delivered, however many changes the batch holds
+        // and however many rounds the plugin's own changes take.
+        // changesCommitted is called once, for the host to resync render
+        // clones and schedule a re-render.
+        //
+        // Params the plugin sets from its instance changed action are held
+        // back while the bracket is open and go to it afterwards, in one
+        // kOfxChangePluginEdited bracket per round of cascading changes,
+        // rather than a bracket each.
+        //
+
+        /// Start collecting changes. Calls nest, the reason, time and render
+        /// scale of the outermost are passed to the plugin.
+        void beginChanges(const std::string &why, OfxTime time, OfxPointD renderScale);
+
+        /// Note the host changed a param, returns kOfxStatErrBadIndex if
+        /// there is no such param. Outside beginChanges/endChanges this is
+        /// sent to the plugin straight away, as kOfxChangeUserEdited at the
+        /// recursive time and render scale.
+        OfxStatus paramChanged(const std::string &paramName);
+
+        /// Note the host changed a clip, say connecting it, as paramChanged.
+        OfxStatus clipChanged(const std::string &clipName);
+
+        /// Stop collecting changes. The outermost call sends them to the
+        /// plugin, returning the first failing status of its actions.
+        OfxStatus endChanges();
+
+        /// are changes being collected
+        bool isInChanges() const { return _changeDepth > 0; }
+
+        /// Called once the plugin has been told of a batch of changes, with
+        /// every param that changed, including those the plugin set itself,
+        /// and every clip. The default does nothing.
+        virtual void changesCommitted(const std::vector<std::string> &paramNames,
+                                      const std::vector<std::string> &clipNames);
+
+        /// Get the images of a batch the plugin fetched through the image
+        /// fetch suite, each as its clip's fetchImage gives it. The default
+        /// fetches up to getImageFetchThreads of them at once. Override this
+        /// to make the images upstream together.
+        virtual void getImages(std::vector<ImageFetch> &fetches);
+
+        /// Let getImages call the clips' getImage on up to n threads at once,
+        /// 0 meaning one per CPU. Only set this above the default of 1 if
+        /// the host's getImage can be called concurrently.
+        void setImageFetchThreads(unsigned int n) {_imageFetchThreads = n;}
+
+        /// how many threads getImages fetches on at once
+        unsigned int getImageFetchThreads() const;
+
         // purge your caches
         virtual OfxStatus purgeCachesAction();
 
@@ -36,6 +36,10 @@ namespace OFX {
         /// map to store contexts in
         std::map<std::string, std::unique_ptr<Descriptor>> _contexts;
 
+        /// contexts in _contexts that were read from the plugin cache, and which the
+        /// loaded binary has not yet been asked to describe itself in
+        std::set<std::string> _cachedContexts;
+
         mutable std::set<std::string> _knownContexts;
         mutable bool _madeKnownContexts;
 
@@ -43,6 +47,13 @@ namespace OFX {
 
         void addContextInternal(const std::string &context) const;
 
+        /// run the describe in context action on the loaded binary, returns null if it failed
+        std::unique_ptr<Descriptor> describeInContext(PluginHandle *ph, const std::string &context);
+
+        /// can this context's descriptors be written to the plugin cache, they can't if they
+        /// hold pointers into the binary, eg: overlay interacts or custom interpolation callbacks
+        bool isContextCacheable(const Descriptor &desc) const;
+
       public:
 			  ImageEffectPlugin(PluginCache &pc, PluginBinary *pb, int pi, OfxPlugin *pl);
 
@@ -72,6 +83,10 @@ namespace OFX {
         Descriptor *getContext(const std::string &context);
 
         void addContext(const std::string &context);
+
+        /// add a context's descriptor read from the plugin cache. The binary won't be
+        /// loaded to describe the context, but will still be asked to describe itself
+        /// in it when it is loaded, as plugins expect that before making instances.
         void addContext(const std::string &context, std::unique_ptr<Descriptor> ied);
 
         virtual void saveXML(std::ostream &os);
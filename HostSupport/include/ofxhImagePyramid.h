@@ -0,0 +1,172 @@
+// Copyright OpenFX and contributors to the OpenFX project.
+// SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef OFXH_IMAGE_PYRAMID_H
+#define OFXH_IMAGE_PYRAMID_H
+
+#include <string>
+#include <map>
+#include <vector>
+#include <utility>
+#include <mutex>
+#include <iosfwd>
+
+#include "ofxCore.h"
+#include "ofxImageEffect.h"
+
+namespace OFX {
+
+  namespace Host {
+
+    namespace ImageEffect {
+
+      // forward declare
+      class ClipInstance;
+      class Image;
+      class ImageBufferPool;
+
+      /// Resample an image to a coarser render scale with a box filter, into
+      /// a buffer from pool. The new image keeps the depth and components of
+      /// src, and its unique identifier is frameIdentifier with the scale
+      /// appended. Pass the full size frame's identifier when src is itself
+      /// a level made here, so ids don't chain, if empty src's own is used.
+      /// Returns NULL if renderScale is finer than the image's own, or its
+      /// pixels are in a depth we can't filter, which is only half float.
+      Image *downsampleImage(ClipInstance &clip,
+                             Image &src,
+                             OfxPointD renderScale,
+                             ImageBufferPool &pool,
+                             const std::string &frameIdentifier = std::string());
+
+      /// Keeps images of a clip's frames at several render scales, so a host
+      /// switching between proxy scales doesn't have to make its source
+      /// images again at each one. A host calls it from its getImage,
+      ///
+      ///     Image *image = pyramid.fetch(*this, time, renderScale);
+      ///     if(!image) {
+      ///       image = makeImage(time, renderScale);
+      ///       pyramid.insert(*this, time, image);
+      ///     }
+      ///
+      /// Given images at some scales, any coarser one is built from the
+      /// nearest finer level there is, halving it until within a factor of
+      /// two, then box filtering to the exact scale. Each level built along
+      /// the way is kept. So the host need only insert its largest image.
+      ///
+      /// Levels are forgotten least recently used first once they hold
+      /// more than a set number of bytes. Images still referenced elsewhere
+      /// live on till they are released. Built levels take their buffers
+      /// from an ImageBufferPool, by default the conversion stage's, which
+      /// so accounts for both.
+      ///
+      /// Frames are keyed by clip and time. If a clip's image at a time
+      /// changes, inserting one with a new unique identifier replaces the
+      /// frame's levels, otherwise the host must erase them.
+      ///
+      /// All calls are locked, levels are built outside the lock.
+      class ImagePyramid {
+      public :
+        /// hit and miss counts
+        struct Stats {
+          size_t hits;        ///< fetches served by a level we had
+          size_t builds;      ///< levels built from a finer one
+          size_t misses;      ///< fetches with nothing fine enough
+          size_t evictions;   ///< levels forgotten to make room
+
+          Stats();
+        };
+
+      protected :
+        typedef std::pair<const ClipInstance *, double> FrameKey; ///< clip and time
+
+        /// an image of a frame at one render scale
+        struct Level {
+          OfxPointD  scale;
+          Image     *image;     ///< we hold a reference on it
+          size_t     bytes;
+          size_t     lastUse;   ///< _clock when last fetched
+        };
+
+        /// the levels of a frame
+        struct Frame {
+          std::string         uniqueIdentifier;   ///< of the images inserted
+          std::vector<Level>  levels;
+        };
+
+        ImageBufferPool                &_pool;
+        size_t                          _maxBytes;
+        size_t                          _bytes;     ///< held in every level
+        size_t                          _clock;     ///< bumped on each use
+        std::map<FrameKey, Frame>       _frames;
+        Stats                           _stats;
+        mutable std::mutex              _lock;      ///< guards the above
+
+        /// the level of a frame at exactly scale, or NULL
+        Level *findLevel(Frame &frame, OfxPointD scale);
+
+        /// the coarsest level of a frame at or finer than scale, or NULL
+        Level *findFinerLevel(Frame &frame, OfxPointD scale);
+
+        /// add a level, taking over a reference on image, call with the lock held
+        void addLevel(Frame &frame, OfxPointD scale, Image *image);
+
+        /// forget levels till we hold no more than _maxBytes, call with the lock held
+        void makeRoom();
+
+        /// release every level of a frame, call with the lock held
+        void releaseFrame(Frame &frame);
+
+      private :
+        ImagePyramid(const ImagePyramid &);
+        ImagePyramid &operator=(const ImagePyramid &);
+
+      public :
+        /// ctor,
+        ///   \arg maxBytes - most bytes of images to hold on to
+        ///   \arg pool - where built levels get their buffers
+        explicit ImagePyramid(size_t maxBytes = size_t(512) << 20);
+        ImagePyramid(size_t maxBytes, ImageBufferPool &pool);
+
+        /// dtor, releases every level
+        ~ImagePyramid();
+
+        /// Add an image of a clip's frame at time, at the image's render
+        /// scale. We take a reference of our own on it. It replaces any
+        /// level at the same scale, and all levels of the frame if it has a
+        /// different unique identifier.
+        void insert(ClipInstance &clip, OfxTime time, Image *image);
+
+        /// Get an image of a clip's frame at time, at renderScale, with a
+        /// reference for the caller, or NULL if there is no level at or finer
+        /// than that to make it from.
+        Image *fetch(ClipInstance &clip, OfxTime time, OfxPointD renderScale);
+
+        /// forget the levels of a clip's frame at time
+        void erase(const ClipInstance &clip, OfxTime time);
+
+        /// forget the levels of every frame of a clip, say when it is deleted
+        void erase(const ClipInstance &clip);
+
+        /// forget everything
+        void clear();
+
+        /// set the most bytes of images to hold, forgetting levels if needed
+        void setMaxBytes(size_t maxBytes);
+
+        /// bytes of images held
+        size_t getBytes() const;
+
+        /// get the hit and miss counts so far
+        Stats getStats() const;
+
+        /// print the hit and miss counts and the bytes held
+        void printStats(std::ostream &os) const;
+      };
+
+    } // namespace ImageEffect
+
+  } // namespace Host
+
+} // namespace OFX
+
+#endif // OFXH_IMAGE_PYRAMID_H
@@ -5,6 +5,10 @@
 #ifndef OFX_INTERACT_H
 #define OFX_INTERACT_H
 
+#include <string>
+#include <deque>
+#include <mutex>
+
 #include "ofxOld.h" // old plugins may rely on deprecated properties being present
 
 namespace OFX {
@@ -75,6 +79,18 @@ namespace OFX {
         State getState() const {return _state;}
       };
 
+      /// a pen, key or focus event waiting in an Instance's event queue
+      struct QueuedEvent {
+        std::string  action;         ///< the kOfxInteractAction* to send
+        OfxTime      time;
+        OfxPointD    renderScale;
+        OfxPointD    penPos;
+        OfxPointI    penPosViewport;
+        double       pressure;
+        int          key;
+        std::string  keyString;
+      };
+
       /// a generic interact, it doesn't belong to anything in particular
       /// we need to generify this slighty more and remove the renderscale args
       /// into a derived class, as they only belong to image effect plugins
@@ -98,6 +114,17 @@ namespace OFX {
         /// set key args in the props
         void setKeyArgProps(int     key,
                             char*   keyString);
+
+        std::deque<QueuedEvent> _eventQueue;       ///< events waiting for drainEvents, in the order they came in
+        bool                    _redrawPending;    ///< has a redraw been asked for since the last drainEvents
+        bool                    _throttleRedraws;  ///< do the plugin's redraw requests wait for drainEvents
+        std::mutex              _eventLock;        ///< guards the above, events may be queued on another thread to the one draining them
+
+        /// add an event to the queue, merging it into the last one if both are pen motions at the same time and scale
+        void queueEvent(const QueuedEvent &event);
+
+        /// send a queued event to the plugin
+        OfxStatus dispatchEvent(QueuedEvent &event);
         
       public:
         Instance(Descriptor &desc, void *effectInstance);
@@ -139,6 +166,37 @@ namespace OFX {
         /// implement this
         virtual OfxStatus redraw() = 0;
 
+        /// Called by the interact suite when the plugin asks for a redraw. If redraws are
+        /// throttled this just notes it, and drainEvents does one redraw for however many
+        /// were asked for, otherwise it calls redraw straight away.
+        OfxStatus requestRedraw();
+
+        /// Should the plugin's redraw requests wait for drainEvents. Off by default, hosts
+        /// that call drainEvents once per display refresh should turn it on.
+        void setRedrawThrottling(bool v);
+
+        /// Queue pen, key and focus events rather than sending them to the plugin straight
+        /// away, they are sent in order by drainEvents. Consecutive pen motions at the same
+        /// time and render scale are merged, only the latest position and pressure is sent,
+        /// so a tablet's flood of motion events costs one action per drain. Anything else
+        /// in between, eg: a pen up or a key press, keeps the motions either side apart.
+        void queuePenMotion(OfxTime time, const OfxPointD &renderScale, const OfxPointD &penPos, const OfxPointI &penPosViewport, double pressure);
+        void queuePenUp(OfxTime time, const OfxPointD &renderScale, const OfxPointD &penPos, const OfxPointI &penPosViewport, double pressure);
+        void queuePenDown(OfxTime time, const OfxPointD &renderScale, const OfxPointD &penPos, const OfxPointI &penPosViewport, double pressure);
+        void queueKeyDown(OfxTime time, const OfxPointD &renderScale, int key, const char *keyString);
+        void queueKeyUp(OfxTime time, const OfxPointD &renderScale, int key, const char *keyString);
+        void queueKeyRepeat(OfxTime time, const OfxPointD &renderScale, int key, const char *keyString);
+        void queueGainFocus(OfxTime time, const OfxPointD &renderScale);
+        void queueLoseFocus(OfxTime time, const OfxPointD &renderScale);
+
+        /// are there events waiting for drainEvents
+        bool hasQueuedEvents();
+
+        /// The host's hook to run between display frames. Sends the queued events to the
+        /// plugin in order, then calls redraw once if any redraws were asked for. All the
+        /// events are sent, the first status that is not OK or default is returned.
+        OfxStatus drainEvents();
+
         /// returns the params the interact uses
         virtual void getSlaveToParam(std::vector<std::string>& params) const;
 
@@ -9,6 +9,7 @@
 #include <map>
 #include <list>
 #include <cstdarg>
+#include <mutex>
 
 //ofx
 #include "ofxParam.h"
@@ -604,9 +605,42 @@ namespace OFX {
         virtual OfxStatus setV(OfxTime time, va_list arg);
       };
 
+      /// A custom param. Unless the host overrides get and set, this keeps the param's
+      /// value and string keyframes itself, and animates between keys by calling the
+      /// plugin's kOfxParamPropCustomInterpCallbackV1. Interpolated values are remembered
+      /// by time until a key changes, so asking for the same time again, as scrubbing and
+      /// rendering do, neither calls the plugin nor has it parse the keys again.
       class CustomInstance : public StringInstance {
+      protected:
+        typedef std::map<OfxTime, std::string> KeyMap;
+        typedef std::pair<OfxTime, std::string> Key;   ///< a key copied out of the map
+
+        std::string            _value;        ///< the value when not animated, and the last value set
+        KeyMap                 _keys;         ///< keyframes by time
+        KeyMap                 _interpolated; ///< values between keys by time, cleared when a key changes
+        unsigned long          _generation;   ///< bumped whenever the keys change, to spot interpolations made before
+        mutable std::mutex     _lock;         ///< guards the above, renders may get values on several threads
+
+        /// call the plugin's interpolation callback for a time between the two given keys
+        OfxStatus interpolate(OfxTime time, const Key &before, const Key &after, std::string &value);
+
+        /// forget the interpolated values, call with the lock held whenever the keys change
+        void keysChanged();
+
       public:
-        CustomInstance(Descriptor& descriptor, Param::SetInstance* instance = 0) : StringInstance(descriptor,instance) {}
+        CustomInstance(Descriptor& descriptor, Param::SetInstance* instance = 0);
+
+        virtual OfxStatus get(std::string &);
+        virtual OfxStatus get(OfxTime time, std::string &);
+        virtual OfxStatus set(const char*);
+        virtual OfxStatus set(OfxTime time, const char*);
+
+        // overridden from KeyframeParam
+        virtual OfxStatus getNumKeys(unsigned int &nKeys) const;
+        virtual OfxStatus getKeyTime(int nth, OfxTime& time) const;
+        virtual OfxStatus getKeyIndex(OfxTime time, int direction, int & index) const;
+        virtual OfxStatus deleteKey(OfxTime time);
+        virtual OfxStatus deleteAllKeys();
       };
 
       class PushbuttonInstance : public Instance, public KeyframeParam {
@@ -363,6 +363,11 @@ namespace OFX {
         return _dirty;
       }
 
+      /// flag the cache as needing writing out again, eg: a plugin has been described in a new context
+      void setDirty() {
+        _dirty = true;
+      }
+
       /// add a file to the plugin path
       void addFileToPath(const std::string &f, bool recurse=true) {
         _pluginPath.push_back(f);
@@ -9,6 +9,8 @@
 #include <map>
 #include <algorithm>
 #include <sstream>
+#include <atomic>
+#include <mutex>
 
 namespace OFX {
   namespace Host {
@@ -184,6 +186,7 @@ namespace OFX {
         bool         _pluginReadOnly;           ///< set is forbidden through suite: value may still change between get() calls
         std::vector<NotifyHook *> _notifyHooks; ///< hooks to call whenever the property is set
         GetHook                  *_getHook;     ///< if we are not storing props locally, they are stored via fetching from here
+        std::atomic<int>          _refCount;    ///< number of sets holding this property, see Set's copy ctor
 
         friend class Set;
       public :
@@ -209,6 +212,19 @@ namespace OFX {
 
         /// override this to return a clone of the property
         virtual Property *deepCopy() = 0;
+
+        /// another set is holding on to this property
+        void addRef() { ++_refCount; }
+
+        /// a set has let go of this property, deletes it once no sets hold it
+        void release() { if(--_refCount == 0) delete this; }
+
+        /// is this held by more than one set, in which case it must not be changed
+        bool isShared() const { return _refCount > 1; }
+
+        /// Can this be shared with a set copied from ours. Hooks belong to
+        /// whoever owns the set they were added to, so hooked properties can't be.
+        bool isShareable() const { return _getHook == 0 && _notifyHooks.empty(); }
         
         /// get the name of this property
         const std::string &getName()
@@ -233,6 +249,9 @@ namespace OFX {
         {
           _getHook = hook;
         }
+
+        /// are values fetched through a get hook rather than held here
+        bool hasGetHook() const { return _getHook != 0; }
         
         /// call notify on the contained notify hooks
         void notify(bool single, int indexOrN);
@@ -370,7 +389,20 @@ namespace OFX {
         const int   _magic; ///< to check for handles being nice
 
       protected :
-        PropertyMap _props; ///< Our properties.
+        /// Our properties. Properties may be shared with sets copied from
+        /// this one, or that this was copied from, in which case fetchProperty
+        /// swaps in a private copy before handing one out to be changed,
+        /// hence the mutable.
+        mutable PropertyMap _props;
+
+        /// Shared properties this set has swapped for its own copy. They are
+        /// held until the set goes, so a Property * this set handed out before
+        /// the swap stays valid however the other sets sharing it go.
+        mutable std::vector<Property *> _retired;
+
+        /// guards swapping entries of _props and adding to _retired, so
+        /// threads can read and fetch from the same set at once
+        mutable std::mutex _propsLock;
 
         /// chained property set, which is read only
         /// these are searched on a get if not found 
@@ -403,7 +435,9 @@ namespace OFX {
         /// ->name is null), and turn these into a Set
         explicit Set(const PropSpec *);
 
-        /// deep copies the property set
+        /// Copies the property set. This is copy on write, properties are
+        /// shared with the other set until either set fetches one to change
+        /// it. Properties with get or notify hooks are copied straight away.
         explicit Set(const Set &);
 
         /// empty ctor
@@ -424,7 +458,8 @@ namespace OFX {
         /// set the chained property set
         void setChainedSet(Set *s) {_chainedSet = s;}
 
-        /// grab the internal properties map
+        /// grab the internal properties map, the properties in it may be
+        /// shared, so use fetchProperty to get one to change
         const PropertyMap &getProperties() const
         {
           return _props;
@@ -439,9 +474,17 @@ namespace OFX {
         void addNotifyHook(const std::string &name, NotifyHook *hook) const;
                 
         /// Fetchs a pointer to a property of the given name, following the property chain if the
-        /// 'followChain' arg is not false.
+        /// 'followChain' arg is not false. If the property is shared with another set, this set
+        /// gets its own copy first, so the property returned can be changed.
         Property *fetchProperty(const std::string &name, bool followChain = false) const;
 
+        /// As fetchProperty, but for reading only. The property may be shared
+        /// with other sets and must not be changed.
+        Property *findProperty(const std::string &name, bool followChain = false) const;
+
+        /// As fetchTypedProperty, but for reading only, see findProperty.
+        template<class T> bool findTypedProperty(const std::string &name, T *&prop, bool followChain = false) const;
+
         /// get property with the particular name and type.  if the property is 
         /// missing or is of the wrong type, return an error status.  if this is a sloppy
         /// property set and the property is missing, a new one will be created of the right
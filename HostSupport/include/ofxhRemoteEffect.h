@@ -0,0 +1,134 @@
+// Copyright OpenFX and contributors to the OpenFX project.
+// SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef OFXH_REMOTE_EFFECT_H
+#define OFXH_REMOTE_EFFECT_H
+
+#include <string>
+#include <mutex>
+
+#include "ofxCore.h"
+#include "ofxImageEffect.h"
+
+namespace OFX {
+
+  namespace Host {
+
+    namespace IPC {
+      class WorkerPool;
+    }
+
+    namespace ImageEffect {
+
+      // forward declare
+      class Instance;
+
+      /// the messages that go between a RemoteRenderer and its workers
+      enum RemoteMessageEnum {
+        eRemoteRender = 1,        ///< render a frame, host to worker
+        eRemoteEndSequence,       ///< end a sequence render, host to worker
+        eRemoteDestroyInstance,   ///< forget an instance, host to worker
+        eRemoteGetImage,          ///< fetch an image from a clip, worker to host
+        eRemoteGetRegionOfDefinition, ///< a clip's region of definition at another time, worker to host
+        eRemoteGetParam,          ///< a param's value at another time, worker to host
+        eRemoteMessage,           ///< post a message, worker to host
+        eRemoteAbort              ///< should the render stop, worker to host
+      };
+
+      /// Runs an instance's renders in a pool of worker processes.
+      ///
+      /// Each render sends the worker everything it needs about the host's
+      /// instance at the time, its clips' preferences and regions of
+      /// definition and its params' values, so any worker can take any
+      /// render. The worker loads the plugin itself, keeps an instance of it
+      /// per renderer, and calls back to the host to fetch images, and param
+      /// values at other times, as the plugin asks for them.
+      ///
+      /// Image pixels are passed as shared memory, with no copy if the host
+      /// image's pixels are already in a Memory::SharedBlock, for example
+      /// one allocated with Memory::SharedInstance, otherwise they are copied
+      /// into one for the render, and for the output back again after. If
+      /// the pool's workers are on other machines the pixels are sent with
+      /// the messages instead. Either way only the render window of an
+      /// output comes back, so tiles of a frame can go to different workers.
+      ///
+      /// The host still creates the instance and runs its other actions, it
+      /// is only renders that go out of process, so a plugin that crashes in
+      /// render fails that frame rather than taking the host down.
+      class RemoteRenderer {
+      protected :
+        IPC::WorkerPool  &_pool;
+        std::string       _key;            ///< names our instance in the workers
+        std::mutex        _lock;           ///< guards the sequence
+        int               _sequence;       ///< id of the current sequence render, 0 if none
+        int               _nextSequence;
+        OfxTime           _seqStart, _seqEnd, _seqStep;
+        bool              _seqInteractive;
+        OfxPointD         _seqRenderScale;
+        bool              _seqSequential;
+        bool              _seqInteractiveRender;
+
+      private :
+        RemoteRenderer(const RemoteRenderer &);
+        RemoteRenderer &operator=(const RemoteRenderer &);
+
+      public :
+        explicit RemoteRenderer(IPC::WorkerPool &pool);
+
+        /// has the workers destroy their instances
+        virtual ~RemoteRenderer();
+
+        /// Start a sequence render, the workers begin it on their instances as
+        /// they are first given a frame of it.
+        void beginSequence(OfxTime startFrame,
+                           OfxTime endFrame,
+                           OfxTime step,
+                           bool interactive,
+                           OfxPointD renderScale,
+                           bool sequentialRender,
+                           bool interactiveRender);
+
+        /// end the sequence render on every worker it was begun on
+        OfxStatus endSequence();
+
+        /// Render a frame of the host's instance in a worker. The instance's
+        /// clips supply the images, so the render lands in its output clip.
+        ///   \arg worker - the index of the worker in the pool to use, -1 for any
+        ///   \arg workerLost - set if the render failed because the worker went,
+        ///                     rather than because the plugin failed it
+        OfxStatus render(Instance &instance,
+                         OfxTime time,
+                         const std::string &field,
+                         const OfxRectI &renderWindow,
+                         OfxPointD renderScale,
+                         bool sequentialRender,
+                         bool interactiveRender,
+                         bool draftRender,
+                         int worker = -1,
+                         bool *workerLost = 0);
+      };
+
+      /// The main loop of a worker process, serving a RemoteRenderer's
+      /// WorkerPool on the given descriptor till the host closes it. It
+      /// returns the exit status for the process.
+      ///
+      /// Call this first thing in the worker, before anything else makes the
+      /// plugin cache. The worker only loads the plugins it is asked to
+      /// render, from the bundles the host found them in.
+      int runWorker(int fd);
+
+      /// The main loop of a render node. Listens on "[host:]port", the
+      /// loopback interface if no host is given, and runs a worker, in a
+      /// process of its own, for each host that connects to it with
+      /// WorkerPool::connect. The plugins a host renders must be on the
+      /// node's own plugin path, where hosts say their bundles are is
+      /// ignored. Only returns on failure.
+      int serveWorkers(const std::string &address);
+
+    } // namespace ImageEffect
+
+  } // namespace Host
+
+} // namespace OFX
+
+#endif // OFXH_REMOTE_EFFECT_H
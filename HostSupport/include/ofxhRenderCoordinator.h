@@ -0,0 +1,141 @@
+// Copyright OpenFX and contributors to the OpenFX project.
+// SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef OFXH_RENDER_COORDINATOR_H
+#define OFXH_RENDER_COORDINATOR_H
+
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <functional>
+#include <iosfwd>
+
+#include "ofxCore.h"
+
+namespace OFX {
+
+  namespace Host {
+
+    namespace IPC {
+      class WorkerPool;
+    }
+
+    namespace ImageEffect {
+
+      /// Hands out the chunks of a render job, frames or tiles of a frame,
+      /// to the workers of a pool.
+      ///
+      ///   - each chunk goes to the idle worker with the best measured
+      ///     throughput, and workers not yet measured are tried first,
+      ///   - at the end of a job, a chunk is held back for a faster worker
+      ///     if it would finish it sooner than the idle one could,
+      ///   - a chunk lost because its worker went is put back at the front
+      ///     of the queue, up to a number of retries, after which the job
+      ///     fails,
+      ///   - chunks are rendered by the caller's function as they are
+      ///     handed out, so their results can be streamed back as each
+      ///     one finishes.
+      ///
+      /// Throughput is kept across jobs, so later jobs start balanced.
+      class RenderCoordinator {
+      public :
+        /// a piece of a job
+        struct Chunk {
+          OfxTime  time;
+          OfxRectI window;     ///< render window, in pixels
+          unsigned attempts;   ///< times it has been lost with its worker
+        };
+
+        /// Renders a chunk on a worker of the pool, returning its status and
+        /// setting workerLost if it failed because the worker went.
+        typedef std::function<OfxStatus(const Chunk &chunk, int worker, bool &workerLost)> RenderFunction;
+
+        /// Called for a chunk that was lost and won't be retried, as the job failed.
+        typedef std::function<void(const Chunk &chunk, OfxStatus stat)> AbandonFunction;
+
+        /// Called after each render of a chunk, with the chunk and workerLost
+        /// as the render saw them, once its worker is free and outside the
+        /// lock, so the host may wait in it without holding anything up.
+        typedef std::function<void(const Chunk &chunk, bool workerLost)> DoneFunction;
+
+      protected :
+        typedef std::chrono::steady_clock Clock;
+
+        /// what we know of a worker
+        struct WorkerStats {
+          bool              busy;
+          Clock::time_point started;         ///< when its current chunk started
+          double            startedPixels;   ///< in its current chunk
+          double            pixelsPerSec;    ///< smoothed, 0 until measured
+          size_t            nChunks;         ///< rendered, successfully or not
+          size_t            nLost;           ///< lost with the worker
+          double            pixels;          ///< rendered in total
+          double            secs;            ///< spent rendering them
+        };
+
+        IPC::WorkerPool          &_pool;
+        unsigned                  _maxRetries;
+        std::vector<WorkerStats>  _stats;       ///< by worker index
+        size_t                    _nRetried;    ///< chunks put back after being lost
+
+        /// the job being run
+        std::deque<Chunk>         _queue;
+        unsigned                  _inFlight;
+        bool                      _failed;
+        OfxStatus                 _result;
+        std::vector<Chunk>        _abandoned;   ///< lost chunks not retried
+
+        std::mutex                _lock;        ///< guards the above
+        std::condition_variable   _changed;     ///< signalled as chunks finish
+
+        /// pick the worker to render a chunk on, or -1 to wait, call with the lock held
+        int pickWorker(const Chunk &chunk);
+
+        /// is any worker still in the pool, call with the lock held
+        bool anyWorkers();
+
+        /// fail the job, call with the lock held
+        void fail(OfxStatus stat);
+
+        /// take chunks and render them till the job is done
+        void work(const RenderFunction &render, const AbandonFunction &abandon, const DoneFunction &done);
+
+      private :
+        RenderCoordinator(const RenderCoordinator &);
+        RenderCoordinator &operator=(const RenderCoordinator &);
+
+      public :
+        /// ctor,
+        ///   \arg pool - the workers, which must outlive us
+        ///   \arg maxRetries - how many times a chunk may be lost before the job fails
+        explicit RenderCoordinator(IPC::WorkerPool &pool, unsigned int maxRetries = 2);
+
+        unsigned int getMaxRetries() const {return _maxRetries;}
+
+        /// Render chunks with up to nThreads in flight at once, returning the
+        /// first failing status. No new chunks are started after a failure.
+        OfxStatus run(const std::vector<Chunk> &chunks,
+                      const RenderFunction &render,
+                      unsigned int nThreads,
+                      const AbandonFunction &abandon = AbandonFunction(),
+                      const DoneFunction &done = DoneFunction());
+
+        /// the measured throughput of a worker in pixels per second, 0 if not yet measured
+        double getThroughput(int worker);
+
+        /// print the chunks, losses and throughput of each worker
+        void printStats(std::ostream &out);
+
+        /// split a window into n bands of rows
+        static std::vector<OfxRectI> splitWindow(const OfxRectI &window, unsigned int n);
+      };
+
+    } // namespace ImageEffect
+
+  } // namespace Host
+
+} // namespace OFX
+
+#endif // OFXH_RENDER_COORDINATOR_H
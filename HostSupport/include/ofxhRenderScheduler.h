@@ -0,0 +1,300 @@
+// Copyright OpenFX and contributors to the OpenFX project.
+// SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef OFXH_RENDER_SCHEDULER_H
+#define OFXH_RENDER_SCHEDULER_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+
+#include "ofxCore.h"
+#include "ofxImageEffect.h"
+
+namespace OFX {
+
+  namespace Host {
+
+    namespace IPC {
+      class WorkerPool;
+    }
+
+    namespace ImageEffect {
+
+      // forward declare
+      class Base;
+      class Instance;
+      class RemoteRenderer;
+      class RenderCoordinator;
+
+      /// Schedules render actions on an effect instance so that the
+      /// plugin's declared render thread safety is honoured, and exploited.
+      ///
+      ///   - kOfxImageEffectRenderUnsafe, only one render at a time across
+      ///     every instance of the plugin in the process,
+      ///   - kOfxImageEffectRenderInstanceSafe, one render at a time per
+      ///     instance. The scheduler will make render clones of the instance
+      ///     with the same param values so several frames can be in flight,
+      ///   - kOfxImageEffectRenderFullySafe, no restrictions, the tiles of a
+      ///     frame are rendered concurrently on one instance. With several
+      ///     frames in flight each still gets an instance of its own, cloned
+      ///     as for instance safe, so one frame's output isn't written over
+      ///     by another's before the host has read it.
+      ///
+      /// Frames are only threaded by the scheduler if the plugin has set
+      /// kOfxImageEffectPluginPropHostFrameThreading, otherwise frames are
+      /// rendered one after the other and the plugin threads itself.
+      ///
+      /// The host still owns the instance being scheduled and still needs
+      /// to run createInstance and clip preferences on it before rendering.
+      ///
+      /// Given a worker pool, renders are run out of process instead, where
+      /// a plugin can't take the host down with it. Each worker renders one
+      /// frame at a time, so every plugin is then scheduled as if it were
+      /// instance safe, with one render in flight per worker. The frames of
+      /// a sequence, and the tiles of a tiled render, are handed out to the
+      /// workers by a RenderCoordinator, which balances them by throughput
+      /// and retries any lost with a worker.
+      class RenderScheduler {
+      public :
+        /// the thread safety of a plugin, as read from kOfxImageEffectPluginRenderThreadSafety
+        enum ThreadSafetyEnum {
+          eRenderUnsafe,
+          eRenderInstanceSafe,
+          eRenderFullySafe
+        };
+
+        /// Derive from this to be told when a frame rendered by renderSequence
+        /// is complete. It is called on the render thread, while the instance
+        /// that rendered the frame is still reserved, so the host can pick
+        /// up the output image from that instance's output clip.
+        class FrameDoneI {
+        public :
+          virtual ~FrameDoneI() {}
+
+          /// called on the render thread just before a frame's render starts
+          virtual void frameStarted(OfxTime /*time*/) {}
+
+          virtual void frameRendered(Instance &instance, OfxTime time, OfxStatus stat) = 0;
+
+          /// Called on the render thread after frameRendered, once the
+          /// instance and anything else the frame held has been given back.
+          /// A host that holds its render threads back, say to bound how far
+          /// ahead of its writer they get, must wait here and not in
+          /// frameRendered, where it would keep other frames from an instance.
+          virtual void frameFinished(OfxTime /*time*/) {}
+        };
+
+      protected :
+        /// an instance that renders can be issued to
+        struct Slot {
+          Instance *instance;       ///< the instance
+          bool      owned;          ///< is this a clone we made and must delete
+          bool      busy;           ///< is a render currently running on it
+          bool      begun;          ///< has begin sequence render been called on it
+          unsigned  generation;     ///< param generation it was last synced at
+        };
+
+        Instance                 &_instance;      ///< the instance we are scheduling
+        ThreadSafetyEnum          _threadSafety;  ///< cached thread safety of the plugin
+        unsigned int              _maxThreads;    ///< most renders we will have in flight
+        unsigned int              _maxClones;     ///< most render clones we will make
+        bool                      _canClone;      ///< cleared if making or syncing a clone ever fails
+
+        std::vector<Slot>         _slots;         ///< master instance, then any render clones
+        unsigned int              _pendingClones; ///< clones being constructed outside the lock
+        unsigned                  _generation;    ///< bumped by paramsChanged
+        mutable std::mutex        _lock;          ///< guards the above
+        std::condition_variable   _slotFreed;     ///< signalled as slots are released
+
+        /// args to the current sequence render, if any
+        bool                      _inSequence;
+        OfxTime                   _seqStart, _seqEnd, _seqStep;
+        bool                      _seqInteractive;
+        OfxPointD                 _seqRenderScale;
+        bool                      _seqSequential;
+        bool                      _seqInteractiveRender;
+
+        IPC::WorkerPool                    *_workers;      ///< renders go out of process to these, if set
+        std::unique_ptr<RemoteRenderer>     _remote;       ///< runs them there
+        std::unique_ptr<RenderCoordinator>  _coordinator;  ///< and spreads them over the workers
+
+        /// reserve an instance to render on, making a clone if needed
+        int acquireSlot();
+
+        /// give the slot back
+        void releaseSlot(int slot);
+
+        /// Holds a slot for a scope, so it is given back however the scope
+        /// is left, including by the plugin or host throwing.
+        class SlotGuard {
+        protected :
+          RenderScheduler &_scheduler;
+          int              _slot;
+
+        private :
+          SlotGuard(const SlotGuard &);
+          SlotGuard &operator=(const SlotGuard &);
+
+        public :
+          explicit SlotGuard(RenderScheduler &scheduler)
+            : _scheduler(scheduler)
+            , _slot(scheduler.acquireSlot())
+          {
+          }
+
+          ~SlotGuard() { _scheduler.releaseSlot(_slot); }
+
+          int getSlot() const { return _slot; }
+        };
+
+        /// render on a reserved slot, in nTiles tiles if the effect can be
+        OfxStatus renderOnSlot(int slot,
+                               OfxTime time,
+                               const std::string &field,
+                               const OfxRectI &renderWindow,
+                               OfxPointD renderScale,
+                               bool sequentialRender,
+                               bool interactiveRender,
+                               bool draftRender,
+                               int worker = -1,
+                               bool *workerLost = 0,
+                               unsigned int nTiles = 1);
+
+        /// will a frame be split into tiles in process, clamping nTiles to how many
+        bool canRenderTiles(unsigned int &nTiles, const OfxRectI &renderWindow) const;
+
+        /// render nTiles tiles of a frame concurrently on the given instance
+        OfxStatus renderTilesOn(Instance &instance,
+                                OfxTime time,
+                                const std::string &field,
+                                const OfxRectI &renderWindow,
+                                OfxPointD renderScale,
+                                bool sequentialRender,
+                                bool interactiveRender,
+                                bool draftRender,
+                                unsigned int nTiles);
+
+        /// render the frames of a sequence on the workers
+        OfxStatus renderSequenceOnWorkers(const std::vector<OfxTime> &frames,
+                                          OfxTime step,
+                                          const std::string &field,
+                                          const OfxRectI &renderWindow,
+                                          OfxPointD renderScale,
+                                          bool interactiveRender,
+                                          bool draftRender,
+                                          FrameDoneI *frameDone);
+
+        /// Make a new render clone of the scheduled instance. The default
+        /// creates a new instance from the same plugin and context, syncs
+        /// its params, then runs createInstance and clip preferences on it.
+        /// Override this if your host needs to pass client data down or
+        /// wire up the clone's clips. Return NULL if a clone can't be made.
+        virtual Instance *newRenderClone();
+
+        /// Copy the param values of the scheduled instance onto a clone.
+        /// The default uses Param::Instance::copyFrom, which hosts need to
+        /// implement for cloning to work.
+        virtual OfxStatus syncRenderClone(Instance &clone);
+
+      public :
+        /// ctor,
+        ///   \arg instance - the effect instance to schedule renders on
+        ///   \arg maxThreads - the most renders in flight at once, 0 means the number of CPUs
+        ///   \arg maxClones - the most render clones to make of an instance safe effect
+        RenderScheduler(Instance &instance, unsigned int maxThreads = 0, unsigned int maxClones = 0);
+
+        /// dtor, ends any outstanding sequence render and destroys the clones
+        virtual ~RenderScheduler();
+
+        /// map the render thread safety property to our enum
+        static ThreadSafetyEnum getThreadSafety(const Base &effect);
+
+        /// get the thread safety of the instance being scheduled
+        ThreadSafetyEnum getThreadSafety() const { return _threadSafety; }
+
+        /// get the instance being scheduled
+        Instance &getInstance() { return _instance; }
+
+        /// Render in a pool of worker processes rather than in this one. The
+        /// pool must outlive the scheduler. Call this before any render, NULL
+        /// goes back to rendering in process.
+        ///   \arg maxRetries - how many times a frame or tile may be lost with a worker
+        void setWorkerPool(IPC::WorkerPool *workers, unsigned int maxRetries = 2);
+
+        /// what spreads renders over the worker pool, NULL if there isn't one
+        RenderCoordinator *getCoordinator() { return _coordinator.get(); }
+
+        /// how many renders can be in flight at once for this effect
+        unsigned int getMaxConcurrency() const;
+
+        /// how many frames the scheduler will render at once in renderSequence
+        unsigned int getFrameConcurrency() const;
+
+        /// Call this whenever params on the scheduled instance change, so
+        /// that render clones are resynced before they next render.
+        void paramsChanged();
+
+        /// Start a sequence render. Calls the begin sequence action on the
+        /// scheduled instance, and on any clones as they are brought into
+        /// use during the sequence.
+        OfxStatus beginSequenceRender(OfxTime startFrame,
+                                      OfxTime endFrame,
+                                      OfxTime step,
+                                      bool interactive,
+                                      OfxPointD renderScale,
+                                      bool sequentialRender,
+                                      bool interactiveRender);
+
+        /// End a sequence render on every instance it was begun on.
+        OfxStatus endSequenceRender();
+
+        /// Render a frame. This may be called concurrently from any number
+        /// of host threads, the scheduler will block as needed to honour the
+        /// plugin's thread safety.
+        OfxStatus render(OfxTime time,
+                         const std::string &field,
+                         const OfxRectI &renderWindow,
+                         OfxPointD renderScale,
+                         bool sequentialRender,
+                         bool interactiveRender,
+                         bool draftRender);
+
+        /// Render a frame split into horizontal tiles rendered concurrently.
+        /// Tiles are only used if the effect is fully safe, supports tiles
+        /// and wants host frame threading, otherwise this is the same as render.
+        /// With a worker pool, tiles go to the workers if the effect supports
+        /// them, whatever its thread safety.
+        OfxStatus renderTiled(OfxTime time,
+                              const std::string &field,
+                              const OfxRectI &renderWindow,
+                              OfxPointD renderScale,
+                              bool sequentialRender,
+                              bool interactiveRender,
+                              bool draftRender,
+                              unsigned int nTiles);
+
+        /// Render every frame in [startFrame, endFrame] at the given step,
+        /// bracketed by begin and end sequence render. Frames are spread
+        /// over threads as the plugin allows. The first failing status is
+        /// returned, and no new frames are started after a failure.
+        OfxStatus renderSequence(OfxTime startFrame,
+                                 OfxTime endFrame,
+                                 OfxTime step,
+                                 const std::string &field,
+                                 const OfxRectI &renderWindow,
+                                 OfxPointD renderScale,
+                                 bool interactiveRender,
+                                 bool draftRender,
+                                 FrameDoneI *frameDone = 0);
+      };
+
+    } // namespace ImageEffect
+
+  } // namespace Host
+
+} // namespace OFX
+
+#endif // OFXH_RENDER_SCHEDULER_H
@@ -0,0 +1,88 @@
+// Copyright OpenFX and contributors to the OpenFX project.
+// SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef OFXH_SHARED_MEMORY_H
+#define OFXH_SHARED_MEMORY_H
+
+#include <cstddef>
+
+#include "ofxCore.h"
+#include "ofxImageEffect.h"
+#include "ofxhMemory.h"
+
+namespace OFX {
+
+  namespace Host {
+
+    namespace Memory {
+
+      /// A block of memory that can be mapped into another process by
+      /// passing its file descriptor over an IPC::Channel. It is made with
+      /// memfd_create where there is one, or an unlinked POSIX shared memory
+      /// object otherwise. Not available on Windows, where create and map
+      /// always fail.
+      ///
+      /// Every block made or mapped in the process is registered, so find
+      /// can tell whether some pixels already live in shared memory and can
+      /// be handed over without a copy.
+      class SharedBlock {
+      protected :
+        int     _fd;    ///< the descriptor, -1 if none
+        void   *_ptr;   ///< where it is mapped
+        size_t  _size;  ///< bytes mapped
+
+      private :
+        SharedBlock(const SharedBlock &);
+        SharedBlock &operator=(const SharedBlock &);
+
+      public :
+        SharedBlock();
+
+        /// unmaps and closes the block
+        ~SharedBlock();
+
+        /// make a new block of nBytes, releasing any old one
+        bool create(size_t nBytes);
+
+        /// map nBytes of a block made by another process, taking ownership of fd
+        bool map(int fd, size_t nBytes);
+
+        /// unmap and close the block
+        void release();
+
+        void  *getPtr() const {return _ptr;}
+        size_t getSize() const {return _size;}
+        int    getFd() const {return _fd;}
+
+        /// Find the block holding the nBytes at ptr, returning it and the
+        /// offset of ptr into it, or NULL if they are not all in one block.
+        /// The block is only good while its owner keeps it.
+        static SharedBlock *find(const void *ptr, size_t nBytes, size_t &offset);
+      };
+
+      /// A memory instance held in a SharedBlock, so that image memory
+      /// allocated by plugins, or by a host that makes its images with one,
+      /// can be given to worker processes without copying. Hosts get these
+      /// from imageMemoryAlloc by overriding newMemoryInstance.
+      class SharedInstance : public Instance {
+      protected :
+        SharedBlock _block;
+
+      public :
+        SharedInstance();
+
+        virtual bool alloc(size_t nBytes);
+        virtual void freeMem();
+        virtual void *getPtr();
+
+        /// the block the memory is in
+        SharedBlock &getBlock() {return _block;}
+      };
+
+    } // Memory
+
+  } // Host
+
+} // OFX
+
+#endif // OFXH_SHARED_MEMORY_H
@@ -0,0 +1,144 @@
+// Copyright OpenFX and contributors to the OpenFX project.
+// SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef OFXH_SNAPSHOT_H
+#define OFXH_SNAPSHOT_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <cstdint>
+
+#include "ofxCore.h"
+
+namespace OFX {
+
+  namespace Host {
+
+    namespace Param {
+      class Instance;
+    }
+
+    namespace ImageEffect {
+
+      // forward declare
+      class Instance;
+
+      /// Get a param's value as doubles, or as a string for string and
+      /// custom params. The value is at time if given, else the param's
+      /// value as it is when not animated. Returns kOfxStatErrUnsupported
+      /// for the sorts of param that have no value, groups, pages, push
+      /// buttons and parametric params.
+      OfxStatus getParamValue(Param::Instance &param,
+                              const OfxTime *time,
+                              std::vector<double> &values,
+                              std::string &str);
+
+      /// Set a param's value from what getParamValue gave, at time if
+      /// given, which for an animating param sets a key there.
+      OfxStatus setParamValue(Param::Instance &param,
+                              const OfxTime *time,
+                              const std::vector<double> &values,
+                              const std::string &str);
+
+      /// The complete state of an effect instance, its param values and
+      /// animation, the properties the plugin can set on it and its params,
+      /// its clip preferences and the metadata of the clips they were
+      /// worked out from. It encodes to a compact versioned binary form, for
+      /// a host to save in its projects, or to make a copy of an instance
+      /// elsewhere.
+      ///
+      /// The state is held as one record for the instance, one per clip and
+      /// one per param. A delta against an earlier snapshot holds only the
+      /// records that differ from it, so an autosave, or a render worker
+      /// being brought up to date, only moves what changed,
+      ///
+      ///     Snapshot now(instance);
+      ///     std::string delta = now.encodeDelta(lastSaved);
+      ///     ...
+      ///     Snapshot restored;
+      ///     restored.decode(delta, &lastSaved);
+      ///     restored.restore(otherInstance);
+      ///
+      /// Restoring sets values straight on the param instances, so the
+      /// plugin gets no instance changed actions for them, and only those
+      /// params that differ are touched at all. The action cache is then
+      /// invalidated once. The clip preferences are taken on if the clips
+      /// are connected as they were, otherwise they are left dirty.
+      ///
+      /// Restoring needs the host's param instances to implement set, and
+      /// for animation getNumKeys, getKeyTime and deleteAllKeys. Only key
+      /// times and values are kept, interpolation is up to the host.
+      class Snapshot {
+      public :
+        /// version of the encoding we write, we read this and any earlier one
+        static const int kVersion = 1;
+
+      protected :
+        std::string                         _pluginId;
+        int                                 _pluginMajor, _pluginMinor;
+        std::string                         _context;
+        std::map<std::string, std::string>  _records;   ///< encoded state of each part, by key
+
+        /// encode the state of an instance into records
+        static void captureRecords(Instance &instance, std::map<std::string, std::string> &records);
+
+        /// the identity part of the encoding, shared by whole snapshots and deltas
+        void encodeHeader(std::string &bytes, bool delta) const;
+
+      public :
+        /// an empty snapshot
+        Snapshot();
+
+        /// a snapshot of an instance as it is now
+        explicit Snapshot(Instance &instance);
+
+        /// take a snapshot of an instance as it is now
+        void capture(Instance &instance);
+
+        /// does it hold anything
+        bool isEmpty() const { return _records.empty(); }
+
+        /// the plugin and context the snapshot is of
+        const std::string &getPluginId() const { return _pluginId; }
+        int getPluginVersionMajor() const { return _pluginMajor; }
+        int getPluginVersionMinor() const { return _pluginMinor; }
+        const std::string &getContext() const { return _context; }
+
+        /// a hash of the state, a delta carries that of its base and of the result
+        uint64_t getChecksum() const;
+
+        /// the whole snapshot in binary
+        std::string encode() const;
+
+        /// Only what differs from base in binary, base needs to be at hand
+        /// to decode it. If base is of another plugin, this is the same as
+        /// encode.
+        std::string encodeDelta(const Snapshot &base) const;
+
+        /// Read a snapshot from what encode or encodeDelta gave. A delta
+        /// needs the snapshot it was made against. Returns
+        /// kOfxStatErrFormat if the bytes are not a snapshot we can read, and
+        /// kOfxStatErrValue if a delta's base is not the one given. On an
+        /// error the snapshot is left as it was.
+        OfxStatus decode(const std::string &bytes, const Snapshot *base = 0);
+
+        /// Put an instance of the same plugin into the snapshot's state,
+        /// without the plugin being told of each change. The names of the
+        /// params whose state changed are appended to changedParams if
+        /// given, so the host can update its interface or render clones.
+        /// Returns kOfxStatErrValue if the instance is of another plugin,
+        /// else the first failure from setting a param, having set the rest.
+        OfxStatus restore(Instance &instance, std::vector<std::string> *changedParams = 0) const;
+
+        /// the names of params whose state differs between two snapshots
+        std::vector<std::string> getChangedParams(const Snapshot &other) const;
+      };
+
+    } // namespace ImageEffect
+
+  } // namespace Host
+
+} // namespace OFX
+
+#endif // OFXH_SNAPSHOT_H
@@ -0,0 +1,163 @@
+// Copyright OpenFX and contributors to the OpenFX project.
+// SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef OFXH_TRACE_H
+#define OFXH_TRACE_H
+
+#include <string>
+#include <map>
+#include <iosfwd>
+#include <chrono>
+
+#include "ofxCore.h"
+
+namespace OFX {
+
+  namespace Host {
+
+    namespace Property {
+      class Set;
+    }
+
+    /// Tracing of the calls made into and out of plugins.
+    ///
+    /// Each action sent to a plugin, and each suite call the plugin makes
+    /// while in it, is recorded as a span with its begin and end times, the
+    /// thread, the plugin and a few of its arguments. Spans are kept in a
+    /// buffer per thread, so recording takes no locks shared with other
+    /// threads. The lot can be written out as Chrome trace event JSON, to be
+    /// loaded into chrome://tracing or Perfetto, and latency histograms per
+    /// plugin and action are kept as spans end.
+    ///
+    /// Tracing is off by default, in which case a span costs a single test.
+    namespace Trace {
+
+      /// A histogram of latencies. Bucket 0 is anything under a microsecond,
+      /// bucket n covers 2^(n-1) to 2^n microseconds, the last bucket takes
+      /// anything longer.
+      class Histogram {
+      public :
+        enum {kNumBuckets = 32};
+
+      protected :
+        size_t _buckets[kNumBuckets];
+        size_t _count;
+        double _total;  ///< microseconds
+        double _min;    ///< microseconds
+        double _max;    ///< microseconds
+
+      public :
+        Histogram();
+
+        /// add a latency in microseconds
+        void add(double micros);
+
+        /// add in all of another histogram
+        void merge(const Histogram &other);
+
+        size_t getCount() const {return _count;}
+        double getTotal() const {return _total;}
+        double getMin() const {return _count ? _min : 0.;}
+        double getMax() const {return _max;}
+        double getMean() const {return _count ? _total / _count : 0.;}
+
+        /// number of latencies in a bucket
+        size_t getBucketCount(int bucket) const {return _buckets[bucket];}
+
+        /// the longest latency in microseconds a bucket takes
+        static double getBucketUpperBound(int bucket);
+
+        /// An estimate of the latency, in microseconds, that the fraction p
+        /// of the latencies are at or under, eg: 0.99 for the 99th
+        /// percentile. This is the top of the bucket it falls in, clamped
+        /// to the maximum seen.
+        double getPercentile(double p) const;
+      };
+
+      /// histograms keyed by plugin identifier then action or suite function name
+      typedef std::map<std::pair<std::string, std::string>, Histogram> HistogramMap;
+
+      /// turn tracing on or off, spans already open when it changes are not recorded
+      void setEnabled(bool v);
+
+      /// is tracing on
+      bool isEnabled();
+
+      /// Set the most spans kept per thread, 1M by default. Spans past that
+      /// are still counted in the histograms, but are dropped from the trace.
+      void setMaxSpansPerThread(size_t n);
+
+      /// forget all recorded spans and histograms
+      void clear();
+
+      /// Write all recorded spans as Chrome trace event JSON.
+      void writeChromeTrace(std::ostream &os);
+
+      /// as above, to a file, returns false if it could not be written
+      bool writeChromeTrace(const std::string &path);
+
+      /// get the latency histograms of all spans recorded so far
+      HistogramMap getLatencyHistograms();
+
+      /// print a line per plugin and action of its count, mean, 50th, 99th percentile and max latency
+      void printLatencySummary(std::ostream &os);
+
+      /// A traced call. Construct one on the stack around the call, it is
+      /// recorded when it goes out of scope. Spans nest, so a span opened
+      /// inside another is drawn under it, and takes its plugin from it if
+      /// not given one.
+      class Span {
+      protected :
+        bool         _active;    ///< was tracing on when we started
+        const char  *_category;  ///< "action", "suite" and so on
+        const char  *_name;      ///< action or function name
+        std::string  _pluginId;  ///< plugin we are in
+        std::string  _args;      ///< arguments, as the inside of a JSON object
+        std::chrono::steady_clock::time_point _start;
+        const Span  *_parent;    ///< span we are nested in on this thread
+
+        /// start of an arg in _args
+        void beginArg(const char *name);
+
+      private :
+        Span(const Span &);
+        Span &operator=(const Span &);
+
+      public :
+        /// a span in the plugin of the span it is nested in
+        Span(const char *category, const char *name);
+
+        /// a span in the given plugin
+        Span(const char *category, const char *name, const std::string &pluginId);
+
+        /// records the span
+        ~Span();
+
+        /// is this span being recorded, only bother working out args if so
+        bool isActive() const {return _active;}
+
+        /// the plugin this span is in
+        const std::string &getPluginId() const {return _pluginId;}
+
+        /// set the plugin this span is in, spans opened in it after this take it too
+        void setPluginId(const std::string &v) {if(_active) _pluginId = v;}
+
+        /// add arguments, which show up against the span in the trace
+        void addArg(const char *name, double v);
+        void addArg(const char *name, const char *v);
+        void addArg(const char *name, const OfxPointD &v);
+        void addArg(const char *name, const OfxRectI &v);
+        void addArg(const char *name, const OfxRectD &v);
+
+        /// Add the arguments of interest from an action's in args, those are
+        /// the time, render window, render scale, field and region of interest.
+        void addArgs(const Property::Set &inArgs);
+      };
+
+    } // namespace Trace
+
+  } // namespace Host
+
+} // namespace OFX
+
+#endif // OFXH_TRACE_H
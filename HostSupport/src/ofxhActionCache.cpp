@@ -0,0 +1,278 @@
+// Copyright OpenFX and contributors to the OpenFX project.
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <iostream>
+
+// ofx
+#include "ofxCore.h"
+#include "ofxImageEffect.h"
+
+// ofx host
+#include "ofxhActionCache.h"
+
+namespace OFX {
+
+  namespace Host {
+
+    namespace ImageEffect {
+
+      /// is a status one we keep
+      static bool isCacheable(OfxStatus stat)
+      {
+        return stat == kOfxStatOK || stat == kOfxStatReplyDefault;
+      }
+
+      ////////////////////////////////////////////////////////////////////////////////
+      // ActionCache::Stats
+
+      ActionCache::Stats::Stats()
+        : invalidations(0)
+      {
+        for(int i = 0; i < eNumActions; ++i) {
+          hits[i] = 0;
+          misses[i] = 0;
+        }
+      }
+
+      double ActionCache::Stats::getHitRate(ActionEnum action) const
+      {
+        size_t n = hits[action] + misses[action];
+        return n ? double(hits[action]) / n : 0.;
+      }
+
+      ////////////////////////////////////////////////////////////////////////////////
+      // ActionCache
+
+      const char *ActionCache::getActionName(ActionEnum action)
+      {
+        switch(action) {
+        case eRegionOfDefinition : return kOfxImageEffectActionGetRegionOfDefinition;
+        case eRegionsOfInterest :  return kOfxImageEffectActionGetRegionsOfInterest;
+        case eIsIdentity :         return kOfxImageEffectActionIsIdentity;
+        case eFramesNeeded :       return kOfxImageEffectActionGetFramesNeeded;
+        case eTimeDomain :         return kOfxImageEffectActionGetTimeDomain;
+        default :                  return "unknown";
+        }
+      }
+
+      ActionCache::ActionCache()
+        : _enabled(false)
+        , _generation(0)
+        , _maxEntries(1024)
+        , _haveTimeDomain(false)
+        , _timeDomainStat(kOfxStatOK)
+      {
+        _timeDomain.min = _timeDomain.max = 0;
+      }
+
+      void ActionCache::setEnabled(bool v)
+      {
+        std::lock_guard<std::mutex> guard(_lock);
+        _enabled = v;
+        ++_generation;
+        _rods.clear();
+        _rois.clear();
+        _identities.clear();
+        _frames.clear();
+        _haveTimeDomain = false;
+      }
+
+      bool ActionCache::isEnabled() const
+      {
+        std::lock_guard<std::mutex> guard(_lock);
+        return _enabled;
+      }
+
+      void ActionCache::setMaxEntries(size_t n)
+      {
+        std::lock_guard<std::mutex> guard(_lock);
+        _maxEntries = n ? n : 1;
+      }
+
+      void ActionCache::invalidate()
+      {
+        std::lock_guard<std::mutex> guard(_lock);
+        ++_generation;
+        if(!_enabled)
+          return;
+        _rods.clear();
+        _rois.clear();
+        _identities.clear();
+        _frames.clear();
+        _haveTimeDomain = false;
+        ++_stats.invalidations;
+      }
+
+      ActionCache::Stats ActionCache::getStats() const
+      {
+        std::lock_guard<std::mutex> guard(_lock);
+        return _stats;
+      }
+
+      void ActionCache::resetStats()
+      {
+        std::lock_guard<std::mutex> guard(_lock);
+        _stats = Stats();
+      }
+
+      void ActionCache::printStats(std::ostream &os) const
+      {
+        Stats stats = getStats();
+        for(int i = 0; i < eNumActions; ++i) {
+          ActionEnum action = ActionEnum(i);
+          os << "  " << getActionName(action)
+             << " hits " << stats.hits[i]
+             << " misses " << stats.misses[i]
+             << " hit rate " << stats.getHitRate(action) * 100. << "%" << std::endl;
+        }
+        os << "  invalidations " << stats.invalidations << std::endl;
+      }
+
+      bool ActionCache::count(ActionEnum action, bool hit)
+      {
+        if(hit)
+          ++_stats.hits[action];
+        else
+          ++_stats.misses[action];
+        return hit;
+      }
+
+      bool ActionCache::canKeep(OfxStatus stat, Generation generation) const
+      {
+        return _enabled && isCacheable(stat) && generation == _generation;
+      }
+
+      bool ActionCache::getRegionOfDefinition(OfxTime time, OfxPointD renderScale, OfxRectD &rod, OfxStatus &stat, Generation &generation)
+      {
+        std::lock_guard<std::mutex> guard(_lock);
+        generation = _generation;
+        if(!_enabled)
+          return false;
+        std::map<RoDKey, RoDResult>::const_iterator it = _rods.find(RoDKey(time, renderScale.x, renderScale.y));
+        if(!count(eRegionOfDefinition, it != _rods.end()))
+          return false;
+        rod = it->second.rod;
+        stat = it->second.stat;
+        return true;
+      }
+
+      void ActionCache::setRegionOfDefinition(OfxTime time, OfxPointD renderScale, const OfxRectD &rod, OfxStatus stat, Generation generation)
+      {
+        std::lock_guard<std::mutex> guard(_lock);
+        if(!canKeep(stat, generation))
+          return;
+        makeRoom(_rods);
+        RoDResult &r = _rods[RoDKey(time, renderScale.x, renderScale.y)];
+        r.stat = stat;
+        r.rod = rod;
+      }
+
+      bool ActionCache::getRegionsOfInterest(OfxTime time, OfxPointD renderScale, const OfxRectD &roi, RoIMap &rois, OfxStatus &stat, Generation &generation)
+      {
+        std::lock_guard<std::mutex> guard(_lock);
+        generation = _generation;
+        if(!_enabled)
+          return false;
+        RoIKey key(time, renderScale.x, renderScale.y, roi.x1, roi.y1, roi.x2, roi.y2);
+        std::map<RoIKey, RoIResult>::const_iterator it = _rois.find(key);
+        if(!count(eRegionsOfInterest, it != _rois.end()))
+          return false;
+        rois = it->second.rois;
+        stat = it->second.stat;
+        return true;
+      }
+
+      void ActionCache::setRegionsOfInterest(OfxTime time, OfxPointD renderScale, const OfxRectD &roi, const RoIMap &rois, OfxStatus stat, Generation generation)
+      {
+        std::lock_guard<std::mutex> guard(_lock);
+        if(!canKeep(stat, generation))
+          return;
+        makeRoom(_rois);
+        RoIResult &r = _rois[RoIKey(time, renderScale.x, renderScale.y, roi.x1, roi.y1, roi.x2, roi.y2)];
+        r.stat = stat;
+        r.rois = rois;
+      }
+
+      bool ActionCache::getIsIdentity(OfxTime time, const std::string &field, const OfxRectI &renderWindow, OfxPointD renderScale,
+                                      OfxTime &identityTime, std::string &clip, OfxStatus &stat, Generation &generation)
+      {
+        std::lock_guard<std::mutex> guard(_lock);
+        generation = _generation;
+        if(!_enabled)
+          return false;
+        IdentityKey key(time, field, renderWindow.x1, renderWindow.y1, renderWindow.x2, renderWindow.y2, renderScale.x, renderScale.y);
+        std::map<IdentityKey, IdentityResult>::const_iterator it = _identities.find(key);
+        if(!count(eIsIdentity, it != _identities.end()))
+          return false;
+        identityTime = it->second.time;
+        clip = it->second.clip;
+        stat = it->second.stat;
+        return true;
+      }
+
+      void ActionCache::setIsIdentity(OfxTime time, const std::string &field, const OfxRectI &renderWindow, OfxPointD renderScale,
+                                      OfxTime identityTime, const std::string &clip, OfxStatus stat, Generation generation)
+      {
+        std::lock_guard<std::mutex> guard(_lock);
+        if(!canKeep(stat, generation))
+          return;
+        makeRoom(_identities);
+        IdentityResult &r = _identities[IdentityKey(time, field, renderWindow.x1, renderWindow.y1, renderWindow.x2, renderWindow.y2, renderScale.x, renderScale.y)];
+        r.stat = stat;
+        r.time = identityTime;
+        r.clip = clip;
+      }
+
+      bool ActionCache::getFramesNeeded(OfxTime time, FramesMap &frames, OfxStatus &stat, Generation &generation)
+      {
+        std::lock_guard<std::mutex> guard(_lock);
+        generation = _generation;
+        if(!_enabled)
+          return false;
+        std::map<double, FramesResult>::const_iterator it = _frames.find(time);
+        if(!count(eFramesNeeded, it != _frames.end()))
+          return false;
+        frames = it->second.frames;
+        stat = it->second.stat;
+        return true;
+      }
+
+      void ActionCache::setFramesNeeded(OfxTime time, const FramesMap &frames, OfxStatus stat, Generation generation)
+      {
+        std::lock_guard<std::mutex> guard(_lock);
+        if(!canKeep(stat, generation))
+          return;
+        makeRoom(_frames);
+        FramesResult &r = _frames[time];
+        r.stat = stat;
+        r.frames = frames;
+      }
+
+      bool ActionCache::getTimeDomain(OfxRangeD &range, OfxStatus &stat, Generation &generation)
+      {
+        std::lock_guard<std::mutex> guard(_lock);
+        generation = _generation;
+        if(!_enabled)
+          return false;
+        if(!count(eTimeDomain, _haveTimeDomain))
+          return false;
+        range = _timeDomain;
+        stat = _timeDomainStat;
+        return true;
+      }
+
+      void ActionCache::setTimeDomain(const OfxRangeD &range, OfxStatus stat, Generation generation)
+      {
+        std::lock_guard<std::mutex> guard(_lock);
+        if(!canKeep(stat, generation))
+          return;
+        _haveTimeDomain = true;
+        _timeDomain = range;
+        _timeDomainStat = stat;
+      }
+
+    } // namespace ImageEffect
+
+  } // namespace Host
+
+} // namespace OFX
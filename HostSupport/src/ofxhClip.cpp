@@ -2,6 +2,8 @@
 // SPDX-License-Identifier: BSD-3-Clause
 
 #include <assert.h>
+#include <cmath>
+#include <cstddef>
 
 // ofx
 #include "ofxCore.h"
@@ -11,6 +13,7 @@
 #include "ofxhPropertySuite.h"
 #include "ofxhClip.h"
 #include "ofxhImageEffect.h"
+#include "ofxhImageConvert.h"
 #ifdef OFX_SUPPORTS_OPENGLRENDER
 #include "ofxGPURender.h"
 #endif
@@ -55,7 +58,9 @@ namespace OFX {
         const Property::PropertyMap &map = _properties.getProperties();
         Property::PropertyMap::const_iterator i;
         for(i = map.begin(); i != map.end(); ++i) {
-          (*i).second->setPluginReadOnly(false);
+          // only fetch the ones that need changing, so the rest stay shared with the descriptor
+          if((*i).second->getPluginReadOnly())
+            _properties.fetchProperty((*i).first)->setPluginReadOnly(false);
         } 
       }
 
@@ -450,6 +455,45 @@ namespace OFX {
 
         return none;
       }
+
+      /// make a view on the field wanted, if the clip extracts single fields from interlaced frames
+      Image* ClipInstance::extractField(Image *image, OfxTime time)
+      {
+        if(!image || getFieldExtraction() != kOfxImageFieldSingle)
+          return image;
+        if(image->getStringProperty(kOfxImagePropField) != kOfxImageFieldBoth)
+          return image;
+        if(!image->getPointerProperty(kOfxImagePropData))
+          return image;
+
+        // the first temporal field is the field order's, at the start of the frame
+        const std::string &order = getFieldOrder();
+        bool lowerFirst = order != kOfxImageFieldUpper;
+        bool first = time - std::floor(time) < 0.5;
+        const char *field = lowerFirst == first ? kOfxImageFieldLower : kOfxImageFieldUpper;
+
+        Image *view = new FieldImage(*image, field);
+
+        // the view holds its own reference on the frame
+        image->releaseReference();
+        return view;
+      }
+
+      /// map an image from getImage to the clip's negotiated depth and components
+      Image* ClipInstance::conformImage(Image *image, const OfxRectD *optionalBounds)
+      {
+        return conformImageToClip(*this, image, optionalBounds);
+      }
+
+      /// the image as clipGetImage hands it to the plugin
+      Image* ClipInstance::fetchImage(OfxTime time, const OfxRectD *optionalBounds)
+      {
+        Image *image = getImage(time, optionalBounds);
+        if(!image)
+          return 0;
+        image = extractField(image, time);
+        return conformImage(image, optionalBounds);
+      }
       
       
       ////////////////////////////////////////////////////////////////////////////////
@@ -558,8 +602,7 @@ namespace OFX {
       // release the reference 
       void ImageBase::releaseReference()
       {
-        _referenceCount -= 1;
-        if(_referenceCount <= 0)
+        if(--_referenceCount <= 0)
           delete this;
       }
 
@@ -603,6 +646,70 @@ namespace OFX {
       Image::~Image() {
         //assert(_referenceCount <= 0);
       }
+
+      ////////////////////////////////////////////////////////////////////////////////
+      // FieldImage
+      //
+
+      /// floor of a / 2, for negative a too
+      static int halfFloor(int a)
+      {
+        return a >= 0 ? a / 2 : -((1 - a) / 2);
+      }
+
+      void FieldImage::getFieldRows(int frameY1, int frameY2, const std::string &field, int &fieldY1, int &fieldY2)
+      {
+        // frame row y is in the lower field if even, the upper if odd, and is row floor(y/2) of it
+        int offset = field == kOfxImageFieldUpper ? 1 : 0;
+        fieldY1 = halfFloor(frameY1 - offset + 1);
+        fieldY2 = halfFloor(frameY2 - offset + 1);
+      }
+
+      FieldImage::FieldImage(Image &frame, const std::string &field)
+        : Image()
+        , _frame(frame)
+      {
+        _frame.addReference();
+
+        setStringProperty(kOfxImageEffectPropPixelDepth, frame.getStringProperty(kOfxImageEffectPropPixelDepth));
+        setStringProperty(kOfxImageEffectPropComponents, frame.getStringProperty(kOfxImageEffectPropComponents));
+        setStringProperty(kOfxImageEffectPropPreMultiplication, frame.getStringProperty(kOfxImageEffectPropPreMultiplication));
+        setDoubleProperty(kOfxImagePropPixelAspectRatio, frame.getDoubleProperty(kOfxImagePropPixelAspectRatio));
+        setDoubleProperty(kOfxImageEffectPropRenderScale, frame.getDoubleProperty(kOfxImageEffectPropRenderScale, 0), 0);
+        setDoubleProperty(kOfxImageEffectPropRenderScale, frame.getDoubleProperty(kOfxImageEffectPropRenderScale, 1) * 0.5, 1);
+        setStringProperty(kOfxImagePropField, field);
+
+        // the same image can give two views, so they need their own identifiers
+        const std::string &id = frame.getStringProperty(kOfxImagePropUniqueIdentifier);
+        if(!id.empty())
+          setStringProperty(kOfxImagePropUniqueIdentifier, id + "." + field);
+
+        OfxRectI bounds = frame.getBounds();
+        OfxRectI rod = frame.getROD();
+        int rowBytes = frame.getIntProperty(kOfxImagePropRowBytes);
+        char *data = static_cast<char *>(frame.getPointerProperty(kOfxImagePropData));
+
+        OfxRectI fieldBounds = bounds;
+        getFieldRows(bounds.y1, bounds.y2, field, fieldBounds.y1, fieldBounds.y2);
+        OfxRectI fieldRod = rod;
+        getFieldRows(rod.y1, rod.y2, field, fieldRod.y1, fieldRod.y2);
+
+        // point at the first of our rows in the frame
+        if(data) {
+          int firstRow = 2 * fieldBounds.y1 + (field == kOfxImageFieldUpper ? 1 : 0);
+          data += ptrdiff_t(firstRow - bounds.y1) * rowBytes;
+        }
+
+        setIntPropertyN(kOfxImagePropBounds, &fieldBounds.x1, 4);
+        setIntPropertyN(kOfxImagePropRegionOfDefinition, &fieldRod.x1, 4);
+        setIntProperty(kOfxImagePropRowBytes, rowBytes * 2);
+        setPointerProperty(kOfxImagePropData, data);
+      }
+
+      FieldImage::~FieldImage()
+      {
+        _frame.releaseReference();
+      }
 #   ifdef OFX_SUPPORTS_OPENGLRENDER
       static const Property::PropSpec textureStuffs[] = {
         { kOfxImageEffectPropOpenGLTextureIndex, Property::eInt, 1, true, "-1" },
@@ -13,6 +13,7 @@
 #include "ofxMemory.h"
 
 #include "ofxhHost.h"
+#include "ofxhTrace.h"
 
 typedef OfxPlugin* (*OfxGetPluginType)(int);
 
@@ -25,6 +26,9 @@ namespace OFX {
     namespace Memory {
       static OfxStatus memoryAlloc(void */*handle*/, size_t bytes, void **data)
       {
+        Trace::Span span("suite", "memoryAlloc");
+        span.addArg("bytes", double(bytes));
+
         *data = malloc(bytes);
         if (*data) {
           return kOfxStatOK;
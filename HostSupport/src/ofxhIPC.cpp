@@ -0,0 +1,891 @@
+// Copyright OpenFX and contributors to the OpenFX project.
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <cstring>
+#include <cerrno>
+#include <iostream>
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#endif
+
+// ofx
+#include "ofxCore.h"
+#include "ofxImageEffect.h"
+
+// ofx host
+#include "ofxhPropertySuite.h"
+#include "ofxhIPC.h"
+
+namespace OFX {
+
+  namespace Host {
+
+    namespace IPC {
+
+      /// most descriptors passed with one message
+      static const unsigned kMaxFds = 16;
+
+      /// what goes down the socket ahead of a message's values
+      struct MessageHeader {
+        int      type;
+        unsigned nFds;
+        size_t   size;
+      };
+
+      ////////////////////////////////////////////////////////////////////////////////
+      // Message
+
+      Message::Message(int type)
+        : _type(type)
+        , _read(0)
+        , _fdRead(0)
+        , _ownsFds(false)
+        , _ok(true)
+      {
+      }
+
+      Message::~Message()
+      {
+        reset(kReply);
+      }
+
+      void Message::reset(int type)
+      {
+#ifndef _WIN32
+        if(_ownsFds) {
+          for(size_t i = _fdRead; i < _fds.size(); ++i)
+            if(_fds[i] >= 0)
+              ::close(_fds[i]);
+        }
+#endif
+        _type = type;
+        _data.clear();
+        _read = 0;
+        _fds.clear();
+        _fdRead = 0;
+        _ownsFds = false;
+        _ok = true;
+      }
+
+      void Message::add(const void *v, size_t n, char tag)
+      {
+        if(tag)
+          _data += tag;
+        _data.append((const char *) v, n);
+      }
+
+      const char *Message::take(size_t n, char tag)
+      {
+        if(!_ok)
+          return 0;
+        if(tag) {
+          if(_read >= _data.size() || _data[_read] != tag) {
+            _ok = false;
+            return 0;
+          }
+          ++_read;
+        }
+        if(_data.size() - _read < n) {
+          _ok = false;
+          return 0;
+        }
+        const char *p = _data.data() + _read;
+        _read += n;
+        return p;
+      }
+
+      void Message::putInt(int v)
+      {
+        add(&v, sizeof(v), 'i');
+      }
+
+      void Message::putDouble(double v)
+      {
+        add(&v, sizeof(v), 'd');
+      }
+
+      void Message::putString(const std::string &v)
+      {
+        size_t n = v.size();
+        add(&n, sizeof(n), 's');
+        add(v.data(), n, 0);
+      }
+
+      void Message::putBytes(const void *v, size_t n)
+      {
+        add(&n, sizeof(n), 'b');
+        add(v, n, 0);
+      }
+
+      void Message::putFd(int fd)
+      {
+        _fds.push_back(fd);
+      }
+
+      int Message::getInt()
+      {
+        int v = 0;
+        if(const char *p = take(sizeof(v), 'i'))
+          memcpy(&v, p, sizeof(v));
+        return v;
+      }
+
+      double Message::getDouble()
+      {
+        double v = 0;
+        if(const char *p = take(sizeof(v), 'd'))
+          memcpy(&v, p, sizeof(v));
+        return v;
+      }
+
+      std::string Message::getString()
+      {
+        size_t n = 0;
+        if(const char *p = take(sizeof(n), 's'))
+          memcpy(&n, p, sizeof(n));
+        if(const char *p = take(n, 0))
+          return std::string(p, n);
+        return std::string();
+      }
+
+      void Message::getBytes(void *v, size_t n)
+      {
+        size_t have = 0;
+        if(const char *p = take(sizeof(have), 'b'))
+          memcpy(&have, p, sizeof(have));
+        if(have != n)
+          _ok = false;
+        if(const char *p = take(n, 0))
+          memcpy(v, p, n);
+        else
+          memset(v, 0, n);
+      }
+
+      int Message::getFd()
+      {
+        if(_fdRead >= _fds.size()) {
+          _ok = false;
+          return -1;
+        }
+        return _fds[_fdRead++];
+      }
+
+      void Message::putProperties(const Property::Set &set)
+      {
+        const Property::PropertyMap &props = set.getProperties();
+
+        int n = 0;
+        for(Property::PropertyMap::const_iterator it = props.begin(); it != props.end(); ++it)
+          if(it->second->getType() != Property::ePointer)
+            ++n;
+        putInt(n);
+
+        for(Property::PropertyMap::const_iterator it = props.begin(); it != props.end(); ++it) {
+          Property::TypeEnum type = it->second->getType();
+          if(type == Property::ePointer)
+            continue;
+
+          // go through the set, so any get hooks give us the live values
+          const std::string &name = it->first;
+          int dim = set.getDimension(name);
+          putString(name);
+          putInt(int(type));
+          putInt(dim);
+          for(int i = 0; i < dim; ++i) {
+            switch(type) {
+            case Property::eInt :    putInt(set.getIntProperty(name, i)); break;
+            case Property::eDouble : putDouble(set.getDoubleProperty(name, i)); break;
+            default :                putString(set.getStringProperty(name, i)); break;
+            }
+          }
+        }
+      }
+
+      void Message::getProperties(Property::Set &set)
+      {
+        int n = getInt();
+        for(int p = 0; p < n && _ok; ++p) {
+          std::string name = getString();
+          Property::TypeEnum type = Property::TypeEnum(getInt());
+          int dim = getInt();
+          if(!_ok || dim < 0)
+            return;
+
+          if(!set.findProperty(name)) {
+            Property::PropSpec spec = { name.c_str(), type, 0, false, 0 };
+            set.createProperty(spec);
+          }
+
+          // the setters leave be a fixed size property of ours that is smaller than theirs
+          switch(type) {
+          case Property::eInt : {
+            std::vector<int> v(dim);
+            for(int i = 0; i < dim; ++i)
+              v[i] = getInt();
+            set.setIntPropertyN(name, v.data(), dim);
+            break;
+          }
+          case Property::eDouble : {
+            std::vector<double> v(dim);
+            for(int i = 0; i < dim; ++i)
+              v[i] = getDouble();
+            set.setDoublePropertyN(name, v.data(), dim);
+            break;
+          }
+          case Property::eString :
+            for(int i = 0; i < dim; ++i)
+              set.setStringProperty(name, getString(), i);
+            break;
+          default :
+            _ok = false;
+            return;
+          }
+        }
+      }
+
+      ////////////////////////////////////////////////////////////////////////////////
+      // Channel
+
+#ifndef _WIN32
+      /// write all of a buffer
+      static bool sendAll(int fd, const char *p, size_t n)
+      {
+        while(n) {
+          ssize_t sent = ::send(fd, p, n, MSG_NOSIGNAL);
+          if(sent < 0 && errno == EINTR)
+            continue;
+          if(sent <= 0)
+            return false;
+          p += sent;
+          n -= sent;
+        }
+        return true;
+      }
+
+      /// read all of a buffer
+      static bool receiveAll(int fd, char *p, size_t n)
+      {
+        while(n) {
+          ssize_t got = ::recv(fd, p, n, 0);
+          if(got < 0 && errno == EINTR)
+            continue;
+          if(got <= 0)
+            return false;
+          p += got;
+          n -= got;
+        }
+        return true;
+      }
+#endif
+
+      Channel::Channel(int fd)
+        : _fd(fd)
+      {
+      }
+
+      Channel::~Channel()
+      {
+        close();
+      }
+
+      void Channel::close()
+      {
+#ifndef _WIN32
+        if(_fd >= 0)
+          ::close(_fd);
+#endif
+        _fd = -1;
+      }
+
+      bool Channel::send(const Message &m)
+      {
+#ifndef _WIN32
+        if(_fd < 0 || m._fds.size() > kMaxFds)
+          return false;
+
+        MessageHeader header;
+        memset(&header, 0, sizeof(header));
+        header.type = m._type;
+        header.nFds = (unsigned) m._fds.size();
+        header.size = m._data.size();
+
+        // the header carries the descriptors
+        struct iovec iov;
+        iov.iov_base = &header;
+        iov.iov_len = sizeof(header);
+
+        char control[CMSG_SPACE(sizeof(int) * kMaxFds)];
+        memset(control, 0, sizeof(control));
+
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        if(header.nFds) {
+          msg.msg_control = control;
+          msg.msg_controllen = CMSG_SPACE(sizeof(int) * header.nFds);
+          struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+          cmsg->cmsg_level = SOL_SOCKET;
+          cmsg->cmsg_type = SCM_RIGHTS;
+          cmsg->cmsg_len = CMSG_LEN(sizeof(int) * header.nFds);
+          memcpy(CMSG_DATA(cmsg), m._fds.data(), sizeof(int) * header.nFds);
+        }
+
+        ssize_t sent;
+        do {
+          sent = ::sendmsg(_fd, &msg, MSG_NOSIGNAL);
+        } while(sent < 0 && errno == EINTR);
+        if(sent <= 0)
+          return false;
+
+        // the rest of the header, if it went in pieces, then the values
+        if(!sendAll(_fd, (const char *) &header + sent, sizeof(header) - sent))
+          return false;
+        return sendAll(_fd, m._data.data(), m._data.size());
+#else
+        (void) m;
+        return false;
+#endif
+      }
+
+      bool Channel::receive(Message &m)
+      {
+        m.reset(Message::kReply);
+#ifndef _WIN32
+        if(_fd < 0)
+          return false;
+
+        MessageHeader header;
+        struct iovec iov;
+        iov.iov_base = &header;
+        iov.iov_len = sizeof(header);
+
+        char control[CMSG_SPACE(sizeof(int) * kMaxFds)];
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+        ssize_t got;
+        do {
+          got = ::recvmsg(_fd, &msg, MSG_CMSG_CLOEXEC);
+        } while(got < 0 && errno == EINTR);
+        if(got <= 0)
+          return false;
+
+        // take the descriptors first, so they are closed if anything goes wrong
+        m._ownsFds = true;
+        for(struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+          if(cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+            size_t n = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            const int *fds = (const int *) CMSG_DATA(cmsg);
+            for(size_t i = 0; i < n; ++i)
+              m._fds.push_back(fds[i]);
+          }
+        }
+
+        if(!receiveAll(_fd, (char *) &header + got, sizeof(header) - got))
+          return false;
+        if(m._fds.size() != header.nFds)
+          return false;
+
+        // the size comes off the wire, so don't let it have us allocate anything
+        if(header.size > Message::kMaxSize)
+          return false;
+
+        m._type = header.type;
+        m._data.resize(header.size);
+        return header.size == 0 || receiveAll(_fd, &m._data[0], header.size);
+#else
+        return false;
+#endif
+      }
+
+      bool Channel::makePair(int &a, int &b)
+      {
+#ifndef _WIN32
+        int fds[2];
+        if(::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0)
+          return false;
+        a = fds[0];
+        b = fds[1];
+        return true;
+#else
+        a = b = -1;
+        return false;
+#endif
+      }
+
+#ifndef _WIN32
+      /// split "host:port" in two, the host is empty if there is no colon
+      static void splitAddress(const std::string &address, std::string &host, std::string &port)
+      {
+        size_t colon = address.rfind(':');
+        if(colon == std::string::npos) {
+          host.clear();
+          port = address;
+        }
+        else {
+          host = address.substr(0, colon);
+          port = address.substr(colon + 1);
+        }
+      }
+
+      /// Look up a TCP address, NULL on failure, free the result with
+      /// freeaddrinfo. No host means the IPv4 loopback interface, for listening
+      /// as well as connecting, so a listener isn't opened to the world by default.
+      static struct addrinfo *lookUp(const std::string &address)
+      {
+        std::string host, port;
+        splitAddress(address, host, port);
+        if(host.empty())
+          host = "127.0.0.1";
+
+        struct addrinfo hints;
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+
+        struct addrinfo *found = 0;
+        if(getaddrinfo(host.c_str(), port.c_str(), &hints, &found) != 0)
+          return 0;
+        return found;
+      }
+
+      /// messages are small and go back and forth, so don't hold them back
+      static void setNoDelay(int fd)
+      {
+        int on = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+      }
+#endif
+
+      int Channel::connectTo(const std::string &address)
+      {
+#ifndef _WIN32
+        struct addrinfo *found = lookUp(address);
+        int fd = -1;
+        for(struct addrinfo *a = found; a && fd < 0; a = a->ai_next) {
+          fd = ::socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+          if(fd < 0)
+            continue;
+          if(::connect(fd, a->ai_addr, a->ai_addrlen) != 0) {
+            ::close(fd);
+            fd = -1;
+          }
+        }
+        if(found)
+          freeaddrinfo(found);
+        if(fd >= 0)
+          setNoDelay(fd);
+        return fd;
+#else
+        (void) address;
+        return -1;
+#endif
+      }
+
+      ////////////////////////////////////////////////////////////////////////////////
+      // Listener
+
+      Listener::Listener()
+        : _fd(-1)
+      {
+      }
+
+      Listener::~Listener()
+      {
+        close();
+      }
+
+      void Listener::close()
+      {
+#ifndef _WIN32
+        if(_fd >= 0)
+          ::close(_fd);
+#endif
+        _fd = -1;
+      }
+
+      bool Listener::listen(const std::string &address)
+      {
+        close();
+#ifndef _WIN32
+        struct addrinfo *found = lookUp(address);
+        for(struct addrinfo *a = found; a && _fd < 0; a = a->ai_next) {
+          _fd = ::socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+          if(_fd < 0)
+            continue;
+          int on = 1;
+          setsockopt(_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+          if(::bind(_fd, a->ai_addr, a->ai_addrlen) != 0 || ::listen(_fd, 16) != 0)
+            close();
+        }
+        if(found)
+          freeaddrinfo(found);
+        if(_fd >= 0)
+          fcntl(_fd, F_SETFD, FD_CLOEXEC);
+        return _fd >= 0;
+#else
+        (void) address;
+        return false;
+#endif
+      }
+
+      int Listener::getPort() const
+      {
+#ifndef _WIN32
+        struct sockaddr_storage addr;
+        socklen_t len = sizeof(addr);
+        if(_fd < 0 || getsockname(_fd, (struct sockaddr *) &addr, &len) != 0)
+          return -1;
+        if(addr.ss_family == AF_INET)
+          return ntohs(((struct sockaddr_in *) &addr)->sin_port);
+        if(addr.ss_family == AF_INET6)
+          return ntohs(((struct sockaddr_in6 *) &addr)->sin6_port);
+#endif
+        return -1;
+      }
+
+      int Listener::accept()
+      {
+#ifndef _WIN32
+        int fd;
+        do {
+          fd = ::accept(_fd, 0, 0);
+        } while(fd < 0 && errno == EINTR);
+        if(fd >= 0)
+          setNoDelay(fd);
+        return fd;
+#else
+        return -1;
+#endif
+      }
+
+      ////////////////////////////////////////////////////////////////////////////////
+      // WorkerPool
+
+      WorkerPool::WorkerPool()
+        : _local(true)
+        , _nRestarts(0)
+      {
+      }
+
+      WorkerPool::~WorkerPool()
+      {
+        shutdown();
+      }
+
+      bool WorkerPool::spawn(Worker &w)
+      {
+        w.pid = -1;
+        w.channel = 0;
+        w.busy = false;
+#ifndef _WIN32
+        if(!w.address.empty()) {
+          int fd = Channel::connectTo(w.address);
+          if(fd < 0)
+            return false;
+          w.pid = 0;
+          w.channel = new Channel(fd);
+          return true;
+        }
+
+        int ours, theirs;
+        if(!Channel::makePair(ours, theirs))
+          return false;
+
+        // our end must not leak into this or any other worker
+        fcntl(ours, F_SETFD, FD_CLOEXEC);
+
+        // build the arguments before forking, only exec is safe after it
+        std::vector<std::string> args(_command);
+        args.push_back(std::to_string(theirs));
+        std::vector<char *> argv;
+        for(size_t i = 0; i < args.size(); ++i)
+          argv.push_back(const_cast<char *>(args[i].c_str()));
+        argv.push_back(0);
+
+        pid_t pid = fork();
+        if(pid < 0) {
+          ::close(ours);
+          ::close(theirs);
+          return false;
+        }
+        if(pid == 0) {
+          execv(argv[0], argv.data());
+          _exit(127);
+        }
+
+        ::close(theirs);
+        w.pid = pid;
+        w.channel = new Channel(ours);
+        return true;
+#else
+        return false;
+#endif
+      }
+
+      void WorkerPool::reap(Worker &w)
+      {
+        delete w.channel;
+        w.channel = 0;
+#ifndef _WIN32
+        if(w.pid > 0) {
+          // closing the channel tells it to exit, give it a moment then make sure
+          int status;
+          pid_t done = 0;
+          for(int i = 0; i < 100 && done == 0; ++i) {
+            done = waitpid(w.pid, &status, WNOHANG);
+            if(done == 0)
+              usleep(10000);
+          }
+          if(done == 0) {
+            kill(w.pid, SIGKILL);
+            waitpid(w.pid, &status, 0);
+          }
+        }
+#endif
+        w.pid = -1;
+      }
+
+      bool WorkerPool::start(const std::vector<std::string> &command, int nWorkers)
+      {
+        shutdown();
+
+        std::lock_guard<std::mutex> guard(_lock);
+        if(command.empty())
+          return false;
+        _command = command;
+        _local = true;
+        _workers.resize(nWorkers > 0 ? nWorkers : 1);
+        for(size_t i = 0; i < _workers.size(); ++i) {
+          if(!spawn(_workers[i])) {
+            for(size_t j = 0; j < i; ++j)
+              reap(_workers[j]);
+            _workers.clear();
+            return false;
+          }
+        }
+        return true;
+      }
+
+      bool WorkerPool::connect(const std::vector<std::string> &addresses)
+      {
+        shutdown();
+
+        std::lock_guard<std::mutex> guard(_lock);
+        _command.clear();
+        _local = false;
+        _workers.resize(addresses.size());
+        for(size_t i = 0; i < _workers.size(); ++i) {
+          _workers[i].address = addresses[i];
+          if(!spawn(_workers[i])) {
+            std::cerr << "OFX: could not connect to a worker at " << addresses[i] << std::endl;
+            for(size_t j = 0; j < i; ++j)
+              reap(_workers[j]);
+            _workers.clear();
+            return false;
+          }
+        }
+        return !_workers.empty();
+      }
+
+      void WorkerPool::shutdown()
+      {
+        std::unique_lock<std::mutex> guard(_lock);
+        for(size_t i = 0; i < _workers.size(); ++i) {
+          while(_workers[i].busy)
+            _idle.wait(guard);
+          reap(_workers[i]);
+        }
+        _workers.clear();
+      }
+
+      int WorkerPool::getNumWorkers()
+      {
+        std::lock_guard<std::mutex> guard(_lock);
+        return int(_workers.size());
+      }
+
+      bool WorkerPool::isLocal()
+      {
+        std::lock_guard<std::mutex> guard(_lock);
+        return _local;
+      }
+
+      bool WorkerPool::isAlive(int index)
+      {
+        std::lock_guard<std::mutex> guard(_lock);
+        return index >= 0 && index < int(_workers.size()) && _workers[index].channel != 0;
+      }
+
+      std::string WorkerPool::getAddress(int index)
+      {
+        std::lock_guard<std::mutex> guard(_lock);
+        if(index < 0 || index >= int(_workers.size()))
+          return std::string();
+        return _workers[index].address;
+      }
+
+      size_t WorkerPool::getNumRestarts()
+      {
+        std::lock_guard<std::mutex> guard(_lock);
+        return _nRestarts;
+      }
+
+      int WorkerPool::acquire(int index)
+      {
+        std::unique_lock<std::mutex> guard(_lock);
+        while(true) {
+          if(_workers.empty() || index >= int(_workers.size()))
+            return -1;
+          if(index >= 0) {
+            if(!_workers[index].channel)
+              return -1;
+            if(!_workers[index].busy) {
+              _workers[index].busy = true;
+              return index;
+            }
+          }
+          else {
+            bool anyAlive = false;
+            for(size_t i = 0; i < _workers.size(); ++i) {
+              if(!_workers[i].channel)
+                continue;
+              anyAlive = true;
+              if(!_workers[i].busy) {
+                _workers[i].busy = true;
+                return int(i);
+              }
+            }
+            if(!anyAlive)
+              return -1;
+          }
+          _idle.wait(guard);
+        }
+      }
+
+      void WorkerPool::release(int index, bool died)
+      {
+        {
+          std::lock_guard<std::mutex> guard(_lock);
+          Worker &w = _workers[index];
+          if(died) {
+            reap(w);
+            if(spawn(w))
+              ++_nRestarts;
+            else if(w.address.empty())
+              std::cerr << "OFX: could not restart a worker process" << std::endl;
+            else
+              std::cerr << "OFX: could not reconnect to the worker at " << w.address << std::endl;
+          }
+          w.busy = false;
+        }
+        _idle.notify_all();
+      }
+
+      OfxStatus WorkerPool::callOn(int index, Message &request, Message &reply, CallbackI *callbacks)
+      {
+        // the worker is reserved, so its channel is ours till we release it
+        Channel *channel = _workers[index].channel;
+        if(!channel || !channel->send(request)) {
+          release(index, true);
+          return kOfxStatFailed;
+        }
+
+        while(true) {
+          if(!channel->receive(reply)) {
+            release(index, true);
+            return kOfxStatFailed;
+          }
+          if(reply.getType() == Message::kReply)
+            break;
+
+          // the worker wants something from us before it can carry on
+          Message answer;
+          if(callbacks)
+            callbacks->callback(reply, answer);
+          if(!channel->send(answer)) {
+            release(index, true);
+            return kOfxStatFailed;
+          }
+        }
+
+        release(index, false);
+        return kOfxStatOK;
+      }
+
+      OfxStatus WorkerPool::call(Message &request, Message &reply, CallbackI *callbacks)
+      {
+        int index = acquire(-1);
+        if(index < 0)
+          return kOfxStatErrFatal;
+        return callOn(index, request, reply, callbacks);
+      }
+
+      OfxStatus WorkerPool::call(int index, Message &request, Message &reply, CallbackI *callbacks)
+      {
+        if(acquire(index) < 0)
+          return kOfxStatErrFatal;
+        return callOn(index, request, reply, callbacks);
+      }
+
+      void WorkerPool::broadcast(Message &request)
+      {
+        int n = getNumWorkers();
+        for(int i = 0; i < n; ++i) {
+          int index = acquire(i);
+          if(index < 0)
+            continue;
+          Message reply;
+          callOn(index, request, reply, 0);
+        }
+      }
+
+      ////////////////////////////////////////////////////////////////////////////////
+      // WorkerChannel
+
+      WorkerChannel::WorkerChannel(int fd)
+        : _channel(fd)
+      {
+#ifndef _WIN32
+        if(fd >= 0)
+          fcntl(fd, F_SETFD, FD_CLOEXEC);
+#endif
+      }
+
+      bool WorkerChannel::receive(Message &request)
+      {
+        return _channel.receive(request);
+      }
+
+      bool WorkerChannel::reply(const Message &reply)
+      {
+        std::lock_guard<std::mutex> guard(_lock);
+        return _channel.send(reply);
+      }
+
+      bool WorkerChannel::callback(const Message &request, Message &reply)
+      {
+        std::lock_guard<std::mutex> guard(_lock);
+        return _channel.send(request) && _channel.receive(reply);
+      }
+
+    } // namespace IPC
+
+  } // namespace Host
+
+} // namespace OFX
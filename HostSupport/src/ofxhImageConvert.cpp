@@ -0,0 +1,443 @@
+// Copyright OpenFX and contributors to the OpenFX project.
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <vector>
+
+// ofx
+#include "ofxCore.h"
+#include "ofxImageEffect.h"
+
+// ofx host
+#include "ofxhBinary.h"
+#include "ofxhPropertySuite.h"
+#include "ofxhClip.h"
+#include "ofxhImageConvert.h"
+#include "ofxhUtilities.h"
+
+namespace OFX {
+
+  namespace Host {
+
+    namespace ImageEffect {
+
+      ////////////////////////////////////////////////////////////////////////////////
+      // ImageBufferPool
+
+      ImageBufferPool::ImageBufferPool(size_t maxFreeBytes)
+        : _freeBytes(0)
+        , _maxFreeBytes(maxFreeBytes)
+        , _usedBytes(0)
+      {
+      }
+
+      ImageBufferPool::~ImageBufferPool()
+      {
+        trim();
+      }
+
+      ImageBufferPool &ImageBufferPool::getDefault()
+      {
+        static ImageBufferPool pool;
+        return pool;
+      }
+
+      void *ImageBufferPool::acquire(size_t nBytes)
+      {
+        {
+          std::lock_guard<std::mutex> guard(_lock);
+          _usedBytes += nBytes;
+          std::multimap<size_t, void *>::iterator it = _free.find(nBytes);
+          if(it != _free.end()) {
+            void *buffer = it->second;
+            _free.erase(it);
+            _freeBytes -= nBytes;
+            return buffer;
+          }
+        }
+        void *buffer = malloc(nBytes ? nBytes : 1);
+        if(!buffer) {
+          std::lock_guard<std::mutex> guard(_lock);
+          _usedBytes -= nBytes;
+        }
+        return buffer;
+      }
+
+      void ImageBufferPool::release(void *buffer, size_t nBytes)
+      {
+        if(!buffer)
+          return;
+
+        {
+          std::lock_guard<std::mutex> guard(_lock);
+          _usedBytes -= nBytes;
+          if(_freeBytes + nBytes <= _maxFreeBytes) {
+            _free.insert(std::make_pair(nBytes, buffer));
+            _freeBytes += nBytes;
+            return;
+          }
+        }
+        free(buffer);
+      }
+
+      size_t ImageBufferPool::getBytesInUse()
+      {
+        std::lock_guard<std::mutex> guard(_lock);
+        return _usedBytes;
+      }
+
+      size_t ImageBufferPool::getFreeBytes()
+      {
+        std::lock_guard<std::mutex> guard(_lock);
+        return _freeBytes;
+      }
+
+      void ImageBufferPool::setMaxFreeBytes(size_t maxFreeBytes)
+      {
+        std::lock_guard<std::mutex> guard(_lock);
+        _maxFreeBytes = maxFreeBytes;
+
+        // drop the biggest buffers first
+        while(_freeBytes > _maxFreeBytes && !_free.empty()) {
+          std::multimap<size_t, void *>::iterator it = --_free.end();
+          _freeBytes -= it->first;
+          free(it->second);
+          _free.erase(it);
+        }
+      }
+
+      void ImageBufferPool::trim()
+      {
+        std::lock_guard<std::mutex> guard(_lock);
+        for(std::multimap<size_t, void *>::iterator it = _free.begin(); it != _free.end(); ++it)
+          free(it->second);
+        _free.clear();
+        _freeBytes = 0;
+      }
+
+      ////////////////////////////////////////////////////////////////////////////////
+      // ConvertedImage
+
+      ConvertedImage::ConvertedImage(ClipInstance &clip,
+                                     ImageBufferPool &pool,
+                                     void *buffer,
+                                     size_t bufferBytes,
+                                     double renderScaleX,
+                                     double renderScaleY,
+                                     const OfxRectI &bounds,
+                                     const OfxRectI &rod,
+                                     int rowBytes,
+                                     const std::string &field,
+                                     const std::string &uniqueIdentifier)
+        : Image(clip, renderScaleX, renderScaleY, buffer, bounds, rod, rowBytes, field, uniqueIdentifier)
+        , _pool(pool)
+        , _buffer(buffer)
+        , _bufferBytes(bufferBytes)
+      {
+      }
+
+      ConvertedImage::~ConvertedImage()
+      {
+        _pool.release(_buffer, _bufferBytes);
+      }
+
+      ////////////////////////////////////////////////////////////////////////////////
+      // pixel kernels
+      //
+      // Rows are converted in two simple passes, a component shuffle at the
+      // source depth, then a depth conversion over every component in the
+      // row. Both are flat loops with no per pixel branching, which the
+      // compiler vectorises.
+
+      /// the value of 'one' at each depth, half is stored as its bits
+      template <class T> struct DepthTraits;
+      template <> struct DepthTraits<unsigned char>  { static unsigned char  one() { return 255; } };
+      template <> struct DepthTraits<unsigned short> { static unsigned short one() { return 65535; } };
+      template <> struct DepthTraits<float>          { static float          one() { return 1.0f; } };
+
+      static const unsigned short kHalfOne = 0x3c00;
+
+      /// depth conversion of n components
+      template <class S, class D>
+      struct DepthConvert;
+
+      template <class T>
+      struct DepthConvert<T, T> {
+        static void row(const T *src, T *dst, int n) { memcpy(dst, src, size_t(n) * sizeof(T)); }
+      };
+
+      template <>
+      struct DepthConvert<unsigned char, unsigned short> {
+        static void row(const unsigned char *src, unsigned short *dst, int n)
+        {
+          for(int i = 0; i < n; ++i)
+            dst[i] = (unsigned short)(src[i] * 257);
+        }
+      };
+
+      template <>
+      struct DepthConvert<unsigned short, unsigned char> {
+        static void row(const unsigned short *src, unsigned char *dst, int n)
+        {
+          for(int i = 0; i < n; ++i)
+            dst[i] = (unsigned char)(((unsigned int)(src[i]) * 255u + 32767u) / 65535u);
+        }
+      };
+
+      template <>
+      struct DepthConvert<float, float> {
+        static void row(const float *src, float *dst, int n) { memcpy(dst, src, size_t(n) * sizeof(float)); }
+      };
+
+      template <class S>
+      struct DepthConvert<S, float> {
+        static void row(const S *src, float *dst, int n)
+        {
+          const float scale = 1.0f / DepthTraits<S>::one();
+          for(int i = 0; i < n; ++i)
+            dst[i] = src[i] * scale;
+        }
+      };
+
+      template <class D>
+      struct DepthConvert<float, D> {
+        static void row(const float *src, D *dst, int n)
+        {
+          const float one = DepthTraits<D>::one();
+          for(int i = 0; i < n; ++i) {
+            float v = src[i] * one + 0.5f;
+            v = v < 0.0f ? 0.0f : (v > one ? one : v);
+            dst[i] = (D) v;
+          }
+        }
+      };
+
+      /// shuffle width pixels from nSrc to nDst components at one depth
+      template <class T>
+      static void shuffleRow(const T *src, int nSrc, T *dst, int nDst, int width, T one)
+      {
+        if(nSrc == 4 && nDst == 3) {
+          for(int x = 0; x < width; ++x) {
+            dst[3*x + 0] = src[4*x + 0];
+            dst[3*x + 1] = src[4*x + 1];
+            dst[3*x + 2] = src[4*x + 2];
+          }
+        }
+        else if(nSrc == 3 && nDst == 4) {
+          for(int x = 0; x < width; ++x) {
+            dst[4*x + 0] = src[3*x + 0];
+            dst[4*x + 1] = src[3*x + 1];
+            dst[4*x + 2] = src[3*x + 2];
+            dst[4*x + 3] = one;
+          }
+        }
+        else if(nSrc == 4 && nDst == 1) {
+          for(int x = 0; x < width; ++x)
+            dst[x] = src[4*x + 3];
+        }
+        else if(nSrc == 3 && nDst == 1) {
+          for(int x = 0; x < width; ++x)
+            dst[x] = one;
+        }
+        else if(nSrc == 1) {
+          // black, with the alpha if there is somewhere to put it
+          memset(dst, 0, size_t(width) * nDst * sizeof(T));
+          if(nDst == 4)
+            for(int x = 0; x < width; ++x)
+              dst[4*x + 3] = src[x];
+        }
+        else {
+          memcpy(dst, src, size_t(width) * nDst * sizeof(T));
+        }
+      }
+
+      /// convert the window, S and D being the storage types of the source and destination
+      template <class S, class D>
+      static void convertWindow(const unsigned char *srcData, const OfxRectI &srcBounds, int srcRowBytes, int nSrc,
+                                unsigned char *dstData, const OfxRectI &dstBounds, int dstRowBytes, int nDst,
+                                const OfxRectI &window, S srcOne)
+      {
+        int width = window.x2 - window.x1;
+        if(width <= 0)
+          return;
+
+        std::vector<S> scratch;
+        if(nSrc != nDst)
+          scratch.resize(size_t(width) * nDst);
+
+        for(int y = window.y1; y < window.y2; ++y) {
+          const S *src = (const S *)(srcData + std::ptrdiff_t(y - srcBounds.y1) * srcRowBytes) + (window.x1 - srcBounds.x1) * nSrc;
+          D *dst = (D *)(dstData + std::ptrdiff_t(y - dstBounds.y1) * dstRowBytes) + (window.x1 - dstBounds.x1) * nDst;
+
+          if(nSrc != nDst) {
+            shuffleRow<S>(src, nSrc, &scratch[0], nDst, width, srcOne);
+            src = &scratch[0];
+          }
+          DepthConvert<S, D>::row(src, dst, width * nDst);
+        }
+      }
+
+      /// dispatch on the destination depth
+      template <class S>
+      static bool convertFrom(const unsigned char *srcData, const OfxRectI &srcBounds, int srcRowBytes, int nSrc,
+                              unsigned char *dstData, const OfxRectI &dstBounds, int dstRowBytes, int nDst,
+                              const std::string &dstDepth, const OfxRectI &window)
+      {
+        if(dstDepth == kOfxBitDepthByte)
+          convertWindow<S, unsigned char>(srcData, srcBounds, srcRowBytes, nSrc, dstData, dstBounds, dstRowBytes, nDst, window, DepthTraits<S>::one());
+        else if(dstDepth == kOfxBitDepthShort)
+          convertWindow<S, unsigned short>(srcData, srcBounds, srcRowBytes, nSrc, dstData, dstBounds, dstRowBytes, nDst, window, DepthTraits<S>::one());
+        else if(dstDepth == kOfxBitDepthFloat)
+          convertWindow<S, float>(srcData, srcBounds, srcRowBytes, nSrc, dstData, dstBounds, dstRowBytes, nDst, window, DepthTraits<S>::one());
+        else
+          return false;
+        return true;
+      }
+
+      ////////////////////////////////////////////////////////////////////////////////
+      // conversion
+
+      int getBytesPerComponent(const std::string &depth)
+      {
+        if(depth == kOfxBitDepthByte)
+          return 1;
+        if(depth == kOfxBitDepthShort || depth == kOfxBitDepthHalf)
+          return 2;
+        if(depth == kOfxBitDepthFloat)
+          return 4;
+        return 0;
+      }
+
+      int getComponentCount(const std::string &components)
+      {
+        if(components == kOfxImageComponentRGBA)
+          return 4;
+        if(components == kOfxImageComponentRGB)
+          return 3;
+        if(components == kOfxImageComponentAlpha)
+          return 1;
+        return 0;
+      }
+
+      bool canConvertPixels(const std::string &srcDepth, const std::string &srcComponents,
+                            const std::string &dstDepth, const std::string &dstComponents)
+      {
+        if(!getBytesPerComponent(srcDepth) || !getBytesPerComponent(dstDepth))
+          return false;
+        if(!getComponentCount(srcComponents) || !getComponentCount(dstComponents))
+          return false;
+
+        // we can only shuffle half, there is no half arithmetic here
+        if((srcDepth == kOfxBitDepthHalf || dstDepth == kOfxBitDepthHalf) && srcDepth != dstDepth)
+          return false;
+
+        return true;
+      }
+
+      bool convertPixels(const void *srcData, const OfxRectI &srcBounds, int srcRowBytes,
+                         const std::string &srcDepth, const std::string &srcComponents,
+                         void *dstData, const OfxRectI &dstBounds, int dstRowBytes,
+                         const std::string &dstDepth, const std::string &dstComponents,
+                         const OfxRectI &window)
+      {
+        if(!canConvertPixels(srcDepth, srcComponents, dstDepth, dstComponents))
+          return false;
+
+        int nSrc = getComponentCount(srcComponents);
+        int nDst = getComponentCount(dstComponents);
+        const unsigned char *src = (const unsigned char *) srcData;
+        unsigned char *dst = (unsigned char *) dstData;
+
+        if(srcDepth == kOfxBitDepthHalf) {
+          convertWindow<unsigned short, unsigned short>(src, srcBounds, srcRowBytes, nSrc, dst, dstBounds, dstRowBytes, nDst, window, kHalfOne);
+          return true;
+        }
+        if(srcDepth == kOfxBitDepthByte)
+          return convertFrom<unsigned char>(src, srcBounds, srcRowBytes, nSrc, dst, dstBounds, dstRowBytes, nDst, dstDepth, window);
+        if(srcDepth == kOfxBitDepthShort)
+          return convertFrom<unsigned short>(src, srcBounds, srcRowBytes, nSrc, dst, dstBounds, dstRowBytes, nDst, dstDepth, window);
+        if(srcDepth == kOfxBitDepthFloat)
+          return convertFrom<float>(src, srcBounds, srcRowBytes, nSrc, dst, dstBounds, dstRowBytes, nDst, dstDepth, window);
+        return false;
+      }
+
+      Image *conformImageToClip(ClipInstance &clip,
+                                Image *image,
+                                const OfxRectD *optionalBounds,
+                                ImageBufferPool &pool)
+      {
+        // output images are rendered into, so there is nothing to convert yet
+        if(!image || clip.isOutput())
+          return image;
+
+        const std::string &srcDepth = image->getStringProperty(kOfxImageEffectPropPixelDepth);
+        const std::string &srcComponents = image->getStringProperty(kOfxImageEffectPropComponents);
+        const std::string &dstDepth = clip.getPixelDepth();
+        const std::string &dstComponents = clip.getComponents();
+
+        // the common case, the host already has what the plugin wants
+        if(srcDepth == dstDepth && srcComponents == dstComponents)
+          return image;
+
+        const void *srcData = image->getPointerProperty(kOfxImagePropData);
+        if(!srcData || !canConvertPixels(srcDepth, srcComponents, dstDepth, dstComponents))
+          return image;
+
+        double renderScaleX = image->getDoubleProperty(kOfxImageEffectPropRenderScale, 0);
+        double renderScaleY = image->getDoubleProperty(kOfxImageEffectPropRenderScale, 1);
+        OfxRectI srcBounds = image->getBounds();
+
+        // only convert what was asked for, mapping the canonical bounds to pixels
+        OfxRectI window = srcBounds;
+        if(optionalBounds) {
+          double par = image->getDoubleProperty(kOfxImagePropPixelAspectRatio);
+          if(par <= 0)
+            par = 1;
+          OfxRectI wanted;
+          wanted.x1 = (int) std::floor(optionalBounds->x1 * renderScaleX / par);
+          wanted.y1 = (int) std::floor(optionalBounds->y1 * renderScaleY);
+          wanted.x2 = (int) std::ceil(optionalBounds->x2 * renderScaleX / par);
+          wanted.y2 = (int) std::ceil(optionalBounds->y2 * renderScaleY);
+
+          window.x1 = Maximum(srcBounds.x1, wanted.x1);
+          window.y1 = Maximum(srcBounds.y1, wanted.y1);
+          window.x2 = Minimum(srcBounds.x2, wanted.x2);
+          window.y2 = Minimum(srcBounds.y2, wanted.y2);
+
+          // nothing overlaps, give them the lot rather than an empty image
+          if(window.x1 >= window.x2 || window.y1 >= window.y2)
+            window = srcBounds;
+        }
+
+        int dstRowBytes = (window.x2 - window.x1) * getComponentCount(dstComponents) * getBytesPerComponent(dstDepth);
+        size_t nBytes = size_t(dstRowBytes) * (window.y2 - window.y1);
+        void *buffer = pool.acquire(nBytes);
+        if(!buffer)
+          return image;
+
+        convertPixels(srcData, srcBounds, image->getIntProperty(kOfxImagePropRowBytes), srcDepth, srcComponents,
+                      buffer, window, dstRowBytes, dstDepth, dstComponents,
+                      window);
+
+        // the new image takes its depth and components from the clip, and as
+        // its pixels differ from the source's, so must its unique identifier
+        std::string uniqueIdentifier = image->getStringProperty(kOfxImagePropUniqueIdentifier);
+        if(!uniqueIdentifier.empty())
+          uniqueIdentifier += "/" + dstDepth + "/" + dstComponents;
+        Image *converted = new ConvertedImage(clip, pool, buffer, nBytes,
+                                              renderScaleX, renderScaleY,
+                                              window, image->getROD(), dstRowBytes,
+                                              image->getStringProperty(kOfxImagePropField),
+                                              uniqueIdentifier);
+
+        image->releaseReference();
+        return converted;
+      }
+
+    } // namespace ImageEffect
+
+  } // namespace Host
+
+} // namespace OFX
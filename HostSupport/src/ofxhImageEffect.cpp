@@ -19,6 +19,7 @@
 #include "ofxhHost.h"
 #include "ofxhImageEffectAPI.h"
 #include "ofxhUtilities.h"
+#include "ofxhTrace.h"
 #ifdef OFX_SUPPORTS_PARAMETRIC
 #include "ofxhParametricParam.h"
 #endif
@@ -26,9 +27,12 @@
 #include "ofxGPURender.h"
 #endif
 #include "ofxOld.h" // old plugins may rely on deprecated properties being present
+#include "ofxsImageFetch.h" // the Support library's image fetch extension
 
 #include <string.h>
 #include <stdarg.h>
+#include <atomic>
+#include <thread>
 
 namespace OFX {
 
@@ -342,11 +346,17 @@ namespace OFX {
         , _continuousSamples(false)
         , _frameVarying(false)
         , _outputFrameRate(24)
+        , _changeDepth(0)
+        , _changeTime(0)
+        , _deliveringChanges(false)
+        , _imageFetchThreads(1)
       {
         int i = 0;
+        _changeRenderScale.x = _changeRenderScale.y = 1;
         _properties.setChainedSet(&other.getProps());
 
-        _properties.setPointerProperty(kOfxImageEffectPropPluginHandle, _plugin->getPluginHandle()->getOfxPlugin());
+        // fetched via the hook, as an instance made from cached descriptors doesn't load the binary until its first action
+        _properties.setGetHook(kOfxImageEffectPropPluginHandle, this);
 
         _properties.setStringProperty(kOfxImageEffectPropContext,context);
         _properties.setIntProperty(kOfxPropIsInteractive,interactive);
@@ -543,6 +553,26 @@ namespace OFX {
           throw Property::Exception(kOfxStatErrUnknown);
       }
 
+      void *Instance::getPointerProperty(const std::string &name, int index) const
+      {
+        if(name==kOfxImageEffectPropPluginHandle){
+          if(index>=1) throw Property::Exception(kOfxStatErrBadIndex);
+          PluginHandle *handle = _plugin ? _plugin->getPluginHandle() : 0;
+          return handle ? handle->getOfxPlugin() : 0;
+        }
+        throw Property::Exception(kOfxStatErrUnknown);
+      }
+
+      void Instance::getPointerPropertyN(const std::string &name, void **values, int count) const
+      {
+        if(name==kOfxImageEffectPropPluginHandle){
+          if(count>1) throw Property::Exception(kOfxStatErrBadIndex);
+          *values = getPointerProperty(name, 0);
+        }
+        else
+          throw Property::Exception(kOfxStatErrUnknown);
+      }
+
       Instance::~Instance(){
         // destroy the instance, only if succesfully created
         if (_created) {
@@ -638,6 +668,10 @@ namespace OFX {
                 outHandle = outArgs->getHandle();
               }
                 
+              Trace::Span span("action", action, _plugin->getIdentifier());
+              if(span.isActive() && inArgs)
+                span.addArgs(*inArgs);
+
               OfxStatus stat;
               try {
                  stat = ofxPlugin->mainEntry(action, handle, inHandle, outHandle);
@@ -723,6 +757,11 @@ namespace OFX {
         if(isClipPreferencesSlaveParam(paramName))
           _clipPrefsDirty = true;
 
+        // anything the plugin told us may have changed with the param, a
+        // batch of changes does this once as it is delivered instead
+        if(_changeDepth == 0 && !_deliveringChanges)
+          _actionCache.invalidate();
+
         if (!param) {
           return kOfxStatFailed;
         }
@@ -759,6 +798,8 @@ namespace OFX {
                                                     OfxPointD   renderScale)
       {
         _clipPrefsDirty = true;
+        if(_changeDepth == 0 && !_deliveringChanges)
+          _actionCache.invalidate();
         std::map<std::string,ClipInstance*>::iterator it=_clips.find(clipName);
         if(it!=_clips.end())
           return (it->second)->instanceChangedAction(why,time,renderScale);
@@ -785,8 +826,180 @@ namespace OFX {
         return st;
       }
 
+      void Instance::beginChanges(const std::string &why, OfxTime time, OfxPointD renderScale)
+      {
+        if(_changeDepth++ == 0) {
+          _changeReason = why;
+          _changeTime = time;
+          _changeRenderScale = renderScale;
+        }
+      }
+
+      OfxStatus Instance::paramChanged(const std::string &paramName)
+      {
+        if(!getParam(paramName))
+          return kOfxStatErrBadIndex;
+        if(_changeDepth > 0) {
+          _changedParams.insert(paramName);
+          return kOfxStatOK;
+        }
+
+        OfxPointD renderScale;
+        getRenderScaleRecursive(renderScale.x, renderScale.y);
+        beginChanges(kOfxChangeUserEdited, getFrameRecursive(), renderScale);
+        _changedParams.insert(paramName);
+        return endChanges();
+      }
+
+      OfxStatus Instance::clipChanged(const std::string &clipName)
+      {
+        if(_clips.find(clipName) == _clips.end())
+          return kOfxStatErrBadIndex;
+        if(_changeDepth > 0) {
+          _changedClips.insert(clipName);
+          return kOfxStatOK;
+        }
+
+        OfxPointD renderScale;
+        getRenderScaleRecursive(renderScale.x, renderScale.y);
+        beginChanges(kOfxChangeUserEdited, getFrameRecursive(), renderScale);
+        _changedClips.insert(clipName);
+        return endChanges();
+      }
+
+      /// a plugin setting a param in its instance changed action which sets it back would go round forever
+      static const int kMaxPluginChangeRounds = 16;
+
+      OfxStatus Instance::deliverChanges(const std::string &why,
+                                         const std::set<std::string> &clips,
+                                         const std::set<std::string> &params,
+                                         std::vector<std::string> &sent)
+      {
+        OfxStatus result = kOfxStatOK;
+        OfxStatus st = beginInstanceChangedAction(why);
+        if(st != kOfxStatOK && st != kOfxStatReplyDefault)
+          result = st;
+
+        for(std::set<std::string>::const_iterator it = clips.begin(); it != clips.end(); ++it) {
+          st = clipInstanceChangedAction(*it, why, _changeTime, _changeRenderScale);
+          if(st != kOfxStatOK && st != kOfxStatReplyDefault && result == kOfxStatOK)
+            result = st;
+        }
+
+        // params the plugin described first may be ones later params depend on
+        const std::list<Param::Instance *> &paramList = getParamList();
+        for(std::list<Param::Instance *>::const_iterator it = paramList.begin(); it != paramList.end(); ++it) {
+          const std::string &name = (*it)->getName();
+          if(params.find(name) == params.end())
+            continue;
+          st = paramInstanceChangedAction(name, why, _changeTime, _changeRenderScale);
+          if(st != kOfxStatOK && st != kOfxStatReplyDefault && result == kOfxStatOK)
+            result = st;
+          sent.push_back(name);
+        }
+
+        st = endInstanceChangedAction(why);
+        if(st != kOfxStatOK && st != kOfxStatReplyDefault && result == kOfxStatOK)
+          result = st;
+        return result;
+      }
+
+      OfxStatus Instance::endChanges()
+      {
+        if(_changeDepth == 0 || --_changeDepth > 0)
+          return kOfxStatOK;
+
+        std::set<std::string> clips, params;
+        clips.swap(_changedClips);
+        params.swap(_changedParams);
+        if(clips.empty() && params.empty() && _pluginChangedParams.empty())
+          return kOfxStatOK;
+
+        // hold back params the plugin sets itself till this bracket is done
+        std::vector<std::string> paramNames, clipNames(clips.begin(), clips.end());
+        _deliveringChanges = true;
+        OfxStatus result = kOfxStatOK;
+        if(!clips.empty() || !params.empty())
+          result = deliverChanges(_changeReason, clips, params, paramNames);
+
+        // then the cascade, a round at a time
+        for(int round = 0; !_pluginChangedParams.empty(); ++round) {
+          std::set<std::string> pluginParams;
+          pluginParams.swap(_pluginChangedParams);
+          if(round == kMaxPluginChangeRounds) {
+            std::cerr << "OFX: " << getPlugin()->getIdentifier()
+                      << " keeps changing its own params, not telling it of any more" << std::endl;
+            break;
+          }
+          OfxStatus st = deliverChanges(kOfxChangePluginEdited, std::set<std::string>(), pluginParams, paramNames);
+          if(result == kOfxStatOK)
+            result = st;
+        }
+        _deliveringChanges = false;
+
+        // once for the lot, after the last round, as the changes and anything
+        // the plugin did on being told of them may change what it would answer
+        _actionCache.invalidate();
+
+        changesCommitted(paramNames, clipNames);
+        return result;
+      }
+
+      void Instance::changesCommitted(const std::vector<std::string> &/*paramNames*/,
+                                      const std::vector<std::string> &/*clipNames*/)
+      {
+      }
+
+      /// fetch one image of a batch, as clipGetImage would
+      static void fetchBatchImage(ImageFetch &fetch)
+      {
+        try {
+          fetch.image = fetch.clip->fetchImage(fetch.time, fetch.region);
+          fetch.status = fetch.image ? kOfxStatOK : kOfxStatFailed;
+        }
+        catch(std::bad_alloc &) {
+          fetch.image = 0;
+          fetch.status = kOfxStatErrMemory;
+        }
+        catch(...) {
+          fetch.image = 0;
+          fetch.status = kOfxStatErrBadHandle;
+        }
+      }
+
+      void Instance::getImages(std::vector<ImageFetch> &fetches)
+      {
+        unsigned int nThreads = Minimum(getImageFetchThreads(), (unsigned int) fetches.size());
+        if(nThreads <= 1) {
+          for(size_t i = 0; i < fetches.size(); ++i)
+            fetchBatchImage(fetches[i]);
+          return;
+        }
+
+        // each thread takes the next image no one has yet
+        std::atomic<size_t> next(0);
+        auto work = [&]() {
+          for(size_t i = next++; i < fetches.size(); i = next++)
+            fetchBatchImage(fetches[i]);
+        };
+        std::vector<std::thread> threads;
+        for(unsigned int i = 1; i < nThreads; ++i)
+          threads.push_back(std::thread(work));
+        work(); // this thread fetches as well
+        for(size_t i = 0; i < threads.size(); ++i)
+          threads[i].join();
+      }
+
+      unsigned int Instance::getImageFetchThreads() const
+      {
+        if(_imageFetchThreads == 0)
+          return Maximum(1u, std::thread::hardware_concurrency());
+        return _imageFetchThreads;
+      }
+
       // purge your caches
       OfxStatus Instance::purgeCachesAction(){
+        _actionCache.invalidate();
 #       ifdef OFX_DEBUG_ACTIONS
           std::cout << "OFX: "<<(void*)this<<"->"<<kOfxActionPurgeCaches<<"()"<<std::endl;
 #       endif
@@ -1087,6 +1300,11 @@ namespace OFX {
                                                       OfxPointD   renderScale,
                                                       OfxRectD &rod)
       {
+        OfxStatus cachedStat;
+        ActionCache::Generation generation;
+        if(_actionCache.getRegionOfDefinition(time, renderScale, rod, cachedStat, generation))
+          return cachedStat;
+
         static const Property::PropSpec inStuff[] = {
           { kOfxPropTime, Property::eDouble, 1, true, "0" },
           { kOfxImageEffectPropRenderScale, Property::eDouble, 2, true, "0" },
@@ -1126,6 +1344,8 @@ namespace OFX {
           }
           std::cout << std::endl;
 #       endif
+
+        _actionCache.setRegionOfDefinition(time, renderScale, rod, stat, generation);
           
         return stat;
       }
@@ -1138,6 +1358,10 @@ namespace OFX {
       {
         OfxStatus stat = kOfxStatReplyDefault;
 
+        ActionCache::Generation generation;
+        if(_actionCache.getRegionsOfInterest(time, renderScale, roi, rois, stat, generation))
+          return stat;
+
         // reset the map
         rois.clear();
 
@@ -1253,6 +1477,8 @@ namespace OFX {
               }
             }
         }
+
+        _actionCache.setRegionsOfInterest(time, renderScale, roi, rois, stat, generation);
   
         return stat;
       }
@@ -1264,6 +1490,30 @@ namespace OFX {
                                                RangeMap &rangeMap)
       {
         OfxStatus stat = kOfxStatReplyDefault;
+
+        // work out the frames on their own, as we append to rangeMap
+        RangeMap frames;
+        ActionCache::Generation generation;
+        if(!_actionCache.getFramesNeeded(time, frames, stat, generation)) {
+          stat = calcFramesNeeded(time, frames);
+          if(stat == kOfxStatFailed)
+            return stat;
+          _actionCache.setFramesNeeded(time, frames, stat, generation);
+        }
+
+        for(RangeMap::iterator it = frames.begin(); it != frames.end(); ++it) {
+          std::vector<OfxRangeD> &ranges = rangeMap[it->first];
+          ranges.insert(ranges.end(), it->second.begin(), it->second.end());
+        }
+
+        return stat;
+      }
+
+      /// call the frames needed action, or work out the default
+      OfxStatus Instance::calcFramesNeeded(OfxTime time,
+                                           RangeMap &rangeMap)
+      {
+        OfxStatus stat = kOfxStatReplyDefault;
         Property::Set outArgs;
       
         if(temporalAccess()) {
@@ -1380,6 +1630,18 @@ namespace OFX {
                                            OfxPointD   renderScale,
                                            std::string &clip)
       {
+        OfxTime identityTime;
+        std::string identityClip;
+        OfxStatus cachedStat;
+        ActionCache::Generation generation;
+        if(_actionCache.getIsIdentity(time, field, renderRoI, renderScale, identityTime, identityClip, cachedStat, generation)) {
+          if(cachedStat == kOfxStatOK) {
+            time = identityTime;
+            clip = identityClip;
+          }
+          return cachedStat;
+        }
+
         static const Property::PropSpec inStuff[] = {
           { kOfxPropTime, Property::eDouble, 1, true, "0" },
           { kOfxImageEffectPropFieldToRender, Property::eString, 1, true, "" }, 
@@ -1422,8 +1684,14 @@ namespace OFX {
 #       endif
 
         if(st==kOfxStatOK){
-          time = outArgs.getDoubleProperty(kOfxPropTime);
-          clip = outArgs.getStringProperty(kOfxPropName);        
+          identityTime = outArgs.getDoubleProperty(kOfxPropTime);
+          identityClip = outArgs.getStringProperty(kOfxPropName);
+          _actionCache.setIsIdentity(time, field, renderRoI, renderScale, identityTime, identityClip, st, generation);
+          time = identityTime;
+          clip = identityClip;
+        }
+        else {
+          _actionCache.setIsIdentity(time, field, renderRoI, renderScale, time, std::string(), st, generation);
         }
         
         return st;
@@ -1684,6 +1952,9 @@ namespace OFX {
       /// call the clip preferences action
       bool Instance::getClipPreferences()
       {      
+        // clip preferences change what the other actions see of the clips
+        _actionCache.invalidate();
+
         /// create the out args with the stuff that does not depend on individual clips
         Property::Set outArgs;
 
@@ -1745,6 +2016,21 @@ namespace OFX {
         return true;
       }
 
+      void Instance::setClipPreferences(const std::string &outputFielding,
+                                        const std::string &outputPremult,
+                                        double outputFrameRate,
+                                        bool continuousSamples,
+                                        bool frameVarying)
+      {
+        _outputFielding = outputFielding;
+        _outputPreMultiplication = outputPremult;
+        _outputFrameRate = outputFrameRate;
+        _continuousSamples = continuousSamples;
+        _frameVarying = frameVarying;
+        _clipPrefsDirty = false;
+        _actionCache.invalidate();
+      }
+
       /// find the most chromatic components out of the two. Override this if you define
       /// more chromatic components
       const std::string &Instance::findMostChromaticComponents(const std::string &a, const std::string &b) const
@@ -1820,6 +2106,15 @@ namespace OFX {
 
       OfxStatus Instance::getTimeDomainAction(OfxRangeD& range)
       {
+        OfxRangeD cachedRange;
+        OfxStatus cachedStat;
+        ActionCache::Generation generation;
+        if(_actionCache.getTimeDomain(cachedRange, cachedStat, generation)) {
+          if(cachedStat == kOfxStatOK)
+            range = cachedRange;
+          return cachedStat;
+        }
+
         static const Property::PropSpec outStuff[] = {
           { kOfxImageEffectPropFrameRange , Property::eDouble, 2, false, "0.0" },
           Property::propSpecEnd
@@ -1841,11 +2136,16 @@ namespace OFX {
           }
           std::cout << std::endl;
 #       endif
-        if(st!=kOfxStatOK) return st;
+        if(st!=kOfxStatOK) {
+          _actionCache.setTimeDomain(range, st, generation);
+          return st;
+        }
 
         range.min = outArgs.getDoubleProperty(kOfxImageEffectPropFrameRange,0);
         range.max = outArgs.getDoubleProperty(kOfxImageEffectPropFrameRange,1);
 
+        _actionCache.setTimeDomain(range, kOfxStatOK, generation);
+
         return kOfxStatOK;
       }
 
@@ -1859,6 +2159,13 @@ namespace OFX {
           // but kOfxActionInstanceChanged should not be called according to the preconditions of http://openfx.sourceforge.net/Documentation/1.3/ofxProgrammingReference.html#kOfxActionInstanceChanged
           return;
         }
+
+        // collected, to go to the plugin in one bracket once the current one is done
+        if(_changeDepth > 0 || _deliveringChanges) {
+          _pluginChangedParams.insert(param->getName());
+          return;
+        }
+
         double frame  = getFrameRecursive();
         OfxPointD renderScale; getRenderScaleRecursive(renderScale.x, renderScale.y);
 
@@ -2004,6 +2311,13 @@ namespace OFX {
                                     const OfxRectD *h2,
                                     OfxPropertySetHandle *h3)
       {
+        Trace::Span span("suite", "clipGetImage");
+        if(span.isActive()) {
+          span.addArg("time", time);
+          if(h2)
+            span.addArg("region", *h2);
+        }
+
         try {
         if (!h3) {
           return kOfxStatErrBadHandle;
@@ -2016,7 +2330,8 @@ namespace OFX {
           return kOfxStatErrBadHandle;
         }
 
-        Image* image = clipInstance->getImage(time,h2);
+        // the field, depth and components the plugin asked for
+        Image* image = clipInstance->fetchImage(time,h2);
         if(!image) {
           *h3 = NULL;
 
@@ -2124,6 +2439,7 @@ namespace OFX {
       // should processing be aborted?
       static int abort(OfxImageEffectHandle imageEffect)
       {
+        Trace::Span span("suite", "abort");
         try {
         ImageEffect::Base *effectBase = reinterpret_cast<ImageEffect::Base*>(imageEffect);
 
@@ -2146,6 +2462,9 @@ namespace OFX {
                                         size_t nBytes,
                                         OfxImageMemoryHandle *memoryHandle)
       {
+        Trace::Span span("suite", "imageMemoryAlloc");
+        span.addArg("bytes", double(nBytes));
+
         try {
         if (!memoryHandle) {
           return kOfxStatErrBadHandle;
@@ -2242,6 +2561,81 @@ namespace OFX {
         }
       }
 
+      ////////////////////////////////////////////////////////////////////////////////
+      // image fetch suite functions
+
+      static OfxStatus clipGetImages(OfxImageFetchRequest *requests, int nRequests)
+      {
+        Trace::Span span("suite", "clipGetImages");
+        if(span.isActive())
+          span.addArg("count", nRequests);
+
+        if(!requests && nRequests > 0)
+          return kOfxStatErrBadHandle;
+
+        // cleared up front, so that if we fail part way the handles set are all ours to release
+        for(int i = 0; i < nRequests; ++i)
+          requests[i].imageHandle = NULL;
+
+        std::vector<ImageFetch> fetches; // the batch being fetched, which may hold images if it throws
+        try {
+          // a batch for each instance the clips are of, normally just the one
+          std::map<Instance *, std::vector<int> > batches;
+          for(int i = 0; i < nRequests; ++i) {
+            ClipInstance *clipInstance = reinterpret_cast<ClipInstance*>(requests[i].clip);
+            if(!clipInstance || !clipInstance->verifyMagic() || !clipInstance->getEffectInstance()) {
+              requests[i].status = kOfxStatErrBadHandle;
+              continue;
+            }
+            batches[clipInstance->getEffectInstance()].push_back(i);
+          }
+
+          for(std::map<Instance *, std::vector<int> >::iterator it = batches.begin(); it != batches.end(); ++it) {
+            const std::vector<int> &indices = it->second;
+            fetches.assign(indices.size(), ImageFetch());
+            for(size_t j = 0; j < indices.size(); ++j) {
+              OfxImageFetchRequest &request = requests[indices[j]];
+              ImageFetch fetch = { reinterpret_cast<ClipInstance*>(request.clip), request.time, request.region, 0, kOfxStatFailed };
+              fetches[j] = fetch;
+            }
+            it->first->getImages(fetches);
+            for(size_t j = 0; j < indices.size(); ++j) {
+              OfxImageFetchRequest &request = requests[indices[j]];
+              request.imageHandle = fetches[j].image ? fetches[j].image->getPropHandle() : NULL;
+              request.status = fetches[j].status;
+            }
+            fetches.clear(); // handed over to the requests
+          }
+        } catch (...) {
+          // give back whatever was fetched before things went wrong, the plugin only hears of the error
+          for(size_t j = 0; j < fetches.size(); ++j)
+            if(fetches[j].image)
+              fetches[j].image->releaseReference();
+          for(int i = 0; i < nRequests; ++i) {
+            if(requests[i].imageHandle) {
+              clipReleaseImage(requests[i].imageHandle);
+              requests[i].imageHandle = NULL;
+            }
+          }
+          return kOfxStatErrBadHandle;
+        }
+
+        // the first error, else failed if any image wasn't there
+        OfxStatus result = kOfxStatOK;
+        for(int i = 0; i < nRequests; ++i) {
+          OfxStatus st = requests[i].status;
+          if(st != kOfxStatOK && st != kOfxStatFailed)
+            return st;
+          if(st == kOfxStatFailed)
+            result = kOfxStatFailed;
+        }
+        return result;
+      }
+
+      static const struct OfxImageFetchSuiteV1 gImageFetchSuite = {
+        clipGetImages
+      };
+
       static const struct OfxImageEffectSuiteV1 gImageEffectSuite = {
         getPropertySet,
         getParamSet,
@@ -2785,6 +3179,12 @@ namespace OFX {
           else 
             return NULL;
         }
+        else if (strcmp(suiteName, kOfxsImageFetchSuite)==0) {
+          if(suiteVersion == 1)
+            return (void*)&gImageFetchSuite;
+          else 
+            return NULL;
+        }
 #     ifdef OFX_SUPPORTS_OPENGLRENDER
         else if (strcmp(suiteName, kOfxOpenGLRenderSuite)==0) {
           if(suiteVersion == 1)
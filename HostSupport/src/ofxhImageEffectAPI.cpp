@@ -22,6 +22,7 @@
 #include "ofxhHost.h"
 #include "ofxhImageEffectAPI.h"
 #include "ofxhXml.h"
+#include "ofxhTrace.h"
 
 // Disable the "this pointer used in base member initialiser list" warning in Windows
 namespace OFX {
@@ -74,6 +75,7 @@ namespace OFX {
           OfxPlugin *op = _pluginHandle->getOfxPlugin();
           OfxStatus stat;
           try {
+            Trace::Span span("action", kOfxActionUnload, getIdentifier());
 #           ifdef OFX_DEBUG_ACTIONS
               std::cout << "OFX: "<<(void*)op<<"->"<<kOfxActionUnload<<"()"<<std::endl;
 #           endif
@@ -105,9 +107,9 @@ namespace OFX {
 
       void ImageEffectPlugin::addContext(const std::string &context, std::unique_ptr<Descriptor> ied)
       {
+        // the known contexts come from the descriptor's supported contexts, which may be more than were cached
         _contexts[context] = std::move(ied);
-        _knownContexts.insert(context);
-        _madeKnownContexts = true;
+        _cachedContexts.insert(context);
       }
 
       void ImageEffectPlugin::addContext(const std::string &context)
@@ -122,9 +124,73 @@ namespace OFX {
         _madeKnownContexts = true;
       }
 
+      /// does a property set hold any non null pointers
+      static bool hasPointerValues(const Property::Set &set)
+      {
+        const Property::PropertyMap &props = set.getProperties();
+        for(Property::PropertyMap::const_iterator i = props.begin(); i != props.end(); ++i) {
+          if(i->second->getType() != Property::ePointer)
+            continue;
+          for(int j = 0; j < i->second->getDimension(); ++j) {
+            if(set.getPointerPropertyRaw(i->first, j))
+              return true;
+          }
+        }
+        return false;
+      }
+
+      bool ImageEffectPlugin::isContextCacheable(const Descriptor &desc) const
+      {
+        if(hasPointerValues(desc.getProps()))
+          return false;
+
+        const std::list<Param::Descriptor *> &params = desc.getParamList();
+        for(std::list<Param::Descriptor *>::const_iterator it = params.begin(); it != params.end(); ++it) {
+          if(hasPointerValues((*it)->getProperties()))
+            return false;
+        }
+
+        const std::vector<ClipDescriptor *> &clips = desc.getClipsByOrder();
+        for(std::vector<ClipDescriptor *>::const_iterator it = clips.begin(); it != clips.end(); ++it) {
+          if(hasPointerValues((*it)->getProps()))
+            return false;
+        }
+        return true;
+      }
+
       void ImageEffectPlugin::saveXML(std::ostream &os) 
       {        
         APICache::propertySetXMLWrite(os, getDescriptor().getProps(), 6);
+
+        // and the contexts we have been described in, so the next run needn't describe them again,
+        // params and clips are written in order, as that is the order instances make them in
+        for(std::map<std::string, std::unique_ptr<Descriptor>>::const_iterator it = _contexts.begin(); it != _contexts.end(); ++it) {
+          const Descriptor &desc = *it->second;
+          if(!isContextCacheable(desc))
+            continue;
+
+          os << "      <context " << XML::attribute("name", it->first) << ">\n";
+          APICache::propertySetXMLWrite(os, desc.getProps(), 8);
+
+          const std::list<Param::Descriptor *> &params = desc.getParamList();
+          for(std::list<Param::Descriptor *>::const_iterator p = params.begin(); p != params.end(); ++p) {
+            os << "        <param "
+               << XML::attribute("name", (*p)->getName())
+               << XML::attribute("type", (*p)->getType())
+               << ">\n";
+            APICache::propertySetXMLWrite(os, (*p)->getProperties(), 10);
+            os << "        </param>\n";
+          }
+
+          const std::vector<ClipDescriptor *> &clips = desc.getClipsByOrder();
+          for(std::vector<ClipDescriptor *>::const_iterator c = clips.begin(); c != clips.end(); ++c) {
+            os << "        <clip " << XML::attribute("name", (*c)->getName()) << ">\n";
+            APICache::propertySetXMLWrite(os, (*c)->getProps(), 10);
+            os << "        </clip>\n";
+          }
+
+          os << "      </context>\n";
+        }
       }
 
       const std::set<std::string> &ImageEffectPlugin::getContexts() const {
@@ -156,6 +222,7 @@ namespace OFX {
 
           OfxStatus stat;
           try {
+            Trace::Span span("action", kOfxActionLoad, getIdentifier());
 #           ifdef OFX_DEBUG_ACTIONS
               std::cout << "OFX: "<<(void*)op<<"->"<<kOfxActionLoad<<"()"<<std::endl;
 #           endif
@@ -171,6 +238,7 @@ namespace OFX {
           }
           
           try {
+            Trace::Span span("action", kOfxActionDescribe, getIdentifier());
 #           ifdef OFX_DEBUG_ACTIONS
               std::cout << "OFX: "<<(void*)op<<"->"<<kOfxActionDescribe<<"()"<<std::endl;
 #           endif
@@ -184,26 +252,21 @@ namespace OFX {
             _pluginHandle.reset();
             return nullptr;
           }
+
+          // Contexts read from the cache have not been described by this load of the binary.
+          // Plugins expect to be, so do so, but keep the cached descriptors, as instances may
+          // already have been made from them, and the binary is the one they were cached from.
+          for(std::set<std::string>::const_iterator it = _cachedContexts.begin(); it != _cachedContexts.end(); ++it) {
+            describeInContext(_pluginHandle.get(), *it);
+          }
+          _cachedContexts.clear();
         }
 
         return _pluginHandle.get();
       }
 
-      Descriptor *ImageEffectPlugin::getContext(const std::string &context) 
+      std::unique_ptr<Descriptor> ImageEffectPlugin::describeInContext(PluginHandle *ph, const std::string &context)
       {
-        std::map<std::string, std::unique_ptr<Descriptor>>::iterator it = _contexts.find(context);
-
-        if (it != _contexts.end()) {
-          //printf("found context description.\n");
-          return it->second.get();
-        }
-
-        if (_knownContexts.find(context) == _knownContexts.end()) {
-          return nullptr;
-        }
-
-        //        printf("doing context description.\n");
-
         OFX::Host::Property::PropSpec inargspec[] = {
           { kOfxImageEffectPropContext, OFX::Host::Property::eString, 1, true, context.c_str() },
             Property::propSpecEnd
@@ -211,11 +274,12 @@ namespace OFX {
         
         OFX::Host::Property::Set inarg(inargspec);
 
-        PluginHandle *ph = getPluginHandle();
         std::unique_ptr<ImageEffect::Descriptor> newContext( gImageEffectHost->makeDescriptor(getDescriptor(), this));
 
         OfxStatus stat;
         try {
+          Trace::Span span("action", kOfxImageEffectActionDescribeInContext, getIdentifier());
+          span.addArg("context", context.c_str());
 #         ifdef OFX_DEBUG_ACTIONS
             std::cout << "OFX: "<<(void*)ph->getOfxPlugin()<<"->"<<kOfxImageEffectActionDescribeInContext<<"("<<context<<")"<<std::endl;
 #         endif
@@ -226,21 +290,46 @@ namespace OFX {
         } CatchAllSetStatus(stat, gImageEffectHost, ph->getOfxPlugin(), kOfxImageEffectActionDescribeInContext);
 
         if (stat == kOfxStatOK || stat == kOfxStatReplyDefault) {
-          _contexts[context] = std::move(newContext);
-          return _contexts[context].get();
+          return newContext;
         }
         return nullptr;
       }
 
-      ImageEffect::Instance* ImageEffectPlugin::createInstance(const std::string &context, void *clientData)
-      {          
+      Descriptor *ImageEffectPlugin::getContext(const std::string &context) 
+      {
+        std::map<std::string, std::unique_ptr<Descriptor>>::iterator it = _contexts.find(context);
 
-        /// todo - we need to make sure action:load is called, then action:describe again
-        /// (not because we are expecting the results to change, but because plugin
-        /// might get confused otherwise), then a describe_in_context
+        if (it != _contexts.end()) {
+          //printf("found context description.\n");
+          return it->second.get();
+        }
 
-        getPluginHandle();
+        if (getContexts().find(context) == getContexts().end()) {
+          return nullptr;
+        }
 
+        PluginHandle *ph = getPluginHandle();
+        if (!ph) {
+          return nullptr;
+        }
+
+        std::unique_ptr<Descriptor> newContext = describeInContext(ph, context);
+        if (!newContext) {
+          return nullptr;
+        }
+
+        // the cache can now hold this context too
+        OFX::Host::PluginCache::getPluginCache()->setDirty();
+
+        _contexts[context] = std::move(newContext);
+        return _contexts[context].get();
+      }
+
+      ImageEffect::Instance* ImageEffectPlugin::createInstance(const std::string &context, void *clientData)
+      {          
+
+        /// The binary is loaded, described and described in context when it is first needed,
+        /// which for a context read from the plugin cache is the instance's first action.
         Descriptor *desc = getContext(context);
         
         if (desc) {
@@ -258,6 +347,7 @@ namespace OFX {
         if (_pluginHandle) {
           OfxStatus stat;
           try {
+            Trace::Span span("action", kOfxActionUnload, getIdentifier());
 #           ifdef OFX_DEBUG_ACTIONS
               std::cout << "OFX: "<<(void*)_pluginHandle->getOfxPlugin()<<"->"<<kOfxActionUnload<<"()"<<std::endl;
 #           endif
@@ -380,6 +470,7 @@ namespace OFX {
 
         OfxStatus stat;
         try {
+          Trace::Span span("action", kOfxActionLoad, op->getIdentifier());
 #         ifdef OFX_DEBUG_ACTIONS
             std::cout << "OFX: "<<(void*)plug.getOfxPlugin()<<"->"<<kOfxActionLoad<<"()"<<std::endl;
 #         endif
@@ -395,6 +486,7 @@ namespace OFX {
         }
 
         try {
+          Trace::Span span("action", kOfxActionDescribe, op->getIdentifier());
 #         ifdef OFX_DEBUG_ACTIONS
             std::cout << "OFX: "<<(void*)plug.getOfxPlugin()<<"->"<<kOfxActionDescribe<<"()"<<std::endl;
 #         endif
@@ -420,6 +512,7 @@ namespace OFX {
         }
 
         try {
+          Trace::Span span("action", kOfxActionUnload, op->getIdentifier());
 #         ifdef OFX_DEBUG_ACTIONS
             std::cout << "OFX: "<<(void*)plug.getOfxPlugin()<<"->"<<kOfxActionUnload<<"()"<<std::endl;
 #         endif
@@ -481,6 +574,11 @@ namespace OFX {
           return;
         }
 
+        if (_currentContext) {
+          APICache::propertySetXMLRead(el, map, _currentContext->getProps(), _currentProp);
+          return;
+        }
+
         if (!_currentContext && !_currentParam) {
           APICache::propertySetXMLRead(el, map, _currentPlugin->getDescriptor().getProps(), _currentProp);
           return;
@@ -498,6 +596,10 @@ namespace OFX {
           _currentParam = 0;
         }
 
+        if (el == "clip") {
+          _currentClip = 0;
+        }
+
         if (el == "context") {
           _currentContext = 0;
         }
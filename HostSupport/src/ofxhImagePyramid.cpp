@@ -0,0 +1,481 @@
+// Copyright OpenFX and contributors to the OpenFX project.
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <cmath>
+#include <cstdlib>
+#include <sstream>
+#include <iostream>
+
+// ofx
+#include "ofxCore.h"
+#include "ofxImageEffect.h"
+
+// ofx host
+#include "ofxhBinary.h"
+#include "ofxhPropertySuite.h"
+#include "ofxhClip.h"
+#include "ofxhImageConvert.h"
+#include "ofxhImagePyramid.h"
+#include "ofxhUtilities.h"
+
+namespace OFX {
+
+  namespace Host {
+
+    namespace ImageEffect {
+
+      ////////////////////////////////////////////////////////////////////////////////
+      // box filter
+      //
+      // Images are resampled separably. Each destination row is the weighted
+      // sum of the source rows it covers, accumulated into a float row with
+      // flat loops over every component, which the compiler vectorises. Each
+      // destination pixel is then the weighted sum of the pixels it covers
+      // in that row. Halving is the two tap case of the same thing.
+
+      /// scales this close are the same
+      static const double kScaleTolerance = 1e-6;
+
+      static bool sameScale(OfxPointD a, OfxPointD b)
+      {
+        return std::fabs(a.x - b.x) <= kScaleTolerance * a.x &&
+               std::fabs(a.y - b.y) <= kScaleTolerance * a.y;
+      }
+
+      /// a source pixel and its share of a destination pixel
+      struct Tap {
+        int   index;    ///< from the start of the source bounds
+        float weight;
+      };
+
+      /// The taps of each destination pixel in [d1, d2), from the source
+      /// pixels in [s1, s2), where a destination pixel is ratio source ones
+      /// wide. The taps of pixel i are taps[first[i]] to taps[first[i + 1]].
+      static void makeTaps(int s1, int s2, int d1, int d2, double ratio,
+                           std::vector<Tap> &taps, std::vector<int> &first)
+      {
+        taps.clear();
+        first.clear();
+        for(int d = d1; d < d2; ++d) {
+          first.push_back(int(taps.size()));
+          double lo = Maximum(d * ratio, double(s1));
+          double hi = Minimum((d + 1) * ratio, double(s2));
+          double total = 0;
+          size_t start = taps.size();
+          for(int s = int(std::floor(lo)); s < hi; ++s) {
+            double w = Minimum(hi, s + 1.) - Maximum(lo, double(s));
+            if(w <= kScaleTolerance)
+              continue;
+            Tap tap = { s - s1, float(w) };
+            taps.push_back(tap);
+            total += w;
+          }
+
+          // an edge pixel that misses the source takes the nearest one
+          if(taps.size() == start) {
+            Tap tap = { Maximum(s1, Minimum(s2 - 1, int(std::floor(lo)))) - s1, 1.0f };
+            taps.push_back(tap);
+            total = 1;
+          }
+          for(size_t i = start; i < taps.size(); ++i)
+            taps[i].weight = float(taps[i].weight / total);
+        }
+        first.push_back(int(taps.size()));
+      }
+
+      /// store a filtered value at a depth, integer depths round
+      template <class T> static inline T storeValue(float v) { return T(v + 0.5f); }
+      template <> inline float storeValue<float>(float v) { return v; }
+
+      template <class T>
+      static void boxFilter(const char *srcData, const OfxRectI &srcBounds, int srcRowBytes,
+                            char *dstData, const OfxRectI &dstBounds, int dstRowBytes,
+                            int nComps,
+                            const std::vector<Tap> &xTaps, const std::vector<int> &xFirst,
+                            const std::vector<Tap> &yTaps, const std::vector<int> &yFirst)
+      {
+        int srcValues = (srcBounds.x2 - srcBounds.x1) * nComps;
+        int dstWidth = dstBounds.x2 - dstBounds.x1;
+        std::vector<float> row(srcValues);
+        float *sums = &row[0];
+
+        for(int y = 0; y < dstBounds.y2 - dstBounds.y1; ++y) {
+          // down the columns
+          for(int i = 0; i < srcValues; ++i)
+            sums[i] = 0;
+          for(int t = yFirst[y]; t < yFirst[y + 1]; ++t) {
+            const T *src = reinterpret_cast<const T *>(srcData + ptrdiff_t(yTaps[t].index) * srcRowBytes);
+            float w = yTaps[t].weight;
+            for(int i = 0; i < srcValues; ++i)
+              sums[i] += w * src[i];
+          }
+
+          // then along the row
+          T *dst = reinterpret_cast<T *>(dstData + ptrdiff_t(y) * dstRowBytes);
+          for(int x = 0; x < dstWidth; ++x) {
+            float pixel[4] = {0, 0, 0, 0};
+            for(int t = xFirst[x]; t < xFirst[x + 1]; ++t) {
+              const float *s = sums + xTaps[t].index * nComps;
+              float w = xTaps[t].weight;
+              for(int c = 0; c < nComps; ++c)
+                pixel[c] += w * s[c];
+            }
+            for(int c = 0; c < nComps; ++c)
+              dst[x * nComps + c] = storeValue<T>(pixel[c]);
+          }
+        }
+      }
+
+      /// map pixel bounds to a scale ratio times coarser
+      static OfxRectI scaleBounds(const OfxRectI &r, double ratioX, double ratioY)
+      {
+        OfxRectI s;
+        s.x1 = int(std::floor(r.x1 / ratioX + kScaleTolerance));
+        s.y1 = int(std::floor(r.y1 / ratioY + kScaleTolerance));
+        s.x2 = int(std::ceil(r.x2 / ratioX - kScaleTolerance));
+        s.y2 = int(std::ceil(r.y2 / ratioY - kScaleTolerance));
+        return s;
+      }
+
+      Image *downsampleImage(ClipInstance &clip,
+                             Image &src,
+                             OfxPointD renderScale,
+                             ImageBufferPool &pool,
+                             const std::string &frameIdentifier)
+      {
+        const char *srcData = static_cast<const char *>(src.getPointerProperty(kOfxImagePropData));
+        const std::string &depth = src.getStringProperty(kOfxImageEffectPropPixelDepth);
+        const std::string &components = src.getStringProperty(kOfxImageEffectPropComponents);
+        int nComps = getComponentCount(components);
+        int bytesPerComp = getBytesPerComponent(depth);
+        if(!srcData || nComps == 0 || nComps > 4 || depth == kOfxBitDepthHalf || bytesPerComp == 0)
+          return NULL;
+
+        OfxPointD srcScale;
+        srcScale.x = src.getDoubleProperty(kOfxImageEffectPropRenderScale, 0);
+        srcScale.y = src.getDoubleProperty(kOfxImageEffectPropRenderScale, 1);
+        if(renderScale.x <= 0 || renderScale.y <= 0 ||
+           renderScale.x > srcScale.x * (1 + kScaleTolerance) ||
+           renderScale.y > srcScale.y * (1 + kScaleTolerance))
+          return NULL;
+
+        double ratioX = srcScale.x / renderScale.x;
+        double ratioY = srcScale.y / renderScale.y;
+        OfxRectI srcBounds = src.getBounds();
+        OfxRectI dstBounds = scaleBounds(srcBounds, ratioX, ratioY);
+        int width = Maximum(0, dstBounds.x2 - dstBounds.x1);
+        int height = Maximum(0, dstBounds.y2 - dstBounds.y1);
+        int dstRowBytes = width * nComps * bytesPerComp;
+        size_t nBytes = size_t(dstRowBytes) * height;
+        char *buffer = static_cast<char *>(pool.acquire(nBytes));
+        if(!buffer)
+          return NULL;
+
+        if(width > 0 && height > 0) {
+          std::vector<Tap> xTaps, yTaps;
+          std::vector<int> xFirst, yFirst;
+          makeTaps(srcBounds.x1, srcBounds.x2, dstBounds.x1, dstBounds.x2, ratioX, xTaps, xFirst);
+          makeTaps(srcBounds.y1, srcBounds.y2, dstBounds.y1, dstBounds.y2, ratioY, yTaps, yFirst);
+
+          int srcRowBytes = src.getIntProperty(kOfxImagePropRowBytes);
+          if(bytesPerComp == 1)
+            boxFilter<unsigned char>(srcData, srcBounds, srcRowBytes, buffer, dstBounds, dstRowBytes, nComps,
+                                     xTaps, xFirst, yTaps, yFirst);
+          else if(bytesPerComp == 2)
+            boxFilter<unsigned short>(srcData, srcBounds, srcRowBytes, buffer, dstBounds, dstRowBytes, nComps,
+                                      xTaps, xFirst, yTaps, yFirst);
+          else
+            boxFilter<float>(srcData, srcBounds, srcRowBytes, buffer, dstBounds, dstRowBytes, nComps,
+                             xTaps, xFirst, yTaps, yFirst);
+        }
+
+        // plugins keying their own caches on the identifier need to tell the scales apart
+        std::ostringstream identifier;
+        identifier << (frameIdentifier.empty() ? src.getStringProperty(kOfxImagePropUniqueIdentifier) : frameIdentifier)
+                   << "@" << renderScale.x << "x" << renderScale.y;
+
+        Image *image = new ConvertedImage(clip, pool, buffer, nBytes,
+                                          renderScale.x, renderScale.y,
+                                          dstBounds, scaleBounds(src.getROD(), ratioX, ratioY), dstRowBytes,
+                                          src.getStringProperty(kOfxImagePropField),
+                                          identifier.str());
+
+        // the pixels are as they were, not as the clip has them
+        image->setStringProperty(kOfxImageEffectPropPixelDepth, depth);
+        image->setStringProperty(kOfxImageEffectPropComponents, components);
+        image->setStringProperty(kOfxImageEffectPropPreMultiplication, src.getStringProperty(kOfxImageEffectPropPreMultiplication));
+        image->setDoubleProperty(kOfxImagePropPixelAspectRatio, src.getDoubleProperty(kOfxImagePropPixelAspectRatio));
+        return image;
+      }
+
+      ////////////////////////////////////////////////////////////////////////////////
+      // ImagePyramid
+
+      ImagePyramid::Stats::Stats()
+        : hits(0)
+        , builds(0)
+        , misses(0)
+        , evictions(0)
+      {
+      }
+
+      ImagePyramid::ImagePyramid(size_t maxBytes)
+        : _pool(ImageBufferPool::getDefault())
+        , _maxBytes(maxBytes)
+        , _bytes(0)
+        , _clock(0)
+      {
+      }
+
+      ImagePyramid::ImagePyramid(size_t maxBytes, ImageBufferPool &pool)
+        : _pool(pool)
+        , _maxBytes(maxBytes)
+        , _bytes(0)
+        , _clock(0)
+      {
+      }
+
+      ImagePyramid::~ImagePyramid()
+      {
+        clear();
+      }
+
+      ImagePyramid::Level *ImagePyramid::findLevel(Frame &frame, OfxPointD scale)
+      {
+        for(size_t i = 0; i < frame.levels.size(); ++i)
+          if(sameScale(frame.levels[i].scale, scale))
+            return &frame.levels[i];
+        return NULL;
+      }
+
+      ImagePyramid::Level *ImagePyramid::findFinerLevel(Frame &frame, OfxPointD scale)
+      {
+        Level *best = NULL;
+        for(size_t i = 0; i < frame.levels.size(); ++i) {
+          Level &level = frame.levels[i];
+          if(level.scale.x < scale.x * (1 - kScaleTolerance) || level.scale.y < scale.y * (1 - kScaleTolerance))
+            continue;
+          if(!best || level.scale.x * level.scale.y < best->scale.x * best->scale.y)
+            best = &level;
+        }
+        return best;
+      }
+
+      void ImagePyramid::addLevel(Frame &frame, OfxPointD scale, Image *image)
+      {
+        OfxRectI bounds = image->getBounds();
+        size_t bytes = size_t(std::abs(image->getIntProperty(kOfxImagePropRowBytes))) *
+                       size_t(Maximum(0, bounds.y2 - bounds.y1));
+
+        Level *level = findLevel(frame, scale);
+        if(level) {
+          _bytes -= level->bytes;
+          level->image->releaseReference();
+        }
+        else {
+          frame.levels.push_back(Level());
+          level = &frame.levels.back();
+        }
+        level->scale = scale;
+        level->image = image;
+        level->bytes = bytes;
+        level->lastUse = ++_clock;
+        _bytes += bytes;
+      }
+
+      void ImagePyramid::makeRoom()
+      {
+        while(_bytes > _maxBytes && !_frames.empty()) {
+          // the least recently used level of any frame
+          std::map<FrameKey, Frame>::iterator oldestFrame = _frames.end();
+          size_t oldest = 0;
+          size_t oldestUse = 0;
+          for(std::map<FrameKey, Frame>::iterator it = _frames.begin(); it != _frames.end(); ++it) {
+            std::vector<Level> &levels = it->second.levels;
+            for(size_t i = 0; i < levels.size(); ++i) {
+              if(oldestFrame == _frames.end() || levels[i].lastUse < oldestUse) {
+                oldestFrame = it;
+                oldest = i;
+                oldestUse = levels[i].lastUse;
+              }
+            }
+          }
+          if(oldestFrame == _frames.end())
+            break;
+
+          std::vector<Level> &levels = oldestFrame->second.levels;
+          _bytes -= levels[oldest].bytes;
+          levels[oldest].image->releaseReference();
+          levels.erase(levels.begin() + oldest);
+          if(levels.empty())
+            _frames.erase(oldestFrame);
+          ++_stats.evictions;
+        }
+      }
+
+      void ImagePyramid::releaseFrame(Frame &frame)
+      {
+        for(size_t i = 0; i < frame.levels.size(); ++i) {
+          _bytes -= frame.levels[i].bytes;
+          frame.levels[i].image->releaseReference();
+        }
+        frame.levels.clear();
+      }
+
+      void ImagePyramid::insert(ClipInstance &clip, OfxTime time, Image *image)
+      {
+        if(!image)
+          return;
+
+        OfxPointD scale;
+        scale.x = image->getDoubleProperty(kOfxImageEffectPropRenderScale, 0);
+        scale.y = image->getDoubleProperty(kOfxImageEffectPropRenderScale, 1);
+        const std::string &identifier = image->getStringProperty(kOfxImagePropUniqueIdentifier);
+
+        std::lock_guard<std::mutex> guard(_lock);
+        Frame &frame = _frames[FrameKey(&clip, time)];
+        if(frame.uniqueIdentifier != identifier) {
+          releaseFrame(frame);
+          frame.uniqueIdentifier = identifier;
+        }
+        image->addReference();
+        addLevel(frame, scale, image);
+        makeRoom();
+      }
+
+      Image *ImagePyramid::fetch(ClipInstance &clip, OfxTime time, OfxPointD renderScale)
+      {
+        FrameKey key(&clip, time);
+        Image *src = NULL;
+        OfxPointD srcScale;
+        std::string identifier;
+        {
+          std::lock_guard<std::mutex> guard(_lock);
+          std::map<FrameKey, Frame>::iterator it = _frames.find(key);
+          if(it == _frames.end()) {
+            ++_stats.misses;
+            return NULL;
+          }
+
+          Level *level = findLevel(it->second, renderScale);
+          if(level) {
+            ++_stats.hits;
+            level->lastUse = ++_clock;
+            level->image->addReference();
+            return level->image;
+          }
+
+          level = findFinerLevel(it->second, renderScale);
+          if(!level) {
+            ++_stats.misses;
+            return NULL;
+          }
+          level->lastUse = ++_clock;
+          src = level->image;
+          src->addReference();
+          srcScale = level->scale;
+          identifier = it->second.uniqueIdentifier;
+        }
+
+        // halve down to within a factor of two, then filter to the exact scale, keeping each level
+        while(true) {
+          OfxPointD scale;
+          scale.x = srcScale.x * 0.5 >= renderScale.x * (1 - kScaleTolerance) ? srcScale.x * 0.5 : renderScale.x;
+          scale.y = srcScale.y * 0.5 >= renderScale.y * (1 - kScaleTolerance) ? srcScale.y * 0.5 : renderScale.y;
+
+          Image *image = downsampleImage(clip, *src, scale, _pool, identifier);
+          src->releaseReference();
+
+          std::lock_guard<std::mutex> guard(_lock);
+          if(!image) {
+            ++_stats.misses;
+            return NULL;
+          }
+          ++_stats.builds;
+
+          // keep it, unless the frame changed while we built it, or someone beat us to it
+          std::map<FrameKey, Frame>::iterator it = _frames.find(key);
+          if(it != _frames.end() && it->second.uniqueIdentifier == identifier) {
+            Level *level = findLevel(it->second, scale);
+            if(level) {
+              image->releaseReference();
+              image = level->image;
+              image->addReference();
+              level->lastUse = ++_clock;
+            }
+            else {
+              image->addReference();
+              addLevel(it->second, scale, image);
+              makeRoom();
+            }
+          }
+
+          if(sameScale(scale, renderScale))
+            return image;
+          src = image;
+          srcScale = scale;
+        }
+      }
+
+      void ImagePyramid::erase(const ClipInstance &clip, OfxTime time)
+      {
+        std::lock_guard<std::mutex> guard(_lock);
+        std::map<FrameKey, Frame>::iterator it = _frames.find(FrameKey(&clip, time));
+        if(it != _frames.end()) {
+          releaseFrame(it->second);
+          _frames.erase(it);
+        }
+      }
+
+      void ImagePyramid::erase(const ClipInstance &clip)
+      {
+        std::lock_guard<std::mutex> guard(_lock);
+        std::map<FrameKey, Frame>::iterator it = _frames.lower_bound(FrameKey(&clip, -HUGE_VAL));
+        while(it != _frames.end() && it->first.first == &clip) {
+          releaseFrame(it->second);
+          _frames.erase(it++);
+        }
+      }
+
+      void ImagePyramid::clear()
+      {
+        std::lock_guard<std::mutex> guard(_lock);
+        for(std::map<FrameKey, Frame>::iterator it = _frames.begin(); it != _frames.end(); ++it)
+          releaseFrame(it->second);
+        _frames.clear();
+      }
+
+      void ImagePyramid::setMaxBytes(size_t maxBytes)
+      {
+        std::lock_guard<std::mutex> guard(_lock);
+        _maxBytes = maxBytes;
+        makeRoom();
+      }
+
+      size_t ImagePyramid::getBytes() const
+      {
+        std::lock_guard<std::mutex> guard(_lock);
+        return _bytes;
+      }
+
+      ImagePyramid::Stats ImagePyramid::getStats() const
+      {
+        std::lock_guard<std::mutex> guard(_lock);
+        return _stats;
+      }
+
+      void ImagePyramid::printStats(std::ostream &os) const
+      {
+        Stats stats = getStats();
+        os << "  hits " << stats.hits
+           << " levels built " << stats.builds
+           << " misses " << stats.misses
+           << " evictions " << stats.evictions
+           << " MB held " << getBytes() / double(1 << 20) << std::endl;
+      }
+
+    } // namespace ImageEffect
+
+  } // namespace Host
+
+} // namespace OFX
@@ -13,7 +13,11 @@
 #include "ofxhParam.h"
 #include "ofxhMemory.h"
 #include "ofxhImageEffect.h"
+#include "ofxhPluginAPICache.h"
+#include "ofxhPluginCache.h"
+#include "ofxhImageEffectAPI.h"
 #include "ofxhInteract.h"
+#include "ofxhTrace.h"
 #include "ofxOld.h" // old plugins may rely on deprecated properties being present
 
 namespace OFX {
@@ -115,6 +119,8 @@ namespace OFX {
         , _state(desc.getState())
         , _effectInstance(effectInstance)
         , _argProperties(interactArgsStuffs)
+        , _redrawPending(false)
+        , _throttleRedraws(false)
       {
         _properties.setPointerProperty(kOfxPropEffectInstance, effectInstance);
         _properties.setChainedSet(&desc.getProperties()); /// chain it into the descriptor props
@@ -142,6 +148,17 @@ namespace OFX {
       OfxStatus Instance::callEntry(const char *action, Property::Set *inArgs)
       {
         if(_state != eFailed) {
+          Trace::Span span("interact", action);
+          if(span.isActive()) {
+            // name the plugin from the effect we are an interact for
+            ImageEffect::Base *effectBase = reinterpret_cast<ImageEffect::Base*>(_effectInstance);
+            ImageEffect::Instance *effectInstance = (effectBase && effectBase->verifyMagic()) ? dynamic_cast<ImageEffect::Instance*>(effectBase) : NULL;
+            if(effectInstance && effectInstance->getPlugin())
+              span.setPluginId(effectInstance->getPlugin()->getIdentifier());
+            if(inArgs)
+              span.addArgs(*inArgs);
+          }
+
           OfxPropertySetHandle inHandle = inArgs ? inArgs->getHandle() : NULL ;
           return _descriptor.callEntry(action, getHandle(), inHandle, NULL);
         }
@@ -371,6 +388,177 @@ namespace OFX {
         return callEntry(kOfxInteractActionLoseFocus,&_argProperties);
       }
 
+      OfxStatus Instance::requestRedraw()
+      {
+        {
+          std::lock_guard<std::mutex> guard(_eventLock);
+          if(_throttleRedraws) {
+            _redrawPending = true;
+            return kOfxStatOK;
+          }
+        }
+        return redraw();
+      }
+
+      void Instance::setRedrawThrottling(bool v)
+      {
+        std::lock_guard<std::mutex> guard(_eventLock);
+        _throttleRedraws = v;
+      }
+
+      void Instance::queueEvent(const QueuedEvent &event)
+      {
+        std::lock_guard<std::mutex> guard(_eventLock);
+        if(event.action == kOfxInteractActionPenMotion && !_eventQueue.empty()) {
+          QueuedEvent &last = _eventQueue.back();
+          if(last.action == kOfxInteractActionPenMotion &&
+             last.time == event.time &&
+             last.renderScale.x == event.renderScale.x &&
+             last.renderScale.y == event.renderScale.y) {
+            last.penPos = event.penPos;
+            last.penPosViewport = event.penPosViewport;
+            last.pressure = event.pressure;
+            return;
+          }
+        }
+        _eventQueue.push_back(event);
+      }
+
+      /// make an event with the args all actions have
+      static QueuedEvent makeEvent(const char *action, OfxTime time, const OfxPointD &renderScale)
+      {
+        QueuedEvent event;
+        event.action = action;
+        event.time = time;
+        event.renderScale = renderScale;
+        event.penPos.x = event.penPos.y = 0;
+        event.penPosViewport.x = event.penPosViewport.y = 0;
+        event.pressure = 0;
+        event.key = 0;
+        return event;
+      }
+
+      /// make a pen event
+      static QueuedEvent makePenEvent(const char *action, OfxTime time, const OfxPointD &renderScale,
+                                      const OfxPointD &penPos, const OfxPointI &penPosViewport, double pressure)
+      {
+        QueuedEvent event = makeEvent(action, time, renderScale);
+        event.penPos = penPos;
+        event.penPosViewport = penPosViewport;
+        event.pressure = pressure;
+        return event;
+      }
+
+      /// make a key event
+      static QueuedEvent makeKeyEvent(const char *action, OfxTime time, const OfxPointD &renderScale,
+                                      int key, const char *keyString)
+      {
+        QueuedEvent event = makeEvent(action, time, renderScale);
+        event.key = key;
+        event.keyString = keyString ? keyString : "";
+        return event;
+      }
+
+      void Instance::queuePenMotion(OfxTime time, const OfxPointD &renderScale, const OfxPointD &penPos, const OfxPointI &penPosViewport, double pressure)
+      {
+        queueEvent(makePenEvent(kOfxInteractActionPenMotion, time, renderScale, penPos, penPosViewport, pressure));
+      }
+
+      void Instance::queuePenUp(OfxTime time, const OfxPointD &renderScale, const OfxPointD &penPos, const OfxPointI &penPosViewport, double pressure)
+      {
+        queueEvent(makePenEvent(kOfxInteractActionPenUp, time, renderScale, penPos, penPosViewport, pressure));
+      }
+
+      void Instance::queuePenDown(OfxTime time, const OfxPointD &renderScale, const OfxPointD &penPos, const OfxPointI &penPosViewport, double pressure)
+      {
+        queueEvent(makePenEvent(kOfxInteractActionPenDown, time, renderScale, penPos, penPosViewport, pressure));
+      }
+
+      void Instance::queueKeyDown(OfxTime time, const OfxPointD &renderScale, int key, const char *keyString)
+      {
+        queueEvent(makeKeyEvent(kOfxInteractActionKeyDown, time, renderScale, key, keyString));
+      }
+
+      void Instance::queueKeyUp(OfxTime time, const OfxPointD &renderScale, int key, const char *keyString)
+      {
+        queueEvent(makeKeyEvent(kOfxInteractActionKeyUp, time, renderScale, key, keyString));
+      }
+
+      void Instance::queueKeyRepeat(OfxTime time, const OfxPointD &renderScale, int key, const char *keyString)
+      {
+        queueEvent(makeKeyEvent(kOfxInteractActionKeyRepeat, time, renderScale, key, keyString));
+      }
+
+      void Instance::queueGainFocus(OfxTime time, const OfxPointD &renderScale)
+      {
+        queueEvent(makeEvent(kOfxInteractActionGainFocus, time, renderScale));
+      }
+
+      void Instance::queueLoseFocus(OfxTime time, const OfxPointD &renderScale)
+      {
+        queueEvent(makeEvent(kOfxInteractActionLoseFocus, time, renderScale));
+      }
+
+      bool Instance::hasQueuedEvents()
+      {
+        std::lock_guard<std::mutex> guard(_eventLock);
+        return !_eventQueue.empty();
+      }
+
+      OfxStatus Instance::dispatchEvent(QueuedEvent &event)
+      {
+        // through the virtuals, so hosts that override the actions still see the events
+        const std::string &action = event.action;
+        if(action == kOfxInteractActionPenMotion)
+          return penMotionAction(event.time, event.renderScale, event.penPos, event.penPosViewport, event.pressure);
+        if(action == kOfxInteractActionPenUp)
+          return penUpAction(event.time, event.renderScale, event.penPos, event.penPosViewport, event.pressure);
+        if(action == kOfxInteractActionPenDown)
+          return penDownAction(event.time, event.renderScale, event.penPos, event.penPosViewport, event.pressure);
+        if(action == kOfxInteractActionKeyDown)
+          return keyDownAction(event.time, event.renderScale, event.key, &event.keyString[0]);
+        if(action == kOfxInteractActionKeyUp)
+          return keyUpAction(event.time, event.renderScale, event.key, &event.keyString[0]);
+        if(action == kOfxInteractActionKeyRepeat)
+          return keyRepeatAction(event.time, event.renderScale, event.key, &event.keyString[0]);
+        if(action == kOfxInteractActionGainFocus)
+          return gainFocusAction(event.time, event.renderScale);
+        if(action == kOfxInteractActionLoseFocus)
+          return loseFocusAction(event.time, event.renderScale);
+        return kOfxStatErrUnknown;
+      }
+
+      OfxStatus Instance::drainEvents()
+      {
+        // take the lot, events queued while we are sending these wait for the next drain
+        std::deque<QueuedEvent> events;
+        {
+          std::lock_guard<std::mutex> guard(_eventLock);
+          events.swap(_eventQueue);
+        }
+
+        OfxStatus result = kOfxStatOK;
+        for(std::deque<QueuedEvent>::iterator it = events.begin(); it != events.end(); ++it) {
+          OfxStatus stat = dispatchEvent(*it);
+          if(result == kOfxStatOK && stat != kOfxStatOK && stat != kOfxStatReplyDefault)
+            result = stat;
+        }
+
+        // one redraw for all the requests made since the last drain, including by the events above
+        bool redrawNow;
+        {
+          std::lock_guard<std::mutex> guard(_eventLock);
+          redrawNow = _redrawPending;
+          _redrawPending = false;
+        }
+        if(redrawNow) {
+          OfxStatus stat = redraw();
+          if(result == kOfxStatOK && stat != kOfxStatOK && stat != kOfxStatReplyDefault)
+            result = stat;
+        }
+        return result;
+      }
+
       ////////////////////////////////////////////////////////////////////////////////
       ////////////////////////////////////////////////////////////////////////////////
       ////////////////////////////////////////////////////////////////////////////////
@@ -394,7 +582,7 @@ namespace OFX {
         try {
         Interact::Instance *interactInstance = reinterpret_cast<Interact::Instance*>(handle);
         if(interactInstance)
-          return interactInstance->redraw();
+          return interactInstance->requestRedraw();
         else
           return kOfxStatErrBadHandle;
         } catch (...) {
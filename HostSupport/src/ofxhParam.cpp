@@ -13,6 +13,7 @@
 #include "ofxhPropertySuite.h"
 #include "ofxhParam.h"
 #include "ofxhImageEffect.h"
+#include "ofxhTrace.h"
 #include "ofxOld.h" // old plugins may rely on deprecated properties being present
 
 
@@ -20,6 +21,7 @@
 #include <float.h>
 #include <limits.h>
 #include <stdarg.h>
+#include <iterator>
 
 namespace OFX {
 
@@ -123,14 +125,14 @@ namespace OFX {
       }
       
       bool Base::getCanUndo() const {
-        if (_properties.fetchProperty(kOfxParamPropCanUndo))  {
+        if (_properties.findProperty(kOfxParamPropCanUndo))  {
           return _properties.getIntProperty(kOfxParamPropCanUndo) != 0;
         }
         return false;
       }
       
       bool Base::getCanAnimate() const {
-        if (_properties.fetchProperty(kOfxParamPropAnimates))  {
+        if (_properties.findProperty(kOfxParamPropAnimates))  {
           return _properties.getIntProperty(kOfxParamPropAnimates) != 0;
         }
         return false;
@@ -1619,6 +1621,228 @@ namespace OFX {
         return set(time, value);
       }
       
+      ////////////////////////////////////////////////////////////////////////////////
+      // custom param
+
+      /// how close two times need to be to count as the same key
+      static const double kKeyTimeTolerance = 1e-6;
+
+      CustomInstance::CustomInstance(Descriptor& descriptor, Param::SetInstance* instance)
+        : StringInstance(descriptor, instance)
+        , _value(descriptor.getProperties().getStringProperty(kOfxParamPropDefault))
+        , _generation(0)
+      {
+      }
+
+      OfxStatus CustomInstance::get(std::string &value)
+      {
+        std::lock_guard<std::mutex> guard(_lock);
+        value = _value;
+        return kOfxStatOK;
+      }
+
+      OfxStatus CustomInstance::get(OfxTime time, std::string &value)
+      {
+        // copy the keys either side out, as the plugin is called without the lock held
+        Key before, after;
+        unsigned long generation;
+        {
+          std::lock_guard<std::mutex> guard(_lock);
+          if(_keys.empty()) {
+            value = _value;
+            return kOfxStatOK;
+          }
+
+          // outside the keys, or on one, is the nearest key
+          KeyMap::const_iterator next = _keys.lower_bound(time - kKeyTimeTolerance);
+          if(next == _keys.end()) {
+            value = _keys.rbegin()->second;
+            return kOfxStatOK;
+          }
+          if(next == _keys.begin() || next->first <= time + kKeyTimeTolerance) {
+            value = next->second;
+            return kOfxStatOK;
+          }
+
+          KeyMap::const_iterator i = _interpolated.find(time);
+          if(i != _interpolated.end()) {
+            value = i->second;
+            return kOfxStatOK;
+          }
+
+          KeyMap::const_iterator prev = next;
+          --prev;
+          before = *prev;
+          after = *next;
+          generation = _generation;
+        }
+
+        // two threads may both interpolate the same time, but will get the same answer
+        OfxStatus stat = interpolate(time, before, after, value);
+        if(stat != kOfxStatOK) {
+          // hold the previous key rather than fail the fetch
+          value = before.second;
+          return kOfxStatOK;
+        }
+
+        // only keep it if the keys it came from are still the keys
+        std::lock_guard<std::mutex> guard(_lock);
+        if(generation == _generation)
+          _interpolated[time] = value;
+        return kOfxStatOK;
+      }
+
+      OfxStatus CustomInstance::set(const char *value)
+      {
+        // once animated the current value is the one at the current time, so key it there
+        TimeLine::TimeLineI *timeLine = dynamic_cast<TimeLine::TimeLineI *>(_paramSetInstance);
+        bool animated;
+        {
+          std::lock_guard<std::mutex> guard(_lock);
+          animated = !_keys.empty();
+        }
+        if(animated && timeLine)
+          return set(timeLine->timeLineGetTime(), value);
+
+        // with no time to key it at, the value holds at every time
+        std::lock_guard<std::mutex> guard(_lock);
+        _value = value;
+        if(!_keys.empty()) {
+          _keys.clear();
+          keysChanged();
+        }
+        return kOfxStatOK;
+      }
+
+      OfxStatus CustomInstance::set(OfxTime time, const char *value)
+      {
+        std::lock_guard<std::mutex> guard(_lock);
+        _value = value;
+
+        KeyMap::iterator i = _keys.lower_bound(time - kKeyTimeTolerance);
+        if(i != _keys.end() && i->first <= time + kKeyTimeTolerance)
+          i->second = value;
+        else
+          _keys[time] = value;
+        keysChanged();
+        return kOfxStatOK;
+      }
+
+      OfxStatus CustomInstance::interpolate(OfxTime time, const Key &before, const Key &after, std::string &value)
+      {
+        OfxCustomParamInterpFuncV1 *interp = (OfxCustomParamInterpFuncV1 *) getProperties().getPointerProperty(kOfxParamPropCustomInterpCallbackV1);
+        if(!interp || !_paramSetInstance)
+          return kOfxStatErrMissingHostFeature;
+
+        Property::PropSpec inSpec[] = {
+          { kOfxPropName,                     Property::eString, 1, true, "" },
+          { kOfxPropTime,                     Property::eDouble, 1, true, "0" },
+          { kOfxParamPropCustomValue,         Property::eString, 2, true, "" },
+          { kOfxParamPropInterpolationTime,   Property::eDouble, 2, true, "0" },
+          { kOfxParamPropInterpolationAmount, Property::eDouble, 1, true, "0" },
+          Property::propSpecEnd
+        };
+        Property::PropSpec outSpec[] = {
+          { kOfxParamPropCustomValue,         Property::eString, 1, false, "" },
+          Property::propSpecEnd
+        };
+        Property::Set inArgs(inSpec);
+        Property::Set outArgs(outSpec);
+
+        inArgs.setStringProperty(kOfxPropName, getName());
+        inArgs.setDoubleProperty(kOfxPropTime, time);
+        inArgs.setStringProperty(kOfxParamPropCustomValue, before.second, 0);
+        inArgs.setStringProperty(kOfxParamPropCustomValue, after.second, 1);
+        inArgs.setDoubleProperty(kOfxParamPropInterpolationTime, before.first, 0);
+        inArgs.setDoubleProperty(kOfxParamPropInterpolationTime, after.first, 1);
+        inArgs.setDoubleProperty(kOfxParamPropInterpolationAmount, (time - before.first) / (after.first - before.first));
+
+        OfxStatus stat;
+        try {
+          stat = interp(_paramSetInstance->getParamSetHandle(), inArgs.getHandle(), outArgs.getHandle());
+        }
+        catch(...) {
+          stat = kOfxStatFailed;
+        }
+#       ifdef OFX_DEBUG_PARAMETERS
+        std::cout << "OFX: " << getName() << " custom interpolation at " << time << "->" << StatStr(stat) << std::endl;
+#       endif
+
+        if(stat != kOfxStatOK)
+          return stat;
+        value = outArgs.getStringProperty(kOfxParamPropCustomValue);
+        return kOfxStatOK;
+      }
+
+      void CustomInstance::keysChanged()
+      {
+        _interpolated.clear();
+        ++_generation;
+      }
+
+      OfxStatus CustomInstance::getNumKeys(unsigned int &nKeys) const
+      {
+        std::lock_guard<std::mutex> guard(_lock);
+        nKeys = (unsigned int)_keys.size();
+        return kOfxStatOK;
+      }
+
+      OfxStatus CustomInstance::getKeyTime(int nth, OfxTime& time) const
+      {
+        std::lock_guard<std::mutex> guard(_lock);
+        if(nth < 0 || nth >= int(_keys.size()))
+          return kOfxStatErrBadIndex;
+
+        KeyMap::const_iterator i = _keys.begin();
+        std::advance(i, nth);
+        time = i->first;
+        return kOfxStatOK;
+      }
+
+      OfxStatus CustomInstance::getKeyIndex(OfxTime time, int direction, int & index) const
+      {
+        std::lock_guard<std::mutex> guard(_lock);
+        index = -1;
+        KeyMap::const_iterator i;
+        if(direction == 0) {
+          i = _keys.lower_bound(time - kKeyTimeTolerance);
+          if(i == _keys.end() || i->first > time + kKeyTimeTolerance)
+            return kOfxStatFailed;
+        }
+        else if(direction > 0) {
+          i = _keys.upper_bound(time + kKeyTimeTolerance);
+          if(i == _keys.end())
+            return kOfxStatFailed;
+        }
+        else {
+          i = _keys.lower_bound(time - kKeyTimeTolerance);
+          if(i == _keys.begin())
+            return kOfxStatFailed;
+          --i;
+        }
+        index = int(std::distance(_keys.begin(), i));
+        return kOfxStatOK;
+      }
+
+      OfxStatus CustomInstance::deleteKey(OfxTime time)
+      {
+        std::lock_guard<std::mutex> guard(_lock);
+        KeyMap::iterator i = _keys.lower_bound(time - kKeyTimeTolerance);
+        if(i == _keys.end() || i->first > time + kKeyTimeTolerance)
+          return kOfxStatErrBadIndex;
+        _keys.erase(i);
+        keysChanged();
+        return kOfxStatOK;
+      }
+
+      OfxStatus CustomInstance::deleteAllKeys()
+      {
+        std::lock_guard<std::mutex> guard(_lock);
+        _keys.clear();
+        keysChanged();
+        return kOfxStatOK;
+      }
+
       //////////////////////////////////////////////////////////////////////////////////
       // Param::SetInstance
       //
@@ -1863,6 +2087,10 @@ namespace OFX {
           return kOfxStatErrBadHandle;
         }
 
+        Trace::Span span("suite", "paramGetValue");
+        if(span.isActive())
+          span.addArg("param", paramInstance->getName().c_str());
+
         va_list ap;
         va_start(ap,paramHandle);
         OfxStatus stat = kOfxStatErrUnsupported;
@@ -1897,6 +2125,12 @@ namespace OFX {
         }
 
 
+        Trace::Span span("suite", "paramGetValueAtTime");
+        if(span.isActive()) {
+          span.addArg("param", paramInstance->getName().c_str());
+          span.addArg("time", time);
+        }
+
         va_list ap;
         va_start(ap, time);
         OfxStatus stat = kOfxStatErrUnsupported;
@@ -171,6 +171,7 @@ namespace OFX {
         , _dimension(dimension)
         , _pluginReadOnly(pluginReadOnly) 
         , _getHook(0)          
+        , _refCount(1)
       {
       }
 
@@ -180,6 +181,7 @@ namespace OFX {
         , _dimension(other._dimension)
         , _pluginReadOnly(other._pluginReadOnly) 
         , _getHook(0)          
+        , _refCount(1)
       {
       }
       
@@ -394,16 +396,61 @@ namespace OFX {
 
       Property *Set::fetchProperty(const std::string&name, bool followChain) const
       {
-        PropertyMap::const_iterator i = _props.find(name);
-        if (i == _props.end()) {
-          if(followChain && _chainedSet) {
-            return _chainedSet->fetchProperty(name, true);
+        {
+          std::lock_guard<std::mutex> guard(_propsLock);
+          PropertyMap::iterator i = _props.find(name);
+          if (i != _props.end()) {
+            // copy on write, the caller may change it, so don't let whoever we share it with see that
+            if(i->second->isShared()) {
+              Property *copyProp = i->second->deepCopy();
+              _retired.push_back(i->second);
+              i->second = copyProp;
+            }
+            return i->second;
           }
-          return NULL;
         }
-        return i->second;
+
+        if(followChain && _chainedSet) {
+          return _chainedSet->fetchProperty(name, true);
+        }
+        return NULL;
+      }
+
+      Property *Set::findProperty(const std::string&name, bool followChain) const
+      {
+        {
+          std::lock_guard<std::mutex> guard(_propsLock);
+          PropertyMap::const_iterator i = _props.find(name);
+          if (i != _props.end())
+            return i->second;
+        }
+
+        if(followChain && _chainedSet) {
+          return _chainedSet->findProperty(name, true);
+        }
+        return NULL;
+      }
+
+      template<class T> bool Set::findTypedProperty(const std::string&name, T *&prop, bool followChain) const
+      {
+        Property *myprop = findProperty(name, followChain);
+
+        if(!myprop)
+          return false;
+
+        prop = dynamic_cast<T *>(myprop);
+        if (prop == 0) {
+          return false;
+        }
+        return true;
       }
 
+      /// findTypedProperty is public, so make it for all our property types
+      template bool Set::findTypedProperty<Int>(const std::string &, Int *&, bool) const;
+      template bool Set::findTypedProperty<Double>(const std::string &, Double *&, bool) const;
+      template bool Set::findTypedProperty<String>(const std::string &, String *&, bool) const;
+      template bool Set::findTypedProperty<Pointer>(const std::string &, Pointer *&, bool) const;
+
       template<class T> bool Set::fetchTypedProperty(const std::string&name, T *&prop, bool followChain) const
       {
         Property *myprop = fetchProperty(name, followChain);
@@ -453,6 +500,7 @@ namespace OFX {
       /// add one new property
       void Set::createProperty(const PropSpec &spec)
       {
+        std::lock_guard<std::mutex> guard(_propsLock);
         if (_props.find(spec.name) != _props.end()) {
 #         ifdef OFX_DEBUG_PROPERTIES
           std::cout << "OFX: Tried to add a duplicate property to a Property::Set: " << spec.name << std::endl;
@@ -489,9 +537,10 @@ namespace OFX {
       /// add one new property
       void Set::addProperty(Property *prop)
       {
+        std::lock_guard<std::mutex> guard(_propsLock);
         PropertyMap::iterator t = _props.find(prop->getName());
         if(t != _props.end())
-           delete t->second;
+           _retired.push_back(t->second);
         _props[prop->getName()] = prop;
       }
 
@@ -515,10 +564,20 @@ namespace OFX {
       {
         bool failed = false;
 
+        // the other set may be swapping in copies of its properties on another thread
+        std::lock_guard<std::mutex> guard(other._propsLock);
         for (std::map<std::string, Property *>::const_iterator i = other._props.begin();
              i != other._props.end();
              i++) 
           {
+            // Share what we can with the other set, anything with hooks on it
+            // belongs to the other set's owner, so that needs a copy of its own.
+            if(i->second->isShareable()) {
+              i->second->addRef();
+              _props[i->first] = i->second;
+              continue;
+            }
+
             Property *copyProp = i->second->deepCopy();
             if (!copyProp) {
               failed = true;
@@ -527,23 +586,25 @@ namespace OFX {
             _props[i->first] = copyProp;
           }
         
-        if (failed)
-          
+        if (failed) {
           for (std::map<std::string, Property *>::iterator j = _props.begin();
                j != _props.end();
                j++) {
-            delete j->second;
+            j->second->release();
           }
-        
+          _props.clear();
+        }
       }
 
       Set::~Set()
       {
         std::map<std::string, Property *>::iterator i = _props.begin();
         while (i != _props.end()) {
-          delete i->second;
+          i->second->release();
           i++;
         }
+        for(size_t r = 0; r < _retired.size(); ++r)
+          _retired[r]->release();
       }
 
       /// set a particular property
@@ -585,7 +646,7 @@ namespace OFX {
       {
         try {
           PropertyTemplate<T> *prop;
-          if(fetchTypedProperty(property, prop, true)) {
+          if(findTypedProperty(property, prop, true)) {
             return prop->getValue(index);
           }
         }
@@ -598,7 +659,7 @@ namespace OFX {
       {
         try {
           PropertyTemplate<T> *prop;
-          if(fetchTypedProperty(property, prop, true)) {
+          if(findTypedProperty(property, prop, true)) {
             return prop->getValueN(value, count);
           }
         }
@@ -610,7 +671,7 @@ namespace OFX {
       {
         try {
           PropertyTemplate<T> *prop;
-          if(fetchTypedProperty(property, prop, true)) {
+          if(findTypedProperty(property, prop, true)) {
             return prop->getValueRaw(index);
           }
         }
@@ -623,7 +684,7 @@ namespace OFX {
       {
         try {
           PropertyTemplate<T> *prop;
-          if(fetchTypedProperty(property, prop, true)) {
+          if(findTypedProperty(property, prop, true)) {
             return prop->getValueNRaw(value, count);
           }
         }
@@ -652,7 +713,7 @@ namespace OFX {
       const std::string &Set::getStringPropertyRaw(const std::string &property, int index)  const
       {
         String *prop;
-        if(fetchTypedProperty(property, prop, true)) {
+        if(findTypedProperty(property, prop, true)) {
           return prop->getValueRaw(index);
         }
         return StringValue::kEmpty;
@@ -734,7 +795,7 @@ namespace OFX {
       int Set::getDimension(const std::string &property) const
       {
         Property *prop = 0;
-        if(fetchTypedProperty(property, prop, true)) {
+        if(findTypedProperty(property, prop, true)) {
           return  prop->getDimension();
         }
         return 0;
@@ -745,7 +806,8 @@ namespace OFX {
       int Set::findStringPropValueIndex(const std::string &propName,
                                         const std::string &propValue) const
       {
-        String *prop = fetchStringProperty(propName, true);
+        String *prop = 0;
+        findTypedProperty(propName, prop, true);
         
         if(prop) {
           const std::vector<std::string> &values = prop->getValues();
@@ -864,7 +926,7 @@ namespace OFX {
             return kOfxStatErrBadHandle;
           }
           PropertyTemplate<T> *prop = 0;
-          if(!thisSet->fetchTypedProperty(property, prop, true)) {
+          if(!thisSet->findTypedProperty(property, prop, true)) {
 #           ifdef OFX_DEBUG_PROPERTIES
             std::cout << ' ' << StatStr(kOfxStatErrUnknown) << std::endl;
 #           endif
@@ -906,7 +968,7 @@ namespace OFX {
             return kOfxStatErrBadHandle;
           }
           PropertyTemplate<T> *prop = 0;
-          if(!thisSet->fetchTypedProperty(property, prop, true)) {
+          if(!thisSet->findTypedProperty(property, prop, true)) {
 #           ifdef OFX_DEBUG_PROPERTIES
             std::cout << ' ' << StatStr(kOfxStatErrUnknown) << std::endl;
 #           endif
@@ -987,7 +1049,7 @@ namespace OFX {
         }
         try {            
           Set *thisSet = reinterpret_cast<Set*>(properties);
-          Property *prop = thisSet->fetchProperty(property, true);
+          Property *prop = thisSet->findProperty(property, true);
           if(!prop) {
 #           ifdef OFX_DEBUG_PROPERTIES
             std::cout << "unknown property\n";
@@ -0,0 +1,1724 @@
+// Copyright OpenFX and contributors to the OpenFX project.
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <map>
+#include <set>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <signal.h>
+#endif
+
+// ofx
+#include "ofxCore.h"
+#include "ofxImageEffect.h"
+
+// ofx host
+#include "ofxhBinary.h"
+#include "ofxhPropertySuite.h"
+#include "ofxhClip.h"
+#include "ofxhParam.h"
+#include "ofxhMemory.h"
+#include "ofxhImageEffect.h"
+#include "ofxhPluginAPICache.h"
+#include "ofxhPluginCache.h"
+#include "ofxhHost.h"
+#include "ofxhImageEffectAPI.h"
+#include "ofxhImageConvert.h"
+#include "ofxhUtilities.h"
+#include "ofxhSharedMemory.h"
+#include "ofxhIPC.h"
+#include "ofxhRemoteEffect.h"
+#include "ofxhSnapshot.h"
+
+namespace OFX {
+
+  namespace Host {
+
+    namespace ImageEffect {
+
+      /// how often a worker asks the host whether to abort, in milliseconds
+      static const int kAbortCheckInterval = 20;
+
+      /// what a message posted by a worker is
+      enum RemoteMessageKindEnum {
+        eRemoteMessagePost,
+        eRemoteMessagePersistent,
+        eRemoteMessageClear
+      };
+
+      static void putRect(IPC::Message &m, const OfxRectD &r)
+      {
+        m.putDouble(r.x1);
+        m.putDouble(r.y1);
+        m.putDouble(r.x2);
+        m.putDouble(r.y2);
+      }
+
+      static OfxRectD getRect(IPC::Message &m)
+      {
+        OfxRectD r;
+        r.x1 = m.getDouble();
+        r.y1 = m.getDouble();
+        r.x2 = m.getDouble();
+        r.y2 = m.getDouble();
+        return r;
+      }
+
+      /// Get a param's value at a time as doubles, or a string, returning
+      /// false if it is a sort that has no value.
+      static bool getParamValue(Param::Instance &param, OfxTime time, std::vector<double> &values, std::string &str)
+      {
+        return getParamValue(param, &time, values, str) == kOfxStatOK;
+      }
+
+      /// where the rows of an image that are inside a render window are
+      struct WindowRows {
+        ptrdiff_t first;      ///< offset of the first one from the data pointer
+        int       rowBytes;   ///< from one row to the next
+        size_t    length;     ///< bytes in each
+        int       nRows;
+
+        size_t getBytes() const {return length * size_t(nRows);}
+      };
+
+      /// Find the rows of an image inside a window, so tiles rendered
+      /// elsewhere only land on their own part of the image. Images with
+      /// pixels we don't know the size of are done a whole row at a time.
+      static WindowRows getWindowRows(Image &image, const OfxRectI &window)
+      {
+        OfxRectI bounds = image.getBounds();
+        int pixelBytes = getBytesPerComponent(image.getStringProperty(kOfxImageEffectPropPixelDepth)) *
+          getComponentCount(image.getStringProperty(kOfxImageEffectPropComponents));
+
+        WindowRows rows;
+        rows.rowBytes = image.getIntProperty(kOfxImagePropRowBytes);
+        int x1 = pixelBytes ? Maximum(bounds.x1, window.x1) : bounds.x1;
+        int x2 = pixelBytes ? Minimum(bounds.x2, window.x2) : bounds.x2;
+        int y1 = Maximum(bounds.y1, window.y1);
+        int y2 = Minimum(bounds.y2, window.y2);
+        if(x2 <= x1 || y2 <= y1) {
+          rows.first = 0;
+          rows.length = 0;
+          rows.nRows = 0;
+          return rows;
+        }
+        rows.first = ptrdiff_t(y1 - bounds.y1) * rows.rowBytes + ptrdiff_t(x1 - bounds.x1) * pixelBytes;
+        rows.length = pixelBytes ? size_t(x2 - x1) * pixelBytes : size_t(rows.rowBytes < 0 ? -rows.rowBytes : rows.rowBytes);
+        rows.nRows = y2 - y1;
+        return rows;
+      }
+
+      /// copy the rows in a window between two images laid out the same
+      static void copyWindowRows(char *dstData, const char *srcData, const WindowRows &rows)
+      {
+        for(int i = 0; i < rows.nRows; ++i) {
+          ptrdiff_t offset = rows.first + ptrdiff_t(i) * rows.rowBytes;
+          memcpy(dstData + offset, srcData + offset, rows.length);
+        }
+      }
+
+      static void putParamValue(IPC::Message &m, const std::vector<double> &values, const std::string &str)
+      {
+        m.putInt(int(values.size()));
+        for(size_t i = 0; i < values.size(); ++i)
+          m.putDouble(values[i]);
+        m.putString(str);
+      }
+
+      static void getParamValue(IPC::Message &m, std::vector<double> &values, std::string &str)
+      {
+        int n = m.getInt();
+        values.clear();
+        for(int i = 0; i < n && m.ok(); ++i)
+          values.push_back(m.getDouble());
+        str = m.getString();
+      }
+
+      ////////////////////////////////////////////////////////////////////////////////
+      // what is sent with each render, the writers run in the host, the readers in the worker
+
+      /// the args to a sequence render
+      struct SequenceArgs {
+        OfxTime   start, end, step;
+        bool      interactive;
+        OfxPointD renderScale;
+        bool      sequential;
+        bool      interactiveRender;
+
+        void put(IPC::Message &m) const
+        {
+          m.putDouble(start);
+          m.putDouble(end);
+          m.putDouble(step);
+          m.putInt(interactive);
+          m.putDouble(renderScale.x);
+          m.putDouble(renderScale.y);
+          m.putInt(sequential);
+          m.putInt(interactiveRender);
+        }
+
+        void get(IPC::Message &m)
+        {
+          start = m.getDouble();
+          end = m.getDouble();
+          step = m.getDouble();
+          interactive = m.getInt() != 0;
+          renderScale.x = m.getDouble();
+          renderScale.y = m.getDouble();
+          sequential = m.getInt() != 0;
+          interactiveRender = m.getInt() != 0;
+        }
+      };
+
+      /// a clip as it is for a render
+      struct ClipSnapshot {
+        std::string unmappedDepth, unmappedComponents, pixelDepth, components, premult, fieldOrder;
+        double      aspectRatio, frameRate, frameStart, frameEnd;
+        double      unmappedFrameRate, unmappedFrameStart, unmappedFrameEnd;
+        bool        connected, continuousSamples;
+        OfxRectD    rod;     ///< at the render time
+
+        ClipSnapshot()
+          : aspectRatio(1), frameRate(25), frameStart(0), frameEnd(0)
+          , unmappedFrameRate(25), unmappedFrameStart(0), unmappedFrameEnd(0)
+          , connected(false), continuousSamples(false)
+        {
+          rod.x1 = rod.y1 = rod.x2 = rod.y2 = 0;
+        }
+
+        static void put(IPC::Message &m, ClipInstance &clip, OfxTime time)
+        {
+          double a, b;
+          m.putString(clip.getUnmappedBitDepth());
+          m.putString(clip.getUnmappedComponents());
+          m.putString(clip.getPixelDepth());
+          m.putString(clip.getComponents());
+          m.putString(clip.getPremult());
+          m.putString(clip.getFieldOrder());
+          m.putDouble(clip.getAspectRatio());
+          m.putDouble(clip.getFrameRate());
+          clip.getFrameRange(a, b);
+          m.putDouble(a);
+          m.putDouble(b);
+          m.putDouble(clip.getUnmappedFrameRate());
+          clip.getUnmappedFrameRange(a, b);
+          m.putDouble(a);
+          m.putDouble(b);
+          m.putInt(clip.getConnected());
+          m.putInt(clip.getContinuousSamples());
+          putRect(m, clip.getRegionOfDefinition(time));
+        }
+
+        void get(IPC::Message &m)
+        {
+          unmappedDepth = m.getString();
+          unmappedComponents = m.getString();
+          pixelDepth = m.getString();
+          components = m.getString();
+          premult = m.getString();
+          fieldOrder = m.getString();
+          aspectRatio = m.getDouble();
+          frameRate = m.getDouble();
+          frameStart = m.getDouble();
+          frameEnd = m.getDouble();
+          unmappedFrameRate = m.getDouble();
+          unmappedFrameStart = m.getDouble();
+          unmappedFrameEnd = m.getDouble();
+          connected = m.getInt() != 0;
+          continuousSamples = m.getInt() != 0;
+          rod = getRect(m);
+        }
+      };
+
+      /// a param's value for a render
+      struct ParamSnapshot {
+        bool                animated;   ///< if not, the value is the same at any time
+        std::vector<double> values;
+        std::string         str;
+      };
+
+      /// an instance as it is for a render
+      struct InstanceSnapshot {
+        double      projectSize[2], projectOffset[2], projectExtent[2];
+        double      pixelAspectRatio, duration, frameRate;
+        std::string defaultFielding, outputFielding, outputPremult;
+        double      outputFrameRate;
+        bool        continuousSamples, frameVarying;
+        double      timeLineTime, timeLineStart, timeLineEnd;
+        std::map<std::string, ClipSnapshot>  clips;
+        std::map<std::string, ParamSnapshot> params;
+
+        InstanceSnapshot()
+          : pixelAspectRatio(1), duration(0), frameRate(25), outputFrameRate(25)
+          , continuousSamples(false), frameVarying(false)
+          , timeLineTime(0), timeLineStart(0), timeLineEnd(0)
+        {
+          projectSize[0] = projectSize[1] = projectOffset[0] = projectOffset[1] = projectExtent[0] = projectExtent[1] = 0;
+        }
+
+        static void put(IPC::Message &m, Instance &instance, OfxTime time)
+        {
+          double x, y;
+          instance.getProjectSize(x, y);
+          m.putDouble(x);
+          m.putDouble(y);
+          instance.getProjectOffset(x, y);
+          m.putDouble(x);
+          m.putDouble(y);
+          instance.getProjectExtent(x, y);
+          m.putDouble(x);
+          m.putDouble(y);
+          m.putDouble(instance.getProjectPixelAspectRatio());
+          m.putDouble(instance.getEffectDuration());
+          m.putDouble(instance.getFrameRate());
+          m.putString(instance.getDefaultOutputFielding());
+          m.putString(instance.getOutputFielding());
+          m.putString(instance.getOutputPreMultiplication());
+          m.putDouble(instance.getOutputFrameRate());
+          m.putInt(instance.continuousSamples());
+          m.putInt(instance.isFrameVarying());
+          m.putDouble(instance.timeLineGetTime());
+          instance.timeLineGetBounds(x, y);
+          m.putDouble(x);
+          m.putDouble(y);
+
+          m.putInt(instance.getNClips());
+          for(int i = 0; i < instance.getNClips(); ++i) {
+            ClipInstance *clip = instance.getNthClip(i);
+            m.putString(clip->getName());
+            ClipSnapshot::put(m, *clip, time);
+          }
+
+          // params with a value, animated ones are fetched at other times as asked
+          std::vector<Param::Instance *> params;
+          std::vector<std::vector<double> > values;
+          std::vector<std::string> strs;
+          const std::list<Param::Instance *> &paramList = instance.getParamList();
+          for(std::list<Param::Instance *>::const_iterator it = paramList.begin(); it != paramList.end(); ++it) {
+            values.push_back(std::vector<double>());
+            strs.push_back(std::string());
+            if(getParamValue(**it, time, values.back(), strs.back()))
+              params.push_back(*it);
+            else {
+              values.pop_back();
+              strs.pop_back();
+            }
+          }
+
+          m.putInt(int(params.size()));
+          for(size_t i = 0; i < params.size(); ++i) {
+            Param::KeyframeParam *keys = dynamic_cast<Param::KeyframeParam *>(params[i]);
+            unsigned int nKeys = 0;
+            bool animated = !keys || keys->getNumKeys(nKeys) != kOfxStatOK || nKeys > 0;
+            m.putString(params[i]->getName());
+            m.putInt(animated);
+            putParamValue(m, values[i], strs[i]);
+          }
+        }
+
+        void get(IPC::Message &m)
+        {
+          for(int i = 0; i < 2; ++i)
+            projectSize[i] = m.getDouble();
+          for(int i = 0; i < 2; ++i)
+            projectOffset[i] = m.getDouble();
+          for(int i = 0; i < 2; ++i)
+            projectExtent[i] = m.getDouble();
+          pixelAspectRatio = m.getDouble();
+          duration = m.getDouble();
+          frameRate = m.getDouble();
+          defaultFielding = m.getString();
+          outputFielding = m.getString();
+          outputPremult = m.getString();
+          outputFrameRate = m.getDouble();
+          continuousSamples = m.getInt() != 0;
+          frameVarying = m.getInt() != 0;
+          timeLineTime = m.getDouble();
+          timeLineStart = m.getDouble();
+          timeLineEnd = m.getDouble();
+
+          int nClips = m.getInt();
+          for(int i = 0; i < nClips && m.ok(); ++i) {
+            std::string name = m.getString();
+            clips[name].get(m);
+          }
+
+          int nParams = m.getInt();
+          for(int i = 0; i < nParams && m.ok(); ++i) {
+            std::string name = m.getString();
+            ParamSnapshot &param = params[name];
+            param.animated = m.getInt() != 0;
+            getParamValue(m, param.values, param.str);
+          }
+        }
+      };
+
+      ////////////////////////////////////////////////////////////////////////////////
+      // the host side
+
+      /// post a formatted message on an instance
+      static OfxStatus postMessage(Instance &instance, int kind, const char *type, const char *id, const char *format, ...)
+      {
+        va_list args;
+        va_start(args, format);
+        OfxStatus st;
+        if(kind == eRemoteMessagePersistent)
+          st = instance.setPersistentMessage(type, id, format, args);
+        else
+          st = instance.vmessage(type, id, format, args);
+        va_end(args);
+        return st;
+      }
+
+      /// Services the callbacks of one render in a worker, and keeps the
+      /// images it fetched till the render is over.
+      class RemoteRenderCall : public IPC::CallbackI {
+      protected :
+        /// an image the worker has, and the shared memory its pixels are in
+        struct FetchedImage {
+          Image               *image;
+          Memory::SharedBlock *copy;     ///< if the pixels weren't shared already
+          char                *data;     ///< the data pointer
+          char                *pixels;   ///< lowest address of the pixels
+          size_t               bytes;
+          bool                 output;
+        };
+
+        Instance                  &_instance;
+        OfxRectI                   _window;        ///< being rendered
+        bool                       _inlinePixels;  ///< send pixels in the messages, as the worker can't share memory
+        std::vector<FetchedImage>  _images;
+
+        void getImage(IPC::Message &request, IPC::Message &reply);
+
+      public :
+        RemoteRenderCall(Instance &instance, const OfxRectI &window, bool inlinePixels)
+          : _instance(instance)
+          , _window(window)
+          , _inlinePixels(inlinePixels)
+        {
+        }
+
+        ~RemoteRenderCall()
+        {
+          finish(false);
+        }
+
+        /// Read the pixels of the output images from the worker's reply,
+        /// if they were sent inline, false if the reply is bad.
+        bool readOutputs(IPC::Message &reply);
+
+        /// copy any output pixels that went through a copy back, then let the images go
+        void finish(bool rendered);
+
+        virtual void callback(IPC::Message &request, IPC::Message &reply);
+      };
+
+      void RemoteRenderCall::getImage(IPC::Message &request, IPC::Message &reply)
+      {
+        std::string clipName = request.getString();
+        OfxTime time = request.getDouble();
+        bool haveBounds = request.getInt() != 0;
+        OfxRectD bounds = getRect(request);
+
+        ClipInstance *clip = _instance.getClip(clipName);
+        Image *image = clip && request.ok() ? clip->getImage(time, haveBounds ? &bounds : 0) : 0;
+        char *data = image ? (char *) image->getPointerProperty(kOfxImagePropData) : 0;
+        if(!data) {
+          if(image)
+            image->releaseReference();
+          reply.putInt(0);
+          return;
+        }
+
+        // rows may go down in memory, in which case the data pointer is at the top of the block
+        OfxRectI pixelBounds = image->getBounds();
+        int rowBytes = image->getIntProperty(kOfxImagePropRowBytes);
+        size_t nRows = pixelBounds.y2 > pixelBounds.y1 ? pixelBounds.y2 - pixelBounds.y1 : 0;
+        FetchedImage fetched;
+        fetched.image = image;
+        fetched.copy = 0;
+        fetched.data = data;
+        fetched.pixels = rowBytes < 0 && nRows ? data + (ptrdiff_t) rowBytes * ptrdiff_t(nRows - 1) : data;
+        fetched.bytes = size_t(rowBytes < 0 ? -rowBytes : rowBytes) * nRows;
+        fetched.output = clip->isOutput();
+
+        size_t dataOffset = data - fetched.pixels;
+        if(_inlinePixels) {
+          // the output's pixels come back with the reply
+          _images.push_back(fetched);
+          reply.putInt(1);
+          reply.putInt(int(_images.size() - 1));
+          reply.putInt(1);
+          reply.putBytes(&fetched.bytes, sizeof(fetched.bytes));
+          reply.putBytes(&dataOffset, sizeof(dataOffset));
+          reply.putInt(!fetched.output);
+          if(!fetched.output)
+            reply.putBytes(fetched.pixels, fetched.bytes);
+          reply.putProperties(*image);
+          return;
+        }
+
+        size_t offset = 0;
+        Memory::SharedBlock *block = Memory::SharedBlock::find(fetched.pixels, fetched.bytes, offset);
+        if(!block) {
+          fetched.copy = new Memory::SharedBlock;
+          if(!fetched.copy->create(fetched.bytes)) {
+            delete fetched.copy;
+            image->releaseReference();
+            reply.putInt(0);
+            return;
+          }
+          // the output's pixels are all about to be rendered over
+          if(!fetched.output)
+            memcpy(fetched.copy->getPtr(), fetched.pixels, fetched.bytes);
+          block = fetched.copy;
+          offset = 0;
+        }
+        _images.push_back(fetched);
+
+        size_t blockSize = block->getSize();
+        dataOffset += offset;
+        reply.putInt(1);
+        reply.putInt(int(_images.size() - 1));
+        reply.putInt(0);
+        reply.putFd(block->getFd());
+        reply.putBytes(&blockSize, sizeof(blockSize));
+        reply.putBytes(&dataOffset, sizeof(dataOffset));
+        reply.putProperties(*image);
+      }
+
+      bool RemoteRenderCall::readOutputs(IPC::Message &reply)
+      {
+        std::vector<char> buffer;
+        int n = reply.getInt();
+        for(int i = 0; i < n && reply.ok(); ++i) {
+          int id = reply.getInt();
+          if(id < 0 || id >= int(_images.size()) || !_images[id].output)
+            return false;
+          FetchedImage &fetched = _images[id];
+          WindowRows rows = getWindowRows(*fetched.image, _window);
+          buffer.resize(rows.getBytes());
+          reply.getBytes(buffer.data(), buffer.size());
+          if(!reply.ok())
+            return false;
+          for(int r = 0; r < rows.nRows; ++r)
+            memcpy(fetched.data + rows.first + ptrdiff_t(r) * rows.rowBytes, &buffer[size_t(r) * rows.length], rows.length);
+        }
+        return reply.ok();
+      }
+
+      void RemoteRenderCall::finish(bool rendered)
+      {
+        for(size_t i = 0; i < _images.size(); ++i) {
+          FetchedImage &fetched = _images[i];
+          if(fetched.copy) {
+            // only the window, other renders may be filling in the rest
+            if(rendered && fetched.output) {
+              char *copyData = (char *) fetched.copy->getPtr() + (fetched.data - fetched.pixels);
+              copyWindowRows(fetched.data, copyData, getWindowRows(*fetched.image, _window));
+            }
+            delete fetched.copy;
+          }
+          fetched.image->releaseReference();
+        }
+        _images.clear();
+      }
+
+      void RemoteRenderCall::callback(IPC::Message &request, IPC::Message &reply)
+      {
+        switch(request.getType()) {
+        case eRemoteGetImage :
+          getImage(request, reply);
+          break;
+
+        case eRemoteGetRegionOfDefinition : {
+          std::string clipName = request.getString();
+          OfxTime time = request.getDouble();
+          ClipInstance *clip = _instance.getClip(clipName);
+          reply.putInt(clip != 0);
+          if(clip)
+            putRect(reply, clip->getRegionOfDefinition(time));
+          break;
+        }
+
+        case eRemoteGetParam : {
+          std::string paramName = request.getString();
+          OfxTime time = request.getDouble();
+          Param::Instance *param = _instance.getParam(paramName);
+          std::vector<double> values;
+          std::string str;
+          bool ok = param && getParamValue(*param, time, values, str);
+          reply.putInt(ok);
+          if(ok)
+            putParamValue(reply, values, str);
+          break;
+        }
+
+        case eRemoteMessage : {
+          int kind = request.getInt();
+          std::string type = request.getString();
+          std::string id = request.getString();
+          std::string text = request.getString();
+          if(kind == eRemoteMessageClear)
+            reply.putInt(_instance.clearPersistentMessage());
+          else
+            reply.putInt(postMessage(_instance, kind, type.c_str(), id.c_str(), "%s", text.c_str()));
+          break;
+        }
+
+        case eRemoteAbort :
+          reply.putInt(_instance.abort());
+          break;
+
+        default :
+          reply.putInt(kOfxStatErrUnsupported);
+          break;
+        }
+      }
+
+      ////////////////////////////////////////////////////////////////////////////////
+      // RemoteRenderer
+
+      RemoteRenderer::RemoteRenderer(IPC::WorkerPool &pool)
+        : _pool(pool)
+        , _sequence(0)
+        , _nextSequence(1)
+        , _seqStart(0)
+        , _seqEnd(0)
+        , _seqStep(1)
+        , _seqInteractive(false)
+        , _seqSequential(false)
+        , _seqInteractiveRender(false)
+      {
+        static std::atomic<unsigned> counter(0);
+        _key = std::to_string(++counter);
+        _seqRenderScale.x = _seqRenderScale.y = 1.;
+      }
+
+      RemoteRenderer::~RemoteRenderer()
+      {
+        if(_sequence)
+          endSequence();
+
+        IPC::Message request(eRemoteDestroyInstance);
+        request.putString(_key);
+        _pool.broadcast(request);
+      }
+
+      void RemoteRenderer::beginSequence(OfxTime startFrame,
+                                         OfxTime endFrame,
+                                         OfxTime step,
+                                         bool interactive,
+                                         OfxPointD renderScale,
+                                         bool sequentialRender,
+                                         bool interactiveRender)
+      {
+        std::lock_guard<std::mutex> guard(_lock);
+        _sequence = _nextSequence++;
+        _seqStart = startFrame;
+        _seqEnd = endFrame;
+        _seqStep = step;
+        _seqInteractive = interactive;
+        _seqRenderScale = renderScale;
+        _seqSequential = sequentialRender;
+        _seqInteractiveRender = interactiveRender;
+      }
+
+      OfxStatus RemoteRenderer::endSequence()
+      {
+        int sequence;
+        {
+          std::lock_guard<std::mutex> guard(_lock);
+          sequence = _sequence;
+          _sequence = 0;
+        }
+        if(!sequence)
+          return kOfxStatOK;
+
+        IPC::Message request(eRemoteEndSequence);
+        request.putString(_key);
+        request.putInt(sequence);
+        _pool.broadcast(request);
+        return kOfxStatOK;
+      }
+
+      OfxStatus RemoteRenderer::render(Instance &instance,
+                                       OfxTime time,
+                                       const std::string &field,
+                                       const OfxRectI &renderWindow,
+                                       OfxPointD renderScale,
+                                       bool sequentialRender,
+                                       bool interactiveRender,
+                                       bool draftRender,
+                                       int worker,
+                                       bool *workerLost)
+      {
+        if(workerLost)
+          *workerLost = false;
+
+        ImageEffectPlugin *plugin = instance.getPlugin();
+        PluginCache *pluginCache = plugin ? dynamic_cast<PluginCache *>(&plugin->getApiHandler()) : 0;
+        if(!pluginCache || !plugin->getBinary())
+          return kOfxStatErrFatal;
+
+        // the worker finds the plugin by scanning the directory its bundle is in
+        std::string bundleDir = plugin->getBinary()->getBundlePath();
+        size_t sep = bundleDir.find_last_of("/\\");
+        bundleDir = sep == std::string::npos ? std::string(".") : bundleDir.substr(0, sep);
+
+        IPC::Message request(eRemoteRender);
+        request.putString(plugin->getIdentifier());
+        request.putInt(plugin->getVersionMajor());
+        request.putInt(plugin->getVersionMinor());
+        request.putString(bundleDir);
+        request.putProperties(pluginCache->getHost()->getProperties());
+        request.putString(_key);
+        request.putString(instance.getContext());
+        InstanceSnapshot::put(request, instance, time);
+
+        {
+          std::lock_guard<std::mutex> guard(_lock);
+          request.putInt(_sequence);
+          if(_sequence) {
+            SequenceArgs args = { _seqStart, _seqEnd, _seqStep, _seqInteractive,
+                                  _seqRenderScale, _seqSequential, _seqInteractiveRender };
+            args.put(request);
+          }
+        }
+
+        request.putDouble(time);
+        request.putString(field);
+        request.putInt(renderWindow.x1);
+        request.putInt(renderWindow.y1);
+        request.putInt(renderWindow.x2);
+        request.putInt(renderWindow.y2);
+        request.putDouble(renderScale.x);
+        request.putDouble(renderScale.y);
+        request.putInt(sequentialRender);
+        request.putInt(interactiveRender);
+        request.putInt(draftRender);
+
+        RemoteRenderCall call(instance, renderWindow, !_pool.isLocal());
+        IPC::Message reply;
+        OfxStatus st = worker < 0 ? _pool.call(request, reply, &call) : _pool.call(worker, request, reply, &call);
+        if(st != kOfxStatOK) {
+          std::cerr << "OFX: the worker rendering " << plugin->getIdentifier() << " at " << time
+                    << " has gone, the render has failed" << std::endl;
+          if(workerLost)
+            *workerLost = true;
+          return st;
+        }
+
+        st = reply.getInt();
+        if(!call.readOutputs(reply))
+          st = kOfxStatFailed;
+        call.finish(st == kOfxStatOK);
+        return st;
+      }
+
+      ////////////////////////////////////////////////////////////////////////////////
+      // the worker side
+
+      class RemoteInstance;
+
+      /// forward a message to the host
+      static OfxStatus postRemoteMessage(IPC::WorkerChannel &channel, int kind,
+                                         const char *type, const char *id, const char *format, va_list args)
+      {
+        char text[4096] = "";
+        if(format)
+          vsnprintf(text, sizeof(text), format, args);
+
+        IPC::Message request(eRemoteMessage), reply;
+        request.putInt(kind);
+        request.putString(type ? type : "");
+        request.putString(id ? id : "");
+        request.putString(text);
+        if(!channel.callback(request, reply))
+          return kOfxStatFailed;
+        OfxStatus st = reply.getInt();
+        return reply.ok() ? st : kOfxStatFailed;
+      }
+
+      /// the host, as far as plugins in a worker can tell
+      class RemoteHost : public Host {
+      protected :
+        IPC::WorkerChannel &_channel;
+
+      public :
+        explicit RemoteHost(IPC::WorkerChannel &channel)
+          : _channel(channel)
+        {
+        }
+
+        virtual Instance *newInstance(void *clientData,
+                                      ImageEffectPlugin *plugin,
+                                      Descriptor &desc,
+                                      const std::string &context);
+
+        virtual Descriptor *makeDescriptor(ImageEffectPlugin *plugin)
+        {
+          return new Descriptor(plugin);
+        }
+
+        virtual Descriptor *makeDescriptor(const Descriptor &rootContext, ImageEffectPlugin *plugin)
+        {
+          return new Descriptor(rootContext, plugin);
+        }
+
+        virtual Descriptor *makeDescriptor(const std::string &bundlePath, ImageEffectPlugin *plugin)
+        {
+          return new Descriptor(bundlePath, plugin);
+        }
+
+        virtual OfxStatus vmessage(const char *type, const char *id, const char *format, va_list args)
+        {
+          return postRemoteMessage(_channel, eRemoteMessagePost, type, id, format, args);
+        }
+
+        virtual OfxStatus setPersistentMessage(const char *type, const char *id, const char *format, va_list args)
+        {
+          return postRemoteMessage(_channel, eRemoteMessagePersistent, type, id, format, args);
+        }
+
+        virtual OfxStatus clearPersistentMessage()
+        {
+          va_list none;
+          return postRemoteMessage(_channel, eRemoteMessageClear, "", "", 0, none);
+        }
+
+#     ifdef OFX_SUPPORTS_OPENGLRENDER
+        /// workers render on the CPU, so have no GL resources to flush
+        virtual OfxStatus flushOpenGLResources() const
+        {
+          return kOfxStatFailed;
+        }
+#     endif
+      };
+
+      /// an image whose pixels are in shared memory from the host, or were sent with it
+      class RemoteImage : public Image {
+      protected :
+        Memory::SharedBlock _block;
+        std::vector<char>   _pixels;    ///< if they were sent
+        int                 _fetchId;   ///< what the host knows it as
+
+      public :
+        RemoteImage()
+          : _fetchId(-1)
+        {
+        }
+
+        int getFetchId() const {return _fetchId;}
+
+        /// were the pixels sent, rather than shared
+        bool isInline() const {return !_block.getPtr();}
+
+        /// read the image from the host's reply to eRemoteGetImage
+        bool read(IPC::Message &m)
+        {
+          _fetchId = m.getInt();
+          bool sent = m.getInt() != 0;
+          int fd = sent ? -1 : m.getFd();
+          size_t size = 0, offset = 0;
+          m.getBytes(&size, sizeof(size));
+          m.getBytes(&offset, sizeof(offset));
+
+          char *base = 0;
+          if(sent) {
+            _pixels.resize(size ? size : 1);
+            if(m.getInt() && m.ok())
+              m.getBytes(_pixels.data(), size);
+            base = _pixels.data();
+          }
+          else if(_block.map(fd, size)) {
+            // the block owns the descriptor from here on
+            base = (char *) _block.getPtr();
+          }
+          m.getProperties(*this);
+
+          if(!m.ok() || !base || offset > size)
+            return false;
+          setPointerProperty(kOfxImagePropData, base + offset);
+          return true;
+        }
+      };
+
+      /// a clip, as the host last sent it
+      class RemoteClipInstance : public ClipInstance {
+      protected :
+        RemoteInstance &_remote;
+        ClipSnapshot    _snap;
+        OfxTime         _time;     ///< that the region of definition is at
+
+      public :
+        RemoteClipInstance(RemoteInstance &remote, ClipDescriptor &desc);
+
+        /// take on a new snapshot, returning whether the clip preferences changed
+        bool apply(const ClipSnapshot &snap, OfxTime time)
+        {
+          bool changed = snap.pixelDepth != getPixelDepth() || snap.components != getComponents();
+          _snap = snap;
+          _time = time;
+          setPixelDepth(snap.pixelDepth);
+          setComponents(snap.components);
+          return changed;
+        }
+
+        virtual const std::string &getUnmappedBitDepth() const {return _snap.unmappedDepth;}
+        virtual const std::string &getUnmappedComponents() const {return _snap.unmappedComponents;}
+        virtual const std::string &getPremult() const {return _snap.premult;}
+        virtual double getAspectRatio() const {return _snap.aspectRatio;}
+        virtual double getFrameRate() const {return _snap.frameRate;}
+        virtual void getFrameRange(double &startFrame, double &endFrame) const
+        {
+          startFrame = _snap.frameStart;
+          endFrame = _snap.frameEnd;
+        }
+        virtual const std::string &getFieldOrder() const {return _snap.fieldOrder;}
+        virtual bool getConnected() const {return _snap.connected;}
+        virtual double getUnmappedFrameRate() const {return _snap.unmappedFrameRate;}
+        virtual void getUnmappedFrameRange(double &startFrame, double &endFrame) const
+        {
+          startFrame = _snap.unmappedFrameStart;
+          endFrame = _snap.unmappedFrameEnd;
+        }
+        virtual bool getContinuousSamples() const {return _snap.continuousSamples;}
+
+        virtual Image *getImage(OfxTime time, const OfxRectD *optionalBounds);
+
+#     ifdef OFX_SUPPORTS_OPENGLRENDER
+        virtual Texture *loadTexture(OfxTime /*time*/, const char * /*format*/, const OfxRectD * /*optionalBounds*/)
+        {
+          return 0;
+        }
+#     endif
+
+        virtual OfxRectD getRegionOfDefinition(OfxTime time) const;
+      };
+
+      /// an instance run by a worker, everything about it is as the host last sent it
+      class RemoteInstance : public Instance {
+      protected :
+        typedef std::chrono::steady_clock Clock;
+
+        IPC::WorkerChannel &_channel;
+        InstanceSnapshot    _snap;
+        OfxTime             _time;          ///< of the render
+        OfxPointD           _renderScale;   ///< of the render
+        int                 _sequence;      ///< the sequence render begun on us, 0 if none
+        SequenceArgs        _seqArgs;
+        std::mutex          _abortLock;
+        Clock::time_point   _lastAbortCheck;
+        int                 _aborted;
+        std::mutex          _outputLock;
+        std::vector<RemoteImage *> _outputs;   ///< sent images fetched from the output clip this render
+
+      public :
+        RemoteInstance(ImageEffectPlugin *plugin, Descriptor &desc, const std::string &context, IPC::WorkerChannel &channel)
+          : Instance(plugin, desc, context, false)
+          , _channel(channel)
+          , _time(0)
+          , _sequence(0)
+          , _aborted(0)
+        {
+          _renderScale.x = _renderScale.y = 1.;
+        }
+
+        /// ask the host for something during a render
+        bool callback(const IPC::Message &request, IPC::Message &reply)
+        {
+          return _channel.callback(request, reply);
+        }
+
+        /// Take on the host's instance as it is for a render, returning
+        /// whether any clip preferences changed.
+        bool apply(const InstanceSnapshot &snap, OfxTime time, OfxPointD renderScale);
+
+        int getSequence() const {return _sequence;}
+
+        /// keep an output image whose pixels need sending back after the render
+        void addOutput(RemoteImage *image)
+        {
+          std::lock_guard<std::mutex> guard(_outputLock);
+          image->addReference();
+          _outputs.push_back(image);
+        }
+
+        /// put the window of each output image kept on the reply to the render, and let them go
+        void putOutputs(IPC::Message &reply, const OfxRectI &window, bool rendered)
+        {
+          std::lock_guard<std::mutex> guard(_outputLock);
+          std::vector<char> buffer;
+          reply.putInt(rendered ? int(_outputs.size()) : 0);
+          for(size_t i = 0; i < _outputs.size(); ++i) {
+            RemoteImage *image = _outputs[i];
+            if(rendered) {
+              WindowRows rows = getWindowRows(*image, window);
+              const char *data = (const char *) image->getPointerProperty(kOfxImagePropData);
+              buffer.resize(rows.getBytes());
+              for(int r = 0; r < rows.nRows; ++r)
+                memcpy(&buffer[size_t(r) * rows.length], data + rows.first + ptrdiff_t(r) * rows.rowBytes, rows.length);
+              reply.putInt(image->getFetchId());
+              reply.putBytes(buffer.data(), buffer.size());
+            }
+            image->releaseReference();
+          }
+          _outputs.clear();
+        }
+
+        OfxStatus beginSequence(int sequence, const SequenceArgs &args)
+        {
+          OfxStatus st = beginRenderAction(args.start, args.end, args.step, args.interactive,
+                                           args.renderScale, args.sequential, args.interactiveRender);
+          if(st == kOfxStatOK || st == kOfxStatReplyDefault) {
+            _sequence = sequence;
+            _seqArgs = args;
+          }
+          return st;
+        }
+
+        OfxStatus endSequence()
+        {
+          if(!_sequence)
+            return kOfxStatOK;
+          _sequence = 0;
+          return endRenderAction(_seqArgs.start, _seqArgs.end, _seqArgs.step, _seqArgs.interactive,
+                                 _seqArgs.renderScale, _seqArgs.sequential, _seqArgs.interactiveRender);
+        }
+
+        virtual const std::string &getDefaultOutputFielding() const {return _snap.defaultFielding;}
+
+        virtual ClipInstance *newClipInstance(Instance * /*plugin*/, ClipDescriptor *descriptor, int /*index*/)
+        {
+          return new RemoteClipInstance(*this, *descriptor);
+        }
+
+        virtual OfxStatus vmessage(const char *type, const char *id, const char *format, va_list args)
+        {
+          return postRemoteMessage(_channel, eRemoteMessagePost, type, id, format, args);
+        }
+
+        virtual OfxStatus setPersistentMessage(const char *type, const char *id, const char *format, va_list args)
+        {
+          return postRemoteMessage(_channel, eRemoteMessagePersistent, type, id, format, args);
+        }
+
+        virtual OfxStatus clearPersistentMessage()
+        {
+          va_list none;
+          return postRemoteMessage(_channel, eRemoteMessageClear, "", "", 0, none);
+        }
+
+        virtual int abort();
+
+        virtual void getProjectSize(double &xSize, double &ySize) const
+        {
+          xSize = _snap.projectSize[0];
+          ySize = _snap.projectSize[1];
+        }
+
+        virtual void getProjectOffset(double &xOffset, double &yOffset) const
+        {
+          xOffset = _snap.projectOffset[0];
+          yOffset = _snap.projectOffset[1];
+        }
+
+        virtual void getProjectExtent(double &xSize, double &ySize) const
+        {
+          xSize = _snap.projectExtent[0];
+          ySize = _snap.projectExtent[1];
+        }
+
+        virtual double getProjectPixelAspectRatio() const {return _snap.pixelAspectRatio;}
+        virtual double getEffectDuration() const {return _snap.duration;}
+        virtual double getFrameRate() const {return _snap.frameRate;}
+        virtual double getFrameRecursive() const {return _time;}
+
+        virtual void getRenderScaleRecursive(double &x, double &y) const
+        {
+          x = _renderScale.x;
+          y = _renderScale.y;
+        }
+
+        virtual Param::Instance *newParam(const std::string &name, Param::Descriptor &descriptor);
+
+        // there is no one to edit anything in a worker
+        virtual OfxStatus editBegin(const std::string & /*name*/) {return kOfxStatErrMissingHostFeature;}
+        virtual OfxStatus editEnd() {return kOfxStatErrMissingHostFeature;}
+
+        virtual void progressStart(const std::string & /*message*/, const std::string & /*messageid*/) {}
+        virtual void progressEnd() {}
+        virtual bool progressUpdate(double /*t*/) {return true;}
+
+        virtual double timeLineGetTime() {return _snap.timeLineTime;}
+        virtual void timeLineGotoTime(double /*t*/) {}
+        virtual void timeLineGetBounds(double &t1, double &t2)
+        {
+          t1 = _snap.timeLineStart;
+          t2 = _snap.timeLineEnd;
+        }
+      };
+
+      RemoteClipInstance::RemoteClipInstance(RemoteInstance &remote, ClipDescriptor &desc)
+        : ClipInstance(&remote, desc)
+        , _remote(remote)
+        , _time(0)
+      {
+      }
+
+      Image *RemoteClipInstance::getImage(OfxTime time, const OfxRectD *optionalBounds)
+      {
+        OfxRectD noBounds = {0, 0, 0, 0};
+        IPC::Message request(eRemoteGetImage), reply;
+        request.putString(getName());
+        request.putDouble(time);
+        request.putInt(optionalBounds != 0);
+        putRect(request, optionalBounds ? *optionalBounds : noBounds);
+        if(!_remote.callback(request, reply) || !reply.getInt())
+          return 0;
+
+        RemoteImage *image = new RemoteImage;
+        if(!image->read(reply)) {
+          image->releaseReference();
+          return 0;
+        }
+        if(image->isInline() && isOutput())
+          _remote.addOutput(image);
+        return image;
+      }
+
+      OfxRectD RemoteClipInstance::getRegionOfDefinition(OfxTime time) const
+      {
+        if(time == _time)
+          return _snap.rod;
+
+        IPC::Message request(eRemoteGetRegionOfDefinition), reply;
+        request.putString(getName());
+        request.putDouble(time);
+        if(_remote.callback(request, reply) && reply.getInt()) {
+          OfxRectD rod = getRect(reply);
+          if(reply.ok())
+            return rod;
+        }
+        return _snap.rod;
+      }
+
+      int RemoteInstance::abort()
+      {
+        // plugins may ask every few rows, which is too often to go to the host each time
+        std::lock_guard<std::mutex> guard(_abortLock);
+        Clock::time_point now = Clock::now();
+        if(now - _lastAbortCheck < std::chrono::milliseconds(kAbortCheckInterval))
+          return _aborted;
+        _lastAbortCheck = now;
+
+        IPC::Message request(eRemoteAbort), reply;
+        if(callback(request, reply)) {
+          int aborted = reply.getInt();
+          if(reply.ok())
+            _aborted = aborted;
+        }
+        return _aborted;
+      }
+
+      /// A param's value, as the host last sent it. Values at other times
+      /// are fetched from the host if the param is animated.
+      class RemoteValue {
+      protected :
+        RemoteInstance      &_remote;
+        std::string          _paramName;
+        OfxTime              _time;
+        bool                 _animated;
+        std::vector<double>  _values;
+        std::string          _str;
+
+      public :
+        RemoteValue(RemoteInstance &remote, Param::Descriptor &descriptor)
+          : _remote(remote)
+          , _paramName(descriptor.getName())
+          , _time(0)
+          , _animated(false)
+        {
+          // start at the default, till the host sends the value
+          const Property::Set &props = descriptor.getProperties();
+          Property::Property *def = props.findProperty(kOfxParamPropDefault);
+          int dim = def ? def->getDimension() : 0;
+          for(int i = 0; i < dim; ++i) {
+            switch(def->getType()) {
+            case Property::eInt :    _values.push_back(props.getIntProperty(kOfxParamPropDefault, i)); break;
+            case Property::eDouble : _values.push_back(props.getDoubleProperty(kOfxParamPropDefault, i)); break;
+            case Property::eString : _str = props.getStringProperty(kOfxParamPropDefault, i); break;
+            default : break;
+            }
+          }
+        }
+
+        virtual ~RemoteValue()
+        {
+        }
+
+        void apply(const ParamSnapshot &snap, OfxTime time)
+        {
+          _time = time;
+          _animated = snap.animated;
+          _values = snap.values;
+          _str = snap.str;
+        }
+
+        /// get the value at a time
+        OfxStatus fetch(OfxTime time, std::vector<double> &values, std::string &str) const
+        {
+          if(!_animated || time == _time) {
+            values = _values;
+            str = _str;
+            return kOfxStatOK;
+          }
+
+          IPC::Message request(eRemoteGetParam), reply;
+          request.putString(_paramName);
+          request.putDouble(time);
+          if(!_remote.callback(request, reply) || !reply.getInt())
+            return kOfxStatFailed;
+          getParamValue(reply, values, str);
+          return reply.ok() ? kOfxStatOK : kOfxStatFailed;
+        }
+
+        template <class T> OfxStatus getN(T *v, int n) const
+        {
+          for(int i = 0; i < n; ++i)
+            v[i] = size_t(i) < _values.size() ? T(_values[i]) : T(0);
+          return kOfxStatOK;
+        }
+
+        template <class T> OfxStatus getN(OfxTime time, T *v, int n) const
+        {
+          std::vector<double> values;
+          std::string str;
+          OfxStatus st = fetch(time, values, str);
+          for(int i = 0; i < n; ++i)
+            v[i] = size_t(i) < values.size() ? T(values[i]) : T(0);
+          return st;
+        }
+
+        /// values set during a render are only seen by the plugin in this worker
+        template <class T> OfxStatus setN(const T *v, int n)
+        {
+          _values.assign(v, v + n);
+          return kOfxStatOK;
+        }
+
+        OfxStatus getString(std::string &v) const
+        {
+          v = _str;
+          return kOfxStatOK;
+        }
+
+        OfxStatus getString(OfxTime time, std::string &v) const
+        {
+          std::vector<double> values;
+          return fetch(time, values, v);
+        }
+
+        OfxStatus setString(const char *v)
+        {
+          _str = v ? v : "";
+          return kOfxStatOK;
+        }
+      };
+
+      class RemoteIntegerParam : public Param::IntegerInstance, public RemoteValue {
+      public :
+        RemoteIntegerParam(Param::Descriptor &d, RemoteInstance &r) : Param::IntegerInstance(d, &r), RemoteValue(r, d) {}
+        virtual OfxStatus get(int &v) {return getN(&v, 1);}
+        virtual OfxStatus get(OfxTime t, int &v) {return getN(t, &v, 1);}
+        virtual OfxStatus set(int v) {return setN(&v, 1);}
+        virtual OfxStatus set(OfxTime, int v) {return setN(&v, 1);}
+      };
+
+      class RemoteDoubleParam : public Param::DoubleInstance, public RemoteValue {
+      public :
+        RemoteDoubleParam(Param::Descriptor &d, RemoteInstance &r) : Param::DoubleInstance(d, &r), RemoteValue(r, d) {}
+        virtual OfxStatus get(double &v) {return getN(&v, 1);}
+        virtual OfxStatus get(OfxTime t, double &v) {return getN(t, &v, 1);}
+        virtual OfxStatus set(double v) {return setN(&v, 1);}
+        virtual OfxStatus set(OfxTime, double v) {return setN(&v, 1);}
+
+        virtual OfxStatus derive(OfxTime t, double &v)
+        {
+          double a = 0, b = 0;
+          OfxStatus st = getN(t - 0.5, &a, 1);
+          if(st == kOfxStatOK)
+            st = getN(t + 0.5, &b, 1);
+          v = b - a;
+          return st;
+        }
+
+        virtual OfxStatus integrate(OfxTime t1, OfxTime t2, double &v)
+        {
+          double a = 0, b = 0;
+          OfxStatus st = getN(t1, &a, 1);
+          if(st == kOfxStatOK)
+            st = getN(t2, &b, 1);
+          v = (t2 - t1) * (a + b) / 2;
+          return st;
+        }
+      };
+
+      class RemoteBooleanParam : public Param::BooleanInstance, public RemoteValue {
+      public :
+        RemoteBooleanParam(Param::Descriptor &d, RemoteInstance &r) : Param::BooleanInstance(d, &r), RemoteValue(r, d) {}
+        virtual OfxStatus get(bool &v) {return getN(&v, 1);}
+        virtual OfxStatus get(OfxTime t, bool &v) {return getN(t, &v, 1);}
+        virtual OfxStatus set(bool v) {return setN(&v, 1);}
+        virtual OfxStatus set(OfxTime, bool v) {return setN(&v, 1);}
+      };
+
+      class RemoteChoiceParam : public Param::ChoiceInstance, public RemoteValue {
+      public :
+        RemoteChoiceParam(Param::Descriptor &d, RemoteInstance &r) : Param::ChoiceInstance(d, &r), RemoteValue(r, d) {}
+        virtual OfxStatus get(int &v) {return getN(&v, 1);}
+        virtual OfxStatus get(OfxTime t, int &v) {return getN(t, &v, 1);}
+        virtual OfxStatus set(int v) {return setN(&v, 1);}
+        virtual OfxStatus set(OfxTime, int v) {return setN(&v, 1);}
+      };
+
+      class RemoteRGBAParam : public Param::RGBAInstance, public RemoteValue {
+      public :
+        RemoteRGBAParam(Param::Descriptor &d, RemoteInstance &r) : Param::RGBAInstance(d, &r), RemoteValue(r, d) {}
+
+        virtual OfxStatus get(double &a, double &b, double &c, double &e)
+        {
+          double v[4];
+          OfxStatus st = getN(v, 4);
+          a = v[0]; b = v[1]; c = v[2]; e = v[3];
+          return st;
+        }
+
+        virtual OfxStatus get(OfxTime t, double &a, double &b, double &c, double &e)
+        {
+          double v[4];
+          OfxStatus st = getN(t, v, 4);
+          a = v[0]; b = v[1]; c = v[2]; e = v[3];
+          return st;
+        }
+
+        virtual OfxStatus set(double a, double b, double c, double e)
+        {
+          double v[4] = {a, b, c, e};
+          return setN(v, 4);
+        }
+
+        virtual OfxStatus set(OfxTime, double a, double b, double c, double e) {return set(a, b, c, e);}
+      };
+
+      /// the three valued params are all alike but for their base and type
+      template <class BASE, class T>
+      class RemoteParam3 : public BASE, public RemoteValue {
+      public :
+        RemoteParam3(Param::Descriptor &d, RemoteInstance &r) : BASE(d, &r), RemoteValue(r, d) {}
+
+        virtual OfxStatus get(T &a, T &b, T &c)
+        {
+          T v[3];
+          OfxStatus st = getN(v, 3);
+          a = v[0]; b = v[1]; c = v[2];
+          return st;
+        }
+
+        virtual OfxStatus get(OfxTime t, T &a, T &b, T &c)
+        {
+          T v[3];
+          OfxStatus st = getN(t, v, 3);
+          a = v[0]; b = v[1]; c = v[2];
+          return st;
+        }
+
+        virtual OfxStatus set(T a, T b, T c)
+        {
+          T v[3] = {a, b, c};
+          return setN(v, 3);
+        }
+
+        virtual OfxStatus set(OfxTime, T a, T b, T c) {return set(a, b, c);}
+      };
+
+      /// as are the two valued ones
+      template <class BASE, class T>
+      class RemoteParam2 : public BASE, public RemoteValue {
+      public :
+        RemoteParam2(Param::Descriptor &d, RemoteInstance &r) : BASE(d, &r), RemoteValue(r, d) {}
+
+        virtual OfxStatus get(T &a, T &b)
+        {
+          T v[2];
+          OfxStatus st = getN(v, 2);
+          a = v[0]; b = v[1];
+          return st;
+        }
+
+        virtual OfxStatus get(OfxTime t, T &a, T &b)
+        {
+          T v[2];
+          OfxStatus st = getN(t, v, 2);
+          a = v[0]; b = v[1];
+          return st;
+        }
+
+        virtual OfxStatus set(T a, T b)
+        {
+          T v[2] = {a, b};
+          return setN(v, 2);
+        }
+
+        virtual OfxStatus set(OfxTime, T a, T b) {return set(a, b);}
+      };
+
+      class RemoteStringParam : public Param::StringInstance, public RemoteValue {
+      public :
+        RemoteStringParam(Param::Descriptor &d, RemoteInstance &r) : Param::StringInstance(d, &r), RemoteValue(r, d) {}
+        virtual OfxStatus get(std::string &v) {return getString(v);}
+        virtual OfxStatus get(OfxTime t, std::string &v) {return getString(t, v);}
+        virtual OfxStatus set(const char *v) {return setString(v);}
+        virtual OfxStatus set(OfxTime, const char *v) {return setString(v);}
+      };
+
+      /// custom params are animated by the host, so the worker only ever needs their values
+      class RemoteCustomParam : public Param::CustomInstance, public RemoteValue {
+      public :
+        RemoteCustomParam(Param::Descriptor &d, RemoteInstance &r) : Param::CustomInstance(d, &r), RemoteValue(r, d) {}
+        virtual OfxStatus get(std::string &v) {return getString(v);}
+        virtual OfxStatus get(OfxTime t, std::string &v) {return getString(t, v);}
+        virtual OfxStatus set(const char *v) {return setString(v);}
+        virtual OfxStatus set(OfxTime, const char *v) {return setString(v);}
+      };
+
+      Param::Instance *RemoteInstance::newParam(const std::string & /*name*/, Param::Descriptor &descriptor)
+      {
+        const std::string &type = descriptor.getType();
+        if(type == kOfxParamTypeInteger)
+          return new RemoteIntegerParam(descriptor, *this);
+        if(type == kOfxParamTypeDouble)
+          return new RemoteDoubleParam(descriptor, *this);
+        if(type == kOfxParamTypeBoolean)
+          return new RemoteBooleanParam(descriptor, *this);
+        if(type == kOfxParamTypeChoice)
+          return new RemoteChoiceParam(descriptor, *this);
+        if(type == kOfxParamTypeRGBA)
+          return new RemoteRGBAParam(descriptor, *this);
+        if(type == kOfxParamTypeRGB)
+          return new RemoteParam3<Param::RGBInstance, double>(descriptor, *this);
+        if(type == kOfxParamTypeDouble2D)
+          return new RemoteParam2<Param::Double2DInstance, double>(descriptor, *this);
+        if(type == kOfxParamTypeInteger2D)
+          return new RemoteParam2<Param::Integer2DInstance, int>(descriptor, *this);
+        if(type == kOfxParamTypeDouble3D)
+          return new RemoteParam3<Param::Double3DInstance, double>(descriptor, *this);
+        if(type == kOfxParamTypeInteger3D)
+          return new RemoteParam3<Param::Integer3DInstance, int>(descriptor, *this);
+        if(type == kOfxParamTypeString)
+          return new RemoteStringParam(descriptor, *this);
+        if(type == kOfxParamTypeCustom)
+          return new RemoteCustomParam(descriptor, *this);
+        if(type == kOfxParamTypeGroup)
+          return new Param::GroupInstance(descriptor, this);
+        if(type == kOfxParamTypePage)
+          return new Param::PageInstance(descriptor, this);
+        if(type == kOfxParamTypePushButton)
+          return new Param::PushbuttonInstance(descriptor, this);
+
+        // anything else has no value we know how to send
+        return new Param::Instance(descriptor, this);
+      }
+
+      bool RemoteInstance::apply(const InstanceSnapshot &snap, OfxTime time, OfxPointD renderScale)
+      {
+        _snap = snap;
+        _time = time;
+        _renderScale = renderScale;
+
+        // the host has run clip preferences, we just take on what it found
+        _outputFielding = snap.outputFielding;
+        _outputPreMultiplication = snap.outputPremult;
+        _outputFrameRate = snap.outputFrameRate;
+        _continuousSamples = snap.continuousSamples;
+        _frameVarying = snap.frameVarying;
+        _clipPrefsDirty = false;
+
+        bool changed = false;
+        for(std::map<std::string, ClipSnapshot>::const_iterator it = snap.clips.begin(); it != snap.clips.end(); ++it) {
+          if(RemoteClipInstance *clip = dynamic_cast<RemoteClipInstance *>(getClip(it->first)))
+            changed = clip->apply(it->second, time) || changed;
+        }
+
+        for(std::map<std::string, ParamSnapshot>::const_iterator it = snap.params.begin(); it != snap.params.end(); ++it) {
+          if(RemoteValue *value = dynamic_cast<RemoteValue *>(getParam(it->first)))
+            value->apply(it->second, time);
+        }
+
+        // a new render, so ask the host afresh
+        std::lock_guard<std::mutex> guard(_abortLock);
+        _lastAbortCheck = Clock::time_point();
+        _aborted = 0;
+        return changed;
+      }
+
+      Instance *RemoteHost::newInstance(void *clientData,
+                                        ImageEffectPlugin *plugin,
+                                        Descriptor &desc,
+                                        const std::string &context)
+      {
+        IPC::WorkerChannel *channel = (IPC::WorkerChannel *) clientData;
+        return new RemoteInstance(plugin, desc, context, channel ? *channel : _channel);
+      }
+
+      /// serves the requests to a worker process
+      class RemoteWorker {
+      protected :
+        IPC::WorkerChannel                       _channel;
+        std::unique_ptr<RemoteHost>              _host;
+        std::unique_ptr<PluginCache>             _pluginCache;
+        bool                                     _local;       ///< is the host the process that started us, rather than a stranger on the network
+        std::set<std::string>                    _scanned;     ///< bundle directories added to the plugin path
+        std::map<std::string, RemoteInstance *>  _instances;   ///< by the key of the renderer they are for
+
+        ImageEffectPlugin *findPlugin(const std::string &id, int major, int minor, const std::string &bundleDir);
+        void render(IPC::Message &request, IPC::Message &reply);
+        OfxStatus render(IPC::Message &request, RemoteInstance *&instance, OfxRectI &renderWindow);
+        OfxStatus endSequence(IPC::Message &request);
+        void destroyInstance(const std::string &key);
+
+      public :
+        RemoteWorker(int fd, bool local)
+          : _channel(fd)
+          , _local(local)
+        {
+        }
+
+        ~RemoteWorker()
+        {
+          // the instances need the plugins, so go first
+          while(!_instances.empty())
+            destroyInstance(_instances.begin()->first);
+        }
+
+        int run();
+      };
+
+      ImageEffectPlugin *RemoteWorker::findPlugin(const std::string &id, int major, int minor, const std::string &bundleDir)
+      {
+        // a host on the network only gets what is on the node's own plugin path,
+        // it doesn't get to say where we load code from
+        std::string dir = _local ? bundleDir : std::string();
+        if(_scanned.insert(dir).second) {
+          if(!dir.empty())
+            OFX::Host::PluginCache::getPluginCache()->prependFileToPath(dir, false);
+          OFX::Host::PluginCache::getPluginCache()->scanPluginFiles();
+        }
+        return _pluginCache->getPluginById(id, major, minor);
+      }
+
+      void RemoteWorker::render(IPC::Message &request, IPC::Message &reply)
+      {
+        RemoteInstance *instance = 0;
+        OfxRectI renderWindow = {0, 0, 0, 0};
+        OfxStatus st = render(request, instance, renderWindow);
+        reply.putInt(st);
+        if(instance)
+          instance->putOutputs(reply, renderWindow, st == kOfxStatOK);
+        else
+          reply.putInt(0);
+      }
+
+      OfxStatus RemoteWorker::render(IPC::Message &request, RemoteInstance *&rendered, OfxRectI &renderWindow)
+      {
+        std::string pluginId = request.getString();
+        int major = request.getInt();
+        int minor = request.getInt();
+        std::string bundleDir = request.getString();
+
+        // the host's properties are only needed before the first plugin is loaded
+        if(!_host) {
+          _host.reset(new RemoteHost(_channel));
+          request.getProperties(_host->getProperties());
+          _pluginCache.reset(new PluginCache(*_host));
+          _pluginCache->registerInCache(*OFX::Host::PluginCache::getPluginCache());
+        }
+        else {
+          Property::Set ignored;
+          request.getProperties(ignored);
+        }
+
+        std::string key = request.getString();
+        std::string context = request.getString();
+        InstanceSnapshot snap;
+        snap.get(request);
+
+        int sequence = request.getInt();
+        SequenceArgs seqArgs;
+        if(sequence)
+          seqArgs.get(request);
+
+        OfxTime time = request.getDouble();
+        std::string field = request.getString();
+        renderWindow.x1 = request.getInt();
+        renderWindow.y1 = request.getInt();
+        renderWindow.x2 = request.getInt();
+        renderWindow.y2 = request.getInt();
+        OfxPointD renderScale;
+        renderScale.x = request.getDouble();
+        renderScale.y = request.getDouble();
+        bool sequentialRender = request.getInt() != 0;
+        bool interactiveRender = request.getInt() != 0;
+        bool draftRender = request.getInt() != 0;
+        if(!request.ok())
+          return kOfxStatErrValue;
+
+        RemoteInstance *&instance = _instances[key];
+        if(!instance) {
+          ImageEffectPlugin *plugin = findPlugin(pluginId, major, minor, bundleDir);
+          Instance *made = plugin ? plugin->createInstance(context, &_channel) : 0;
+          instance = dynamic_cast<RemoteInstance *>(made);
+          if(!instance) {
+            delete made;
+            _instances.erase(key);
+            return kOfxStatErrFatal;
+          }
+
+          // params need their values before create instance is called
+          instance->apply(snap, time, renderScale);
+          OfxStatus st = instance->createInstanceAction();
+          if(st != kOfxStatOK && st != kOfxStatReplyDefault) {
+            destroyInstance(key);
+            return st;
+          }
+        }
+        else if(instance->apply(snap, time, renderScale)) {
+          // the plugin may have kept what it knew of the old clip preferences
+          instance->purgeCachesAction();
+        }
+
+        if(instance->getSequence() != sequence) {
+          instance->endSequence();
+          if(sequence) {
+            OfxStatus st = instance->beginSequence(sequence, seqArgs);
+            if(st != kOfxStatOK && st != kOfxStatReplyDefault)
+              return st;
+          }
+        }
+
+        rendered = instance;
+        return instance->renderAction(time, field, renderWindow, renderScale,
+                                      sequentialRender, interactiveRender, draftRender);
+      }
+
+      OfxStatus RemoteWorker::endSequence(IPC::Message &request)
+      {
+        std::string key = request.getString();
+        int sequence = request.getInt();
+        std::map<std::string, RemoteInstance *>::iterator it = _instances.find(key);
+        if(it == _instances.end() || it->second->getSequence() != sequence)
+          return kOfxStatOK;
+        return it->second->endSequence();
+      }
+
+      void RemoteWorker::destroyInstance(const std::string &key)
+      {
+        std::map<std::string, RemoteInstance *>::iterator it = _instances.find(key);
+        if(it == _instances.end())
+          return;
+        if(it->second)
+          it->second->endSequence();
+        delete it->second;
+        _instances.erase(it);
+      }
+
+      int RemoteWorker::run()
+      {
+        IPC::Message request;
+        while(_channel.receive(request)) {
+          IPC::Message reply(IPC::Message::kReply);
+          switch(request.getType()) {
+          case eRemoteRender :
+            render(request, reply);
+            break;
+          case eRemoteEndSequence :
+            reply.putInt(endSequence(request));
+            break;
+          case eRemoteDestroyInstance :
+            destroyInstance(request.getString());
+            reply.putInt(kOfxStatOK);
+            break;
+          default :
+            reply.putInt(kOfxStatErrUnsupported);
+            break;
+          }
+          if(!_channel.reply(reply))
+            break;
+        }
+        return 0;
+      }
+
+      int runWorker(int fd)
+      {
+#ifndef _WIN32
+        // only load what the host asks for, not everything on its path
+        unsetenv("OFX_PLUGIN_PATH");
+#endif
+        RemoteWorker worker(fd, true);
+        return worker.run();
+      }
+
+      int serveWorkers(const std::string &address)
+      {
+#ifndef _WIN32
+        IPC::Listener listener;
+        if(!listener.listen(address)) {
+          std::cerr << "OFX: can't listen for hosts at " << address << std::endl;
+          return 1;
+        }
+        std::cout << "Render worker listening on port " << listener.getPort() << std::endl;
+
+        // nobody waits on the workers, so don't leave zombies
+        struct sigaction action;
+        memset(&action, 0, sizeof(action));
+        action.sa_handler = SIG_DFL;
+        action.sa_flags = SA_NOCLDWAIT;
+        sigaction(SIGCHLD, &action, 0);
+
+        while(true) {
+          int fd = listener.accept();
+          if(fd < 0)
+            continue;
+          pid_t pid = fork();
+          if(pid == 0) {
+            listener.close();
+            RemoteWorker worker(fd, false);
+            _exit(worker.run());
+          }
+          if(pid < 0)
+            std::cerr << "OFX: can't start a render worker" << std::endl;
+          ::close(fd);
+        }
+#else
+        std::cerr << "OFX: render workers are not supported on this platform" << std::endl;
+        return 1;
+#endif
+      }
+
+    } // namespace ImageEffect
+
+  } // namespace Host
+
+} // namespace OFX
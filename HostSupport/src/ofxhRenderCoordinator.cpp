@@ -0,0 +1,269 @@
+// Copyright OpenFX and contributors to the OpenFX project.
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <thread>
+#include <iostream>
+
+// ofx
+#include "ofxCore.h"
+#include "ofxImageEffect.h"
+
+// ofx host
+#include "ofxhUtilities.h"
+#include "ofxhIPC.h"
+#include "ofxhRenderCoordinator.h"
+
+namespace OFX {
+
+  namespace Host {
+
+    namespace ImageEffect {
+
+      /// how much a new measurement of a worker's throughput counts for
+      static const double kThroughputSmoothing = 0.3;
+
+      static double getPixels(const OfxRectI &window)
+      {
+        double w = window.x2 - window.x1, h = window.y2 - window.y1;
+        return w > 0 && h > 0 ? w * h : 1.;
+      }
+
+      RenderCoordinator::RenderCoordinator(IPC::WorkerPool &pool, unsigned int maxRetries)
+        : _pool(pool)
+        , _maxRetries(maxRetries)
+        , _nRetried(0)
+        , _inFlight(0)
+        , _failed(false)
+        , _result(kOfxStatOK)
+      {
+      }
+
+      bool RenderCoordinator::anyWorkers()
+      {
+        for(size_t i = 0; i < _stats.size(); ++i)
+          if(_pool.isAlive(int(i)))
+            return true;
+        return false;
+      }
+
+      int RenderCoordinator::pickWorker(const Chunk &chunk)
+      {
+        // the fastest idle worker, an unmeasured one beats any measured one
+        int best = -1;
+        for(size_t i = 0; i < _stats.size(); ++i) {
+          if(_stats[i].busy || !_pool.isAlive(int(i)))
+            continue;
+          if(best < 0 ||
+             (_stats[best].pixelsPerSec > 0 &&
+              (_stats[i].pixelsPerSec == 0 || _stats[i].pixelsPerSec > _stats[best].pixelsPerSec)))
+            best = int(i);
+        }
+        // a lost chunk goes out at once, later ones may be waiting on it
+        if(best < 0 || _stats[best].pixelsPerSec == 0 || chunk.attempts > 0)
+          return best;
+
+        // while there is more than enough to go round, anyone may have it
+        unsigned nBusy = 0;
+        for(size_t i = 0; i < _stats.size(); ++i)
+          if(_stats[i].busy)
+            ++nBusy;
+        if(_queue.size() > nBusy)
+          return best;
+
+        // at the tail, leave it to a busy worker that would get it done sooner
+        double pixels = getPixels(chunk.window);
+        double ours = pixels / _stats[best].pixelsPerSec;
+        Clock::time_point now = Clock::now();
+        for(size_t i = 0; i < _stats.size(); ++i) {
+          const WorkerStats &s = _stats[i];
+          if(!s.busy || s.pixelsPerSec == 0 || !_pool.isAlive(int(i)))
+            continue;
+          double elapsed = std::chrono::duration<double>(now - s.started).count();
+          double remaining = Maximum(0., s.startedPixels / s.pixelsPerSec - elapsed);
+          if(remaining + pixels / s.pixelsPerSec < ours)
+            return -1;
+        }
+        return best;
+      }
+
+      void RenderCoordinator::fail(OfxStatus stat)
+      {
+        if(!_failed) {
+          _failed = true;
+          _result = stat;
+        }
+      }
+
+      void RenderCoordinator::work(const RenderFunction &render, const AbandonFunction &abandon, const DoneFunction &done)
+      {
+        std::unique_lock<std::mutex> guard(_lock);
+        while(true) {
+          // whoever fails the job tells the host about the chunks it lost
+          if(_failed)
+            break;
+
+          if(_queue.empty()) {
+            // a chunk in flight may yet come back
+            if(_inFlight == 0)
+              break;
+            _changed.wait(guard);
+            continue;
+          }
+
+          if(!anyWorkers()) {
+            std::cerr << "OFX: every render worker has gone" << std::endl;
+            fail(kOfxStatErrFatal);
+            for(std::deque<Chunk>::iterator it = _queue.begin(); it != _queue.end(); ++it)
+              if(it->attempts > 0)
+                _abandoned.push_back(*it);
+            _queue.clear();
+            break;
+          }
+
+          int worker = pickWorker(_queue.front());
+          if(worker < 0) {
+            _changed.wait(guard);
+            continue;
+          }
+
+          Chunk chunk = _queue.front();
+          _queue.pop_front();
+          WorkerStats &stats = _stats[worker];
+          stats.busy = true;
+          stats.started = Clock::now();
+          stats.startedPixels = getPixels(chunk.window);
+          ++_inFlight;
+
+          guard.unlock();
+          bool lost = false;
+          OfxStatus st = render(chunk, worker, lost);
+          guard.lock();
+          Chunk rendered = chunk;
+
+          --_inFlight;
+          stats.busy = false;
+          ++stats.nChunks;
+          if(lost) {
+            ++stats.nLost;
+            if(++chunk.attempts <= _maxRetries && !_failed) {
+              _queue.push_front(chunk);
+              ++_nRetried;
+            }
+            else {
+              fail(st);
+              _abandoned.push_back(chunk);
+            }
+          }
+          else {
+            double secs = std::chrono::duration<double>(Clock::now() - stats.started).count();
+            stats.pixels += stats.startedPixels;
+            stats.secs += secs;
+            if(secs > 0) {
+              double rate = stats.startedPixels / secs;
+              stats.pixelsPerSec = stats.pixelsPerSec == 0 ? rate :
+                (1 - kThroughputSmoothing) * stats.pixelsPerSec + kThroughputSmoothing * rate;
+            }
+            if(st != kOfxStatOK)
+              fail(st);
+          }
+          _changed.notify_all();
+
+          if(done) {
+            guard.unlock();
+            done(rendered, lost);
+            guard.lock();
+          }
+        }
+
+        // pass on any chunks that were given up on, outside the lock as the host may wait in it
+        std::vector<Chunk> abandoned;
+        abandoned.swap(_abandoned);
+        OfxStatus result = _result;
+        _changed.notify_all();
+        guard.unlock();
+        if(abandon) {
+          for(size_t i = 0; i < abandoned.size(); ++i)
+            abandon(abandoned[i], result);
+        }
+      }
+
+      OfxStatus RenderCoordinator::run(const std::vector<Chunk> &chunks,
+                                       const RenderFunction &render,
+                                       unsigned int nThreads,
+                                       const AbandonFunction &abandon,
+                                       const DoneFunction &done)
+      {
+        {
+          std::lock_guard<std::mutex> guard(_lock);
+          WorkerStats fresh = { false, Clock::time_point(), 0, 0, 0, 0, 0, 0 };
+          _stats.resize(_pool.getNumWorkers(), fresh);
+          _queue.assign(chunks.begin(), chunks.end());
+          _inFlight = 0;
+          _failed = false;
+          _result = kOfxStatOK;
+          _abandoned.clear();
+        }
+
+        nThreads = Minimum(nThreads, (unsigned int) _stats.size());
+        nThreads = Minimum(nThreads, (unsigned int) chunks.size());
+        if(nThreads == 0)
+          return chunks.empty() ? kOfxStatOK : kOfxStatErrFatal;
+
+        std::vector<std::thread> threads;
+        for(unsigned int i = 1; i < nThreads; ++i)
+          threads.push_back(std::thread([&]() { work(render, abandon, done); }));
+        work(render, abandon, done); // this thread works as well
+        for(size_t i = 0; i < threads.size(); ++i)
+          threads[i].join();
+
+        std::lock_guard<std::mutex> guard(_lock);
+        return _result;
+      }
+
+      double RenderCoordinator::getThroughput(int worker)
+      {
+        std::lock_guard<std::mutex> guard(_lock);
+        return worker >= 0 && worker < int(_stats.size()) ? _stats[worker].pixelsPerSec : 0;
+      }
+
+      void RenderCoordinator::printStats(std::ostream &out)
+      {
+        std::lock_guard<std::mutex> guard(_lock);
+        out << "Render workers, " << _nRetried << " chunks retried" << std::endl;
+        for(size_t i = 0; i < _stats.size(); ++i) {
+          const WorkerStats &s = _stats[i];
+          std::string address = _pool.getAddress(int(i));
+          out << "  worker " << i;
+          if(!address.empty())
+            out << " at " << address;
+          if(!_pool.isAlive(int(i)))
+            out << " (gone)";
+          out << " chunks " << s.nChunks << " lost " << s.nLost
+              << " Mpixels/s " << (s.secs > 0 ? s.pixels / s.secs / 1e6 : 0.) << std::endl;
+        }
+      }
+
+      std::vector<OfxRectI> RenderCoordinator::splitWindow(const OfxRectI &window, unsigned int n)
+      {
+        std::vector<OfxRectI> bands;
+        int height = window.y2 - window.y1;
+        if(height > 0)
+          n = Minimum(n, (unsigned int) height);
+        if(n <= 1 || height <= 0) {
+          bands.push_back(window);
+          return bands;
+        }
+        for(unsigned int i = 0; i < n; ++i) {
+          OfxRectI band = window;
+          band.y1 = window.y1 + int((long long) height * i / n);
+          band.y2 = window.y1 + int((long long) height * (i + 1) / n);
+          bands.push_back(band);
+        }
+        return bands;
+      }
+
+    } // namespace ImageEffect
+
+  } // namespace Host
+
+} // namespace OFX
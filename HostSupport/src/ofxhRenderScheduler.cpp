@@ -0,0 +1,648 @@
+// Copyright OpenFX and contributors to the OpenFX project.
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <thread>
+#include <map>
+#include <atomic>
+
+// ofx
+#include "ofxCore.h"
+#include "ofxImageEffect.h"
+
+// ofx host
+#include "ofxhBinary.h"
+#include "ofxhPropertySuite.h"
+#include "ofxhClip.h"
+#include "ofxhParam.h"
+#include "ofxhImageEffect.h"
+#include "ofxhPluginAPICache.h"
+#include "ofxhPluginCache.h"
+#include "ofxhImageEffectAPI.h"
+#include "ofxhIPC.h"
+#include "ofxhRemoteEffect.h"
+#include "ofxhRenderCoordinator.h"
+#include "ofxhRenderScheduler.h"
+
+namespace OFX {
+
+  namespace Host {
+
+    namespace ImageEffect {
+
+      /// Get the lock that serialises renders of unsafe plugins. There is one
+      /// per plugin, shared by every instance of it in the process.
+      static std::mutex &getUnsafePluginLock(const ImageEffectPlugin *plugin)
+      {
+        static std::mutex mapLock;
+        static std::map<const ImageEffectPlugin *, std::mutex> locks;
+
+        std::lock_guard<std::mutex> guard(mapLock);
+        return locks[plugin];
+      }
+
+      RenderScheduler::RenderScheduler(Instance &instance, unsigned int maxThreads, unsigned int maxClones)
+        : _instance(instance)
+        , _threadSafety(getThreadSafety(instance))
+        , _maxThreads(maxThreads)
+        , _maxClones(maxClones)
+        , _canClone(true)
+        , _pendingClones(0)
+        , _generation(0)
+        , _inSequence(false)
+        , _seqStart(0)
+        , _seqEnd(0)
+        , _seqStep(1)
+        , _seqInteractive(false)
+        , _seqSequential(false)
+        , _seqInteractiveRender(false)
+        , _workers(0)
+      {
+        if(_maxThreads == 0) {
+          _maxThreads = std::thread::hardware_concurrency();
+          if(_maxThreads == 0)
+            _maxThreads = 1;
+        }
+
+        // by default make enough clones to keep every thread busy
+        if(_maxClones == 0)
+          _maxClones = _maxThreads - 1;
+
+        _seqRenderScale.x = _seqRenderScale.y = 1.;
+
+        // never reallocate, as render threads hold on to their slots
+        _slots.reserve(_maxClones + 1);
+
+        Slot master = { &_instance, false, false, false, 0 };
+        _slots.push_back(master);
+      }
+
+      RenderScheduler::~RenderScheduler()
+      {
+        if(_inSequence)
+          endSequenceRender();
+
+        for(std::vector<Slot>::iterator it = _slots.begin(); it != _slots.end(); ++it) {
+          if(it->owned)
+            delete it->instance;
+        }
+        _slots.clear();
+      }
+
+      /// map the render thread safety property to our enum
+      RenderScheduler::ThreadSafetyEnum RenderScheduler::getThreadSafety(const Base &effect)
+      {
+        const std::string &safety = effect.getRenderThreadSafety();
+        if(safety == kOfxImageEffectRenderFullySafe)
+          return eRenderFullySafe;
+        if(safety == kOfxImageEffectRenderInstanceSafe)
+          return eRenderInstanceSafe;
+        return eRenderUnsafe;
+      }
+
+      void RenderScheduler::setWorkerPool(IPC::WorkerPool *workers, unsigned int maxRetries)
+      {
+        _workers = workers;
+        _remote.reset(workers ? new RemoteRenderer(*workers) : 0);
+        _coordinator.reset(workers ? new RenderCoordinator(*workers, maxRetries) : 0);
+      }
+
+      /// how many renders can be in flight at once for this effect
+      unsigned int RenderScheduler::getMaxConcurrency() const
+      {
+        // one per worker, each on its own instance
+        if(_remote) {
+          std::lock_guard<std::mutex> guard(_lock);
+          if(!_canClone)
+            return 1;
+          return Minimum(Minimum(_maxThreads, _maxClones + 1), (unsigned int) _workers->getNumWorkers());
+        }
+
+        switch(_threadSafety) {
+        case eRenderFullySafe :
+          return _maxThreads;
+        case eRenderInstanceSafe : {
+          std::lock_guard<std::mutex> guard(_lock);
+          if(!_canClone)
+            return 1;
+          return Minimum(_maxThreads, _maxClones + 1);
+        }
+        case eRenderUnsafe :
+        default :
+          return 1;
+        }
+      }
+
+      /// how many frames the scheduler will render at once in renderSequence
+      unsigned int RenderScheduler::getFrameConcurrency() const
+      {
+        // the plugin does its own threading, which it can still do in a worker
+        if(!_remote && !_instance.getHostFrameThreading())
+          return 1;
+
+        // the plugin needs its frames in order on the one instance
+        if(_instance.getProps().getIntProperty(kOfxImageEffectInstancePropSequentialRender) == 1)
+          return 1;
+
+        return getMaxConcurrency();
+      }
+
+      void RenderScheduler::paramsChanged()
+      {
+        std::lock_guard<std::mutex> guard(_lock);
+        ++_generation;
+      }
+
+      /// copy the master param values onto a clone
+      OfxStatus RenderScheduler::syncRenderClone(Instance &clone)
+      {
+        const std::list<Param::Instance *> &params = _instance.getParamList();
+        for(std::list<Param::Instance *>::const_iterator it = params.begin(); it != params.end(); ++it) {
+          const std::string &type = (*it)->getType();
+
+          // these have no value to copy
+          if(type == kOfxParamTypeGroup || type == kOfxParamTypePage || type == kOfxParamTypePushButton)
+            continue;
+
+          Param::Instance *cloneParam = clone.getParam((*it)->getName());
+          if(!cloneParam)
+            return kOfxStatErrValue;
+
+          OfxStatus st = cloneParam->copyFrom(**it, 0, NULL);
+          if(st != kOfxStatOK)
+            return st;
+        }
+
+        // the values were set under the clone, so it won't have forgotten what it knew of the old ones
+        clone.getActionCache().invalidate();
+        return kOfxStatOK;
+      }
+
+      /// make a new render clone of the scheduled instance
+      Instance *RenderScheduler::newRenderClone()
+      {
+        ImageEffectPlugin *plugin = _instance.getPlugin();
+        if(!plugin)
+          return NULL;
+
+        Instance *clone = plugin->createInstance(_instance.getContext(), NULL);
+        if(!clone)
+          return NULL;
+
+        // cache actions on clones if the host does so on the master
+        clone->getActionCache().setEnabled(_instance.getActionCache().isEnabled());
+
+        // params need their values before create instance is called
+        if(syncRenderClone(*clone) != kOfxStatOK) {
+          delete clone;
+          return NULL;
+        }
+
+        OfxStatus st = clone->createInstanceAction();
+        if(st != kOfxStatOK && st != kOfxStatReplyDefault) {
+          delete clone;
+          return NULL;
+        }
+
+        if(!clone->getClipPreferences()) {
+          delete clone;
+          return NULL;
+        }
+
+        return clone;
+      }
+
+      /// reserve an instance to render on, making a clone if needed
+      int RenderScheduler::acquireSlot()
+      {
+        std::unique_lock<std::mutex> guard(_lock);
+
+        while(true) {
+          // any idle instance will do
+          for(size_t i = 0; i < _slots.size(); ++i) {
+            if(!_slots[i].busy) {
+              _slots[i].busy = true;
+              return int(i);
+            }
+          }
+
+          // room for another clone? make it outside the lock, as it calls the plugin
+          if(_canClone && _slots.size() + _pendingClones < size_t(_maxClones) + 1) {
+            ++_pendingClones;
+            guard.unlock();
+            Instance *clone = NULL;
+            try {
+              clone = newRenderClone();
+            }
+            catch(...) {
+              // as good as failing to make one, and _pendingClones must still come down
+            }
+            guard.lock();
+            --_pendingClones;
+
+            if(clone) {
+              Slot slot = { clone, true, true, false, _generation };
+              _slots.push_back(slot);
+              return int(_slots.size() - 1);
+            }
+
+            // don't try again, and wake up anyone waiting on the clone
+            _canClone = false;
+            _slotFreed.notify_all();
+            continue;
+          }
+
+          _slotFreed.wait(guard);
+        }
+      }
+
+      void RenderScheduler::releaseSlot(int slot)
+      {
+        {
+          std::lock_guard<std::mutex> guard(_lock);
+          _slots[slot].busy = false;
+        }
+        _slotFreed.notify_one();
+      }
+
+      /// render on a reserved slot
+      OfxStatus RenderScheduler::renderOnSlot(int slot,
+                                              OfxTime time,
+                                              const std::string &field,
+                                              const OfxRectI &renderWindow,
+                                              OfxPointD renderScale,
+                                              bool sequentialRender,
+                                              bool interactiveRender,
+                                              bool draftRender,
+                                              int worker,
+                                              bool *workerLost,
+                                              unsigned int nTiles)
+      {
+        // the slot is ours, so we can look at it without holding the lock
+        Slot &s = _slots[slot];
+        bool resync;
+        {
+          std::lock_guard<std::mutex> guard(_lock);
+          resync = s.owned && s.generation != _generation;
+          s.generation = _generation;
+        }
+
+        if(resync) {
+          OfxStatus st = syncRenderClone(*s.instance);
+          if(st != kOfxStatOK)
+            return st;
+        }
+
+        // the workers begin the sequence themselves
+        if(_remote)
+          return _remote->render(*s.instance, time, field, renderWindow, renderScale,
+                                 sequentialRender, interactiveRender, draftRender, worker, workerLost);
+
+        if(_inSequence && !s.begun) {
+          OfxStatus st = s.instance->beginRenderAction(_seqStart, _seqEnd, _seqStep, _seqInteractive,
+                                                       _seqRenderScale, _seqSequential, _seqInteractiveRender);
+          if(st != kOfxStatOK && st != kOfxStatReplyDefault)
+            return st;
+          s.begun = true;
+        }
+
+        if(canRenderTiles(nTiles, renderWindow))
+          return renderTilesOn(*s.instance, time, field, renderWindow, renderScale,
+                               sequentialRender, interactiveRender, draftRender, nTiles);
+
+        return s.instance->renderAction(time, field, renderWindow, renderScale,
+                                        sequentialRender, interactiveRender, draftRender);
+      }
+
+      OfxStatus RenderScheduler::beginSequenceRender(OfxTime startFrame,
+                                                     OfxTime endFrame,
+                                                     OfxTime step,
+                                                     bool interactive,
+                                                     OfxPointD renderScale,
+                                                     bool sequentialRender,
+                                                     bool interactiveRender)
+      {
+        std::lock_guard<std::mutex> guard(_lock);
+
+        _inSequence = true;
+        _seqStart = startFrame;
+        _seqEnd = endFrame;
+        _seqStep = step;
+        _seqInteractive = interactive;
+        _seqRenderScale = renderScale;
+        _seqSequential = sequentialRender;
+        _seqInteractiveRender = interactiveRender;
+
+        if(_remote) {
+          _remote->beginSequence(startFrame, endFrame, step, interactive,
+                                 renderScale, sequentialRender, interactiveRender);
+          return kOfxStatOK;
+        }
+
+        OfxStatus st = _instance.beginRenderAction(startFrame, endFrame, step, interactive,
+                                                   renderScale, sequentialRender, interactiveRender);
+        if(st == kOfxStatOK || st == kOfxStatReplyDefault)
+          _slots[0].begun = true;
+        return st;
+      }
+
+      OfxStatus RenderScheduler::endSequenceRender()
+      {
+        std::lock_guard<std::mutex> guard(_lock);
+
+        if(_remote) {
+          _inSequence = false;
+          return _remote->endSequence();
+        }
+
+        OfxStatus result = kOfxStatOK;
+        for(std::vector<Slot>::iterator it = _slots.begin(); it != _slots.end(); ++it) {
+          if(it->begun) {
+            OfxStatus st = it->instance->endRenderAction(_seqStart, _seqEnd, _seqStep, _seqInteractive,
+                                                         _seqRenderScale, _seqSequential, _seqInteractiveRender);
+            if(st != kOfxStatOK && st != kOfxStatReplyDefault)
+              result = st;
+            it->begun = false;
+          }
+        }
+        _inSequence = false;
+        return result;
+      }
+
+      OfxStatus RenderScheduler::render(OfxTime time,
+                                        const std::string &field,
+                                        const OfxRectI &renderWindow,
+                                        OfxPointD renderScale,
+                                        bool sequentialRender,
+                                        bool interactiveRender,
+                                        bool draftRender)
+      {
+        ThreadSafetyEnum threadSafety = _remote ? eRenderInstanceSafe : _threadSafety;
+        switch(threadSafety) {
+        case eRenderFullySafe :
+          // anything goes, render straight on the instance
+          return _instance.renderAction(time, field, renderWindow, renderScale,
+                                        sequentialRender, interactiveRender, draftRender);
+
+        case eRenderInstanceSafe : {
+          SlotGuard slot(*this);
+          return renderOnSlot(slot.getSlot(), time, field, renderWindow, renderScale,
+                              sequentialRender, interactiveRender, draftRender);
+        }
+
+        case eRenderUnsafe :
+        default : {
+          std::lock_guard<std::mutex> guard(getUnsafePluginLock(_instance.getPlugin()));
+          return _instance.renderAction(time, field, renderWindow, renderScale,
+                                        sequentialRender, interactiveRender, draftRender);
+        }
+        }
+      }
+
+      OfxStatus RenderScheduler::renderTiled(OfxTime time,
+                                             const std::string &field,
+                                             const OfxRectI &renderWindow,
+                                             OfxPointD renderScale,
+                                             bool sequentialRender,
+                                             bool interactiveRender,
+                                             bool draftRender,
+                                             unsigned int nTiles)
+      {
+        // each tile can go to a different worker, on its own instance there
+        if(_coordinator && nTiles > 1 && _instance.supportsTiles()) {
+          std::vector<OfxRectI> tiles = RenderCoordinator::splitWindow(renderWindow, nTiles);
+          std::vector<RenderCoordinator::Chunk> chunks;
+          for(size_t i = 0; i < tiles.size(); ++i) {
+            RenderCoordinator::Chunk chunk = { time, tiles[i], 0 };
+            chunks.push_back(chunk);
+          }
+          auto renderTile = [&](const RenderCoordinator::Chunk &chunk, int worker, bool &lost) {
+            return _remote->render(_instance, chunk.time, field, chunk.window, renderScale,
+                                   sequentialRender, interactiveRender, draftRender, worker, &lost);
+          };
+          return _coordinator->run(chunks, renderTile, _maxThreads);
+        }
+
+        if(_remote || !canRenderTiles(nTiles, renderWindow))
+          return render(time, field, renderWindow, renderScale,
+                        sequentialRender, interactiveRender, draftRender);
+
+        return renderTilesOn(_instance, time, field, renderWindow, renderScale,
+                             sequentialRender, interactiveRender, draftRender, nTiles);
+      }
+
+      /// will a frame be split into tiles in process, clamping nTiles to how many it will be split into
+      bool RenderScheduler::canRenderTiles(unsigned int &nTiles, const OfxRectI &renderWindow) const
+      {
+        int height = renderWindow.y2 - renderWindow.y1;
+        nTiles = Minimum(nTiles, _maxThreads);
+        if(height > 0)
+          nTiles = Minimum(nTiles, (unsigned int)height);
+
+        return nTiles > 1 &&
+          _threadSafety == eRenderFullySafe &&
+          _instance.supportsTiles() &&
+          _instance.getHostFrameThreading();
+      }
+
+      /// render the tiles of a frame concurrently on the given instance
+      OfxStatus RenderScheduler::renderTilesOn(Instance &instance,
+                                               OfxTime time,
+                                               const std::string &field,
+                                               const OfxRectI &renderWindow,
+                                               OfxPointD renderScale,
+                                               bool sequentialRender,
+                                               bool interactiveRender,
+                                               bool draftRender,
+                                               unsigned int nTiles)
+      {
+        int height = renderWindow.y2 - renderWindow.y1;
+        std::vector<OfxStatus> stats(nTiles, kOfxStatOK);
+        std::vector<std::thread> threads;
+        threads.reserve(nTiles);
+
+        for(unsigned int i = 0; i < nTiles; ++i) {
+          OfxRectI tile = renderWindow;
+          tile.y1 = renderWindow.y1 + int((long long)height * i / nTiles);
+          tile.y2 = renderWindow.y1 + int((long long)height * (i + 1) / nTiles);
+
+          threads.push_back(std::thread([=, &stats, &instance]() {
+                stats[i] = instance.renderAction(time, field, tile, renderScale,
+                                                  sequentialRender, interactiveRender, draftRender);
+              }));
+        }
+
+        OfxStatus result = kOfxStatOK;
+        for(unsigned int i = 0; i < nTiles; ++i) {
+          threads[i].join();
+          if(stats[i] != kOfxStatOK && result == kOfxStatOK)
+            result = stats[i];
+        }
+        return result;
+      }
+
+      OfxStatus RenderScheduler::renderSequenceOnWorkers(const std::vector<OfxTime> &frames,
+                                                         OfxTime step,
+                                                         const std::string &field,
+                                                         const OfxRectI &renderWindow,
+                                                         OfxPointD renderScale,
+                                                         bool interactiveRender,
+                                                         bool draftRender,
+                                                         FrameDoneI *frameDone)
+      {
+        unsigned int nThreads = Minimum(getFrameConcurrency(), (unsigned int)frames.size());
+        if(nThreads == 0)
+          return kOfxStatOK;
+        bool sequential = nThreads == 1;
+
+        OfxStatus st = beginSequenceRender(frames.front(), frames.back(), step, false, renderScale, sequential, interactiveRender);
+        if(st != kOfxStatOK && st != kOfxStatReplyDefault)
+          return st;
+
+        std::vector<RenderCoordinator::Chunk> chunks;
+        for(size_t i = 0; i < frames.size(); ++i) {
+          RenderCoordinator::Chunk chunk = { frames[i], renderWindow, 0 };
+          chunks.push_back(chunk);
+        }
+
+        // a frame lost with its worker is only done once it won't be retried
+        unsigned int maxRetries = _coordinator->getMaxRetries();
+        auto renderFrame = [&](const RenderCoordinator::Chunk &chunk, int worker, bool &lost) {
+          if(frameDone && chunk.attempts == 0)
+            frameDone->frameStarted(chunk.time);
+          SlotGuard slot(*this);
+          OfxStatus frameStat = renderOnSlot(slot.getSlot(), chunk.time, field, chunk.window, renderScale,
+                                             sequential, interactiveRender, draftRender, worker, &lost);
+          if(frameDone && (!lost || chunk.attempts >= maxRetries))
+            frameDone->frameRendered(*_slots[slot.getSlot()].instance, chunk.time, frameStat);
+          return frameStat;
+        };
+        auto abandonFrame = [&](const RenderCoordinator::Chunk &chunk, OfxStatus frameStat) {
+          if(frameDone && chunk.attempts <= maxRetries) {
+            frameDone->frameRendered(_instance, chunk.time, frameStat);
+            frameDone->frameFinished(chunk.time);
+          }
+        };
+        auto frameFinished = [&](const RenderCoordinator::Chunk &chunk, bool lost) {
+          if(frameDone && (!lost || chunk.attempts >= maxRetries))
+            frameDone->frameFinished(chunk.time);
+        };
+
+        OfxStatus result = _coordinator->run(chunks, renderFrame, nThreads, abandonFrame, frameFinished);
+
+        st = endSequenceRender();
+        if(result == kOfxStatOK && st != kOfxStatOK && st != kOfxStatReplyDefault)
+          result = st;
+        return result;
+      }
+
+      OfxStatus RenderScheduler::renderSequence(OfxTime startFrame,
+                                                OfxTime endFrame,
+                                                OfxTime step,
+                                                const std::string &field,
+                                                const OfxRectI &renderWindow,
+                                                OfxPointD renderScale,
+                                                bool interactiveRender,
+                                                bool draftRender,
+                                                FrameDoneI *frameDone)
+      {
+        if(step <= 0)
+          return kOfxStatErrValue;
+
+        std::vector<OfxTime> frames;
+        for(OfxTime t = startFrame; t <= endFrame; t += step)
+          frames.push_back(t);
+
+        if(_coordinator)
+          return renderSequenceOnWorkers(frames, step, field, renderWindow, renderScale,
+                                         interactiveRender, draftRender, frameDone);
+
+        unsigned int nWorkers = Minimum(getFrameConcurrency(), (unsigned int)frames.size());
+        if(nWorkers == 0)
+          return kOfxStatOK;
+
+        // frames only go out in order if we are rendering one at a time
+        bool sequential = nWorkers == 1;
+
+        // if there are spare threads for a fully safe effect, give them to tiles
+        unsigned int nTiles = 1;
+        ThreadSafetyEnum threadSafety = _remote ? eRenderInstanceSafe : _threadSafety;
+        if(threadSafety == eRenderFullySafe && frames.size() < _maxThreads)
+          nTiles = _maxThreads / (unsigned int)frames.size();
+
+        OfxStatus st = beginSequenceRender(startFrame, endFrame, step, false, renderScale, sequential, interactiveRender);
+        if(st != kOfxStatOK && st != kOfxStatReplyDefault)
+          return st;
+
+        std::atomic<size_t> nextFrame(0);
+        std::atomic<bool> failed(false);
+        std::mutex resultLock;
+        OfxStatus result = kOfxStatOK;
+
+        auto worker = [&]() {
+          while(!failed) {
+            size_t index = nextFrame++;
+            if(index >= frames.size())
+              return;
+            OfxTime time = frames[index];
+
+            if(frameDone)
+              frameDone->frameStarted(time);
+
+            OfxStatus frameStat;
+            if(threadSafety == eRenderFullySafe && sequential) {
+              frameStat = renderTiled(time, field, renderWindow, renderScale,
+                                      sequential, interactiveRender, draftRender, nTiles);
+              if(frameDone)
+                frameDone->frameRendered(_instance, time, frameStat);
+            }
+            else if(threadSafety != eRenderUnsafe) {
+              // Each frame in flight has an instance to itself, so its output
+              // can be read in frameRendered without another frame writing over
+              // it. A fully safe effect's frames are still tiled on theirs.
+              SlotGuard slot(*this);
+              frameStat = renderOnSlot(slot.getSlot(), time, field, renderWindow, renderScale,
+                                       sequential, interactiveRender, draftRender,
+                                       -1, 0, threadSafety == eRenderFullySafe ? nTiles : 1);
+              if(frameDone)
+                frameDone->frameRendered(*_slots[slot.getSlot()].instance, time, frameStat);
+            }
+            else {
+              std::lock_guard<std::mutex> guard(getUnsafePluginLock(_instance.getPlugin()));
+              frameStat = _instance.renderAction(time, field, renderWindow, renderScale,
+                                                 sequential, interactiveRender, draftRender);
+              if(frameDone)
+                frameDone->frameRendered(_instance, time, frameStat);
+            }
+
+            // nothing is held now, so the host may wait here
+            if(frameDone)
+              frameDone->frameFinished(time);
+
+            if(frameStat != kOfxStatOK) {
+              std::lock_guard<std::mutex> guard(resultLock);
+              if(result == kOfxStatOK)
+                result = frameStat;
+              failed = true;
+            }
+          }
+        };
+
+        std::vector<std::thread> threads;
+        for(unsigned int i = 1; i < nWorkers; ++i)
+          threads.push_back(std::thread(worker));
+        worker(); // this thread works as well
+        for(size_t i = 0; i < threads.size(); ++i)
+          threads[i].join();
+
+        st = endSequenceRender();
+        if(result == kOfxStatOK && st != kOfxStatOK && st != kOfxStatReplyDefault)
+          result = st;
+
+        return result;
+      }
+
+    } // namespace ImageEffect
+
+  } // namespace Host
+
+} // namespace OFX
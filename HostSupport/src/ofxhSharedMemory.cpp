@@ -0,0 +1,197 @@
+// Copyright OpenFX and contributors to the OpenFX project.
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <map>
+#include <mutex>
+#include <cstdio>
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#endif
+
+// ofx
+#include "ofxCore.h"
+#include "ofxImageEffect.h"
+
+// ofx host
+#include "ofxhSharedMemory.h"
+
+namespace OFX {
+
+  namespace Host {
+
+    namespace Memory {
+
+      /// every block mapped in the process, by address, so find can look them up
+      static std::mutex &getRegistryLock()
+      {
+        static std::mutex lock;
+        return lock;
+      }
+
+      static std::map<const char *, SharedBlock *> &getRegistry()
+      {
+        static std::map<const char *, SharedBlock *> registry;
+        return registry;
+      }
+
+#ifndef _WIN32
+      /// make an anonymous shared memory object of nBytes, returning its descriptor or -1
+      static int makeSharedFd(size_t nBytes)
+      {
+        int fd = -1;
+#if defined(__linux__) && defined(SYS_memfd_create)
+        // called through syscall, as older C libraries have no wrapper
+        fd = (int) syscall(SYS_memfd_create, "ofxImage", 1u /* MFD_CLOEXEC */);
+#endif
+        if(fd < 0) {
+          // fall back to a named object, unlinked as soon as it is open
+          static int counter = 0;
+          char name[64];
+          for(int tries = 0; fd < 0 && tries < 16; ++tries) {
+            snprintf(name, sizeof(name), "/ofxImage.%d.%d", (int) getpid(), counter++);
+            fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+          }
+          if(fd < 0)
+            return -1;
+          shm_unlink(name);
+          fcntl(fd, F_SETFD, FD_CLOEXEC);
+        }
+        if(ftruncate(fd, (off_t) nBytes) != 0) {
+          close(fd);
+          return -1;
+        }
+        return fd;
+      }
+#endif
+
+      ////////////////////////////////////////////////////////////////////////////////
+      // SharedBlock
+
+      SharedBlock::SharedBlock()
+        : _fd(-1)
+        , _ptr(0)
+        , _size(0)
+      {
+      }
+
+      SharedBlock::~SharedBlock()
+      {
+        release();
+      }
+
+      bool SharedBlock::create(size_t nBytes)
+      {
+        release();
+#ifndef _WIN32
+        // zero sized maps are not allowed
+        if(nBytes == 0)
+          nBytes = 1;
+        int fd = makeSharedFd(nBytes);
+        if(fd < 0)
+          return false;
+        return map(fd, nBytes);
+#else
+        (void) nBytes;
+        return false;
+#endif
+      }
+
+      bool SharedBlock::map(int fd, size_t nBytes)
+      {
+        release();
+#ifndef _WIN32
+        if(fd < 0)
+          return false;
+        void *ptr = mmap(0, nBytes ? nBytes : 1, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if(ptr == MAP_FAILED) {
+          close(fd);
+          return false;
+        }
+        _fd = fd;
+        _ptr = ptr;
+        _size = nBytes;
+
+        std::lock_guard<std::mutex> guard(getRegistryLock());
+        getRegistry()[(const char *) _ptr] = this;
+        return true;
+#else
+        (void) fd;
+        (void) nBytes;
+        return false;
+#endif
+      }
+
+      void SharedBlock::release()
+      {
+#ifndef _WIN32
+        if(_ptr) {
+          {
+            std::lock_guard<std::mutex> guard(getRegistryLock());
+            getRegistry().erase((const char *) _ptr);
+          }
+          munmap(_ptr, _size ? _size : 1);
+        }
+        if(_fd >= 0)
+          close(_fd);
+#endif
+        _fd = -1;
+        _ptr = 0;
+        _size = 0;
+      }
+
+      SharedBlock *SharedBlock::find(const void *ptr, size_t nBytes, size_t &offset)
+      {
+        const char *p = (const char *) ptr;
+        std::lock_guard<std::mutex> guard(getRegistryLock());
+        std::map<const char *, SharedBlock *> &registry = getRegistry();
+
+        // the last block starting at or before p
+        std::map<const char *, SharedBlock *>::iterator it = registry.upper_bound(p);
+        if(it == registry.begin())
+          return 0;
+        --it;
+
+        SharedBlock *block = it->second;
+        offset = p - it->first;
+        if(offset + nBytes > block->_size)
+          return 0;
+        return block;
+      }
+
+      ////////////////////////////////////////////////////////////////////////////////
+      // SharedInstance
+
+      SharedInstance::SharedInstance()
+      {
+      }
+
+      bool SharedInstance::alloc(size_t nBytes)
+      {
+        if(_locked)
+          return false;
+        // _ptr is left null so the base class has nothing to delete
+        return _block.create(nBytes);
+      }
+
+      void SharedInstance::freeMem()
+      {
+        _block.release();
+        _locked = 0;
+      }
+
+      void *SharedInstance::getPtr()
+      {
+        return _block.getPtr();
+      }
+
+    } // Memory
+
+  } // Host
+
+} // OFX
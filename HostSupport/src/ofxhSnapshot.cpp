@@ -0,0 +1,866 @@
+// Copyright OpenFX and contributors to the OpenFX project.
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <cstring>
+
+// ofx
+#include "ofxCore.h"
+#include "ofxImageEffect.h"
+
+// ofx host
+#include "ofxhBinary.h"
+#include "ofxhPropertySuite.h"
+#include "ofxhClip.h"
+#include "ofxhParam.h"
+#include "ofxhImageEffect.h"
+#include "ofxhPluginAPICache.h"
+#include "ofxhPluginCache.h"
+#include "ofxhHost.h"
+#include "ofxhImageEffectAPI.h"
+#include "ofxhSnapshot.h"
+
+namespace OFX {
+
+  namespace Host {
+
+    namespace ImageEffect {
+
+      ////////////////////////////////////////////////////////////////////////////////
+      // param values
+
+      OfxStatus getParamValue(Param::Instance &param, const OfxTime *time, std::vector<double> &values, std::string &str)
+      {
+        values.clear();
+        str.clear();
+        OfxStatus st = kOfxStatErrUnsupported;
+        if(Param::IntegerInstance *p = dynamic_cast<Param::IntegerInstance *>(&param)) {
+          int v = 0;
+          st = time ? p->get(*time, v) : p->get(v);
+          values.push_back(v);
+        }
+        else if(Param::DoubleInstance *p = dynamic_cast<Param::DoubleInstance *>(&param)) {
+          double v = 0;
+          st = time ? p->get(*time, v) : p->get(v);
+          values.push_back(v);
+        }
+        else if(Param::BooleanInstance *p = dynamic_cast<Param::BooleanInstance *>(&param)) {
+          bool v = false;
+          st = time ? p->get(*time, v) : p->get(v);
+          values.push_back(v);
+        }
+        else if(Param::ChoiceInstance *p = dynamic_cast<Param::ChoiceInstance *>(&param)) {
+          int v = 0;
+          st = time ? p->get(*time, v) : p->get(v);
+          values.push_back(v);
+        }
+        else if(Param::RGBAInstance *p = dynamic_cast<Param::RGBAInstance *>(&param)) {
+          double v[4] = {0, 0, 0, 0};
+          st = time ? p->get(*time, v[0], v[1], v[2], v[3]) : p->get(v[0], v[1], v[2], v[3]);
+          values.assign(v, v + 4);
+        }
+        else if(Param::RGBInstance *p = dynamic_cast<Param::RGBInstance *>(&param)) {
+          double v[3] = {0, 0, 0};
+          st = time ? p->get(*time, v[0], v[1], v[2]) : p->get(v[0], v[1], v[2]);
+          values.assign(v, v + 3);
+        }
+        else if(Param::Double2DInstance *p = dynamic_cast<Param::Double2DInstance *>(&param)) {
+          double v[2] = {0, 0};
+          st = time ? p->get(*time, v[0], v[1]) : p->get(v[0], v[1]);
+          values.assign(v, v + 2);
+        }
+        else if(Param::Integer2DInstance *p = dynamic_cast<Param::Integer2DInstance *>(&param)) {
+          int v[2] = {0, 0};
+          st = time ? p->get(*time, v[0], v[1]) : p->get(v[0], v[1]);
+          values.assign(v, v + 2);
+        }
+        else if(Param::Double3DInstance *p = dynamic_cast<Param::Double3DInstance *>(&param)) {
+          double v[3] = {0, 0, 0};
+          st = time ? p->get(*time, v[0], v[1], v[2]) : p->get(v[0], v[1], v[2]);
+          values.assign(v, v + 3);
+        }
+        else if(Param::Integer3DInstance *p = dynamic_cast<Param::Integer3DInstance *>(&param)) {
+          int v[3] = {0, 0, 0};
+          st = time ? p->get(*time, v[0], v[1], v[2]) : p->get(v[0], v[1], v[2]);
+          values.assign(v, v + 3);
+        }
+        else if(Param::StringInstance *p = dynamic_cast<Param::StringInstance *>(&param)) {
+          st = time ? p->get(*time, str) : p->get(str);
+        }
+        return st;
+      }
+
+      OfxStatus setParamValue(Param::Instance &param, const OfxTime *time, const std::vector<double> &values, const std::string &str)
+      {
+        // short values come out as zeros
+        double v[4] = {0, 0, 0, 0};
+        for(size_t i = 0; i < values.size() && i < 4; ++i)
+          v[i] = values[i];
+
+        if(Param::IntegerInstance *p = dynamic_cast<Param::IntegerInstance *>(&param))
+          return time ? p->set(*time, int(v[0])) : p->set(int(v[0]));
+        if(Param::DoubleInstance *p = dynamic_cast<Param::DoubleInstance *>(&param))
+          return time ? p->set(*time, v[0]) : p->set(v[0]);
+        if(Param::BooleanInstance *p = dynamic_cast<Param::BooleanInstance *>(&param))
+          return time ? p->set(*time, v[0] != 0) : p->set(v[0] != 0);
+        if(Param::ChoiceInstance *p = dynamic_cast<Param::ChoiceInstance *>(&param))
+          return time ? p->set(*time, int(v[0])) : p->set(int(v[0]));
+        if(Param::RGBAInstance *p = dynamic_cast<Param::RGBAInstance *>(&param))
+          return time ? p->set(*time, v[0], v[1], v[2], v[3]) : p->set(v[0], v[1], v[2], v[3]);
+        if(Param::RGBInstance *p = dynamic_cast<Param::RGBInstance *>(&param))
+          return time ? p->set(*time, v[0], v[1], v[2]) : p->set(v[0], v[1], v[2]);
+        if(Param::Double2DInstance *p = dynamic_cast<Param::Double2DInstance *>(&param))
+          return time ? p->set(*time, v[0], v[1]) : p->set(v[0], v[1]);
+        if(Param::Integer2DInstance *p = dynamic_cast<Param::Integer2DInstance *>(&param))
+          return time ? p->set(*time, int(v[0]), int(v[1])) : p->set(int(v[0]), int(v[1]));
+        if(Param::Double3DInstance *p = dynamic_cast<Param::Double3DInstance *>(&param))
+          return time ? p->set(*time, v[0], v[1], v[2]) : p->set(v[0], v[1], v[2]);
+        if(Param::Integer3DInstance *p = dynamic_cast<Param::Integer3DInstance *>(&param))
+          return time ? p->set(*time, int(v[0]), int(v[1]), int(v[2])) : p->set(int(v[0]), int(v[1]), int(v[2]));
+        if(Param::StringInstance *p = dynamic_cast<Param::StringInstance *>(&param))
+          return time ? p->set(*time, str.c_str()) : p->set(str.c_str());
+        return kOfxStatErrUnsupported;
+      }
+
+      ////////////////////////////////////////////////////////////////////////////////
+      // encoding
+      //
+      // Counts and ints are little endian base 128 varints, ints zig zagged
+      // so small negative ones stay short. Doubles are their 8 bytes, little
+      // endian. Strings are a count then their bytes.
+      //
+      // A whole snapshot is
+      //
+      //     "OFXS" version kind=0 pluginId major minor context
+      //     nRecords (key record)*
+      //
+      // and a delta is
+      //
+      //     "OFXS" version kind=1 pluginId major minor context
+      //     baseChecksum resultChecksum
+      //     nChanged (key record)* nRemoved key*
+      //
+      // A record is a string, so a reader can skip the ones it doesn't know.
+      // Keys are a letter for the sort of record and then the name of the
+      // clip or param it is of.
+
+      static const char kMagic[4] = {'O', 'F', 'X', 'S'};
+
+      enum SnapshotKindEnum {
+        eSnapshotWhole = 0,
+        eSnapshotDelta = 1
+      };
+
+      /// how a param's value is kept in its record
+      enum ValueKindEnum {
+        eValueNone = 0,     ///< it has no value
+        eValueStatic = 1,   ///< one value
+        eValueKeyed = 2     ///< a value at each key
+      };
+
+      static const char kInstanceKey[] = "i";
+      static const char kClipPrefix = 'c';
+      static const char kParamPrefix = 'p';
+
+      /// appends to a string of bytes
+      class Writer {
+        std::string &_bytes;
+
+      public :
+        explicit Writer(std::string &bytes) : _bytes(bytes) {}
+
+        void putByte(int b)
+        {
+          _bytes.push_back(char(b));
+        }
+
+        void putCount(uint64_t n)
+        {
+          while(n >= 0x80) {
+            putByte(int(n & 0x7f) | 0x80);
+            n >>= 7;
+          }
+          putByte(int(n));
+        }
+
+        void putInt(int v)
+        {
+          int64_t w = v;
+          putCount((uint64_t(w) << 1) ^ uint64_t(w >> 63));
+        }
+
+        void putFixed(uint64_t n)
+        {
+          for(int i = 0; i < 8; ++i)
+            putByte(int((n >> (8 * i)) & 0xff));
+        }
+
+        void putDouble(double d)
+        {
+          uint64_t n;
+          memcpy(&n, &d, sizeof(n));
+          putFixed(n);
+        }
+
+        void putString(const std::string &s)
+        {
+          putCount(s.size());
+          _bytes.append(s);
+        }
+      };
+
+      /// reads from a string of bytes, going bad rather than past the end
+      class Reader {
+        const std::string &_bytes;
+        size_t             _pos;
+        bool               _ok;
+
+      public :
+        explicit Reader(const std::string &bytes) : _bytes(bytes), _pos(0), _ok(true) {}
+
+        bool ok() const { return _ok; }
+
+        void fail() { _ok = false; }
+
+        bool atEnd() const { return _pos == _bytes.size(); }
+
+        int getByte()
+        {
+          if(_pos >= _bytes.size()) {
+            _ok = false;
+            return 0;
+          }
+          return (unsigned char) _bytes[_pos++];
+        }
+
+        uint64_t getCount()
+        {
+          uint64_t n = 0;
+          for(int shift = 0; shift < 64 && _ok; shift += 7) {
+            int b = getByte();
+            n |= uint64_t(b & 0x7f) << shift;
+            if(!(b & 0x80))
+              return n;
+          }
+          _ok = false;
+          return 0;
+        }
+
+        /// a count of things each at least a byte long, so no more than are left
+        size_t getLength()
+        {
+          uint64_t n = getCount();
+          if(n > _bytes.size() - _pos) {
+            _ok = false;
+            return 0;
+          }
+          return size_t(n);
+        }
+
+        int getInt()
+        {
+          uint64_t n = getCount();
+          return int(int64_t(n >> 1) ^ -int64_t(n & 1));
+        }
+
+        uint64_t getFixed()
+        {
+          uint64_t n = 0;
+          for(int i = 0; i < 8; ++i)
+            n |= uint64_t(getByte()) << (8 * i);
+          return n;
+        }
+
+        double getDouble()
+        {
+          uint64_t n = getFixed();
+          double d;
+          memcpy(&d, &n, sizeof(d));
+          return d;
+        }
+
+        std::string getString()
+        {
+          size_t n = getLength();
+          std::string s = _ok ? _bytes.substr(_pos, n) : std::string();
+          _pos += n;
+          return s;
+        }
+      };
+
+      /// the properties of a set that are the plugin's to change, pointers
+      /// aside, as they mean nothing in another instance
+      static bool isPluginState(Property::Property &prop)
+      {
+        return prop.getType() != Property::ePointer && !prop.getPluginReadOnly() && !prop.hasGetHook();
+      }
+
+      /// the value of a property, whatever its type
+      struct PropertyValue {
+        Property::TypeEnum        type;
+        std::vector<int>          ints;
+        std::vector<double>       doubles;
+        std::vector<std::string>  strings;
+
+        PropertyValue() : type(Property::eInt) {}
+
+        /// get it from a set, through any get hooks
+        PropertyValue(const Property::Set &set, const std::string &name, Property::TypeEnum t)
+          : type(t)
+        {
+          int dim = set.getDimension(name);
+          for(int i = 0; i < dim; ++i) {
+            switch(type) {
+            case Property::eInt :    ints.push_back(set.getIntProperty(name, i)); break;
+            case Property::eDouble : doubles.push_back(set.getDoubleProperty(name, i)); break;
+            default :                strings.push_back(set.getStringProperty(name, i)); break;
+            }
+          }
+        }
+
+        bool operator==(const PropertyValue &other) const
+        {
+          return type == other.type && ints == other.ints && doubles == other.doubles && strings == other.strings;
+        }
+
+        bool operator!=(const PropertyValue &other) const { return !(*this == other); }
+
+        int getDimension() const
+        {
+          return int(type == Property::eInt ? ints.size() : type == Property::eDouble ? doubles.size() : strings.size());
+        }
+
+        void put(Writer &w, const std::string &name) const
+        {
+          w.putString(name);
+          w.putByte(type);
+          w.putCount(getDimension());
+          for(size_t i = 0; i < ints.size(); ++i)
+            w.putInt(ints[i]);
+          for(size_t i = 0; i < doubles.size(); ++i)
+            w.putDouble(doubles[i]);
+          for(size_t i = 0; i < strings.size(); ++i)
+            w.putString(strings[i]);
+        }
+
+        /// read one, returning false if it is of a type we can't size
+        bool get(Reader &r, std::string &name)
+        {
+          name = r.getString();
+          type = Property::TypeEnum(r.getByte());
+          size_t dim = r.getLength();
+          for(size_t i = 0; i < dim && r.ok(); ++i) {
+            switch(type) {
+            case Property::eInt :    ints.push_back(r.getInt()); break;
+            case Property::eDouble : doubles.push_back(r.getDouble()); break;
+            case Property::eString : strings.push_back(r.getString()); break;
+            default :                r.fail(); break;
+            }
+          }
+          return r.ok();
+        }
+
+        /// set it on a set, going through it so any notify hooks see it, and
+        /// so a property shared copy on write is copied before it is touched
+        void set(Property::Set &set, const std::string &name) const
+        {
+          int dim = getDimension();
+          switch(type) {
+          case Property::eInt :
+            set.setIntPropertyN(name, ints.data(), dim);
+            break;
+          case Property::eDouble :
+            set.setDoublePropertyN(name, doubles.data(), dim);
+            break;
+          default :
+            // strings are set one at a time, so a longer one has to be emptied first
+            if(set.getDimension(name) > dim)
+              set.fetchProperty(name)->reset();
+            for(int i = 0; i < dim; ++i)
+              set.setStringProperty(name, strings[i], i);
+            break;
+          }
+        }
+      };
+
+      /// Write the properties of a set that are the plugin's. If given a
+      /// baseline, say the param's descriptor, only those that differ from it.
+      static void putProperties(Writer &w, const Property::Set &set, const Property::Set *baseline)
+      {
+        const Property::PropertyMap &props = set.getProperties();
+        std::vector<std::pair<const std::string *, PropertyValue> > values;
+        for(Property::PropertyMap::const_iterator it = props.begin(); it != props.end(); ++it) {
+          Property::Property &prop = *it->second;
+          if(!isPluginState(prop))
+            continue;
+          PropertyValue value(set, it->first, prop.getType());
+          if(baseline && baseline->findProperty(it->first) &&
+             PropertyValue(*baseline, it->first, prop.getType()) == value)
+            continue;
+          values.push_back(std::make_pair(&it->first, value));
+        }
+
+        w.putCount(values.size());
+        for(size_t i = 0; i < values.size(); ++i)
+          values[i].second.put(w, *values[i].first);
+      }
+
+      /// Set the properties of a set that are the plugin's to those read,
+      /// or the baseline's if not there, touching only those that differ.
+      static void restoreProperties(Reader &r, Property::Set &set, const Property::Set *baseline)
+      {
+        std::map<std::string, PropertyValue> read;
+        size_t n = r.getLength();
+        for(size_t i = 0; i < n && r.ok(); ++i) {
+          std::string name;
+          PropertyValue value;
+          if(value.get(r, name))
+            read[name] = value;
+        }
+        if(!r.ok())
+          return;
+
+        const Property::PropertyMap &props = set.getProperties();
+        for(Property::PropertyMap::const_iterator it = props.begin(); it != props.end(); ++it) {
+          Property::Property &prop = *it->second;
+          if(!isPluginState(prop))
+            continue;
+
+          PropertyValue wanted;
+          std::map<std::string, PropertyValue>::const_iterator found = read.find(it->first);
+          if(found != read.end())
+            wanted = found->second;
+          else if(baseline && baseline->findProperty(it->first))
+            wanted = PropertyValue(*baseline, it->first, prop.getType());
+          else
+            continue;
+
+          if(wanted.type != prop.getType() || (prop.isFixedSize() && prop.getFixedDimension() != wanted.getDimension()))
+            continue;
+          if(PropertyValue(set, it->first, prop.getType()) != wanted)
+            wanted.set(set, it->first);
+        }
+      }
+
+      static void putValue(Writer &w, const std::vector<double> &values, const std::string &str)
+      {
+        w.putCount(values.size());
+        for(size_t i = 0; i < values.size(); ++i)
+          w.putDouble(values[i]);
+        w.putString(str);
+      }
+
+      static void getValue(Reader &r, std::vector<double> &values, std::string &str)
+      {
+        size_t n = r.getLength();
+        values.clear();
+        for(size_t i = 0; i < n && r.ok(); ++i)
+          values.push_back(r.getDouble());
+        str = r.getString();
+      }
+
+      /// the number of keys on a param, none if it can't say
+      static unsigned int getNumKeys(Param::Instance &param)
+      {
+        Param::KeyframeParam *keys = dynamic_cast<Param::KeyframeParam *>(&param);
+        unsigned int nKeys = 0;
+        if(!keys || keys->getNumKeys(nKeys) != kOfxStatOK)
+          return 0;
+        return nKeys;
+      }
+
+      /// the properties a param was described with, what a plugin changes them from
+      static const Property::Set *getDescribedProperties(Instance &instance, const Param::Instance &param)
+      {
+        const std::map<std::string, Param::Descriptor *> &params = instance.getDescriptor().getParams();
+        std::map<std::string, Param::Descriptor *>::const_iterator it = params.find(param.getName());
+        return it == params.end() ? 0 : &it->second->getProperties();
+      }
+
+      static std::string encodeParam(Instance &instance, Param::Instance &param)
+      {
+        std::string bytes;
+        Writer w(bytes);
+        putProperties(w, param.getProperties(), getDescribedProperties(instance, param));
+
+        std::vector<double> values;
+        std::string str;
+        unsigned int nKeys = getNumKeys(param);
+        if(nKeys == 0) {
+          if(getParamValue(param, 0, values, str) == kOfxStatOK) {
+            w.putByte(eValueStatic);
+            putValue(w, values, str);
+          }
+          else
+            w.putByte(eValueNone);
+          return bytes;
+        }
+
+        Param::KeyframeParam *keys = dynamic_cast<Param::KeyframeParam *>(&param);
+        w.putByte(eValueKeyed);
+        w.putCount(nKeys);
+        for(unsigned int i = 0; i < nKeys; ++i) {
+          OfxTime time = 0;
+          keys->getKeyTime(int(i), time);
+          getParamValue(param, &time, values, str);
+          w.putDouble(time);
+          putValue(w, values, str);
+        }
+        return bytes;
+      }
+
+      static OfxStatus restoreParam(Instance &instance, Param::Instance &param, const std::string &record)
+      {
+        Reader r(record);
+        restoreProperties(r, param.getProperties(), getDescribedProperties(instance, param));
+        int kind = r.getByte();
+        if(!r.ok())
+          return kOfxStatErrFormat;
+        if(kind == eValueNone)
+          return kOfxStatOK;
+
+        // start from no animation, then put the keys back
+        Param::KeyframeParam *keys = dynamic_cast<Param::KeyframeParam *>(&param);
+        if(keys && getNumKeys(param) > 0)
+          keys->deleteAllKeys();
+
+        std::vector<double> values;
+        std::string str;
+        if(kind == eValueStatic) {
+          getValue(r, values, str);
+          return r.ok() ? setParamValue(param, 0, values, str) : kOfxStatErrFormat;
+        }
+
+        OfxStatus result = kOfxStatOK;
+        size_t nKeys = r.getLength();
+        for(size_t i = 0; i < nKeys && r.ok(); ++i) {
+          OfxTime time = r.getDouble();
+          getValue(r, values, str);
+          OfxStatus st = r.ok() ? setParamValue(param, &time, values, str) : kOfxStatErrFormat;
+          if(st != kOfxStatOK && result == kOfxStatOK)
+            result = st;
+        }
+        return r.ok() ? result : kOfxStatErrFormat;
+      }
+
+      /// what a clip's preferences were worked out from
+      static std::string encodeClipMetadata(ClipInstance &clip)
+      {
+        std::string bytes;
+        Writer w(bytes);
+        double a, b;
+        w.putByte(clip.getConnected());
+        w.putString(clip.getUnmappedBitDepth());
+        w.putString(clip.getUnmappedComponents());
+        w.putString(clip.getPremult());
+        w.putString(clip.getFieldOrder());
+        w.putDouble(clip.getAspectRatio());
+        w.putDouble(clip.getFrameRate());
+        clip.getFrameRange(a, b);
+        w.putDouble(a);
+        w.putDouble(b);
+        w.putDouble(clip.getUnmappedFrameRate());
+        clip.getUnmappedFrameRange(a, b);
+        w.putDouble(a);
+        w.putDouble(b);
+        w.putByte(clip.getContinuousSamples());
+        return bytes;
+      }
+
+      static std::string encodeClip(ClipInstance &clip)
+      {
+        std::string bytes;
+        Writer w(bytes);
+        w.putString(clip.getPixelDepth());
+        w.putString(clip.getComponents());
+        w.putString(encodeClipMetadata(clip));
+        return bytes;
+      }
+
+      static std::string encodeInstance(Instance &instance)
+      {
+        std::string bytes;
+        Writer w(bytes);
+        putProperties(w, instance.getProps(), 0);
+        w.putByte(instance.areClipPrefsDirty());
+        w.putString(instance.getOutputFielding());
+        w.putString(instance.getOutputPreMultiplication());
+        w.putDouble(instance.getOutputFrameRate());
+        w.putByte(instance.continuousSamples());
+        w.putByte(instance.isFrameVarying());
+        return bytes;
+      }
+
+      ////////////////////////////////////////////////////////////////////////////////
+      // Snapshot
+
+      Snapshot::Snapshot()
+        : _pluginMajor(0)
+        , _pluginMinor(0)
+      {
+      }
+
+      Snapshot::Snapshot(Instance &instance)
+        : _pluginMajor(0)
+        , _pluginMinor(0)
+      {
+        capture(instance);
+      }
+
+      void Snapshot::captureRecords(Instance &instance, std::map<std::string, std::string> &records)
+      {
+        records.clear();
+        records[kInstanceKey] = encodeInstance(instance);
+        for(int i = 0; i < instance.getNClips(); ++i) {
+          ClipInstance *clip = instance.getNthClip(i);
+          records[kClipPrefix + clip->getName()] = encodeClip(*clip);
+        }
+        const std::list<Param::Instance *> &params = instance.getParamList();
+        for(std::list<Param::Instance *>::const_iterator it = params.begin(); it != params.end(); ++it)
+          records[kParamPrefix + (*it)->getName()] = encodeParam(instance, **it);
+      }
+
+      void Snapshot::capture(Instance &instance)
+      {
+        ImageEffectPlugin *plugin = instance.getPlugin();
+        _pluginId = plugin ? plugin->getIdentifier() : std::string();
+        _pluginMajor = plugin ? plugin->getVersionMajor() : 0;
+        _pluginMinor = plugin ? plugin->getVersionMinor() : 0;
+        _context = instance.getContext();
+        captureRecords(instance, _records);
+      }
+
+      uint64_t Snapshot::getChecksum() const
+      {
+        // 64 bit FNV-1a over the encoding of everything
+        std::string bytes;
+        Writer w(bytes);
+        w.putString(_pluginId);
+        w.putInt(_pluginMajor);
+        w.putInt(_pluginMinor);
+        w.putString(_context);
+        uint64_t h = 14695981039346656037ULL;
+        for(std::map<std::string, std::string>::const_iterator it = _records.begin(); ; ++it) {
+          for(size_t i = 0; i < bytes.size(); ++i) {
+            h ^= (unsigned char) bytes[i];
+            h *= 1099511628211ULL;
+          }
+          if(it == _records.end())
+            break;
+          bytes.clear();
+          w.putString(it->first);
+          w.putString(it->second);
+        }
+        return h;
+      }
+
+      void Snapshot::encodeHeader(std::string &bytes, bool delta) const
+      {
+        Writer w(bytes);
+        bytes.append(kMagic, sizeof(kMagic));
+        w.putCount(kVersion);
+        w.putByte(delta ? eSnapshotDelta : eSnapshotWhole);
+        w.putString(_pluginId);
+        w.putInt(_pluginMajor);
+        w.putInt(_pluginMinor);
+        w.putString(_context);
+      }
+
+      std::string Snapshot::encode() const
+      {
+        std::string bytes;
+        encodeHeader(bytes, false);
+        Writer w(bytes);
+        w.putCount(_records.size());
+        for(std::map<std::string, std::string>::const_iterator it = _records.begin(); it != _records.end(); ++it) {
+          w.putString(it->first);
+          w.putString(it->second);
+        }
+        return bytes;
+      }
+
+      std::string Snapshot::encodeDelta(const Snapshot &base) const
+      {
+        if(base._pluginId != _pluginId || base._pluginMajor != _pluginMajor ||
+           base._pluginMinor != _pluginMinor || base._context != _context)
+          return encode();
+
+        std::vector<std::map<std::string, std::string>::const_iterator> changed;
+        for(std::map<std::string, std::string>::const_iterator it = _records.begin(); it != _records.end(); ++it) {
+          std::map<std::string, std::string>::const_iterator theirs = base._records.find(it->first);
+          if(theirs == base._records.end() || theirs->second != it->second)
+            changed.push_back(it);
+        }
+        std::vector<std::string> removed;
+        for(std::map<std::string, std::string>::const_iterator it = base._records.begin(); it != base._records.end(); ++it)
+          if(_records.find(it->first) == _records.end())
+            removed.push_back(it->first);
+
+        std::string bytes;
+        encodeHeader(bytes, true);
+        Writer w(bytes);
+        w.putFixed(base.getChecksum());
+        w.putFixed(getChecksum());
+        w.putCount(changed.size());
+        for(size_t i = 0; i < changed.size(); ++i) {
+          w.putString(changed[i]->first);
+          w.putString(changed[i]->second);
+        }
+        w.putCount(removed.size());
+        for(size_t i = 0; i < removed.size(); ++i)
+          w.putString(removed[i]);
+        return bytes;
+      }
+
+      OfxStatus Snapshot::decode(const std::string &bytes, const Snapshot *base)
+      {
+        if(bytes.size() < sizeof(kMagic) || memcmp(bytes.data(), kMagic, sizeof(kMagic)) != 0)
+          return kOfxStatErrFormat;
+
+        Reader r(bytes);
+        for(size_t i = 0; i < sizeof(kMagic); ++i)
+          r.getByte();
+        uint64_t version = r.getCount();
+        int kind = r.getByte();
+        Snapshot read;
+        read._pluginId = r.getString();
+        read._pluginMajor = r.getInt();
+        read._pluginMinor = r.getInt();
+        read._context = r.getString();
+        if(!r.ok() || version < 1 || version > uint64_t(kVersion))
+          return kOfxStatErrFormat;
+
+        if(kind == eSnapshotWhole) {
+          size_t n = r.getLength();
+          for(size_t i = 0; i < n && r.ok(); ++i) {
+            std::string key = r.getString();
+            read._records[key] = r.getString();
+          }
+          if(!r.ok() || !r.atEnd())
+            return kOfxStatErrFormat;
+        }
+        else if(kind == eSnapshotDelta) {
+          uint64_t baseChecksum = r.getFixed();
+          uint64_t checksum = r.getFixed();
+          if(!r.ok())
+            return kOfxStatErrFormat;
+          if(!base || base->getChecksum() != baseChecksum)
+            return kOfxStatErrValue;
+
+          read._records = base->_records;
+          size_t n = r.getLength();
+          for(size_t i = 0; i < n && r.ok(); ++i) {
+            std::string key = r.getString();
+            read._records[key] = r.getString();
+          }
+          n = r.getLength();
+          for(size_t i = 0; i < n && r.ok(); ++i)
+            read._records.erase(r.getString());
+          if(!r.ok() || !r.atEnd() || read.getChecksum() != checksum)
+            return kOfxStatErrFormat;
+        }
+        else
+          return kOfxStatErrFormat;
+
+        *this = read;
+        return kOfxStatOK;
+      }
+
+      OfxStatus Snapshot::restore(Instance &instance, std::vector<std::string> *changedParams) const
+      {
+        ImageEffectPlugin *plugin = instance.getPlugin();
+        if(!plugin || plugin->getIdentifier() != _pluginId || plugin->getVersionMajor() != _pluginMajor ||
+           instance.getContext() != _context)
+          return kOfxStatErrValue;
+
+        OfxStatus result = kOfxStatOK;
+        bool changed = false;
+
+        // the params, only those that differ, so the host hears of nothing else
+        const std::list<Param::Instance *> &params = instance.getParamList();
+        for(std::list<Param::Instance *>::const_iterator it = params.begin(); it != params.end(); ++it) {
+          std::map<std::string, std::string>::const_iterator record = _records.find(kParamPrefix + (*it)->getName());
+          if(record == _records.end() || encodeParam(instance, **it) == record->second)
+            continue;
+          OfxStatus st = restoreParam(instance, **it, record->second);
+          if(st != kOfxStatOK && result == kOfxStatOK)
+            result = st;
+          if(changedParams)
+            changedParams->push_back((*it)->getName());
+          changed = true;
+        }
+
+        // the instance's own properties and its clip preferences
+        std::map<std::string, std::string>::const_iterator record = _records.find(kInstanceKey);
+        bool prefsChanged = record != _records.end() && encodeInstance(instance) != record->second;
+        for(int i = 0; i < instance.getNClips() && record != _records.end() && !prefsChanged; ++i) {
+          ClipInstance *clip = instance.getNthClip(i);
+          std::map<std::string, std::string>::const_iterator clipRecord = _records.find(kClipPrefix + clip->getName());
+          prefsChanged = clipRecord != _records.end() && encodeClip(*clip) != clipRecord->second;
+        }
+
+        if(prefsChanged) {
+          Reader r(record->second);
+          restoreProperties(r, instance.getProps(), 0);
+          bool prefsDirty = r.getByte() != 0;
+          std::string outputFielding = r.getString();
+          std::string outputPremult = r.getString();
+          double outputFrameRate = r.getDouble();
+          bool continuousSamples = r.getByte() != 0;
+          bool frameVarying = r.getByte() != 0;
+          if(!r.ok())
+            return kOfxStatErrFormat;
+
+          // the clips' preferences only hold if they are connected as they were
+          for(int i = 0; i < instance.getNClips() && !prefsDirty; ++i) {
+            ClipInstance *clip = instance.getNthClip(i);
+            std::map<std::string, std::string>::const_iterator clipRecord = _records.find(kClipPrefix + clip->getName());
+            if(clipRecord == _records.end()) {
+              prefsDirty = true;
+              break;
+            }
+            Reader c(clipRecord->second);
+            std::string depth = c.getString();
+            std::string components = c.getString();
+            std::string metadata = c.getString();
+            if(!c.ok() || metadata != encodeClipMetadata(*clip))
+              prefsDirty = true;
+            else {
+              clip->setPixelDepth(depth);
+              clip->setComponents(components);
+            }
+          }
+
+          if(prefsDirty)
+            instance.setClipPrefsDirty();
+          else
+            instance.setClipPreferences(outputFielding, outputPremult, outputFrameRate, continuousSamples, frameVarying);
+          changed = true;
+        }
+
+        if(changed)
+          instance.getActionCache().invalidate();
+        return result;
+      }
+
+      std::vector<std::string> Snapshot::getChangedParams(const Snapshot &other) const
+      {
+        std::vector<std::string> names;
+        for(std::map<std::string, std::string>::const_iterator it = _records.begin(); it != _records.end(); ++it) {
+          if(it->first.empty() || it->first[0] != kParamPrefix)
+            continue;
+          std::map<std::string, std::string>::const_iterator theirs = other._records.find(it->first);
+          if(theirs == other._records.end() || theirs->second != it->second)
+            names.push_back(it->first.substr(1));
+        }
+        for(std::map<std::string, std::string>::const_iterator it = other._records.begin(); it != other._records.end(); ++it) {
+          if(!it->first.empty() && it->first[0] == kParamPrefix && _records.find(it->first) == _records.end())
+            names.push_back(it->first.substr(1));
+        }
+        return names;
+      }
+
+    } // namespace ImageEffect
+
+  } // namespace Host
+
+} // namespace OFX
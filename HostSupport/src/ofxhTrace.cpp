@@ -0,0 +1,477 @@
+// Copyright OpenFX and contributors to the OpenFX project.
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <cstdio>
+#include <cmath>
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+
+// ofx
+#include "ofxCore.h"
+#include "ofxImageEffect.h"
+
+// ofx host
+#include "ofxhPropertySuite.h"
+#include "ofxhTrace.h"
+
+namespace OFX {
+
+  namespace Host {
+
+    namespace Trace {
+
+      ////////////////////////////////////////////////////////////////////////////////
+      // Histogram
+
+      Histogram::Histogram()
+        : _count(0)
+        , _total(0)
+        , _min(0)
+        , _max(0)
+      {
+        for(int i = 0; i < kNumBuckets; ++i)
+          _buckets[i] = 0;
+      }
+
+      void Histogram::add(double micros)
+      {
+        int bucket = 0;
+        if(micros >= 1.) {
+          bucket = int(std::floor(std::log2(micros))) + 1;
+          if(bucket >= kNumBuckets)
+            bucket = kNumBuckets - 1;
+        }
+        ++_buckets[bucket];
+
+        if(_count == 0 || micros < _min)
+          _min = micros;
+        if(micros > _max)
+          _max = micros;
+        _total += micros;
+        ++_count;
+      }
+
+      void Histogram::merge(const Histogram &other)
+      {
+        if(other._count == 0)
+          return;
+        for(int i = 0; i < kNumBuckets; ++i)
+          _buckets[i] += other._buckets[i];
+        if(_count == 0 || other._min < _min)
+          _min = other._min;
+        if(other._max > _max)
+          _max = other._max;
+        _total += other._total;
+        _count += other._count;
+      }
+
+      double Histogram::getBucketUpperBound(int bucket)
+      {
+        return std::ldexp(1., bucket);
+      }
+
+      double Histogram::getPercentile(double p) const
+      {
+        if(_count == 0)
+          return 0.;
+
+        double wanted = p * _count;
+        size_t seen = 0;
+        for(int i = 0; i < kNumBuckets; ++i) {
+          seen += _buckets[i];
+          if(seen >= wanted && seen > 0)
+            return std::min(getBucketUpperBound(i), _max);
+        }
+        return _max;
+      }
+
+      ////////////////////////////////////////////////////////////////////////////////
+      // recording
+
+      typedef std::chrono::steady_clock Clock;
+
+      /// a finished span
+      struct Record {
+        const char  *category;
+        std::string  name;
+        std::string  pluginId;
+        std::string  args;
+        unsigned int tid;
+        double       start;    ///< microseconds since the trace epoch
+        double       duration; ///< microseconds
+      };
+
+      /// What a thread records into. Only its thread adds to it, the lock is
+      /// there for the odd time someone reads it, so it is never contended
+      /// while rendering.
+      struct ThreadBuffer {
+        std::mutex          lock;
+        unsigned int        tid;
+        std::vector<Record> records;
+        size_t              dropped;
+        HistogramMap        histograms;
+      };
+
+      /// all the thread buffers, and what was left by threads that have gone
+      struct Registry {
+        std::mutex                  lock;
+        std::vector<ThreadBuffer *> buffers;
+        std::vector<Record>         retiredRecords;
+        size_t                      retiredDropped;
+        HistogramMap                retiredHistograms;
+        unsigned int                nextTid;
+        Clock::time_point           epoch;
+
+        Registry() : retiredDropped(0), nextTid(1), epoch(Clock::now()) {}
+      };
+
+      static std::atomic<bool>   gEnabled(false);
+      static std::atomic<size_t> gMaxSpansPerThread(size_t(1) << 20);
+
+      /// never deleted, so it outlives the threads that record into it
+      static Registry &getRegistry()
+      {
+        static Registry *registry = new Registry;
+        return *registry;
+      }
+
+      /// move a buffer's contents to the registry, and delete it
+      static void retireBuffer(ThreadBuffer *buffer)
+      {
+        Registry &registry = getRegistry();
+        std::lock_guard<std::mutex> guard(registry.lock);
+        for(std::vector<ThreadBuffer *>::iterator it = registry.buffers.begin(); it != registry.buffers.end(); ++it) {
+          if(*it == buffer) {
+            registry.buffers.erase(it);
+            break;
+          }
+        }
+
+        registry.retiredRecords.insert(registry.retiredRecords.end(), buffer->records.begin(), buffer->records.end());
+        registry.retiredDropped += buffer->dropped;
+        for(HistogramMap::iterator it = buffer->histograms.begin(); it != buffer->histograms.end(); ++it)
+          registry.retiredHistograms[it->first].merge(it->second);
+        delete buffer;
+      }
+
+      /// owns a thread's buffer, and hands it back when the thread goes
+      struct ThreadBufferOwner {
+        ThreadBuffer *buffer;
+        ThreadBufferOwner() : buffer(0) {}
+        ~ThreadBufferOwner() {if(buffer) retireBuffer(buffer);}
+      };
+
+      static thread_local ThreadBufferOwner tBufferOwner;
+
+      /// the innermost span open on this thread
+      static thread_local const Span *tCurrentSpan = 0;
+
+      static ThreadBuffer &getThreadBuffer()
+      {
+        if(!tBufferOwner.buffer) {
+          ThreadBuffer *buffer = new ThreadBuffer;
+          buffer->dropped = 0;
+
+          Registry &registry = getRegistry();
+          std::lock_guard<std::mutex> guard(registry.lock);
+          buffer->tid = registry.nextTid++;
+          registry.buffers.push_back(buffer);
+          tBufferOwner.buffer = buffer;
+        }
+        return *tBufferOwner.buffer;
+      }
+
+      void setEnabled(bool v)
+      {
+        if(v)
+          getRegistry(); // so the epoch is before any span
+        gEnabled = v;
+      }
+
+      bool isEnabled()
+      {
+        return gEnabled;
+      }
+
+      void setMaxSpansPerThread(size_t n)
+      {
+        gMaxSpansPerThread = n;
+      }
+
+      void clear()
+      {
+        Registry &registry = getRegistry();
+        std::lock_guard<std::mutex> guard(registry.lock);
+        for(std::vector<ThreadBuffer *>::iterator it = registry.buffers.begin(); it != registry.buffers.end(); ++it) {
+          std::lock_guard<std::mutex> bufferGuard((*it)->lock);
+          (*it)->records.clear();
+          (*it)->dropped = 0;
+          (*it)->histograms.clear();
+        }
+        registry.retiredRecords.clear();
+        registry.retiredDropped = 0;
+        registry.retiredHistograms.clear();
+      }
+
+      ////////////////////////////////////////////////////////////////////////////////
+      // Span
+
+      Span::Span(const char *category, const char *name)
+        : _active(gEnabled)
+        , _category(category)
+        , _name(name)
+        , _parent(0)
+      {
+        if(_active) {
+          _parent = tCurrentSpan;
+          if(_parent)
+            _pluginId = _parent->_pluginId;
+          tCurrentSpan = this;
+          _start = Clock::now();
+        }
+      }
+
+      Span::Span(const char *category, const char *name, const std::string &pluginId)
+        : _active(gEnabled)
+        , _category(category)
+        , _name(name)
+        , _parent(0)
+      {
+        if(_active) {
+          _pluginId = pluginId;
+          _parent = tCurrentSpan;
+          tCurrentSpan = this;
+          _start = Clock::now();
+        }
+      }
+
+      Span::~Span()
+      {
+        if(!_active)
+          return;
+
+        Clock::time_point end = Clock::now();
+        tCurrentSpan = _parent;
+
+        double duration = std::chrono::duration<double, std::micro>(end - _start).count();
+        const char *name = _name ? _name : "";
+
+        ThreadBuffer &buffer = getThreadBuffer();
+        std::lock_guard<std::mutex> guard(buffer.lock);
+        buffer.histograms[std::make_pair(_pluginId, std::string(name))].add(duration);
+
+        if(buffer.records.size() >= gMaxSpansPerThread) {
+          ++buffer.dropped;
+          return;
+        }
+
+        buffer.records.push_back(Record());
+        Record &record = buffer.records.back();
+        record.category = _category;
+        record.name = name;
+        record.pluginId.swap(_pluginId);
+        record.args.swap(_args);
+        record.tid = buffer.tid;
+        record.start = std::chrono::duration<double, std::micro>(_start - getRegistry().epoch).count();
+        record.duration = duration;
+      }
+
+      /// write a string as a JSON string
+      static void writeJSONString(std::ostream &os, const char *s)
+      {
+        os << '"';
+        for(; *s; ++s) {
+          unsigned char c = (unsigned char)(*s);
+          switch(c) {
+          case '"'  : os << "\\\""; break;
+          case '\\' : os << "\\\\"; break;
+          case '\n' : os << "\\n"; break;
+          case '\r' : os << "\\r"; break;
+          case '\t' : os << "\\t"; break;
+          default :
+            if(c < 0x20) {
+              char buf[8];
+              snprintf(buf, sizeof(buf), "\\u%04x", c);
+              os << buf;
+            }
+            else
+              os << *s;
+          }
+        }
+        os << '"';
+      }
+
+      /// a double as JSON, which has no inf or nan
+      static std::string jsonNumber(double v)
+      {
+        if(!std::isfinite(v))
+          return "null";
+        std::ostringstream os;
+        os << std::setprecision(15) << v;
+        return os.str();
+      }
+
+      void Span::beginArg(const char *name)
+      {
+        std::ostringstream os;
+        if(!_args.empty())
+          os << ',';
+        writeJSONString(os, name);
+        os << ':';
+        _args += os.str();
+      }
+
+      void Span::addArg(const char *name, double v)
+      {
+        if(!_active) return;
+        beginArg(name);
+        _args += jsonNumber(v);
+      }
+
+      void Span::addArg(const char *name, const char *v)
+      {
+        if(!_active) return;
+        beginArg(name);
+        std::ostringstream os;
+        writeJSONString(os, v ? v : "");
+        _args += os.str();
+      }
+
+      void Span::addArg(const char *name, const OfxPointD &v)
+      {
+        if(!_active) return;
+        beginArg(name);
+        _args += "[" + jsonNumber(v.x) + "," + jsonNumber(v.y) + "]";
+      }
+
+      void Span::addArg(const char *name, const OfxRectI &v)
+      {
+        if(!_active) return;
+        std::ostringstream os;
+        os << '[' << v.x1 << ',' << v.y1 << ',' << v.x2 << ',' << v.y2 << ']';
+        beginArg(name);
+        _args += os.str();
+      }
+
+      void Span::addArg(const char *name, const OfxRectD &v)
+      {
+        if(!_active) return;
+        beginArg(name);
+        _args += "[" + jsonNumber(v.x1) + "," + jsonNumber(v.y1) + "," + jsonNumber(v.x2) + "," + jsonNumber(v.y2) + "]";
+      }
+
+      void Span::addArgs(const Property::Set &inArgs)
+      {
+        if(!_active) return;
+
+        Property::Double *d;
+        if(inArgs.findTypedProperty(kOfxPropTime, d) && d->getDimension() == 1)
+          addArg("time", d->getValueRaw());
+
+        if(inArgs.findTypedProperty(kOfxImageEffectPropRenderScale, d) && d->getDimension() == 2) {
+          OfxPointD scale = {d->getValueRaw(0), d->getValueRaw(1)};
+          addArg("renderScale", scale);
+        }
+
+        if(inArgs.findTypedProperty(kOfxImageEffectPropRegionOfInterest, d) && d->getDimension() == 4) {
+          OfxRectD roi = {d->getValueRaw(0), d->getValueRaw(1), d->getValueRaw(2), d->getValueRaw(3)};
+          addArg("regionOfInterest", roi);
+        }
+
+        Property::Int *i;
+        if(inArgs.findTypedProperty(kOfxImageEffectPropRenderWindow, i) && i->getDimension() == 4) {
+          OfxRectI window = {i->getValueRaw(0), i->getValueRaw(1), i->getValueRaw(2), i->getValueRaw(3)};
+          addArg("renderWindow", window);
+        }
+
+        Property::String *s;
+        if(inArgs.findTypedProperty(kOfxImageEffectPropFieldToRender, s) && s->getDimension() == 1)
+          addArg("field", s->getValueRaw().c_str());
+      }
+
+      ////////////////////////////////////////////////////////////////////////////////
+      // output
+
+      static void writeRecord(std::ostream &os, const Record &record, bool &first)
+      {
+        os << (first ? "\n" : ",\n") << "{\"name\":";
+        first = false;
+        writeJSONString(os, record.name.c_str());
+        os << ",\"cat\":";
+        writeJSONString(os, record.category ? record.category : "");
+        os << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << record.tid
+           << ",\"ts\":" << jsonNumber(record.start)
+           << ",\"dur\":" << jsonNumber(record.duration)
+           << ",\"args\":{\"plugin\":";
+        writeJSONString(os, record.pluginId.c_str());
+        if(!record.args.empty())
+          os << ',' << record.args;
+        os << "}}";
+      }
+
+      void writeChromeTrace(std::ostream &os)
+      {
+        Registry &registry = getRegistry();
+        std::lock_guard<std::mutex> guard(registry.lock);
+
+        size_t dropped = registry.retiredDropped;
+        bool first = true;
+        os << "{\"traceEvents\":[";
+        for(std::vector<Record>::const_iterator it = registry.retiredRecords.begin(); it != registry.retiredRecords.end(); ++it)
+          writeRecord(os, *it, first);
+        for(std::vector<ThreadBuffer *>::iterator it = registry.buffers.begin(); it != registry.buffers.end(); ++it) {
+          std::lock_guard<std::mutex> bufferGuard((*it)->lock);
+          for(std::vector<Record>::const_iterator rit = (*it)->records.begin(); rit != (*it)->records.end(); ++rit)
+            writeRecord(os, *rit, first);
+          dropped += (*it)->dropped;
+        }
+        os << "\n],\"displayTimeUnit\":\"ms\",\"otherData\":{\"droppedSpans\":" << dropped << "}}\n";
+      }
+
+      bool writeChromeTrace(const std::string &path)
+      {
+        std::ofstream os(path.c_str());
+        if(!os)
+          return false;
+        writeChromeTrace(os);
+        return bool(os);
+      }
+
+      HistogramMap getLatencyHistograms()
+      {
+        Registry &registry = getRegistry();
+        std::lock_guard<std::mutex> guard(registry.lock);
+
+        HistogramMap histograms = registry.retiredHistograms;
+        for(std::vector<ThreadBuffer *>::iterator it = registry.buffers.begin(); it != registry.buffers.end(); ++it) {
+          std::lock_guard<std::mutex> bufferGuard((*it)->lock);
+          for(HistogramMap::const_iterator hit = (*it)->histograms.begin(); hit != (*it)->histograms.end(); ++hit)
+            histograms[hit->first].merge(hit->second);
+        }
+        return histograms;
+      }
+
+      void printLatencySummary(std::ostream &os)
+      {
+        HistogramMap histograms = getLatencyHistograms();
+        for(HistogramMap::const_iterator it = histograms.begin(); it != histograms.end(); ++it) {
+          const Histogram &h = it->second;
+          os << "  " << (it->first.first.empty() ? "(host)" : it->first.first) << ' ' << it->first.second
+             << " count " << h.getCount()
+             << " latency (us) mean " << h.getMean()
+             << " p50 " << h.getPercentile(0.5)
+             << " p99 " << h.getPercentile(0.99)
+             << " max " << h.getMax() << std::endl;
+        }
+      }
+
+    } // namespace Trace
+
+  } // namespace Host
+
+} // namespace OFX
@@ -11,6 +11,8 @@
 
 #include "ofxsMemory.h"
 
+#include <cstdint>
+
 namespace OFX {
   /** @brief Throws an @ref OFX::Exception depending on the status flag passed in */
   void throwSuiteStatusException(OfxStatus stat)
@@ -107,6 +109,116 @@ namespace OFX {
         OFX::Private::gMemorySuite->memoryFree(ptr);            
     }
 
+    ////////////////////////////////////////////////////////////////////////////////
+    // scratch arena
+
+    /** @brief ctor */
+    ScratchArena::ScratchArena(ImageEffect *effect, size_t blockSize)
+      : _effect(effect)
+      , _blockSize(blockSize)
+      , _block(0)
+      , _used(0)
+      , _inUse(0)
+      , _highWater(0)
+    {
+    }
+
+    /** @brief dtor */
+    ScratchArena::~ScratchArena()
+    {
+      release();
+    }
+
+    /** @brief allocate from the current block, moving on to the next or getting a new one if it won't fit */
+    void *ScratchArena::allocate(size_t nBytes, size_t alignment)
+    {
+      if(alignment == 0 || (alignment & (alignment - 1)) != 0)
+        alignment = kDefaultAlignment;
+
+      while(true) {
+        if(_block < _blocks.size()) {
+          Block &block = _blocks[_block];
+          size_t start = size_t(reinterpret_cast<uintptr_t>(block.data)) + _used;
+          size_t pad = (alignment - (start & (alignment - 1))) & (alignment - 1);
+          if(pad + nBytes <= block.size - _used) {
+            char *ptr = block.data + _used + pad;
+            _used  += pad + nBytes;
+            _inUse += pad + nBytes;
+            if(_inUse > _highWater)
+              _highWater = _inUse;
+            return ptr;
+          }
+
+          // won't fit, the rest of this block goes unused till we are rewound past it
+          _inUse += block.size - _used;
+          ++_block;
+          _used = 0;
+        }
+        else {
+          Block block;
+          block.size = nBytes + alignment > _blockSize ? nBytes + alignment : _blockSize;
+          block.data = static_cast<char *>(OFX::Memory::allocate(block.size, _effect));
+          _blocks.push_back(block);
+          _block = _blocks.size() - 1;
+          _used = 0;
+        }
+      }
+    }
+
+    /** @brief where the arena is now */
+    ScratchArena::Mark ScratchArena::getMark(void) const
+    {
+      Mark mark;
+      mark.block = _block;
+      mark.used  = _used;
+      mark.inUse = _inUse;
+      return mark;
+    }
+
+    /** @brief free everything allocated since the mark */
+    void ScratchArena::rewind(const Mark &mark)
+    {
+      if(mark.inUse == 0 && _blocks.size() > 1) {
+        // we had to grow over several blocks, swap them for one that would have held the lot
+        size_t highWater = _highWater + kDefaultAlignment;
+        release();
+        if(highWater > _blockSize)
+          _blockSize = highWater;
+        return;
+      }
+
+      _block = mark.block;
+      _used  = mark.used;
+      _inUse = mark.inUse;
+    }
+
+    /** @brief free everything allocated, but keep the memory */
+    void ScratchArena::reset(void)
+    {
+      Mark start = {0, 0, 0};
+      rewind(start);
+    }
+
+    /** @brief give all memory back to the host */
+    void ScratchArena::release(void)
+    {
+      for(size_t i = 0; i < _blocks.size(); ++i)
+        OFX::Memory::free(_blocks[i].data);
+      _blocks.clear();
+      _block = 0;
+      _used  = 0;
+      _inUse = 0;
+    }
+
+    /** @brief bytes held from the host */
+    size_t ScratchArena::getBytesReserved(void) const
+    {
+      size_t n = 0;
+      for(size_t i = 0; i < _blocks.size(); ++i)
+        n += _blocks[i].size;
+      return n;
+    }
+
   };
 
 }; // namespace OFX
@@ -13,6 +13,11 @@
 #include "ofxGPURender.h"
 #include "ofxsCore.h"
 
+// check cached clip properties against the host's on every get in debug builds
+#ifdef DEBUG
+#define kOfxsVerifyClipCache
+#endif
+
 #if defined __APPLE__ || defined __linux__ || defined __FreeBSD__
 # if __GNUC__ >= 4
 #  define EXPORT __attribute__((visibility("default")))
@@ -120,6 +125,7 @@ namespace OFX {
     OfxProgressSuiteV1    *gProgressSuiteV1 = 0;
     OfxProgressSuiteV2    *gProgressSuiteV2 = 0;
     OfxTimeLineSuiteV1    *gTimeLineSuite = 0;
+    OfxImageFetchSuiteV1  *gImageFetchSuite = 0;
     OfxParametricParameterSuiteV1 *gParametricParameterSuite = 0;
 #ifdef OFX_SUPPORTS_OPENGLRENDER
     OfxImageEffectOpenGLRenderSuiteV1 *gOpenGLRenderSuite = 0;
@@ -207,21 +213,21 @@ namespace OFX {
   }
 
   /** @brief turns a bit depth string into and enum */
-  BitDepthEnum mapStrToBitDepthEnum(const std::string &str)
+  BitDepthEnum mapStrToBitDepthEnum(const char *str)
   {
-    if(str == kOfxBitDepthByte) {
+    if(strcmp(str, kOfxBitDepthByte) == 0) {
       return eBitDepthUByte;
     }
-    else if(str == kOfxBitDepthShort) {
+    else if(strcmp(str, kOfxBitDepthShort) == 0) {
       return eBitDepthUShort;
     }
-    else if(str == kOfxBitDepthHalf) {
+    else if(strcmp(str, kOfxBitDepthHalf) == 0) {
       return eBitDepthHalf;
     }
-    else if(str == kOfxBitDepthFloat) {
+    else if(strcmp(str, kOfxBitDepthFloat) == 0) {
       return eBitDepthFloat;
     }
-    else if(str == kOfxBitDepthNone) {
+    else if(strcmp(str, kOfxBitDepthNone) == 0) {
       return eBitDepthNone;
     }
     else {
@@ -229,6 +235,11 @@ namespace OFX {
     }
   }
 
+  BitDepthEnum mapStrToBitDepthEnum(const std::string &str)
+  {
+    return mapStrToBitDepthEnum(str.c_str());
+  }
+
   /** @brief turns a bit depth string into and enum */
   const char* mapBitDepthEnumToStr(BitDepthEnum bitDepth)
   {
@@ -252,18 +263,18 @@ namespace OFX {
   }
 
   /** @brief turns a pixel component string into and enum */
-  PixelComponentEnum mapStrToPixelComponentEnum(const std::string &str)
+  PixelComponentEnum mapStrToPixelComponentEnum(const char *str)
   {
-    if(str == kOfxImageComponentRGBA) {
+    if(strcmp(str, kOfxImageComponentRGBA) == 0) {
       return ePixelComponentRGBA;
     }
-    else if(str == kOfxImageComponentRGB) {
+    else if(strcmp(str, kOfxImageComponentRGB) == 0) {
       return ePixelComponentRGB;
     }
-    else if(str == kOfxImageComponentAlpha) {
+    else if(strcmp(str, kOfxImageComponentAlpha) == 0) {
       return ePixelComponentAlpha;
     }
-    else if(str == kOfxImageComponentNone) {
+    else if(strcmp(str, kOfxImageComponentNone) == 0) {
       return ePixelComponentNone;
     }
     else {
@@ -271,6 +282,11 @@ namespace OFX {
     }
   }
 
+  PixelComponentEnum mapStrToPixelComponentEnum(const std::string &str)
+  {
+    return mapStrToPixelComponentEnum(str.c_str());
+  }
+
   /** @brief turns a pixel component string into and enum */
   const char* mapPixelComponentEnumToStr(PixelComponentEnum pixelComponent)
   {
@@ -290,15 +306,15 @@ namespace OFX {
   }
 
   /** @brief turns a premultiplication string into and enum */
-  static PreMultiplicationEnum mapStrToPreMultiplicationEnum(const std::string &str)
+  static PreMultiplicationEnum mapStrToPreMultiplicationEnum(const char *str)
   {
-    if(str == kOfxImageOpaque) {
+    if(strcmp(str, kOfxImageOpaque) == 0) {
       return eImageOpaque;
     }
-    else if(str == kOfxImagePreMultiplied) {
+    else if(strcmp(str, kOfxImagePreMultiplied) == 0) {
       return eImagePreMultiplied;
     }
-    else if(str == kOfxImageUnPreMultiplied) {
+    else if(strcmp(str, kOfxImageUnPreMultiplied) == 0) {
       return eImageUnPreMultiplied;
     }
     else {
@@ -776,17 +792,17 @@ namespace OFX {
 
   ////////////////////////////////////////////////////////////////////////////////
   // wraps up an image  
-  ImageBase::ImageBase(OfxPropertySetHandle props)
+  ImageBase::ImageBase(OfxPropertySetHandle props, OfxImageClipHandle clip)
     : _imageProps(props)
   {
-    OFX::Validation::validateImageBaseProperties(props);
+    OFX::Validation::validateImageBaseProperties(props, clip);
 
     // and fetch all the properties
     _rowBytes         = _imageProps.propGetInt(kOfxImagePropRowBytes, /*throwOnFailure*/false); // not required for OpenCL Images
     _pixelAspectRatio = _imageProps.propGetDouble(kOfxImagePropPixelAspectRatio);;
       
-    std::string str  = _imageProps.propGetString(kOfxImageEffectPropComponents);
-    _pixelComponents = mapStrToPixelComponentEnum(str);
+    // the host's strings are mapped straight to enums, with no copies made, as this is done for every image fetched
+    _pixelComponents = mapStrToPixelComponentEnum(_imageProps.propGetCString(kOfxImageEffectPropComponents));
 
     switch (_pixelComponents) {
       case ePixelComponentAlpha:
@@ -807,8 +823,7 @@ namespace OFX {
         break;
     }
 
-    str = _imageProps.propGetString(kOfxImageEffectPropPixelDepth);
-    _pixelDepth = mapStrToBitDepthEnum(str);
+    _pixelDepth = mapStrToBitDepthEnum(_imageProps.propGetCString(kOfxImageEffectPropPixelDepth));
 
     // compute bytes per pixel
     _pixelBytes = _pixelComponentCount;
@@ -823,8 +838,7 @@ namespace OFX {
     case eBitDepthCustom : _pixelBytes *= 0; break;
     }
 
-    str = _imageProps.propGetString(kOfxImageEffectPropPreMultiplication);
-    _preMultiplication =  mapStrToPreMultiplicationEnum(str);
+    _preMultiplication = mapStrToPreMultiplicationEnum(_imageProps.propGetCString(kOfxImageEffectPropPreMultiplication));
 
     _regionOfDefinition.x1 = _imageProps.propGetInt(kOfxImagePropRegionOfDefinition, 0);
     _regionOfDefinition.y1 = _imageProps.propGetInt(kOfxImagePropRegionOfDefinition, 1);
@@ -836,7 +850,7 @@ namespace OFX {
     _bounds.x2 = _imageProps.propGetInt(kOfxImagePropBounds, 2);
     _bounds.y2 = _imageProps.propGetInt(kOfxImagePropBounds, 3);
 
-    str = _imageProps.propGetString(kOfxImagePropField);
+    std::string str = _imageProps.propGetString(kOfxImagePropField);
     if(str == kOfxImageFieldNone) {
       _field = eFieldNone;
     }
@@ -854,7 +868,7 @@ namespace OFX {
       _field = eFieldNone;
     }
 
-    _uniqueID = _imageProps.propGetString(kOfxImagePropUniqueIdentifier);
+    _uniqueID = _imageProps.propGetCString(kOfxImagePropUniqueIdentifier);
 
     _renderScale.x = _imageProps.propGetDouble(kOfxImageEffectPropRenderScale, 0);
     _renderScale.y = _imageProps.propGetDouble(kOfxImageEffectPropRenderScale, 1);
@@ -866,21 +880,115 @@ namespace OFX {
 
   ////////////////////////////////////////////////////////////////////////////////
   // wraps up an image  
-  Image::Image(OfxPropertySetHandle props)
-    : ImageBase(props)
+  Image::Image(OfxPropertySetHandle props, OfxImageClipHandle clip)
+    : ImageBase(props, clip)
   {
-    OFX::Validation::validateImageProperties(props);
+    OFX::Validation::validateImageProperties(props, clip);
 
     // and fetch all the properties
     _OpenCLImage = nullptr;
     _OpenCLImage = _imageProps.propGetPointer(kOfxImageEffectPropOpenCLImage, /*throwOnFailure*/false);
     // should throw if it is not an image
     _pixelData = _imageProps.propGetPointer(kOfxImagePropData, /*throwOnFailure*/!_OpenCLImage);
+    _isFieldView = false;
+  }
+
+  /** @brief floor of a / 2, for negative a too */
+  static int halfFloor(int a)
+  {
+    return a >= 0 ? a / 2 : -((1 - a) / 2);
+  }
+
+  /** @brief the rows of a frame from y1 to y2 that are in a field, in the field's own coordinates */
+  static void getFieldRows(int y1, int y2, FieldEnum field, int &fieldY1, int &fieldY2)
+  {
+    // frame row y is in the lower field if even, the upper if odd, and is row floor(y/2) of it
+    int offset = field == eFieldUpper ? 1 : 0;
+    fieldY1 = halfFloor(y1 - offset + 1);
+    fieldY2 = halfFloor(y2 - offset + 1);
+  }
+
+  /** @brief make a view on one field of an interlaced image */
+  Image::Image(Image &frame, FieldEnum field)
+    : ImageBase(frame)
+    , _pixelData(0)
+    , _OpenCLImage(0)
+    , _isFieldView(true)
+  {
+    if(field != eFieldLower && field != eFieldUpper)
+      throw OFX::Exception::Suite(kOfxStatErrValue);
+
+    getFieldRows(frame._bounds.y1, frame._bounds.y2, field, _bounds.y1, _bounds.y2);
+    getFieldRows(frame._regionOfDefinition.y1, frame._regionOfDefinition.y2, field, _regionOfDefinition.y1, _regionOfDefinition.y2);
+    _rowBytes = frame._rowBytes * 2;
+    _field = field;
+    _renderScale.y = frame._renderScale.y * 0.5;
+    if(!_uniqueID.empty())
+      _uniqueID += field == eFieldLower ? "." kOfxImageFieldLower : "." kOfxImageFieldUpper;
+
+    // point at the first of our rows in the frame
+    if(frame._pixelData) {
+      int firstRow = 2 * _bounds.y1 + (field == eFieldUpper ? 1 : 0);
+      _pixelData = static_cast<char *>(frame._pixelData) + ptrdiff_t(firstRow - frame._bounds.y1) * frame._rowBytes;
+    }
   }
 
   Image::~Image()
   {
-    OFX::Private::gEffectSuite->clipReleaseImage(_imageProps.propSetHandle());
+    // views don't own the host's image
+    if(!_isFieldView)
+      OFX::Private::gEffectSuite->clipReleaseImage(_imageProps.propSetHandle());
+  }
+
+  /** @brief free Image sized blocks kept by a thread for reuse */
+  struct ImagePool {
+    enum {kMaxBlocks = 16}; /**< @brief most blocks kept, more than the images a thread holds at once */
+
+    void   *blocks[kMaxBlocks];
+    int     nBlocks;
+
+    ImagePool() : nBlocks(0) {}
+    ~ImagePool()
+    {
+      while(nBlocks > 0)
+        ::operator delete(blocks[--nBlocks]);
+    }
+  };
+
+  static thread_local ImagePool gImagePool;
+
+  /** @brief allocate an image, reusing a block the thread freed earlier if it has one */
+  void *Image::operator new(size_t size)
+  {
+    // a plugin's own image class may be bigger
+    if(size == sizeof(Image) && gImagePool.nBlocks > 0)
+      return gImagePool.blocks[--gImagePool.nBlocks];
+    return ::operator new(size);
+  }
+
+  /** @brief keep the block of a deleted image for the thread to reuse, images may be deleted on another thread than fetched them */
+  void Image::operator delete(void *ptr, size_t size) noexcept
+  {
+    if(ptr == 0)
+      return;
+    if(size == sizeof(Image) && gImagePool.nBlocks < ImagePool::kMaxBlocks)
+      gImagePool.blocks[gImagePool.nBlocks++] = ptr;
+    else
+      ::operator delete(ptr);
+  }
+
+  /** @brief as operator new, but returns NULL rather than throwing */
+  void *Image::operator new(size_t size, const std::nothrow_t &) noexcept
+  {
+    if(size == sizeof(Image) && gImagePool.nBlocks > 0)
+      return gImagePool.blocks[--gImagePool.nBlocks];
+    return ::operator new(size, std::nothrow);
+  }
+
+  /** @brief frees a block from the nothrow new if the constructor throws, pooled blocks came from the global new as well */
+  void Image::operator delete(void *ptr, const std::nothrow_t &) noexcept
+  {
+    ::operator delete(ptr);
   }
 
 #ifdef OFX_SUPPORTS_OPENGLRENDER
@@ -940,10 +1048,71 @@ namespace OFX {
     , _clipProps(props)
     , _clipHandle(handle)
     , _effect(effect)
+    , _cachedMask(0)
+    , _cacheGeneration(0)
   {
     OFX::Validation::validateClipInstanceProperties(_clipProps);
   }
 
+#ifdef kOfxsVerifyClipCache
+  /** @brief compare cached and host values */
+  template <class T>
+  static bool sameClipValue(const T &a, const T &b) {return a == b;}
+
+  static bool sameClipValue(const OfxRangeD &a, const OfxRangeD &b) {return a.min == b.min && a.max == b.max;}
+#endif
+
+  /** @brief Return the cached value at bit, calling fetch to get it from the host if it isn't cached. */
+  template <class T, class FETCH>
+  T Clip::getCached(unsigned int bit, T &cached, const char *what, FETCH fetch) const
+  {
+    if(_cachedMask.load(std::memory_order_acquire) & bit) {
+      // copy it out under the lock, as another thread may be refilling it after an invalidate
+      T v;
+      bool hit;
+      {
+        std::lock_guard<std::mutex> guard(_cacheLock);
+        hit = (_cachedMask.load(std::memory_order_relaxed) & bit) != 0;
+        if(hit)
+          v = cached;
+      }
+      if(hit) {
+#ifdef kOfxsVerifyClipCache
+        T fromHost = fetch();
+        OFX::Log::error(!sameClipValue(fromHost, v), "Cached %s on clip '%s' differs from the host's, the host changed it without telling us.", what, _clipName.c_str());
+        return fromHost;
+#else
+        (void)what;
+        return v;
+#endif
+      }
+    }
+
+    unsigned int generation;
+    {
+      std::lock_guard<std::mutex> guard(_cacheLock);
+      generation = _cacheGeneration;
+    }
+
+    // fetch outside the lock, as fetching may ask for other cached values
+    T v = fetch();
+
+    std::lock_guard<std::mutex> guard(_cacheLock);
+    if(generation == _cacheGeneration && !(_cachedMask.load(std::memory_order_relaxed) & bit)) {
+      cached = v;
+      _cachedMask.fetch_or(bit, std::memory_order_release);
+    }
+    return v;
+  }
+
+  /** @brief forget all cached properties */
+  void Clip::invalidateCache(void)
+  {
+    std::lock_guard<std::mutex> guard(_cacheLock);
+    _cachedMask.store(0, std::memory_order_release);
+    ++_cacheGeneration;
+  }
+
   /** @brief fetch the label */
   void Clip::getLabel(std::string &label) const
   {
@@ -961,59 +1130,57 @@ namespace OFX {
   /** @brief get the pixel depth */
   BitDepthEnum Clip::getPixelDepth(void) const
   {
-    std::string str = _clipProps.propGetString(kOfxImageEffectPropPixelDepth);
-    BitDepthEnum e;
-    try {
-      e = mapStrToBitDepthEnum(str);
-      if(e == eBitDepthNone && isConnected()) {
-        OFX::Log::error(true, "Clip %s is connected and has no pixel depth.", _clipName.c_str());
+    return getCached(eCachedPixelDepth, _cached.pixelDepth, "pixel depth", [this]() {
+      std::string str = _clipProps.propGetString(kOfxImageEffectPropPixelDepth);
+      BitDepthEnum e;
+      try {
+        e = mapStrToBitDepthEnum(str);
+        if(e == eBitDepthNone && isConnected()) {
+          OFX::Log::error(true, "Clip %s is connected and has no pixel depth.", _clipName.c_str());
+        }
       }
-    }
-    // gone wrong ?
-    catch(std::invalid_argument&) {
-      OFX::Log::error(true, "Unknown pixel depth property '%s' reported on clip '%s'", str.c_str(), _clipName.c_str());
-      e = eBitDepthNone;
-    }
-    return e;
+      // gone wrong ?
+      catch(std::invalid_argument&) {
+        OFX::Log::error(true, "Unknown pixel depth property '%s' reported on clip '%s'", str.c_str(), _clipName.c_str());
+        e = eBitDepthNone;
+      }
+      return e;
+    });
   }
 
   /** @brief get the components in the image */
   PixelComponentEnum Clip::getPixelComponents(void) const
   {
-    std::string str = _clipProps.propGetString(kOfxImageEffectPropComponents);
-    PixelComponentEnum e;
-    try {
-      e = mapStrToPixelComponentEnum(str);
-      if(e == ePixelComponentNone && isConnected()) {
-        OFX::Log::error(true, "Clip %s is connected and has no pixel component type!", _clipName.c_str());
+    return getCached(eCachedPixelComponents, _cached.pixelComponents, "pixel components", [this]() {
+      std::string str = getPixelComponentsProperty();
+      PixelComponentEnum e;
+      try {
+        e = mapStrToPixelComponentEnum(str);
+        if(e == ePixelComponentNone && isConnected()) {
+          OFX::Log::error(true, "Clip %s is connected and has no pixel component type!", _clipName.c_str());
+        }
       }
-    }
-    // gone wrong ?
-    catch(std::invalid_argument&) {
-      OFX::Log::error(true, "Unknown  pixel component type '%s' reported on clip '%s'", str.c_str(), _clipName.c_str());
-      e = ePixelComponentNone;
-    }
-    return e;
+      // gone wrong ?
+      catch(std::invalid_argument&) {
+        OFX::Log::error(true, "Unknown  pixel component type '%s' reported on clip '%s'", str.c_str(), _clipName.c_str());
+        e = ePixelComponentNone;
+      }
+      return e;
+    });
+  }
+
+  /** @brief get the string representing the pixel components */
+  std::string Clip::getPixelComponentsProperty(void) const
+  {
+    return getCached(eCachedPixelComponentsStr, _cached.pixelComponentsStr, "pixel components", [this]() {
+      return _clipProps.propGetString(kOfxImageEffectPropComponents);
+    });
   }
 
   /** @brief get the number of components in the image */
   int Clip::getPixelComponentCount(void) const
   {
-    std::string str = _clipProps.propGetString(kOfxImageEffectPropComponents);
-    PixelComponentEnum e;
-    try {
-      e = mapStrToPixelComponentEnum(str);
-      if(e == ePixelComponentNone && isConnected()) {
-        OFX::Log::error(true, "Clip %s is connected and has no pixel component type!", _clipName.c_str());
-      }
-    }
-    // gone wrong ?
-    catch(std::invalid_argument&) {
-      OFX::Log::error(true, "Unknown  pixel component type '%s' reported on clip '%s'", str.c_str(), _clipName.c_str());
-      e = ePixelComponentNone;
-    }
-
-    switch (e) {
+    switch (getPixelComponents()) {
       case ePixelComponentAlpha:
         return 1;
       case ePixelComponentNone:
@@ -1031,125 +1198,155 @@ namespace OFX {
   /** @brief what is the actual pixel depth of the clip */
   BitDepthEnum Clip::getUnmappedPixelDepth(void) const
   {
-    std::string str = _clipProps.propGetString(kOfxImageClipPropUnmappedPixelDepth);
-    BitDepthEnum e;
-    try {
-      e = mapStrToBitDepthEnum(str);
-      if(e == eBitDepthNone && !isConnected()) {
-        OFX::Log::error(true, "Clip %s is connected and has no unmapped pixel depth.", _clipName.c_str());
+    return getCached(eCachedUnmappedPixelDepth, _cached.unmappedPixelDepth, "unmapped pixel depth", [this]() {
+      std::string str = _clipProps.propGetString(kOfxImageClipPropUnmappedPixelDepth);
+      BitDepthEnum e;
+      try {
+        e = mapStrToBitDepthEnum(str);
+        if(e == eBitDepthNone && !isConnected()) {
+          OFX::Log::error(true, "Clip %s is connected and has no unmapped pixel depth.", _clipName.c_str());
+        }
       }
-    }
-    // gone wrong ?
-    catch(std::invalid_argument&) {
-      OFX::Log::error(true, "Unknown unmapped pixel depth property '%s' reported on clip '%s'", str.c_str(), _clipName.c_str());
-      e = eBitDepthNone;
-    }
-    return e;
+      // gone wrong ?
+      catch(std::invalid_argument&) {
+        OFX::Log::error(true, "Unknown unmapped pixel depth property '%s' reported on clip '%s'", str.c_str(), _clipName.c_str());
+        e = eBitDepthNone;
+      }
+      return e;
+    });
   }
 
   /** @brief what is the component type of the clip */
   PixelComponentEnum Clip::getUnmappedPixelComponents(void) const
   {
-    std::string str = _clipProps.propGetString(kOfxImageClipPropUnmappedComponents);
-    PixelComponentEnum e;
-    try {
-      e = mapStrToPixelComponentEnum(str);
-      if(e == ePixelComponentNone && !isConnected()) {
-        OFX::Log::error(true, "Clip %s is connected and has no unmapped pixel component type!", _clipName.c_str());
+    return getCached(eCachedUnmappedPixelComponents, _cached.unmappedPixelComponents, "unmapped pixel components", [this]() {
+      std::string str = getUnmappedPixelComponentsProperty();
+      PixelComponentEnum e;
+      try {
+        e = mapStrToPixelComponentEnum(str);
+        if(e == ePixelComponentNone && !isConnected()) {
+          OFX::Log::error(true, "Clip %s is connected and has no unmapped pixel component type!", _clipName.c_str());
+        }
       }
-    }
-    // gone wrong ?
-    catch(std::invalid_argument&) {
-      OFX::Log::error(true, "Unknown unmapped pixel component type '%s' reported on clip '%s'", str.c_str(), _clipName.c_str());
-      e = ePixelComponentNone;
-    }
-    return e;
+      // gone wrong ?
+      catch(std::invalid_argument&) {
+        OFX::Log::error(true, "Unknown unmapped pixel component type '%s' reported on clip '%s'", str.c_str(), _clipName.c_str());
+        e = ePixelComponentNone;
+      }
+      return e;
+    });
+  }
+
+  /** @brief get the string representing the unmapped pixel components */
+  std::string Clip::getUnmappedPixelComponentsProperty(void) const
+  {
+    return getCached(eCachedUnmappedComponentsStr, _cached.unmappedComponentsStr, "unmapped pixel components", [this]() {
+      return _clipProps.propGetString(kOfxImageClipPropUnmappedComponents);
+    });
   }
 
   /** @brief get the components in the image */
   PreMultiplicationEnum Clip::getPreMultiplication(void) const
   {
-    std::string str = _clipProps.propGetString(kOfxImageEffectPropPreMultiplication);
-    PreMultiplicationEnum e;
-    try {
-      e = mapStrToPreMultiplicationEnum(str);
-    }
-    // gone wrong ?
-    catch(std::invalid_argument&) {
-      OFX::Log::error(true, "Unknown premultiplication type '%s' reported on clip %s!", str.c_str(), _clipName.c_str());
-      e = eImageOpaque;
-    }
-    return e;
+    return getCached(eCachedPreMultiplication, _cached.preMultiplication, "premultiplication", [this]() {
+      std::string str = _clipProps.propGetString(kOfxImageEffectPropPreMultiplication);
+      PreMultiplicationEnum e;
+      try {
+        e = mapStrToPreMultiplicationEnum(str.c_str());
+      }
+      // gone wrong ?
+      catch(std::invalid_argument&) {
+        OFX::Log::error(true, "Unknown premultiplication type '%s' reported on clip %s!", str.c_str(), _clipName.c_str());
+        e = eImageOpaque;
+      }
+      return e;
+    });
   }
 
   /** @brief which spatial field comes first temporally */
   FieldEnum Clip::getFieldOrder(void) const
   {
-    std::string str = _clipProps.propGetString(kOfxImageClipPropFieldOrder);
-    FieldEnum e;
-    try {
-      e = mapStrToFieldEnum(str);
-      OFX::Log::error(e != eFieldNone && e != eFieldLower && e != eFieldUpper, 
-        "Field order '%s' reported on a clip %s is invalid, it must be none, lower or upper.", str.c_str(), _clipName.c_str());
-    }
-    // gone wrong ?
-    catch(std::invalid_argument&) {
-      OFX::Log::error(true, "Unknown field order '%s' reported on a clip %s.", str.c_str(), _clipName.c_str());
-      e = eFieldNone;
-    }
-    return e;
+    return getCached(eCachedFieldOrder, _cached.fieldOrder, "field order", [this]() {
+      std::string str = _clipProps.propGetString(kOfxImageClipPropFieldOrder);
+      FieldEnum e;
+      try {
+        e = mapStrToFieldEnum(str);
+        OFX::Log::error(e != eFieldNone && e != eFieldLower && e != eFieldUpper, 
+          "Field order '%s' reported on a clip %s is invalid, it must be none, lower or upper.", str.c_str(), _clipName.c_str());
+      }
+      // gone wrong ?
+      catch(std::invalid_argument&) {
+        OFX::Log::error(true, "Unknown field order '%s' reported on a clip %s.", str.c_str(), _clipName.c_str());
+        e = eFieldNone;
+      }
+      return e;
+    });
   }
 
   /** @brief is the clip connected */
   bool Clip::isConnected(void) const
   {
-    return _clipProps.propGetInt(kOfxImageClipPropConnected) != 0;
+    return getCached(eCachedConnected, _cached.connected, "connected state", [this]() {
+      return _clipProps.propGetInt(kOfxImageClipPropConnected) != 0;
+    });
   }
 
   /** @brief can the clip be continuously sampled */
   bool Clip::hasContinuousSamples(void) const
   {
-    return _clipProps.propGetInt(kOfxImageClipPropContinuousSamples) != 0;
+    return getCached(eCachedContinuousSamples, _cached.continuousSamples, "continuous samples", [this]() {
+      return _clipProps.propGetInt(kOfxImageClipPropContinuousSamples) != 0;
+    });
   }
 
   /** @brief get the scale factor that has been applied to this clip */
   double Clip::getPixelAspectRatio(void) const
   {
-    try {
-      return _clipProps.propGetDouble(kOfxImagePropPixelAspectRatio);
-    } catch(...) {
-      return 1.0;  // This error could happen in Eyeon Fusion.
-    }
+    return getCached(eCachedPixelAspectRatio, _cached.pixelAspectRatio, "pixel aspect ratio", [this]() {
+      try {
+        return _clipProps.propGetDouble(kOfxImagePropPixelAspectRatio);
+      } catch(...) {
+        return 1.0;  // This error could happen in Eyeon Fusion.
+      }
+    });
   }
 
   /** @brief get the frame rate, in frames per second on this clip, after any clip preferences have been applied */
   double Clip::getFrameRate(void) const
   {
-    return _clipProps.propGetDouble(kOfxImageEffectPropFrameRate);
+    return getCached(eCachedFrameRate, _cached.frameRate, "frame rate", [this]() {
+      return _clipProps.propGetDouble(kOfxImageEffectPropFrameRate);
+    });
   }
 
   /** @brief return the range of frames over which this clip has images, after any clip preferences have been applied */
   OfxRangeD Clip::getFrameRange(void) const
   {
-    OfxRangeD v;
-    v.min = _clipProps.propGetDouble(kOfxImageEffectPropFrameRange, 0);
-    v.max = _clipProps.propGetDouble(kOfxImageEffectPropFrameRange, 1);
-    return v;
+    return getCached(eCachedFrameRange, _cached.frameRange, "frame range", [this]() {
+      OfxRangeD v;
+      v.min = _clipProps.propGetDouble(kOfxImageEffectPropFrameRange, 0);
+      v.max = _clipProps.propGetDouble(kOfxImageEffectPropFrameRange, 1);
+      return v;
+    });
   }
 
   /** @brief get the frame rate, in frames per second on this clip, before any clip preferences have been applied */
   double Clip::getUnmappedFrameRate(void) const
   {
-    return _clipProps.propGetDouble(kOfxImageEffectPropUnmappedFrameRate);
+    return getCached(eCachedUnmappedFrameRate, _cached.unmappedFrameRate, "unmapped frame rate", [this]() {
+      return _clipProps.propGetDouble(kOfxImageEffectPropUnmappedFrameRate);
+    });
   }
 
   /** @brief return the range of frames over which this clip has images, before any clip preferences have been applied */
   OfxRangeD Clip::getUnmappedFrameRange(void) const
   {
-    OfxRangeD v;
-    v.min = _clipProps.propGetDouble(kOfxImageEffectPropUnmappedFrameRange, 0);
-    v.max = _clipProps.propGetDouble(kOfxImageEffectPropUnmappedFrameRange, 1);
-    return v;
+    return getCached(eCachedUnmappedFrameRange, _cached.unmappedFrameRange, "unmapped frame range", [this]() {
+      OfxRangeD v;
+      v.min = _clipProps.propGetDouble(kOfxImageEffectPropUnmappedFrameRange, 0);
+      v.max = _clipProps.propGetDouble(kOfxImageEffectPropUnmappedFrameRange, 1);
+      return v;
+    });
   }
 
   /** @brief get the RoD for this clip in the cannonical coordinate system */
@@ -1175,7 +1372,7 @@ namespace OFX {
     else
       throwSuiteStatusException(stat);
 
-    return new Image(imageHandle);
+    return new Image(imageHandle, _clipHandle);
   }
 
   /** @brief fetch an image, with a specific region in cannonical coordinates */
@@ -1189,7 +1386,65 @@ namespace OFX {
     else
       throwSuiteStatusException(stat);
 
-    return new Image(imageHandle);
+    return new Image(imageHandle, _clipHandle);
+  }
+
+  /** @brief fetch several images in one go */
+  void fetchImages(std::vector<ImageFetch> &fetches)
+  {
+    if(fetches.empty())
+      return;
+
+    // one after the other, giving back any we have if one throws
+    if(!OFX::Private::gImageFetchSuite) {
+      try {
+        for(size_t i = 0; i < fetches.size(); ++i)
+          fetches[i].image = fetches[i].clip->fetchImage(fetches[i].time, fetches[i].hasBounds ? &fetches[i].bounds : NULL);
+      }
+      catch(...) {
+        for(size_t i = 0; i < fetches.size(); ++i) {
+          delete fetches[i].image;
+          fetches[i].image = NULL;
+        }
+        throw;
+      }
+      return;
+    }
+
+    std::vector<OfxImageFetchRequest> requests(fetches.size());
+    for(size_t i = 0; i < fetches.size(); ++i) {
+      requests[i].clip = fetches[i].clip->getHandle();
+      requests[i].time = fetches[i].time;
+      requests[i].region = fetches[i].hasBounds ? &fetches[i].bounds : NULL;
+      requests[i].imageHandle = NULL;
+      requests[i].status = kOfxStatFailed;
+    }
+    OfxStatus stat = OFX::Private::gImageFetchSuite->clipGetImages(&requests[0], int(requests.size()));
+
+    // failed just means some images aren't there, anything else and we give back those that are
+    if(stat != kOfxStatOK && stat != kOfxStatFailed) {
+      for(size_t i = 0; i < requests.size(); ++i)
+        if(requests[i].imageHandle)
+          OFX::Private::gEffectSuite->clipReleaseImage(requests[i].imageHandle);
+      throwSuiteStatusException(stat);
+    }
+
+    // wrap them, and if a wrapper throws give back the wrapped and the unwrapped alike
+    size_t i = 0;
+    try {
+      for(; i < fetches.size(); ++i)
+        fetches[i].image = requests[i].imageHandle ? new Image(requests[i].imageHandle, fetches[i].clip->getHandle()) : NULL;
+    }
+    catch(...) {
+      for(size_t j = 0; j < i; ++j) {
+        delete fetches[j].image;
+        fetches[j].image = NULL;
+      }
+      for(size_t j = i; j < requests.size(); ++j)
+        if(requests[j].imageHandle)
+          OFX::Private::gEffectSuite->clipReleaseImage(requests[j].imageHandle);
+      throw;
+    }
   }
 
 #ifdef OFX_SUPPORTS_OPENGLRENDER
@@ -1215,6 +1470,9 @@ namespace OFX {
     , _effectProps(0)
     , _context(eContextNone)
     , _progressStartSuccess(false)
+    , _nScratchArenas(0)
+    , _sequenceRenderDepth(0)
+    , _derivedDataCache(this)
   {
     // get the property handle
     _effectProps = OFX::Private::fetchEffectProps(handle);
@@ -1243,10 +1501,15 @@ namespace OFX {
     // clobber the instance data property on the effect handle
     _effectProps.propSetPointer(kOfxPropInstanceData, 0);
 
+    // the host is free to reuse our handles once we are gone
+    OFX::Validation::forgetValidated(_effectProps.propSetHandle());
+
     // delete any clip instances we may have constructed
     std::map<std::string, Clip *>::iterator iter;
     for(iter = _fetchedClips.begin(); iter != _fetchedClips.end(); ++iter) {
       if(iter->second) {
+        OFX::Validation::forgetValidated(iter->second->getPropertySet().propSetHandle());
+        OFX::Validation::forgetValidated(iter->second->getHandle());
         delete iter->second;
         iter->second = NULL;
       }
@@ -1506,6 +1769,68 @@ namespace OFX {
     // fa niente
   }
 
+  /** @brief get the calling thread's scratch arena, making it if need be */
+  Memory::ScratchArena &ImageEffect::getScratchArena(void)
+  {
+    unsigned int n = _nScratchArenas.load(std::memory_order_acquire);
+    if(n == 0) {
+      OFX::MultiThread::AutoMutex guard(_scratchLock);
+      n = _nScratchArenas.load(std::memory_order_relaxed);
+      if(n == 0) {
+        n = OFX::MultiThread::getNumCPUs();
+        if(n == 0)
+          n = 1;
+        _scratchArenas.reset(new std::unique_ptr<Memory::ScratchArena>[n]);
+        _nScratchArenas.store(n, std::memory_order_release);
+      }
+    }
+
+    unsigned int index = OFX::MultiThread::getThreadIndex();
+    if(index >= n)
+      throw OFX::Exception::Suite(kOfxStatErrBadIndex);
+
+    // only threads with this index touch this slot, so no need to lock
+    std::unique_ptr<Memory::ScratchArena> &arena = _scratchArenas[index];
+    if(!arena)
+      arena.reset(new Memory::ScratchArena(this));
+    return *arena;
+  }
+
+  /** @brief forget the cached properties of all clips fetched so far */
+  void ImageEffect::invalidateClipCaches(void)
+  {
+    for(std::map<std::string, Clip *>::iterator it = _fetchedClips.begin(); it != _fetchedClips.end(); ++it)
+      it->second->invalidateCache();
+  }
+
+  /** @brief note a sequence render has started */
+  void ImageEffect::beginScratchSequence(void)
+  {
+    OFX::MultiThread::AutoMutex guard(_scratchLock);
+    ++_sequenceRenderDepth;
+  }
+
+  /** @brief note a sequence render has ended, releasing the arenas if it was the last one */
+  void ImageEffect::endScratchSequence(void)
+  {
+    {
+      OFX::MultiThread::AutoMutex guard(_scratchLock);
+      if(_sequenceRenderDepth > 0)
+        --_sequenceRenderDepth;
+    }
+    releaseScratchArenas();
+  }
+
+  /** @brief give all scratch memory back to the host */
+  void ImageEffect::releaseScratchArenas(void)
+  {
+    OFX::MultiThread::AutoMutex guard(_scratchLock);
+    if(_sequenceRenderDepth > 0)
+      return; // a render may be using them
+    _nScratchArenas.store(0, std::memory_order_release);
+    _scratchArenas.reset();
+  }
+
   /** @brief The sync private data action, called when the effect needs to sync any private data to persistant parameters */
   void ImageEffect::syncPrivateData(void)
   {
@@ -1820,6 +2145,182 @@ namespace OFX {
     (void)stat;
   }
 
+  ////////////////////////////////////////////////////////////////////////////////
+  // derived data cache
+
+  /** @brief image memory holding one piece of derived data */
+  struct DerivedDataCache::Entry {
+    ImageMemory memory;
+    size_t      size;
+
+    Entry(size_t nBytes, ImageEffect *effect) : memory(nBytes > 0 ? nBytes : 1, effect), size(nBytes) {}
+  };
+
+  /** @brief an entry locked for as long as this lives */
+  struct DerivedDataCache::Locked {
+    std::shared_ptr<Entry> entry;
+    void                  *data;
+
+    explicit Locked(const std::shared_ptr<Entry> &e) : entry(e), data(e->memory.lock()) {}
+    ~Locked() {entry->memory.unlock();}
+  };
+
+  /** @brief key for data derived from an image */
+  DerivedDataCache::Key::Key(const ImageBase &image, const std::string &d)
+    : uniqueID(image.getUniqueIdentifier())
+    , derivation(d)
+    , renderScale(image.getRenderScale())
+  {
+  }
+
+  bool DerivedDataCache::Key::operator<(const Key &other) const
+  {
+    if(uniqueID != other.uniqueID) return uniqueID < other.uniqueID;
+    if(derivation != other.derivation) return derivation < other.derivation;
+    if(renderScale.x != other.renderScale.x) return renderScale.x < other.renderScale.x;
+    return renderScale.y < other.renderScale.y;
+  }
+
+  /** @brief ctor */
+  DerivedDataCache::DerivedDataCache(ImageEffect *effect, size_t maxBytes)
+    : _effect(effect)
+    , _maxBytes(maxBytes)
+    , _bytes(0)
+    , _hits(0)
+    , _misses(0)
+  {
+  }
+
+  /** @brief dtor */
+  DerivedDataCache::~DerivedDataCache()
+  {
+    flush();
+  }
+
+  /** @brief lock an entry's memory for use */
+  DerivedDataCache::Data DerivedDataCache::lockEntry(const std::shared_ptr<Entry> &entry)
+  {
+    Data data;
+    data._locked.reset(new Locked(entry));
+    data._data = data._locked->data;
+    data._size = entry->size;
+    return data;
+  }
+
+  /** @brief drop the least recently used entries, called with _lock held */
+  void DerivedDataCache::trim(size_t maxBytes)
+  {
+    while(_bytes > maxBytes && !_entries.empty()) {
+      _bytes -= _entries.back().second->size;
+      _index.erase(_entries.back().first);
+      _entries.pop_back();
+    }
+  }
+
+  /** @brief set the budget */
+  void DerivedDataCache::setMaxBytes(size_t maxBytes)
+  {
+    OFX::MultiThread::AutoMutex guard(_lock);
+    _maxBytes = maxBytes;
+    trim(_maxBytes);
+  }
+
+  /** @brief the budget */
+  size_t DerivedDataCache::getMaxBytes(void) const
+  {
+    OFX::MultiThread::AutoMutex guard(_lock);
+    return _maxBytes;
+  }
+
+  /** @brief bytes of data held */
+  size_t DerivedDataCache::getBytes(void) const
+  {
+    OFX::MultiThread::AutoMutex guard(_lock);
+    return _bytes;
+  }
+
+  /** @brief how many finds found something */
+  unsigned int DerivedDataCache::getHits(void) const
+  {
+    OFX::MultiThread::AutoMutex guard(_lock);
+    return _hits;
+  }
+
+  /** @brief how many finds didn't */
+  unsigned int DerivedDataCache::getMisses(void) const
+  {
+    OFX::MultiThread::AutoMutex guard(_lock);
+    return _misses;
+  }
+
+  /** @brief find the data for a key */
+  DerivedDataCache::Data DerivedDataCache::find(const Key &key)
+  {
+    std::shared_ptr<Entry> entry;
+    {
+      OFX::MultiThread::AutoMutex guard(_lock);
+      std::map<Key, EntryList::iterator>::iterator it = _index.find(key);
+      if(it == _index.end()) {
+        ++_misses;
+        return Data();
+      }
+      ++_hits;
+      _entries.splice(_entries.begin(), _entries, it->second);
+      entry = it->second->second;
+    }
+
+    // lock it outside our lock, the host may take a while, and our reference keeps it alive
+    return lockEntry(entry);
+  }
+
+  /** @brief allocate memory for new data */
+  DerivedDataCache::Data DerivedDataCache::allocate(size_t nBytes)
+  {
+    std::shared_ptr<Entry> entry(new Entry(nBytes, _effect));
+    return lockEntry(entry);
+  }
+
+  /** @brief cache data made with allocate */
+  DerivedDataCache::Data DerivedDataCache::insert(const Key &key, const Data &data)
+  {
+    if(key.uniqueID.empty() || !data._locked)
+      return data;
+
+    std::shared_ptr<Entry> existing;
+    {
+      OFX::MultiThread::AutoMutex guard(_lock);
+      std::map<Key, EntryList::iterator>::iterator it = _index.find(key);
+      if(it != _index.end()) {
+        // another thread got there first, use theirs so both share one copy
+        _entries.splice(_entries.begin(), _entries, it->second);
+        existing = it->second->second;
+      }
+      else {
+        if(data._size > _maxBytes)
+          return data;
+        trim(_maxBytes - data._size);
+        _entries.push_front(std::make_pair(key, data._locked->entry));
+        _index[key] = _entries.begin();
+        _bytes += data._size;
+        return data;
+      }
+    }
+    return lockEntry(existing);
+  }
+
+  /** @brief drop all cached data */
+  void DerivedDataCache::flush(void)
+  {
+    EntryList dropped;
+    {
+      OFX::MultiThread::AutoMutex guard(_lock);
+      dropped.swap(_entries);
+      _index.clear();
+      _bytes = 0;
+    }
+    // memory is given back to the host as dropped goes, outside our lock
+  }
+
 
 
   /** @brief OFX::Private namespace, for things private to the support library code here generally calls image effect class members */
@@ -1961,6 +2462,7 @@ namespace OFX {
         gProgressSuiteV1 = (OfxProgressSuiteV1 *)     fetchSuite(kOfxProgressSuite, 1, true);
         gProgressSuiteV2 = (OfxProgressSuiteV2 *)     fetchSuite(kOfxProgressSuite, 2, true);
         gTimeLineSuite   = (OfxTimeLineSuiteV1 *)     fetchSuite(kOfxTimeLineSuite, 1, true);
+        gImageFetchSuite = (OfxImageFetchSuiteV1 *)   fetchSuite(kOfxsImageFetchSuite, 1, true);
         gParametricParameterSuite = (OfxParametricParameterSuiteV1*) fetchSuite(kOfxParametricParameterSuite, 1, true);
 #ifdef OFX_SUPPORTS_OPENGLRENDER
         gOpenGLRenderSuite = (OfxImageEffectOpenGLRenderSuiteV1*) fetchSuite(kOfxOpenGLRenderSuite, 1, true);
@@ -1973,6 +2475,7 @@ namespace OFX {
         OFX::gHostDescription.supportsMessageSuiteV2 = gMessageSuiteV2 != NULL;
         OFX::gHostDescription.supportsProgressSuite = (gProgressSuiteV1 != NULL || gProgressSuiteV2 != NULL);
         OFX::gHostDescription.supportsTimeLineSuite = gTimeLineSuite != NULL;
+        OFX::gHostDescription.supportsImageFetchSuite = gImageFetchSuite != NULL;
 
         // fetch the interact suite if the host supports interaction
         if(OFX::gHostDescription.supportsOverlays || OFX::gHostDescription.supportsCustomInteract)
@@ -1999,6 +2502,9 @@ namespace OFX {
 
       if(gLoadCount==0)
       {
+        // say what property validation did, and forget it
+        OFX::Validation::finalise();
+
         // force these to null
         gEffectSuite = 0;
         gPropSuite = 0;
@@ -2186,7 +2692,11 @@ namespace OFX {
       args.sequentialRenderStatus = inArgs.propGetInt(kOfxImageEffectPropSequentialRenderStatus, false) != 0;
       args.interactiveRenderStatus = inArgs.propGetInt(kOfxImageEffectPropInteractiveRenderStatus, false) != 0;
         
+      // the host will have applied any clip preferences by now
+      effectInstance->invalidateClipCaches();
+
       // and call the plugin client render code
+      effectInstance->beginScratchSequence();
       effectInstance->beginSequenceRender(args);
     }
 
@@ -2220,8 +2730,15 @@ namespace OFX {
       args.sequentialRenderStatus = inArgs.propGetInt(kOfxImageEffectPropSequentialRenderStatus, false) != 0;
       args.interactiveRenderStatus = inArgs.propGetInt(kOfxImageEffectPropInteractiveRenderStatus, false) != 0;
 
-      // and call the plugin client render code
-      effectInstance->endSequenceRender(args);
+      // and call the plugin client render code, releasing scratch memory even if it throws
+      try {
+        effectInstance->endSequenceRender(args);
+      }
+      catch(...) {
+        effectInstance->endScratchSequence();
+        throw;
+      }
+      effectInstance->endScratchSequence();
     }
 
 
@@ -2485,9 +3002,13 @@ namespace OFX {
       ImageEffectDescriptor* desc = gEffectDescriptors[plugname][effectInstance->getContext()];
       ClipPreferencesSetter prefs(outArgs, desc->getClipDepthPropNames(), desc->getClipComponentPropNames(), desc->getClipPARPropNames());
 
-      // and call the plug-in client code
+      // and call the plug-in client code, with what the host has now
+      effectInstance->invalidateClipCaches();
       effectInstance->getClipPreferences(prefs);
 
+      // the host applies the preferences once we return, so look again next time we are asked
+      effectInstance->invalidateClipCaches();
+
       // did we do anything ?
       if(prefs.didSomething()) 
         return true;
@@ -2533,6 +3054,9 @@ namespace OFX {
         effectInstance->changedParam(args, changedName);
       }
       else if(changedType == kOfxTypeClip) {
+        // a clip changing can change the others' preferences, so forget the lot
+        effectInstance->invalidateClipCaches();
+
         // and call the plugin client code
         effectInstance->changedClip(args, changedName);
       }
@@ -2749,6 +3273,9 @@ namespace OFX {
 
           // purge 'em
           instance->purgeCaches();
+          instance->releaseScratchArenas();
+          instance->getDerivedDataCache().flush();
+          instance->invalidateClipCaches();
         }
         else if(action == kOfxActionSyncPrivateData) {
           checkMainHandles(actionRaw, handleRaw, inArgsRaw, outArgsRaw, false, true, true);
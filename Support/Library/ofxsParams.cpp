@@ -1241,6 +1241,8 @@ namespace OFX {
   /** @brief dtor */
   Param::~Param()
   {
+    // the host is free to reuse our handle once we are gone
+    OFX::Validation::forgetValidated(_paramProps.propSetHandle());
   }
 
   /** @brief get name */
@@ -174,6 +174,21 @@ namespace OFX {
     return value != NULL ?  std::string(value) : std::string();
   }
 
+  /** @brief Get single string property, without copying it */
+  const char *PropertySet::propGetCString(const char* property, int idx, bool throwOnFailure) const
+  {
+    assert(_propHandle != 0);
+    char *value = NULL;
+    OfxStatus stat = gPropSuite->propGetString(_propHandle, property, idx, &value);
+    OFX::Log::error(stat != kOfxStatOK, "Failed on getting string property %s[%d], host returned status %s;", 
+      property, idx, mapStatusToString(stat));
+    if(throwOnFailure)
+      throwPropertyException(stat, property);
+
+    if(_gPropLogging > 0) Log::print("Retrieved string property %s[%d], was given %s.",  property, idx, value);
+    return value != NULL ? value : "";
+  }
+
   /** @brief Get single double property */
   double PropertySet::propGetDouble(const char* property, int idx, bool throwOnFailure) const
   {
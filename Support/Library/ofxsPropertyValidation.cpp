@@ -9,6 +9,8 @@ This file contains headers for classes that are used to validate property sets a
 
 #include "ofxsSupportPrivate.h"
 #include <stdarg.h>
+#include <map>
+#include <mutex>
 #ifdef OFX_SUPPORTS_OPENGLRENDER
 #include "ofxGPURender.h"
 #endif
@@ -1046,6 +1048,68 @@ namespace OFX {
       NULLPTR);
 
 #endif
+
+#ifndef kOfxsDisableValidation
+    ////////////////////////////////////////////////////////////////////////////////
+    // Validation is incremental. Each property set handle is only validated the
+    // first time it is seen, action arguments once per action per host, and only
+    // the first few images fetched from each clip. What was checked and what was
+    // skipped is logged on unload.
+
+    /** @brief How many images fetched from a clip get validated, later ones are assumed to look the same */
+    static const int kImagesValidatedPerClip = 8;
+
+    /** @brief How often a kind of property set was validated, and how often it was skipped as already seen */
+    struct ValidationCount {
+      int validated;
+      int skipped;
+      ValidationCount() : validated(0), skipped(0) {}
+    };
+
+    /** @brief guards the maps below, images can be fetched on any render thread */
+    static std::mutex gValidationLock;
+
+    /** @brief how many times each (kind, key) pair has been validated */
+    static std::map<std::pair<std::string, const void *>, int> gValidatedKeys;
+
+    /** @brief counts by kind of property set, for the report */
+    static std::map<std::string, ValidationCount> gValidationCounts;
+
+    /** @brief Returns true if the (kind, key) pair has been validated fewer than budget times, and counts it either way */
+    static bool
+      needsValidating(const std::string &kind, const void *key, int budget = 1)
+    {
+      std::lock_guard<std::mutex> guard(gValidationLock);
+      ValidationCount &count = gValidationCounts[kind];
+      int &seen = gValidatedKeys[std::make_pair(kind, key)];
+      if(seen >= budget) {
+        ++count.skipped;
+        return false;
+      }
+      ++seen;
+      ++count.validated;
+      return true;
+    }
+#endif
+
+    /** @brief Drops every (kind, key) pair with this key, so a handle reallocated at the same address gets validated afresh */
+    void
+      forgetValidated(const void *key)
+    {
+#ifdef kOfxsDisableValidation
+    (void)key;
+#else
+      std::lock_guard<std::mutex> guard(gValidationLock);
+      std::map<std::pair<std::string, const void *>, int>::iterator it = gValidatedKeys.begin();
+      while(it != gValidatedKeys.end()) {
+        if(it->first.second == key)
+          gValidatedKeys.erase(it++);
+        else
+          ++it;
+      }
+#endif
+    }
+
     /** @brief Validates the host structure and property handle */
     void
       validateHostProperties(OfxHost *host)
@@ -1066,7 +1130,8 @@ namespace OFX {
 #ifdef kOfxsDisableValidation
     (void)props;
 #else
-      gPluginDescriptorPropSet.validate(props);
+      if(needsValidating("effect descriptor", props.propSetHandle()))
+        gPluginDescriptorPropSet.validate(props);
 #endif
     }
 
@@ -1077,7 +1142,8 @@ namespace OFX {
 #ifdef kOfxsDisableValidation
     (void)props;
 #else
-      gPluginInstancePropSet.validate(props);
+      if(needsValidating("effect instance", props.propSetHandle()))
+        gPluginInstancePropSet.validate(props);
 #endif
     }
 
@@ -1088,7 +1154,8 @@ namespace OFX {
 #ifdef kOfxsDisableValidation
     (void)props;
 #else
-      gClipDescriptorPropSet.validate(props);
+      if(needsValidating("clip descriptor", props.propSetHandle()))
+        gClipDescriptorPropSet.validate(props);
 #endif
     }
 
@@ -1099,29 +1166,34 @@ namespace OFX {
 #ifdef kOfxsDisableValidation
     (void)props;
 #else
-      gClipInstancePropSet.validate(props);
+      if(needsValidating("clip instance", props.propSetHandle()))
+        gClipInstancePropSet.validate(props);
 #endif
     }
 
-    /** @brief validates an image or texture instance */
+    /** @brief validates an image or texture instance, only the first few from each clip are checked */
     void
-      validateImageBaseProperties(PropertySet props)
+      validateImageBaseProperties(PropertySet props, OfxImageClipHandle clip)
     {
 #ifdef kOfxsDisableValidation
     (void)props;
+    (void)clip;
 #else
-      gImageBaseInstancePropSet.validate(props);
+      if(needsValidating("image base", clip, kImagesValidatedPerClip))
+        gImageBaseInstancePropSet.validate(props);
 #endif
     }
 
-    /** @brief validates an image instance */
+    /** @brief validates an image instance, only the first few from each clip are checked */
     void
-      validateImageProperties(PropertySet props)
+      validateImageProperties(PropertySet props, OfxImageClipHandle clip)
     {
 #ifdef kOfxsDisableValidation
     (void)props;
+    (void)clip;
 #else
-      gImageInstancePropSet.validate(props);
+      if(needsValidating("image", clip, kImagesValidatedPerClip))
+        gImageInstancePropSet.validate(props);
 #endif
     }
 
@@ -1133,7 +1205,8 @@ namespace OFX {
 #ifdef kOfxsDisableValidation
     (void)props;
 #else
-      gTextureInstancePropSet.validate(props);
+      if(needsValidating("texture", NULL, kImagesValidatedPerClip))
+        gTextureInstancePropSet.validate(props);
 #endif
     }
 #endif
@@ -1147,6 +1220,10 @@ namespace OFX {
     (void)inArgs;
     (void)outArgs;
 #else
+      // the shape of an action's arguments only depends on the host
+      if(!needsValidating(action, OFX::Private::gHost))
+        return;
+
       if(action == kOfxActionInstanceChanged) {
         gInstanceChangedInArgPropSet.validate(inArgs);
       }
@@ -1202,6 +1279,9 @@ namespace OFX {
     (void)paramProps;
     (void)checkDefaults;
 #else
+      if(!needsValidating(checkDefaults ? "param descriptor" : "param instance", paramProps.propSetHandle()))
+        return;
+
       // should use a map here
       switch(paramType) 
       {
@@ -1308,6 +1388,26 @@ namespace OFX {
           eDescFinished);
         gBooleanParamPropSet.addProperty(desc, true);
       }
+#endif
+    }
+
+    /** @brief Logs what was validated and what was skipped, then forgets it all, called during the unload action */
+    void
+      finalise(void)
+    {
+#ifndef kOfxsDisableValidation
+      std::lock_guard<std::mutex> guard(gValidationLock);
+
+      OFX::Log::print("Property validation summary, validated/skipped as already seen.");
+      OFX::Log::indent();
+      for(std::map<std::string, ValidationCount>::const_iterator it = gValidationCounts.begin(); it != gValidationCounts.end(); ++it) {
+        OFX::Log::print("%s : %d/%d", it->first.c_str(), it->second.validated, it->second.skipped);
+      }
+      OFX::Log::outdent();
+
+      // handles mean nothing once we are unloaded
+      gValidatedKeys.clear();
+      gValidationCounts.clear();
 #endif
     }
   };
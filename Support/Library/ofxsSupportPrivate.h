@@ -50,6 +50,9 @@ namespace OFX {
     /** @brief Pointer to the optional timeline suite */
     extern OfxTimeLineSuiteV1     *gTimeLineSuite;
 
+    /** @brief Pointer to the optional image fetch suite */
+    extern OfxImageFetchSuiteV1   *gImageFetchSuite;
+
     /** @brief Pointer to the parametric parameter suite */
     extern OfxParametricParameterSuiteV1* gParametricParameterSuite;
 
@@ -196,13 +199,13 @@ namespace OFX {
     void
       validateClipInstanceProperties(PropertySet props);
 
-    /** @brief validates an image or texture instance */
+    /** @brief validates an image or texture instance, only the first few from each clip are checked */
     void
-      validateImageBaseProperties(PropertySet props);
+      validateImageBaseProperties(PropertySet props, OfxImageClipHandle clip = 0);
 
-    /** @brief validates an image instance */
+    /** @brief validates an image instance, only the first few from each clip are checked */
     void
-      validateImageProperties(PropertySet props);
+      validateImageProperties(PropertySet props, OfxImageClipHandle clip = 0);
 
 #ifdef OFX_SUPPORTS_OPENGLRENDER
     /** @brief validates an OpenGL texture descriptor */
@@ -220,8 +223,15 @@ namespace OFX {
       OFX::PropertySet paramProps,
       bool checkDefaults);
 
+    /** @brief forgets that a handle was validated, call this when the object it belongs to is destroyed, as the host may hand the same address out again */
+    void
+      forgetValidated(const void *key);
+
     /** @brief initialises the validation code, call this in on load */
     void initialise(void);
+
+    /** @brief logs a summary of what was validated and resets, call this in unload */
+    void finalise(void);
   };
 
 };
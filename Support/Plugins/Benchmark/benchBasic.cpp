@@ -0,0 +1,32 @@
+// Copyright OpenFX and contributors to the OpenFX project.
+// SPDX-License-Identifier: BSD-3-Clause
+
+// benchmark the basic example's processor, with and without a mask
+#include "../Basic/basic.cpp"
+#include "ofxsBenchmark.h"
+
+/** @brief add the scaler, masked or not */
+static void addScaler(const char *name, bool masked)
+{
+  OFX::Benchmark::addKernel(name, [=](OFX::ImageEffect &effect, OFX::Benchmark::Fixture &fixture) {
+    return OFX::Benchmark::makeForPixelType(fixture, [&](auto type) {
+      typedef decltype(type) T;
+      ImageScaler<typename T::Pix, T::nComponents, T::max> *processor = new ImageScaler<typename T::Pix, T::nComponents, T::max>(effect);
+      processor->setDstImg(fixture.getDst());
+      processor->setSrcImg(fixture.getSrc(0));
+      processor->setScales(0.9f, 1.1f, 0.5f, 1.f);
+      if(masked) {
+        processor->doMasking(true);
+        processor->setMaskImg(fixture.getSrc(1));
+      }
+      processor->setRenderWindow(fixture.getRenderWindow());
+      return OFX::Benchmark::makeProcessorKernel(processor);
+    });
+  });
+}
+
+void OFX::Benchmark::registerKernels(void)
+{
+  addScaler("basic", false);
+  addScaler("basicMasked", true);
+}
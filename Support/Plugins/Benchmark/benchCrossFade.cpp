@@ -0,0 +1,22 @@
+// Copyright OpenFX and contributors to the OpenFX project.
+// SPDX-License-Identifier: BSD-3-Clause
+
+// benchmark the cross fade example's image blender
+#include "../Transition/crossFade.cpp"
+#include "ofxsBenchmark.h"
+
+void OFX::Benchmark::registerKernels(void)
+{
+  addKernel("crossFade", [](OFX::ImageEffect &effect, Fixture &fixture) {
+    return makeForPixelType(fixture, [&](auto type) {
+      typedef decltype(type) T;
+      OFX::ImageBlender<typename T::Pix, T::nComponents> *processor = new OFX::ImageBlender<typename T::Pix, T::nComponents>(effect);
+      processor->setDstImg(fixture.getDst());
+      processor->setFromImg(fixture.getSrc(0));
+      processor->setToImg(fixture.getSrc(1));
+      processor->setBlend(0.25f);
+      processor->setRenderWindow(fixture.getRenderWindow());
+      return makeProcessorKernel(processor);
+    });
+  });
+}
@@ -0,0 +1,23 @@
+// Copyright OpenFX and contributors to the OpenFX project.
+// SPDX-License-Identifier: BSD-3-Clause
+
+// benchmark the multi bundle example's dot generator
+#include "../MultiBundle/multibundle2.cpp"
+#include "ofxsBenchmark.h"
+
+void OFX::Benchmark::registerKernels(void)
+{
+  addKernel("dotGenerator", [](OFX::ImageEffect &effect, Fixture &fixture) {
+    return makeForPixelType(fixture, [&](auto type) {
+      typedef decltype(type) T;
+      DotGenerator<typename T::Pix, T::nComponents, T::max> *processor = new DotGenerator<typename T::Pix, T::nComponents, T::max>(effect);
+      OfxRectI window = fixture.getRenderWindow();
+      processor->setDstImg(fixture.getDst());
+      processor->setRadius(float(window.y2) / 3);
+      processor->setColour(1, 0.5, 0.25, 1);
+      processor->setPosition(float(window.x2) / 2, float(window.y2) / 2);
+      processor->setRenderWindow(window);
+      return makeProcessorKernel(processor);
+    });
+  });
+}
@@ -0,0 +1,20 @@
+// Copyright OpenFX and contributors to the OpenFX project.
+// SPDX-License-Identifier: BSD-3-Clause
+
+// benchmark the field example's processor
+#include "../Field/field.cpp"
+#include "ofxsBenchmark.h"
+
+void OFX::Benchmark::registerKernels(void)
+{
+  addKernel("field", [](OFX::ImageEffect &effect, Fixture &fixture) {
+    return makeForPixelType(fixture, [&](auto type) {
+      typedef decltype(type) T;
+      ImageFielder<typename T::Pix, T::nComponents, T::max> *processor = new ImageFielder<typename T::Pix, T::nComponents, T::max>(effect, OFX::eFieldLower);
+      processor->setDstImg(fixture.getDst());
+      processor->setSrcImg(fixture.getSrc());
+      processor->setRenderWindow(fixture.getRenderWindow());
+      return makeProcessorKernel(processor);
+    });
+  });
+}
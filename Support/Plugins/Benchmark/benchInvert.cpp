@@ -0,0 +1,20 @@
+// Copyright OpenFX and contributors to the OpenFX project.
+// SPDX-License-Identifier: BSD-3-Clause
+
+// benchmark the invert example's processor
+#include "../Invert/invert.cpp"
+#include "ofxsBenchmark.h"
+
+void OFX::Benchmark::registerKernels(void)
+{
+  addKernel("invert", [](OFX::ImageEffect &effect, Fixture &fixture) {
+    return makeForPixelType(fixture, [&](auto type) {
+      typedef decltype(type) T;
+      ImageInverter<typename T::Pix, T::nComponents, T::max> *processor = new ImageInverter<typename T::Pix, T::nComponents, T::max>(effect);
+      processor->setDstImg(fixture.getDst());
+      processor->setSrcImg(fixture.getSrc());
+      processor->setRenderWindow(fixture.getRenderWindow());
+      return makeProcessorKernel(processor);
+    });
+  });
+}
@@ -0,0 +1,21 @@
+// Copyright OpenFX and contributors to the OpenFX project.
+// SPDX-License-Identifier: BSD-3-Clause
+
+// benchmark the noise generator example's processor
+#include "../Generator/noise.cpp"
+#include "ofxsBenchmark.h"
+
+void OFX::Benchmark::registerKernels(void)
+{
+  addKernel("noise", [](OFX::ImageEffect &effect, Fixture &fixture) {
+    return makeForPixelType(fixture, [&](auto type) {
+      typedef decltype(type) T;
+      NoiseGenerator<typename T::Pix, T::nComponents, T::max> *processor = new NoiseGenerator<typename T::Pix, T::nComponents, T::max>(effect);
+      processor->setDstImg(fixture.getDst());
+      processor->setNoiseLevel(0.5f);
+      processor->setSeed(1);
+      processor->setRenderWindow(fixture.getRenderWindow());
+      return makeProcessorKernel(processor);
+    });
+  });
+}
@@ -0,0 +1,790 @@
+// Copyright OpenFX and contributors to the OpenFX project.
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <iomanip>
+
+#include "ofxsImageEffect.h"
+#include "../../Library/ofxsSupportPrivate.h"
+
+#include "ofxsBenchmark.h"
+
+////////////////////////////////////////////////////////////////////////////////
+// A stub host, with only what the processors and the images they work on need
+//
+// Run it as
+//    bench<plugin> [-sizes 640x480,1920x1080] [-depths byte,short,float] [-components rgba,alpha]
+//                  [-threads 1,4] [-repeats 5] [-filter name]
+//                  [-baseline file [-tolerance 0.1]] [-write-baseline file]
+//
+// With -baseline, any case more than tolerance slower than its baseline fails the run.
+// -write-baseline adds this run's results to the file, replacing any for the same cases.
+
+namespace OFX {
+
+  namespace Benchmark {
+
+    /** @brief a value of a stub property */
+    struct PropValue {
+      std::string s;
+      int         i;
+      double      d;
+      void       *p;
+      PropValue() : i(0), d(0), p(0) {}
+    };
+
+    typedef std::map<std::string, std::vector<PropValue> > PropMap;
+
+    /** @brief a stub property set, handles are pointers to these */
+    struct StubProps {
+      PropMap props;
+    };
+
+    /** @brief the effect we hand processors, its handle is a pointer to this */
+    struct StubEffect {
+      StubProps props;
+    };
+
+    static unsigned int gNumThreads = 1;                 /**< @brief what the thread suite says the CPU count is */
+    static thread_local unsigned int tThreadIndex = 0;
+    static thread_local bool tSpawned = false;
+
+    static PropMap &getPropMap(OfxPropertySetHandle h)
+    {
+      return reinterpret_cast<StubProps *>(h)->props;
+    }
+
+    /** @brief find the nth value of a property, making it if needed */
+    static PropValue &setValue(OfxPropertySetHandle h, const char *name, int index)
+    {
+      std::vector<PropValue> &v = getPropMap(h)[name];
+      if(int(v.size()) <= index)
+        v.resize(index + 1);
+      return v[index];
+    }
+
+    /** @brief find the nth value of a property, or NULL */
+    static const PropValue *getValue(OfxPropertySetHandle h, const char *name, int index)
+    {
+      PropMap &props = getPropMap(h);
+      PropMap::const_iterator it = props.find(name);
+      if(it == props.end() || index < 0 || index >= int(it->second.size()))
+        return NULL;
+      return &it->second[index];
+    }
+
+    static OfxStatus propSetPointer(OfxPropertySetHandle h, const char *name, int index, void *value)
+    {
+      setValue(h, name, index).p = value;
+      return kOfxStatOK;
+    }
+
+    static OfxStatus propSetString(OfxPropertySetHandle h, const char *name, int index, const char *value)
+    {
+      setValue(h, name, index).s = value ? value : "";
+      return kOfxStatOK;
+    }
+
+    static OfxStatus propSetDouble(OfxPropertySetHandle h, const char *name, int index, double value)
+    {
+      setValue(h, name, index).d = value;
+      return kOfxStatOK;
+    }
+
+    static OfxStatus propSetInt(OfxPropertySetHandle h, const char *name, int index, int value)
+    {
+      setValue(h, name, index).i = value;
+      return kOfxStatOK;
+    }
+
+    static OfxStatus propSetPointerN(OfxPropertySetHandle h, const char *name, int count, void *const *value)
+    {
+      for(int i = 0; i < count; ++i)
+        propSetPointer(h, name, i, value[i]);
+      return kOfxStatOK;
+    }
+
+    static OfxStatus propSetStringN(OfxPropertySetHandle h, const char *name, int count, const char *const *value)
+    {
+      for(int i = 0; i < count; ++i)
+        propSetString(h, name, i, value[i]);
+      return kOfxStatOK;
+    }
+
+    static OfxStatus propSetDoubleN(OfxPropertySetHandle h, const char *name, int count, const double *value)
+    {
+      for(int i = 0; i < count; ++i)
+        propSetDouble(h, name, i, value[i]);
+      return kOfxStatOK;
+    }
+
+    static OfxStatus propSetIntN(OfxPropertySetHandle h, const char *name, int count, const int *value)
+    {
+      for(int i = 0; i < count; ++i)
+        propSetInt(h, name, i, value[i]);
+      return kOfxStatOK;
+    }
+
+    static OfxStatus propGetPointer(OfxPropertySetHandle h, const char *name, int index, void **value)
+    {
+      const PropValue *v = getValue(h, name, index);
+      if(!v) return kOfxStatErrUnknown;
+      *value = v->p;
+      return kOfxStatOK;
+    }
+
+    static OfxStatus propGetString(OfxPropertySetHandle h, const char *name, int index, char **value)
+    {
+      const PropValue *v = getValue(h, name, index);
+      if(!v) return kOfxStatErrUnknown;
+      *value = const_cast<char *>(v->s.c_str());
+      return kOfxStatOK;
+    }
+
+    static OfxStatus propGetDouble(OfxPropertySetHandle h, const char *name, int index, double *value)
+    {
+      const PropValue *v = getValue(h, name, index);
+      if(!v) return kOfxStatErrUnknown;
+      *value = v->d;
+      return kOfxStatOK;
+    }
+
+    static OfxStatus propGetInt(OfxPropertySetHandle h, const char *name, int index, int *value)
+    {
+      const PropValue *v = getValue(h, name, index);
+      if(!v) return kOfxStatErrUnknown;
+      *value = v->i;
+      return kOfxStatOK;
+    }
+
+    static OfxStatus propGetPointerN(OfxPropertySetHandle h, const char *name, int count, void **value)
+    {
+      for(int i = 0; i < count; ++i)
+        if(propGetPointer(h, name, i, &value[i]) != kOfxStatOK) return kOfxStatErrUnknown;
+      return kOfxStatOK;
+    }
+
+    static OfxStatus propGetStringN(OfxPropertySetHandle h, const char *name, int count, char **value)
+    {
+      for(int i = 0; i < count; ++i)
+        if(propGetString(h, name, i, &value[i]) != kOfxStatOK) return kOfxStatErrUnknown;
+      return kOfxStatOK;
+    }
+
+    static OfxStatus propGetDoubleN(OfxPropertySetHandle h, const char *name, int count, double *value)
+    {
+      for(int i = 0; i < count; ++i)
+        if(propGetDouble(h, name, i, &value[i]) != kOfxStatOK) return kOfxStatErrUnknown;
+      return kOfxStatOK;
+    }
+
+    static OfxStatus propGetIntN(OfxPropertySetHandle h, const char *name, int count, int *value)
+    {
+      for(int i = 0; i < count; ++i)
+        if(propGetInt(h, name, i, &value[i]) != kOfxStatOK) return kOfxStatErrUnknown;
+      return kOfxStatOK;
+    }
+
+    static OfxStatus propReset(OfxPropertySetHandle h, const char *name)
+    {
+      getPropMap(h).erase(name);
+      return kOfxStatOK;
+    }
+
+    static OfxStatus propGetDimension(OfxPropertySetHandle h, const char *name, int *count)
+    {
+      PropMap &props = getPropMap(h);
+      PropMap::const_iterator it = props.find(name);
+      if(it == props.end()) return kOfxStatErrUnknown;
+      *count = int(it->second.size());
+      return kOfxStatOK;
+    }
+
+    static OfxStatus getPropertySet(OfxImageEffectHandle effect, OfxPropertySetHandle *props)
+    {
+      *props = reinterpret_cast<OfxPropertySetHandle>(&reinterpret_cast<StubEffect *>(effect)->props);
+      return kOfxStatOK;
+    }
+
+    static OfxStatus getParamSet(OfxImageEffectHandle /*effect*/, OfxParamSetHandle *paramSet)
+    {
+      // no param set, the processors get their params set directly
+      *paramSet = NULL;
+      return kOfxStatOK;
+    }
+
+    static OfxStatus clipReleaseImage(OfxPropertySetHandle)
+    {
+      // the BenchImage owns the pixels
+      return kOfxStatOK;
+    }
+
+    static int abort(OfxImageEffectHandle)
+    {
+      return 0;
+    }
+
+    /** @brief run func on nThreads threads, the calling thread being the first */
+    static OfxStatus multiThread(OfxThreadFunctionV1 func, unsigned int nThreads, void *customArg)
+    {
+      std::vector<std::thread> threads;
+      for(unsigned int i = 1; i < nThreads; ++i) {
+        threads.push_back(std::thread([=]() {
+          tThreadIndex = i;
+          tSpawned = true;
+          func(i, nThreads, customArg);
+        }));
+      }
+      func(0, nThreads, customArg);
+      for(size_t i = 0; i < threads.size(); ++i)
+        threads[i].join();
+      return kOfxStatOK;
+    }
+
+    static OfxStatus multiThreadNumCPUs(unsigned int *nCPUs)
+    {
+      *nCPUs = gNumThreads;
+      return kOfxStatOK;
+    }
+
+    static OfxStatus multiThreadIndex(unsigned int *threadIndex)
+    {
+      *threadIndex = tThreadIndex;
+      return kOfxStatOK;
+    }
+
+    static int multiThreadIsSpawnedThread(void)
+    {
+      return tSpawned;
+    }
+
+    static OfxStatus mutexCreate(OfxMutexHandle *mutex, int lockCount)
+    {
+      std::recursive_mutex *m = new std::recursive_mutex;
+      for(int i = 0; i < lockCount; ++i)
+        m->lock();
+      *mutex = reinterpret_cast<OfxMutexHandle>(m);
+      return kOfxStatOK;
+    }
+
+    static OfxStatus mutexDestroy(const OfxMutexHandle mutex)
+    {
+      delete reinterpret_cast<std::recursive_mutex *>(mutex);
+      return kOfxStatOK;
+    }
+
+    static OfxStatus mutexLock(const OfxMutexHandle mutex)
+    {
+      reinterpret_cast<std::recursive_mutex *>(mutex)->lock();
+      return kOfxStatOK;
+    }
+
+    static OfxStatus mutexUnLock(const OfxMutexHandle mutex)
+    {
+      reinterpret_cast<std::recursive_mutex *>(mutex)->unlock();
+      return kOfxStatOK;
+    }
+
+    static OfxStatus mutexTryLock(const OfxMutexHandle mutex)
+    {
+      return reinterpret_cast<std::recursive_mutex *>(mutex)->try_lock() ? kOfxStatOK : kOfxStatFailed;
+    }
+
+    static OfxStatus message(void *, const char *type, const char *, const char *format, ...)
+    {
+      std::printf("%s: %s\n", type, format);
+      return kOfxStatOK;
+    }
+
+    static OfxStatus setPersistentMessage(void *handle, const char *type, const char *id, const char *format, ...)
+    {
+      return message(handle, type, id, format);
+    }
+
+    static OfxStatus clearPersistentMessage(void *)
+    {
+      return kOfxStatOK;
+    }
+
+    static OfxPropertySuiteV1    gPropSuite;
+    static OfxImageEffectSuiteV1 gEffectSuite;
+    static OfxMultiThreadSuiteV1 gThreadSuite;
+    static OfxMessageSuiteV2     gMessageSuite;
+
+    /** @brief point the support library at our stub suites, the rest are left NULL */
+    static void installStubHost(void)
+    {
+      gPropSuite.propSetPointer = propSetPointer;
+      gPropSuite.propSetString = propSetString;
+      gPropSuite.propSetDouble = propSetDouble;
+      gPropSuite.propSetInt = propSetInt;
+      gPropSuite.propSetPointerN = propSetPointerN;
+      gPropSuite.propSetStringN = propSetStringN;
+      gPropSuite.propSetDoubleN = propSetDoubleN;
+      gPropSuite.propSetIntN = propSetIntN;
+      gPropSuite.propGetPointer = propGetPointer;
+      gPropSuite.propGetString = propGetString;
+      gPropSuite.propGetDouble = propGetDouble;
+      gPropSuite.propGetInt = propGetInt;
+      gPropSuite.propGetPointerN = propGetPointerN;
+      gPropSuite.propGetStringN = propGetStringN;
+      gPropSuite.propGetDoubleN = propGetDoubleN;
+      gPropSuite.propGetIntN = propGetIntN;
+      gPropSuite.propReset = propReset;
+      gPropSuite.propGetDimension = propGetDimension;
+
+      gEffectSuite.getPropertySet = getPropertySet;
+      gEffectSuite.getParamSet = getParamSet;
+      gEffectSuite.clipReleaseImage = clipReleaseImage;
+      gEffectSuite.abort = abort;
+
+      gThreadSuite.multiThread = multiThread;
+      gThreadSuite.multiThreadNumCPUs = multiThreadNumCPUs;
+      gThreadSuite.multiThreadIndex = multiThreadIndex;
+      gThreadSuite.multiThreadIsSpawnedThread = multiThreadIsSpawnedThread;
+      gThreadSuite.mutexCreate = mutexCreate;
+      gThreadSuite.mutexDestroy = mutexDestroy;
+      gThreadSuite.mutexLock = mutexLock;
+      gThreadSuite.mutexUnLock = mutexUnLock;
+      gThreadSuite.mutexTryLock = mutexTryLock;
+
+      gMessageSuite.message = message;
+      gMessageSuite.setPersistentMessage = setPersistentMessage;
+      gMessageSuite.clearPersistentMessage = clearPersistentMessage;
+
+      OFX::Private::gPropSuite = &gPropSuite;
+      OFX::Private::gEffectSuite = &gEffectSuite;
+      OFX::Private::gThreadSuite = &gThreadSuite;
+      OFX::Private::gMessageSuite = reinterpret_cast<OfxMessageSuiteV1 *>(&gMessageSuite);
+      OFX::Private::gMessageSuiteV2 = &gMessageSuite;
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////
+    // images
+
+    static int bytesPerComponent(OFX::BitDepthEnum depth)
+    {
+      switch(depth) {
+      case OFX::eBitDepthUByte : return 1;
+      case OFX::eBitDepthUShort : return 2;
+      case OFX::eBitDepthFloat : return 4;
+      default : return 0;
+      }
+    }
+
+    static int componentCount(OFX::PixelComponentEnum components)
+    {
+      switch(components) {
+      case OFX::ePixelComponentRGBA : return 4;
+      case OFX::ePixelComponentRGB : return 3;
+      case OFX::ePixelComponentAlpha : return 1;
+      default : return 0;
+      }
+    }
+
+    static const char *depthName(OFX::BitDepthEnum depth)
+    {
+      switch(depth) {
+      case OFX::eBitDepthUByte : return "byte";
+      case OFX::eBitDepthUShort : return "short";
+      case OFX::eBitDepthFloat : return "float";
+      default : return "none";
+      }
+    }
+
+    static const char *componentsName(OFX::PixelComponentEnum components)
+    {
+      switch(components) {
+      case OFX::ePixelComponentRGBA : return "rgba";
+      case OFX::ePixelComponentRGB : return "rgb";
+      case OFX::ePixelComponentAlpha : return "alpha";
+      default : return "none";
+      }
+    }
+
+    static const char *depthString(OFX::BitDepthEnum depth)
+    {
+      switch(depth) {
+      case OFX::eBitDepthUByte : return kOfxBitDepthByte;
+      case OFX::eBitDepthUShort : return kOfxBitDepthShort;
+      case OFX::eBitDepthFloat : return kOfxBitDepthFloat;
+      default : return kOfxBitDepthNone;
+      }
+    }
+
+    static const char *componentsString(OFX::PixelComponentEnum components)
+    {
+      switch(components) {
+      case OFX::ePixelComponentRGBA : return kOfxImageComponentRGBA;
+      case OFX::ePixelComponentRGB : return kOfxImageComponentRGB;
+      case OFX::ePixelComponentAlpha : return kOfxImageComponentAlpha;
+      default : return kOfxImageComponentNone;
+      }
+    }
+
+    BenchImage::BenchImage(int width, int height, OFX::BitDepthEnum depth, OFX::PixelComponentEnum components, int seed)
+      : _props(new StubProps)
+    {
+      int nComps = componentCount(components);
+      int bytes = bytesPerComponent(depth);
+      int rowBytes = width * nComps * bytes;
+      _pixels.resize(size_t(rowBytes) * height);
+
+      // a ramp, so kernels that branch on pixel values don't see the same value everywhere
+      size_t nValues = size_t(width) * height * nComps;
+      for(size_t i = 0; i < nValues; ++i) {
+        double v = double((i * 7 + seed * 13) % 256) / 255.;
+        switch(depth) {
+        case OFX::eBitDepthUByte : _pixels[i] = (unsigned char)(v * 255); break;
+        case OFX::eBitDepthUShort : reinterpret_cast<unsigned short *>(&_pixels[0])[i] = (unsigned short)(v * 65535); break;
+        case OFX::eBitDepthFloat : reinterpret_cast<float *>(&_pixels[0])[i] = float(v); break;
+        default : break;
+        }
+      }
+
+      OfxPropertySetHandle h = reinterpret_cast<OfxPropertySetHandle>(_props.get());
+      int bounds[4] = {0, 0, width, height};
+      double scale[2] = {1, 1};
+      propSetInt(h, kOfxImagePropRowBytes, 0, rowBytes);
+      propSetDouble(h, kOfxImagePropPixelAspectRatio, 0, 1.);
+      propSetString(h, kOfxImageEffectPropComponents, 0, componentsString(components));
+      propSetString(h, kOfxImageEffectPropPixelDepth, 0, depthString(depth));
+      propSetString(h, kOfxImageEffectPropPreMultiplication, 0, kOfxImagePreMultiplied);
+      propSetIntN(h, kOfxImagePropRegionOfDefinition, 4, bounds);
+      propSetIntN(h, kOfxImagePropBounds, 4, bounds);
+      propSetString(h, kOfxImagePropField, 0, kOfxImageFieldNone);
+      propSetString(h, kOfxImagePropUniqueIdentifier, 0, "");
+      propSetDoubleN(h, kOfxImageEffectPropRenderScale, 2, scale);
+      propSetPointer(h, kOfxImagePropData, 0, _pixels.empty() ? NULL : &_pixels[0]);
+
+      _image.reset(new OFX::Image(h));
+    }
+
+    BenchImage::~BenchImage()
+    {
+    }
+
+    Fixture::Fixture(int width, int height, OFX::BitDepthEnum depth, OFX::PixelComponentEnum components)
+      : _width(width)
+      , _height(height)
+      , _depth(depth)
+      , _components(components)
+    {
+    }
+
+    Fixture::~Fixture()
+    {
+    }
+
+    OfxRectI Fixture::getRenderWindow(void) const
+    {
+      OfxRectI window = {0, 0, _width, _height};
+      return window;
+    }
+
+    OFX::Image *Fixture::getDst(void)
+    {
+      if(!_dst)
+        _dst.reset(new BenchImage(_width, _height, _depth, _components, 0));
+      return _dst->getImage();
+    }
+
+    OFX::Image *Fixture::getSrc(int i)
+    {
+      while(int(_srcs.size()) <= i)
+        _srcs.push_back(std::unique_ptr<BenchImage>(new BenchImage(_width, _height, _depth, _components, int(_srcs.size()) + 1)));
+      return _srcs[i]->getImage();
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////
+    // running
+
+    typedef std::vector<std::pair<std::string, KernelFactory> > KernelList;
+
+    static KernelList &getKernels(void)
+    {
+      static KernelList kernels;
+      return kernels;
+    }
+
+    void addKernel(const std::string &name, KernelFactory factory)
+    {
+      getKernels().push_back(std::make_pair(name, factory));
+    }
+
+    /** @brief an effect with our stub properties behind it */
+    class BenchEffect : public OFX::ImageEffect {
+    public :
+      explicit BenchEffect(StubEffect &stub) : OFX::ImageEffect(reinterpret_cast<OfxImageEffectHandle>(&stub)) {}
+
+      /** @brief never called, kernels run processors directly */
+      void render(const OFX::RenderArguments &/*args*/) {}
+    };
+
+    /** @brief what to sweep over and check against */
+    struct Options {
+      std::vector<std::pair<int, int> >         sizes;
+      std::vector<OFX::BitDepthEnum>            depths;
+      std::vector<OFX::PixelComponentEnum>      components;
+      std::vector<unsigned int>                 threads;
+      int                                       repeats;
+      std::string                               filter;
+      std::string                               baselineFile;
+      std::string                               writeBaselineFile;
+      double                                    tolerance;
+    };
+
+    static std::vector<std::string> splitList(const std::string &s)
+    {
+      std::vector<std::string> items;
+      std::stringstream ss(s);
+      std::string item;
+      while(std::getline(ss, item, ','))
+        if(!item.empty())
+          items.push_back(item);
+      return items;
+    }
+
+    static bool parseOptions(int argc, char **argv, Options &options)
+    {
+      options.sizes.push_back(std::make_pair(640, 480));
+      options.sizes.push_back(std::make_pair(1920, 1080));
+      options.depths.push_back(OFX::eBitDepthUByte);
+      options.depths.push_back(OFX::eBitDepthUShort);
+      options.depths.push_back(OFX::eBitDepthFloat);
+      options.components.push_back(OFX::ePixelComponentRGBA);
+      options.components.push_back(OFX::ePixelComponentAlpha);
+      options.threads.push_back(1);
+      unsigned int nCPUs = std::thread::hardware_concurrency();
+      if(nCPUs > 1)
+        options.threads.push_back(nCPUs);
+      options.repeats = 5;
+      options.tolerance = 0.1;
+
+      for(int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool haveValue = i + 1 < argc;
+        if(arg == "-sizes" && haveValue) {
+          options.sizes.clear();
+          std::vector<std::string> items = splitList(argv[++i]);
+          for(size_t j = 0; j < items.size(); ++j) {
+            int w = 0, h = 0;
+            if(std::sscanf(items[j].c_str(), "%dx%d", &w, &h) != 2 || w <= 0 || h <= 0) {
+              std::cerr << "bad size " << items[j] << ", expected WxH" << std::endl;
+              return false;
+            }
+            options.sizes.push_back(std::make_pair(w, h));
+          }
+        }
+        else if(arg == "-depths" && haveValue) {
+          options.depths.clear();
+          std::vector<std::string> items = splitList(argv[++i]);
+          for(size_t j = 0; j < items.size(); ++j) {
+            if(items[j] == "byte") options.depths.push_back(OFX::eBitDepthUByte);
+            else if(items[j] == "short") options.depths.push_back(OFX::eBitDepthUShort);
+            else if(items[j] == "float") options.depths.push_back(OFX::eBitDepthFloat);
+            else {
+              std::cerr << "bad depth " << items[j] << ", expected byte, short or float" << std::endl;
+              return false;
+            }
+          }
+        }
+        else if(arg == "-components" && haveValue) {
+          options.components.clear();
+          std::vector<std::string> items = splitList(argv[++i]);
+          for(size_t j = 0; j < items.size(); ++j) {
+            if(items[j] == "rgba") options.components.push_back(OFX::ePixelComponentRGBA);
+            else if(items[j] == "rgb") options.components.push_back(OFX::ePixelComponentRGB);
+            else if(items[j] == "alpha") options.components.push_back(OFX::ePixelComponentAlpha);
+            else {
+              std::cerr << "bad components " << items[j] << ", expected rgba, rgb or alpha" << std::endl;
+              return false;
+            }
+          }
+        }
+        else if(arg == "-threads" && haveValue) {
+          options.threads.clear();
+          std::vector<std::string> items = splitList(argv[++i]);
+          for(size_t j = 0; j < items.size(); ++j)
+            options.threads.push_back(std::max(1, std::atoi(items[j].c_str())));
+        }
+        else if(arg == "-repeats" && haveValue) {
+          options.repeats = std::max(1, std::atoi(argv[++i]));
+        }
+        else if(arg == "-filter" && haveValue) {
+          options.filter = argv[++i];
+        }
+        else if(arg == "-baseline" && haveValue) {
+          options.baselineFile = argv[++i];
+        }
+        else if(arg == "-write-baseline" && haveValue) {
+          options.writeBaselineFile = argv[++i];
+        }
+        else if(arg == "-tolerance" && haveValue) {
+          options.tolerance = std::atof(argv[++i]);
+        }
+        else {
+          std::cerr << "unknown option " << arg << std::endl;
+          return false;
+        }
+      }
+      return true;
+    }
+
+    /** @brief read a baseline file, lines of a case name then Mpixels/s, # for comments */
+    static std::map<std::string, double> readBaseline(const std::string &file)
+    {
+      std::map<std::string, double> baseline;
+      std::ifstream is(file.c_str());
+      std::string line;
+      while(std::getline(is, line)) {
+        if(line.empty() || line[0] == '#')
+          continue;
+        std::istringstream ls(line);
+        std::string name;
+        double v;
+        if(ls >> name >> v)
+          baseline[name] = v;
+      }
+      return baseline;
+    }
+
+    static bool writeBaseline(const std::string &file, const std::map<std::string, double> &baseline)
+    {
+      std::ofstream os(file.c_str());
+      os << "# OFX support processor benchmark baseline, case then Mpixels/s" << std::endl;
+      for(std::map<std::string, double>::const_iterator it = baseline.begin(); it != baseline.end(); ++it)
+        os << it->first << ' ' << it->second << std::endl;
+      return bool(os);
+    }
+
+    typedef std::chrono::steady_clock Clock;
+
+    /** @brief run all the cases, returns the exit status */
+    static int run(const Options &options)
+    {
+      std::map<std::string, double> baseline;
+      if(!options.baselineFile.empty())
+        baseline = readBaseline(options.baselineFile);
+
+      std::map<std::string, double> results;
+      int nRegressions = 0;
+
+      StubEffect stub;
+      OfxPropertySetHandle effectProps = reinterpret_cast<OfxPropertySetHandle>(&stub.props);
+      propSetString(effectProps, kOfxImageEffectPropContext, 0, kOfxImageEffectContextFilter);
+      BenchEffect effect(stub);
+
+      const KernelList &kernels = getKernels();
+      for(KernelList::const_iterator kit = kernels.begin(); kit != kernels.end(); ++kit) {
+        if(!options.filter.empty() && kit->first.find(options.filter) == std::string::npos)
+          continue;
+
+        for(size_t si = 0; si < options.sizes.size(); ++si) {
+          for(size_t di = 0; di < options.depths.size(); ++di) {
+            for(size_t ci = 0; ci < options.components.size(); ++ci) {
+              Fixture fixture(options.sizes[si].first, options.sizes[si].second, options.depths[di], options.components[ci]);
+              std::unique_ptr<Kernel> kernel(kit->second(effect, fixture));
+              if(!kernel)
+                continue; // not something this kernel does
+
+              for(size_t ti = 0; ti < options.threads.size(); ++ti) {
+                gNumThreads = options.threads[ti];
+
+                std::ostringstream name;
+                name << kit->first << '/' << options.sizes[si].first << 'x' << options.sizes[si].second
+                     << '/' << depthName(options.depths[di]) << '/' << componentsName(options.components[ci])
+                     << "/t" << gNumThreads;
+
+                // one to warm the caches and page in the images, then the timed ones
+                kernel->process();
+                std::vector<double> rates;
+                for(int r = 0; r < options.repeats; ++r) {
+                  Clock::time_point start = Clock::now();
+                  kernel->process();
+                  double secs = std::chrono::duration<double>(Clock::now() - start).count();
+                  rates.push_back(secs > 0 ? fixture.getPixelCount() / secs / 1e6 : 0.);
+                }
+
+                double mean = 0, var = 0;
+                for(size_t r = 0; r < rates.size(); ++r)
+                  mean += rates[r];
+                mean /= rates.size();
+                for(size_t r = 0; r < rates.size(); ++r)
+                  var += (rates[r] - mean) * (rates[r] - mean);
+                double stddev = rates.size() > 1 ? std::sqrt(var / (rates.size() - 1)) : 0.;
+                results[name.str()] = mean;
+
+                std::cout << std::left << std::setw(40) << name.str() << std::right
+                          << std::fixed << std::setprecision(1)
+                          << std::setw(10) << mean << " Mpixels/s +- " << stddev
+                          << " (" << (mean > 0 ? 100. * stddev / mean : 0.) << "%)";
+
+                std::map<std::string, double>::const_iterator bit = baseline.find(name.str());
+                if(bit != baseline.end() && bit->second > 0) {
+                  double change = mean / bit->second - 1.;
+                  std::cout << ", " << std::showpos << 100. * change << std::noshowpos << "% on baseline";
+                  if(change < -options.tolerance) {
+                    std::cout << " REGRESSION";
+                    ++nRegressions;
+                  }
+                }
+                std::cout << std::endl;
+                std::cout.unsetf(std::ios::fixed);
+              }
+            }
+          }
+        }
+      }
+
+      if(!options.writeBaselineFile.empty()) {
+        std::map<std::string, double> written = readBaseline(options.writeBaselineFile);
+        for(std::map<std::string, double>::const_iterator it = results.begin(); it != results.end(); ++it)
+          written[it->first] = it->second;
+        if(!writeBaseline(options.writeBaselineFile, written)) {
+          std::cerr << "failed to write " << options.writeBaselineFile << std::endl;
+          return 1;
+        }
+      }
+
+      if(nRegressions) {
+        std::cout << nRegressions << " case(s) more than " << std::defaultfloat << std::setprecision(3) << 100. * options.tolerance << "% slower than the baseline" << std::endl;
+        return 1;
+      }
+      return 0;
+    }
+
+  };
+
+};
+
+int main(int argc, char **argv)
+{
+  OFX::Benchmark::Options options;
+  if(!OFX::Benchmark::parseOptions(argc, argv, options))
+    return 2;
+
+  OFX::Benchmark::installStubHost();
+  OFX::Benchmark::registerKernels();
+
+  try {
+    return OFX::Benchmark::run(options);
+  }
+  catch(std::exception &e) {
+    std::cerr << "benchmark failed, " << e.what() << std::endl;
+  }
+  catch(...) {
+    std::cerr << "benchmark failed" << std::endl;
+  }
+  return 1;
+}
@@ -0,0 +1,159 @@
+#ifndef _ofxsBenchmark_h_
+#define _ofxsBenchmark_h_
+
+// Copyright OpenFX and contributors to the OpenFX project.
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+
+#include "ofxsImageEffect.h"
+
+/** @file This file contains a harness to benchmark the example plugins' image processors without a host
+
+Each benchmark executable is built from one plugin's source plus one of the bench*.cpp files, which
+registers that plugin's processors as kernels. The harness stands in for the host with just enough
+of the property, image effect and multi thread suites to make images and run processors. It sweeps
+the kernels over image sizes, bit depths, components and thread counts, reports the throughput of
+each, and can fail if it is slower than a stored baseline.
+*/
+
+namespace OFX {
+
+  namespace Benchmark {
+
+    /** @brief the stub host's property set, see ofxsBenchmark.cpp */
+    struct StubProps;
+
+    /** @brief An image held in memory, with the properties a host would give it */
+    class BenchImage {
+    protected :
+      std::unique_ptr<StubProps>  _props;   /**< @brief the image's properties, as the stub property suite sees them */
+      std::vector<unsigned char>  _pixels;  /**< @brief the pixel data */
+      std::unique_ptr<OFX::Image> _image;   /**< @brief the image made from _props */
+
+    public :
+      /** @brief make a width x height image, filled with a ramp seeded by seed */
+      BenchImage(int width, int height, OFX::BitDepthEnum depth, OFX::PixelComponentEnum components, int seed);
+
+      ~BenchImage();
+
+      /** @brief the image to hand to a processor */
+      OFX::Image *getImage(void) {return _image.get();}
+    };
+
+    /** @brief The images and settings for one run of one kernel */
+    class Fixture {
+    protected :
+      int                       _width;
+      int                       _height;
+      OFX::BitDepthEnum         _depth;
+      OFX::PixelComponentEnum   _components;
+      std::unique_ptr<BenchImage>              _dst;
+      std::vector<std::unique_ptr<BenchImage> > _srcs;
+
+    public :
+      Fixture(int width, int height, OFX::BitDepthEnum depth, OFX::PixelComponentEnum components);
+
+      ~Fixture();
+
+      OFX::BitDepthEnum getPixelDepth(void) const {return _depth;}
+      OFX::PixelComponentEnum getPixelComponents(void) const {return _components;}
+
+      /** @brief the whole image */
+      OfxRectI getRenderWindow(void) const;
+
+      /** @brief number of pixels in the render window */
+      double getPixelCount(void) const {return double(_width) * double(_height);}
+
+      /** @brief the image to render into */
+      OFX::Image *getDst(void);
+
+      /** @brief the i'th source image, made on first asking, each has different pixels */
+      OFX::Image *getSrc(int i = 0);
+    };
+
+    /** @brief something to time, made for a fixture by a KernelFactory */
+    class Kernel {
+    public :
+      virtual ~Kernel() {}
+
+      /** @brief do the work being timed */
+      virtual void process(void) = 0;
+    };
+
+    /** @brief a Kernel that runs an OFX::ImageProcessor, which it owns */
+    template <class PROC>
+    class ProcessorKernel : public Kernel {
+    protected :
+      std::unique_ptr<PROC> _processor;
+
+    public :
+      explicit ProcessorKernel(PROC *processor) : _processor(processor) {}
+
+      void process(void) {_processor->process();}
+    };
+
+    /** @brief make a ProcessorKernel for a processor */
+    template <class PROC>
+    Kernel *makeProcessorKernel(PROC *processor)
+    {
+      return new ProcessorKernel<PROC>(processor);
+    }
+
+    /** @brief Makes a kernel for the fixture, using effect as the processor's effect.
+        Returns NULL if the fixture's depth and components are not supported.
+    */
+    typedef std::function<Kernel *(OFX::ImageEffect &effect, Fixture &fixture)> KernelFactory;
+
+    /** @brief names a pixel type, as the templated processors take them */
+    template <class PIX, int nComps, int maxValue>
+    struct PixelType {
+      typedef PIX Pix;
+      enum {nComponents = nComps, max = maxValue};
+    };
+
+    /** @brief Call make with the PixelType matching the fixture's depth and components, one of
+        RGBA or alpha in bytes, shorts or floats, as the example plugins support. Returns what
+        make returns, or NULL if there is no match.
+
+        make is typically a generic lambda, eg:
+        @verbatim
+          return makeForPixelType(fixture, [&](auto type) {
+            typedef decltype(type) T;
+            return makeProcessorKernel(new MyProcessor<typename T::Pix, T::nComponents, T::max>(effect));
+          });
+        @endverbatim
+    */
+    template <class MAKE>
+    Kernel *makeForPixelType(const Fixture &fixture, MAKE make)
+    {
+      bool rgba = fixture.getPixelComponents() == OFX::ePixelComponentRGBA;
+      if(!rgba && fixture.getPixelComponents() != OFX::ePixelComponentAlpha)
+        return NULL;
+
+      switch(fixture.getPixelDepth()) {
+      case OFX::eBitDepthUByte :
+        return rgba ? make(PixelType<unsigned char, 4, 255>()) : make(PixelType<unsigned char, 1, 255>());
+      case OFX::eBitDepthUShort :
+        return rgba ? make(PixelType<unsigned short, 4, 65535>()) : make(PixelType<unsigned short, 1, 65535>());
+      case OFX::eBitDepthFloat :
+        return rgba ? make(PixelType<float, 4, 1>()) : make(PixelType<float, 1, 1>());
+      default :
+        return NULL;
+      }
+    }
+
+    /** @brief add a kernel to be benchmarked under name */
+    void addKernel(const std::string &name, KernelFactory factory);
+
+    /** @brief Defined by each bench*.cpp file, adds that plugin's kernels with addKernel. */
+    void registerKernels(void);
+
+  };
+
+};
+
+#endif
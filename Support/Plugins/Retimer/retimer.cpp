@@ -146,9 +146,13 @@ RetimerPlugin::setupAndProcess(OFX::ImageBlenderBase &processor, const OFX::Rend
     double blend;
     framesNeeded(sourceTime, args.fieldToRender, &fromTime, &toTime, &blend);
 
-    // fetch the two source images
-    std::unique_ptr<OFX::Image> fromImg(srcClip_->fetchImage(fromTime));
-    std::unique_ptr<OFX::Image> toImg(srcClip_->fetchImage(toTime));
+    // fetch the two source images in one go, so the host can make them at once
+    std::vector<OFX::ImageFetch> fetches;
+    fetches.push_back(OFX::ImageFetch(srcClip_, fromTime));
+    fetches.push_back(OFX::ImageFetch(srcClip_, toTime));
+    OFX::fetchImages(fetches);
+    std::unique_ptr<OFX::Image> fromImg(fetches[0].image);
+    std::unique_ptr<OFX::Image> toImg(fetches[1].image);
 
     // make sure bit depths are sane
     if(fromImg.get()) checkComponents(*fromImg, dstBitDepth, dstComponents);
@@ -15,6 +15,7 @@
 #include "ofxsImageEffect.h"
 #include "ofxsMultiThread.h"
 #include "ofxsInteract.h"
+#include "ofxsAnalysis.h"
 
 #include "../include/ofxsProcessing.H"
 
@@ -219,18 +220,55 @@ public :
 
 
 
-template<class TypeCarrier, int kComponents, int kMax>
-class Analyser
+/** @brief mean of all the components of an image, scaled by kMax */
+template<class PIX, int kMax>
+static double imageMean(OFX::Image &image)
 {
+  const OfxRectI &bounds = image.getBounds();
+  int rowComponents = (bounds.x2 - bounds.x1) * image.getPixelComponentCount();
+  double sum = 0;
+  long long n = 0;
+  for(int y = bounds.y1; y < bounds.y2; ++y)
+  {
+    const PIX *pix = (const PIX *) image.getPixelAddress(bounds.x1, y);
+    if(!pix)
+      continue;
+    for(int i = 0; i < rowComponents; ++i)
+      sum += pix[i];
+    n += rowComponents;
+  }
+  return n ? sum / (double(n) * kMax) : 0.;
+}
+
+/** @brief keys the mean of each frame of the source onto a double param */
+class Analyser : public OFX::ClipAnalyser<double>
+{
+protected:
+  OFX::DoubleParam* _dbl;
+
 public:
-  Analyser(OFX::Clip* srcClip, OFX::DoubleParam* dbl)
+  Analyser(OFX::ImageEffect &effect, OFX::Clip* srcClip, OFX::DoubleParam* dbl)
+    : OFX::ClipAnalyser<double>(effect, srcClip)
+    , _dbl(dbl)
   {
-    OfxRangeD range = srcClip->getFrameRange();
-    for(double d = range.min; d< range.max; ++d)
+  }
+
+  bool mapFrame(OFX::Image &image, double /*time*/, double &mean)
+  {
+    switch(image.getPixelDepth()) 
     {
-      std::unique_ptr<OFX::Image> src(srcClip->fetchImage(d));
-      dbl->setValueAtTime(d, d);
+    case OFX::eBitDepthUByte :  mean = imageMean<unsigned char, 255>(image); return true;
+    case OFX::eBitDepthUShort : mean = imageMean<unsigned short, 65535>(image); return true;
+    case OFX::eBitDepthFloat :  mean = imageMean<float, 1>(image); return true;
+    default :
+      OFX::throwSuiteStatusException(kOfxStatErrUnsupported);
     }
+    return false;
+  }
+
+  void reduce(double time, const double &mean)
+  {
+    _dbl->setValueAtTime(time, mean);
   }
 };
 
@@ -241,12 +279,15 @@ class GenericTestPlugin : public OFX::ImageEffect
 protected :
   OFX::Clip *dstClip_;
   OFX::Clip *srcClip_;
+  Analyser analyser_;   // kept for the life of the instance, so re-analysing only maps changed frames
 
 public :
-  GenericTestPlugin(OfxImageEffectHandle handle) : ImageEffect(handle), dstClip_(0), srcClip_(0)
+  GenericTestPlugin(OfxImageEffectHandle handle)
+    : ImageEffect(handle)
+    , dstClip_(fetchClip(kOfxImageEffectOutputClipName))
+    , srcClip_(fetchClip(kOfxImageEffectSimpleSourceClipName))
+    , analyser_(*this, srcClip_, fetchDoubleParam("analysisParam"))
   {
-    dstClip_ = fetchClip(kOfxImageEffectOutputClipName);
-    srcClip_ = fetchClip(kOfxImageEffectSimpleSourceClipName);
   }
 
   virtual void render(const OFX::RenderArguments &args);
@@ -271,56 +312,7 @@ public :
     }
     else if(paramName == "analyseButton")
     {
-      OFX::BitDepthEnum       dstBitDepth    = srcClip_->getPixelDepth();
-      OFX::PixelComponentEnum dstComponents  = srcClip_->getPixelComponents();
-      OFX::DoubleParam* dbl = fetchDoubleParam("analysisParam");
-
-      if(dstComponents == OFX::ePixelComponentRGBA) 
-      {
-        switch(dstBitDepth) 
-        {
-        case OFX::eBitDepthUByte : 
-          {
-            Analyser<unsigned char, 4, 255> analyse(srcClip_, dbl);
-            break;
-          }
-        case OFX::eBitDepthUShort :
-          {
-            Analyser<unsigned short, 4, 65535> analyse(srcClip_, dbl);
-            break;
-          }
-        case OFX::eBitDepthFloat :
-          {
-            Analyser<float, 4, 1> analyse(srcClip_, dbl);
-            break;
-          }
-        default :
-          OFX::throwSuiteStatusException(kOfxStatErrUnsupported);
-        }
-      }
-      else 
-      {
-        switch(dstBitDepth) 
-        {
-        case OFX::eBitDepthUByte :
-          {
-            Analyser<unsigned char, 1, 255> analyse(srcClip_, dbl);
-            break;
-          }
-        case OFX::eBitDepthUShort :
-          {
-            Analyser<unsigned short, 1, 65535> analyse(srcClip_, dbl);
-            break;
-          }
-        case OFX::eBitDepthFloat : 
-          {
-            Analyser<float, 1, 1> analyse(srcClip_, dbl);
-            break;
-          }
-        default :
-          OFX::throwSuiteStatusException(kOfxStatErrUnsupported);
-        }
-      }
+      analyser_.analyse(srcClip_->getFrameRange());
     }
   }
 };
@@ -75,9 +75,13 @@ CrossFadePlugin::setupAndProcess(OFX::ImageBlenderBase &processor, const OFX::Re
   OFX::BitDepthEnum          dstBitDepth    = dst->getPixelDepth();
   OFX::PixelComponentEnum    dstComponents  = dst->getPixelComponents();
 
-  // fetch the two source images
-  std::unique_ptr<OFX::Image> fromImg(fromClip_->fetchImage(args.time));
-  std::unique_ptr<OFX::Image> toImg(toClip_->fetchImage(args.time));
+  // fetch the two source images in one go, so the host can make them at once
+  std::vector<OFX::ImageFetch> fetches;
+  fetches.push_back(OFX::ImageFetch(fromClip_, args.time));
+  fetches.push_back(OFX::ImageFetch(toClip_, args.time));
+  OFX::fetchImages(fetches);
+  std::unique_ptr<OFX::Image> fromImg(fetches[0].image);
+  std::unique_ptr<OFX::Image> toImg(fetches[1].image);
 
   // make sure bit depths are sane
   if(fromImg.get()) checkComponents(*fromImg, dstBitDepth, dstComponents);
@@ -0,0 +1,275 @@
+#ifndef _ofxsAnalysis_h_
+#define _ofxsAnalysis_h_
+
+// Copyright OpenFX and contributors to the OpenFX project.
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "ofxsImageEffect.h"
+#include "ofxsMultiThread.h"
+
+/** @file This file contains a base class that can be used to analyse a clip over a range of frames
+
+Analysis is split in two. A map step turns a single frame's image into a result, and is run
+over several frames at once on the host's threads. A reduce step is then handed the results in
+frame order on the calling thread, typically to write keys.
+*/
+
+namespace OFX {
+
+    ////////////////////////////////////////////////////////////////////////////////
+    /** @brief base class to analyse a clip with, Result is whatever mapFrame makes of one frame, and
+        must be default constructible and copyable.
+
+    Results are cached by the unique identifier of the image they were made from, so analysing
+    again only maps the frames whose images have changed. Keep the analyser around between
+    analyses, eg: as a member of your effect, to get the benefit. Hosts that don't give images
+    unique identifiers get no caching.
+    */
+    template <class Result>
+    class ClipAnalyser : public OFX::MultiThread::Processor {
+    protected :
+        OFX::ImageEffect        &_effect;            /**< @brief effect doing the analysis */
+        OFX::Clip               *_clip;              /**< @brief clip to analyse */
+        unsigned int             _maxFramesInFlight; /**< @brief most images fetched at once, 0 for one per CPU */
+
+        std::vector<double>      _frames;            /**< @brief frames being analysed */
+        std::vector<Result>      _results;           /**< @brief result for each of _frames */
+        std::vector<std::string> _frameIDs;          /**< @brief unique identifier of the image each result came from */
+        std::vector<char>        _haveResult;        /**< @brief is there a result for each of _frames, not a vector<bool> as threads write to it */
+        size_t                   _nextFrame;         /**< @brief next of _frames for a thread to take */
+        bool                     _failed;            /**< @brief did a map fail or the effect get aborted */
+        unsigned int             _cacheHits;         /**< @brief frames whose result came from the cache on the last analysis */
+        OFX::MultiThread::Mutex  _lock;              /**< @brief guards _nextFrame, _failed, _cacheHits and _cache */
+
+        std::map<std::string, Result> _cache;        /**< @brief results by the unique identifier of the image they came from */
+
+        size_t                   _waveStart;         /**< @brief first frame of the wave whose images were fetched together */
+        size_t                   _waveEnd;           /**< @brief one past its last frame */
+        std::vector<OFX::Image *> _waveImages;       /**< @brief the images of that wave, taken by the threads mapping them */
+
+        /** @brief fetch and map the i'th frame, or get its result from the cache */
+        void analyseFrame(size_t i)
+        {
+            std::unique_ptr<OFX::Image> image;
+            if(_waveEnd > _waveStart) {
+                // fetched already along with the rest of the wave, each slot is only taken by one thread
+                image.reset(_waveImages[i - _waveStart]);
+                _waveImages[i - _waveStart] = 0;
+            }
+            else
+                image.reset(_clip->fetchImage(_frames[i]));
+            if(!image.get())
+                return; // nothing there, so no result for this frame
+
+            const std::string &id = image->getUniqueIdentifier();
+            if(!id.empty()) {
+                OFX::MultiThread::AutoMutex guard(_lock);
+                typename std::map<std::string, Result>::const_iterator it = _cache.find(id);
+                if(it != _cache.end()) {
+                    _results[i] = it->second;
+                    _frameIDs[i] = id;
+                    _haveResult[i] = 1;
+                    ++_cacheHits;
+                    return;
+                }
+            }
+
+            // each thread writes its own frame's slots, so no need to lock
+            if(mapFrame(*image, _frames[i], _results[i])) {
+                _frameIDs[i] = id;
+                _haveResult[i] = 1;
+            }
+        }
+
+    public :
+        /** @brief ctor */
+        ClipAnalyser(OFX::ImageEffect &effect, OFX::Clip *clip)
+          : _effect(effect)
+          , _clip(clip)
+          , _maxFramesInFlight(0)
+          , _nextFrame(0)
+          , _failed(false)
+          , _cacheHits(0)
+          , _waveStart(0)
+          , _waveEnd(0)
+        {
+        }
+
+        /** @brief Set the most frames mapped at once, and so the most images held at once. By
+            default this is one per CPU. */
+        void setMaxFramesInFlight(unsigned int v) {_maxFramesInFlight = v;}
+
+        /** @brief how many frames of the last analysis had their results taken from the cache */
+        unsigned int getCacheHits(void) const {return _cacheHits;}
+
+        /** @brief forget all cached results */
+        void clearCache(void) {_cache.clear();}
+
+        /** @brief Map one frame's image into a result. This is called on several threads at once,
+            so must only touch the image and result it is given. Return false if the frame has no
+            result, it will be skipped by reduce. Throw to fail the whole analysis. */
+        virtual bool mapFrame(OFX::Image &image, double time, Result &result) = 0;
+
+        /** @brief called before reduce is called on any frames */
+        virtual void beginReduce(void) {}
+
+        /** @brief called with each frame's result in frame order, inside a param edit block */
+        virtual void reduce(double time, const Result &result) = 0;
+
+        /** @brief called after reduce has been called on all frames, inside the same edit block */
+        virtual void endReduce(void) {}
+
+        /** @brief overridden from OFX::MultiThread::Processor. Threads take frames one at a time until there are none left */
+        void multiThreadFunction(unsigned int /*threadId*/, unsigned int /*nThreads*/)
+        {
+            while(true) {
+                size_t i;
+                {
+                    OFX::MultiThread::AutoMutex guard(_lock);
+                    size_t end = _waveEnd > _waveStart ? _waveEnd : _frames.size();
+                    if(_failed || _nextFrame >= end)
+                        return;
+                    i = _nextFrame++;
+                }
+
+                bool failed = _effect.abort();
+                if(!failed) {
+                    try {
+                        analyseFrame(i);
+                    }
+                    catch(...) {
+                        // don't let exceptions out through the host's thread suite
+                        failed = true;
+                    }
+                }
+
+                if(failed) {
+                    OFX::MultiThread::AutoMutex guard(_lock);
+                    _failed = true;
+                    return;
+                }
+            }
+        }
+
+        /** @brief fetch the images of frames [start, end) in one go and map them, deleting any the threads never took */
+        void analyseWave(size_t start, size_t end, unsigned int nThreads)
+        {
+            std::vector<OFX::ImageFetch> fetches;
+            for(size_t i = start; i < end; ++i)
+                fetches.push_back(OFX::ImageFetch(_clip, _frames[i]));
+            try {
+                OFX::fetchImages(fetches);
+            }
+            catch(...) {
+                // as when a thread fails to fetch its frame
+                _failed = true;
+                return;
+            }
+
+            _waveImages.resize(fetches.size());
+            for(size_t i = 0; i < fetches.size(); ++i)
+                _waveImages[i] = fetches[i].image;
+            _waveStart = start;
+            _waveEnd = end;
+            _nextFrame = start;
+
+            if(end - start < nThreads)
+                nThreads = (unsigned int)(end - start);
+            try {
+                multiThread(nThreads);
+            }
+            catch(...) {
+                endWave();
+                throw;
+            }
+            endWave();
+        }
+
+        /** @brief delete the images of the wave that were not mapped */
+        void endWave(void)
+        {
+            for(size_t i = 0; i < _waveImages.size(); ++i)
+                delete _waveImages[i];
+            _waveImages.clear();
+            _waveStart = _waveEnd = 0;
+        }
+
+        /** @brief Analyse each frame from range.min to range.max inclusive. The frames are mapped
+            in parallel, then reduced in order within one param edit block, named by editName, so
+            the keys the reduce writes are a single undoable change.
+
+            If the host has the image fetch suite, the frames are fetched in waves of as many as
+            are mapped at once, each wave in one call, so the host can make their images together.
+
+            Returns false if the effect was aborted or a map failed, in which case nothing is reduced.
+        */
+        bool analyse(const OfxRangeD &range, const std::string &editName = "Analysis")
+        {
+            _frames.clear();
+            for(double t = range.min; t <= range.max; t += 1.)
+                _frames.push_back(t);
+
+            _results.assign(_frames.size(), Result());
+            _frameIDs.assign(_frames.size(), std::string());
+            _haveResult.assign(_frames.size(), 0);
+            _nextFrame = 0;
+            _failed = false;
+            _cacheHits = 0;
+
+            unsigned int nThreads = OFX::MultiThread::getNumCPUs();
+            if(_maxFramesInFlight > 0 && _maxFramesInFlight < nThreads)
+                nThreads = _maxFramesInFlight;
+            if(_frames.size() < nThreads)
+                nThreads = (unsigned int)_frames.size();
+            if(nThreads > 0 && OFX::getImageEffectHostDescription()->supportsImageFetchSuite) {
+                for(size_t start = 0; start < _frames.size() && !_failed; start += nThreads) {
+                    if(_effect.abort()) {
+                        _failed = true;
+                        break;
+                    }
+                    size_t end = start + nThreads;
+                    if(end > _frames.size())
+                        end = _frames.size();
+                    analyseWave(start, end, nThreads);
+                }
+            }
+            else if(nThreads > 0)
+                multiThread(nThreads);
+
+            if(_failed)
+                return false;
+
+            // only keep what this analysis saw, so the cache is never bigger than the clip
+            std::map<std::string, Result> cache;
+            for(size_t i = 0; i < _frames.size(); ++i) {
+                if(_haveResult[i] && !_frameIDs[i].empty())
+                    cache[_frameIDs[i]] = _results[i];
+            }
+            _cache.swap(cache);
+
+            _effect.beginEditBlock(editName);
+            try {
+                beginReduce();
+                for(size_t i = 0; i < _frames.size(); ++i) {
+                    if(_haveResult[i])
+                        reduce(_frames[i], _results[i]);
+                }
+                endReduce();
+            }
+            catch(...) {
+                _effect.endEditBlock();
+                throw;
+            }
+            _effect.endEditBlock();
+            return true;
+        }
+    };
+
+};
+
+#endif
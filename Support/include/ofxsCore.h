@@ -288,6 +288,11 @@ namespace OFX {
 
     /// get a string property
     std::string propGetString(const char* property, int idx, bool throwOnFailure = true) const;
+
+    /// get a string property without copying it, the host owns the string, which stays valid
+    /// until the property is next set, returns "" on failure if not throwing
+    const char *propGetCString(const char* property, int idx = 0, bool throwOnFailure = true) const;
+
     /// get a double property
     double      propGetDouble(const char* property, int idx, bool throwOnFailure = true) const;
 
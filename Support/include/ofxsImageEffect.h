@@ -8,15 +8,22 @@
 This file only holds code that is visible to a plugin implementation, and so hides much
 of the direct OFX objects and any library side only functions.
 */
+#include <list>
 #include <map>
 #include <string>
 #include <sstream>
 #include <memory>
+#include <new>
+#include <atomic>
+#include <mutex>
 #include "ofxsParam.h"
 #include "ofxsInteract.h"
 #include "ofxsMessage.h"
+#include "ofxsMemory.h"
+#include "ofxsMultiThread.h"
 #include "ofxProgress.h"
 #include "ofxTimeLine.h"
+#include "ofxsImageFetch.h"
 #include "ofxParametricParam.h"
 
 /** @brief Nasty macro used to define empty protected copy ctors and assign ops */
@@ -132,10 +139,12 @@ namespace OFX {
   InstanceChangeReason mapToInstanceChangedReason(const std::string &s);
 
   BitDepthEnum mapStrToBitDepthEnum(const std::string &str);
+  BitDepthEnum mapStrToBitDepthEnum(const char *str);
 
   const char* mapBitDepthEnumToStr(BitDepthEnum bitDepth);
 
   PixelComponentEnum mapStrToPixelComponentEnum(const std::string &str);
+  PixelComponentEnum mapStrToPixelComponentEnum(const char *str);
 
   const char* mapPixelComponentEnumToStr(PixelComponentEnum pixelComponent);
 
@@ -273,6 +282,7 @@ namespace OFX {
     bool supportsProgressSuite;
     bool supportsTimeLineSuite;
     bool supportsMessageSuiteV2;
+    bool supportsImageFetchSuite;
 
   public:
     bool supportsPixelComponent(const PixelComponentEnum component) const;
@@ -503,8 +513,8 @@ namespace OFX {
     OfxPointD _renderScale;                  /**< @brief any scaling factor applied to the image */
 
   public :
-    /** @brief ctor */
-    ImageBase(OfxPropertySetHandle props);
+    /** @brief ctor, clip is the clip the image was fetched from, if known */
+    ImageBase(OfxPropertySetHandle props, OfxImageClipHandle clip = 0);
 
     /** @brief dtor */
     virtual ~ImageBase();
@@ -556,14 +566,35 @@ namespace OFX {
   protected :
     void     *_pixelData;                    /**< @brief the base address of the image */
     void     *_OpenCLImage;                  /**< @brief the OpenCL Image handle */
+    bool      _isFieldView;                  /**< @brief is this a view on another image, which owns the host's image */
 
   public :
-    /** @brief ctor */
-    Image(OfxPropertySetHandle props);
+    /** @brief ctor, clip is the clip the image was fetched from, if known */
+    Image(OfxPropertySetHandle props, OfxImageClipHandle clip = 0);
+
+    /** @brief Make a view on one field of an interlaced image, field being eFieldLower or eFieldUpper.
+
+    The view points into the frame's pixels with twice its row bytes, so no pixels are copied.
+    It is half the height of the frame, row y of it being row 2y of the frame for the lower
+    field, row 2y+1 for the upper, and its render scale in y is halved to match. The frame
+    must outlive the view, and the view's property set is the frame's.
+    */
+    Image(Image &frame, FieldEnum field);
 
     /** @brief dtor */
     virtual ~Image();
 
+    /** @brief Images are allocated from a small pool kept by each thread, so fetching one per
+    tile does not go to the heap each time. Deleting one still releases the host's image. */
+    static void *operator new(size_t size);
+    static void operator delete(void *ptr, size_t size) noexcept;
+
+    /** @brief the nothrow and placement forms, which the above would otherwise hide, with the deletes used if a constructor throws */
+    static void *operator new(size_t size, const std::nothrow_t &) noexcept;
+    static void operator delete(void *ptr, const std::nothrow_t &) noexcept;
+    static void *operator new(size_t, void *where) noexcept {return where;}
+    static void operator delete(void *, void *) noexcept {}
+
     /** @brief get the pixel data for this image */
     void *getPixelData(void) { return _pixelData;}
 
@@ -634,6 +665,63 @@ namespace OFX {
     /** @brief effect instance that owns this clip */
     ImageEffect *_effect;
 
+    /** @brief bits in _cachedMask, one per cached property */
+    enum CachedEnum {
+      eCachedPixelDepth              = 1 << 0,
+      eCachedPixelComponents         = 1 << 1,
+      eCachedPixelComponentsStr      = 1 << 2,
+      eCachedUnmappedPixelDepth      = 1 << 3,
+      eCachedUnmappedPixelComponents = 1 << 4,
+      eCachedUnmappedComponentsStr   = 1 << 5,
+      eCachedPreMultiplication       = 1 << 6,
+      eCachedFieldOrder              = 1 << 7,
+      eCachedConnected               = 1 << 8,
+      eCachedContinuousSamples       = 1 << 9,
+      eCachedPixelAspectRatio        = 1 << 10,
+      eCachedFrameRate               = 1 << 11,
+      eCachedFrameRange              = 1 << 12,
+      eCachedUnmappedFrameRate       = 1 << 13,
+      eCachedUnmappedFrameRange      = 1 << 14
+    };
+
+    /** @brief clip properties as last fetched from the host, valid where set in _cachedMask */
+    struct CachedMetadata {
+      BitDepthEnum          pixelDepth;
+      PixelComponentEnum    pixelComponents;
+      std::string           pixelComponentsStr;
+      BitDepthEnum          unmappedPixelDepth;
+      PixelComponentEnum    unmappedPixelComponents;
+      std::string           unmappedComponentsStr;
+      PreMultiplicationEnum preMultiplication;
+      FieldEnum             fieldOrder;
+      bool                  connected;
+      bool                  continuousSamples;
+      double                pixelAspectRatio;
+      double                frameRate;
+      OfxRangeD             frameRange;
+      double                unmappedFrameRate;
+      OfxRangeD             unmappedFrameRange;
+    };
+
+    /** @brief the cached properties */
+    mutable CachedMetadata _cached;
+
+    /** @brief which of _cached are valid, cleared by invalidateCache */
+    mutable std::atomic<unsigned int> _cachedMask;
+
+    /** @brief Guards reading and filling in _cached, which can happen on any render thread. Not a
+        host mutex, as it is taken on every cached read, which is meant to be cheaper than asking the host. */
+    mutable std::mutex _cacheLock;
+
+    /** @brief Bumped by invalidateCache, guarded by _cacheLock. A value fetched from the host across
+        an invalidate is returned but not cached, as it may be from before the change. */
+    mutable unsigned int _cacheGeneration;
+
+    /** @brief Return the cached value at bit, calling fetch to get it from the host if it isn't cached.
+        If fetch throws nothing is cached and the exception propagates. */
+    template <class T, class FETCH>
+    T getCached(unsigned int bit, T &cached, const char *what, FETCH fetch) const;
+
     /** @brief hidden constructor */
     Clip(ImageEffect *effect, const std::string &name, OfxImageClipHandle handle, OfxPropertySetHandle props);
 
@@ -669,7 +757,7 @@ namespace OFX {
     int getPixelComponentCount(void) const;
 
     /** @brief get the string representing the pixel components */
-    std::string getPixelComponentsProperty(void) const { return _clipProps.propGetString(kOfxImageEffectPropComponents);}
+    std::string getPixelComponentsProperty(void) const;
 
     /** @brief what is the actual pixel depth of the clip */
     BitDepthEnum getUnmappedPixelDepth(void) const;
@@ -678,7 +766,7 @@ namespace OFX {
     PixelComponentEnum getUnmappedPixelComponents(void) const;
 
     /** @brief get the string representing the pixel components */
-    std::string getUnmappedPixelComponentsProperty(void) const { return _clipProps.propGetString(kOfxImageClipPropUnmappedComponents);}
+    std::string getUnmappedPixelComponentsProperty(void) const;
 
     /** @brief get the components in the image */
     PreMultiplicationEnum getPreMultiplication(void) const;
@@ -710,6 +798,16 @@ namespace OFX {
     /** @brief get the RoD for this clip in the cannonical coordinate system */
     OfxRectD getRegionOfDefinition(double t);
 
+    /** @brief Forget the clip properties cached by the getters above, so they are fetched from the
+        host again when next asked for.
+
+        The library calls this whenever the host signals the clip may have changed, that is on a clip
+        instance changed action, after the get clip preferences action, at begin sequence render and on
+        purge caches. A plugin only needs to call it if it knows of some other change. In DEBUG builds
+        each cached value is checked against the host, and an error logged if they differ.
+    */
+    void invalidateCache(void);
+
     /** @brief fetch an image
 
     When finished with, the client code must delete the image.
@@ -745,6 +843,37 @@ namespace OFX {
 #endif
   };
 
+  ////////////////////////////////////////////////////////////////////////////////
+  /** @brief An image to fetch along with others with @ref OFX::fetchImages */
+  struct ImageFetch {
+    Clip     *clip;
+    double    time;
+    bool      hasBounds;  /**< @brief fetch only bounds, in cannonical coordinates */
+    OfxRectD  bounds;
+    Image    *image;      /**< @brief set by fetchImages, which the client code must delete, NULL if there is none */
+
+    ImageFetch(Clip *c, double t)
+      : clip(c), time(t), hasBounds(false), image(0)
+    {
+      bounds.x1 = bounds.y1 = bounds.x2 = bounds.y2 = 0;
+    }
+
+    ImageFetch(Clip *c, double t, const OfxRectD &b)
+      : clip(c), time(t), hasBounds(true), bounds(b), image(0)
+    {
+    }
+  };
+
+  /** @brief fetch several images in one go
+
+  If the host has the image fetch suite, it is given the whole list in one call, so it can make
+  the images at the same time, otherwise they are fetched one after the other with Clip::fetchImage.
+
+  As with Clip::fetchImage, an image that can't be fetched is left NULL. Any other error throws,
+  with none of the images left fetched.
+  */
+  void fetchImages(std::vector<ImageFetch> &fetches);
+
   ////////////////////////////////////////////////////////////////////////////////
   /** @brief Class that skins image memory allocation */
   class ImageMemory {
@@ -765,6 +894,139 @@ namespace OFX {
     void unlock(void);
   };
 
+  ////////////////////////////////////////////////////////////////////////////////
+  /** @brief A byte budgeted cache of data derived from images, eg: float copies, blurred pyramids
+  or histograms, so a temporal effect need not rebuild them from a frame it has already seen, as
+  when a retimer's toTime frame becomes the next frame's fromTime.
+
+  Data is keyed by the unique identifier of the image it came from, a name for how it was derived
+  and the render scale. Its memory comes from the image memory suite, so the host can account for
+  it, and is only locked while a DerivedDataCache::Data refers to it. The least recently used data
+  is dropped once the cache is over budget. The cache is thread safe, eg:
+  @verbatim
+    OFX::DerivedDataCache::Data hist = getDerivedDataCache().fetch(*src, "histogram", 256 * sizeof(float),
+                                                                  [&](void *mem) { makeHistogram(*src, (float *)mem); });
+    const float *bins = (const float *)hist.getData();
+  @endverbatim
+
+  Nothing is cached for images from hosts that don't give unique identifiers.
+  */
+  class DerivedDataCache {
+  public :
+    /** @brief what derived data is cached by */
+    struct Key {
+      std::string uniqueID;    /**< @brief unique identifier of the image the data came from */
+      std::string derivation;  /**< @brief how the data was derived from it */
+      OfxPointD   renderScale; /**< @brief render scale of the image */
+
+      Key(const ImageBase &image, const std::string &derivation);
+      bool operator<(const Key &other) const;
+    };
+
+  protected :
+    struct Entry;
+    struct Locked;
+
+  public :
+    /** @brief Some derived data. The memory is locked and valid for as long as any copy of this
+    refers to it, even if the cache drops it in the meantime. */
+    class Data {
+    protected :
+      friend class DerivedDataCache;
+      std::shared_ptr<Locked> _locked;
+      void                   *_data;
+      size_t                  _size;
+
+    public :
+      /** @brief ctor, referring to no data */
+      Data() : _data(0), _size(0) {}
+
+      /** @brief does this refer to any data */
+      bool isValid(void) const {return _data != 0;}
+
+      /** @brief the memory holding the data */
+      void *getData(void) const {return _data;}
+
+      /** @brief its size in bytes */
+      size_t getSize(void) const {return _size;}
+    };
+
+  protected :
+    typedef std::list<std::pair<Key, std::shared_ptr<Entry> > > EntryList;
+
+    ImageEffect                          *_effect;    /**< @brief effect the memory is allocated against, or NULL */
+    size_t                                _maxBytes;  /**< @brief budget */
+    size_t                                _bytes;     /**< @brief bytes of data held */
+    unsigned int                          _hits;      /**< @brief finds that found something */
+    unsigned int                          _misses;    /**< @brief finds that didn't */
+    EntryList                             _entries;   /**< @brief most recently used first */
+    std::map<Key, EntryList::iterator>    _index;     /**< @brief where each key is in _entries */
+    mutable MultiThread::Mutex            _lock;      /**< @brief guards all of the above */
+
+    /** @brief lock an entry's memory for use */
+    static Data lockEntry(const std::shared_ptr<Entry> &entry);
+
+    /** @brief drop the least recently used entries until at most maxBytes are held, called with _lock held */
+    void trim(size_t maxBytes);
+
+  private :
+    DerivedDataCache(const DerivedDataCache &);
+    DerivedDataCache &operator=(const DerivedDataCache &);
+
+  public :
+    /** @brief ctor, allocating against the given effect and holding at most maxBytes */
+    explicit DerivedDataCache(ImageEffect *effect = 0, size_t maxBytes = 64 * 1024 * 1024);
+
+    /** @brief dtor */
+    ~DerivedDataCache();
+
+    /** @brief set the budget, dropping data to fit it */
+    void setMaxBytes(size_t maxBytes);
+
+    /** @brief the budget */
+    size_t getMaxBytes(void) const;
+
+    /** @brief bytes of data held */
+    size_t getBytes(void) const;
+
+    /** @brief how many finds found something, and how many didn't */
+    unsigned int getHits(void) const;
+    unsigned int getMisses(void) const;
+
+    /** @brief find the data for a key, which is not valid if there is none */
+    Data find(const Key &key);
+
+    /** @brief Allocate nBytes for new data, which is not cached until passed to insert.
+
+    Succeeds or throws std::bad_alloc
+    */
+    Data allocate(size_t nBytes);
+
+    /** @brief Cache data made with allocate. If another thread cached data for the key first,
+    that is returned instead, otherwise data is. Data for images with no unique identifier, or
+    bigger than the budget, is not cached. */
+    Data insert(const Key &key, const Data &data);
+
+    /** @brief Get the data derived from image as named by derivation, calling make(void *) to
+    fill nBytes of memory with it if it isn't cached. Two threads may make the same data at
+    once, the first to finish is kept. */
+    template <class Make>
+    Data fetch(const ImageBase &image, const std::string &derivation, size_t nBytes, Make make)
+    {
+      Key key(image, derivation);
+      Data data = find(key);
+      if(!data.isValid()) {
+        data = allocate(nBytes);
+        make(data.getData());
+        data = insert(key, data);
+      }
+      return data;
+    }
+
+    /** @brief drop all cached data */
+    void flush(void);
+  };
+
   ////////////////////////////////////////////////////////////////////////////////
   /** @brief POD struct to pass rendering arguments into @ref ImageEffect::render */
   struct RenderArguments {
@@ -1001,6 +1263,22 @@ namespace OFX {
 
     /** @brief cached result of whether progress start succeeded. */
     bool _progressStartSuccess;
+
+    /** @brief scratch arena for each thread index, made on demand */
+    std::unique_ptr<std::unique_ptr<Memory::ScratchArena>[]> _scratchArenas;
+
+    /** @brief number of _scratchArenas, 0 if none have been made */
+    std::atomic<unsigned int> _nScratchArenas;
+
+    /** @brief number of sequence renders in progress */
+    int _sequenceRenderDepth;
+
+    /** @brief guards making and releasing _scratchArenas and _sequenceRenderDepth */
+    MultiThread::Mutex _scratchLock;
+
+    /** @brief data derived from images, flushed on purgeCaches */
+    DerivedDataCache _derivedDataCache;
+
   public :
     /** @brief ctor */
     ImageEffect(OfxImageEffectHandle handle);
@@ -1089,6 +1367,32 @@ namespace OFX {
     bool flushOpenGLResources(void);
 #endif
 
+    /** @brief Get the scratch arena of the calling thread, as given by OFX::MultiThread::getThreadIndex.
+
+    The arena is kept across the tiles and frames of a sequence render, so temporaries allocated
+    from it during render do not go to the host's allocator once it has grown big enough. Allocate
+    from it within an OFX::Memory::ScratchArena::Scope, so each piece of work frees what it used.
+    All arenas are released after endSequenceRender, or on purgeCaches outside a sequence render.
+
+    As arenas are by thread index, only use them when the effect renders one frame at a time,
+    ie: its render thread safety is eRenderInstanceSafe or eRenderUnsafe.
+    */
+    Memory::ScratchArena &getScratchArena(void);
+
+    /** @brief called by the support library around beginSequenceRender and endSequenceRender */
+    void beginScratchSequence(void);
+    void endScratchSequence(void);
+
+    /** @brief give all scratch arena memory back to the host, unless a sequence render is in progress */
+    void releaseScratchArenas(void);
+
+    /** @brief Get the cache of data derived from images for this instance, kept between renders and
+    flushed by the support library on purgeCaches. Use it from any render thread. */
+    DerivedDataCache &getDerivedDataCache(void) {return _derivedDataCache;}
+
+    /** @brief forget the cached properties of all clips fetched so far, see Clip::invalidateCache */
+    void invalidateClipCaches(void);
+
     ////////////////////////////////////////////////////////////////////////////////
     // these are actions that need to be overridden by a plugin that implements an effect host
 
@@ -0,0 +1,90 @@
+// Copyright OpenFX and contributors to the OpenFX project.
+// SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef _ofxsImageFetch_h_
+#define _ofxsImageFetch_h_
+
+#include "ofxCore.h"
+#include "ofxImageEffect.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @file ofxsImageFetch.h
+
+This file contains an optional suite for fetching several images in one call.
+
+It is not part of the OFX standard. It is an extension offered by hosts built
+on the HostSupport library and used by the Support library, so its name
+carries the openfx project's prefix rather than the Ofx one kept for
+standard suites.
+
+With OfxImageEffectSuiteV1::clipGetImage a plugin that needs more than one
+image, say two frames to blend between or the frames of a range to
+analyse, asks for them one after the other, and each call blocks while the
+host makes its image. The host only ever sees one request at a time, so
+can't make the images upstream of the plugin at once.
+
+With this suite the plugin hands the host the whole list, which it is free
+to satisfy in any order, or concurrently. Plugins should fall back to
+clipGetImage if the host does not provide the suite.
+*/
+
+/** @brief The name of the image fetch suite, used to fetch from a host via
+    OfxHost::fetchSuite
+ */
+#define kOfxsImageFetchSuite "net.sf.openfx.ImageFetchSuite"
+
+/** @brief One image asked for from OfxImageFetchSuiteV1::clipGetImages
+
+The plugin fills in the clip, time and region, the host the image handle
+and status.
+*/
+typedef struct OfxImageFetchRequest {
+  /** @brief the clip to fetch from */
+  OfxImageClipHandle    clip;
+
+  /** @brief time to fetch the image at */
+  OfxTime               time;
+
+  /** @brief region to fetch the image from, as with clipGetImage, may be NULL */
+  const OfxRectD       *region;
+
+  /** @brief the image fetched, released with clipReleaseImage, or NULL */
+  OfxPropertySetHandle  imageHandle;
+
+  /** @brief what clipGetImage would have returned for this image */
+  OfxStatus             status;
+} OfxImageFetchRequest;
+
+/** @brief Suite to fetch several images at once
+
+    This is an optional suite in the Image Effect API.
+*/
+typedef struct OfxImageFetchSuiteV1 {
+  /** @brief Get several images from clips, as clipGetImage would for each
+
+  \arg \c requests the images to fetch, with their handles and statuses set on return
+  \arg \c nRequests how many there are
+
+  The host may make the images in any order and at the same time, but
+  returns only once every request has its image handle and status set.
+  Each image fetched must be released with clipReleaseImage, as if it
+  were fetched on its own.
+
+  @returns
+  - ::kOfxStatOK - every image was fetched
+  - ::kOfxStatFailed - some images could not be fetched, the others were,
+    as with clipGetImage this is not an error
+  - ::kOfxStatErrBadHandle - some request had a bad clip handle
+  - ::kOfxStatErrMemory - some request ran out of memory
+  */
+  OfxStatus (*clipGetImages)(OfxImageFetchRequest *requests, int nRequests);
+} OfxImageFetchSuiteV1;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
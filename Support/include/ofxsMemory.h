@@ -9,6 +9,9 @@ This file only holds code that is visible to a plugin implementation, and so hid
 of the direct OFX objects and any library side only functions.
 */
 
+#include <cstddef>
+#include <vector>
+
 /** @brief The core 'OFX Support' namespace, used by plugin implementations. All code for these are defined in the common support libraries.
 */
 namespace OFX {
@@ -36,6 +39,117 @@ namespace OFX {
     \arg \e ptr	      - pointer previously returned by OFX::Memory::allocate
     */
     void free(void *ptr) noexcept;
+
+    /** @brief A bump allocator for scratch memory, for temporaries that only live as long as
+    some piece of work, eg: the intermediate rows of a separable filter.
+
+    Memory comes from the host in large blocks, which are kept and reused rather than freed
+    each time they are done with. Allocations are rewound in a stack like fashion, either
+    with getMark/rewind or with a ScratchArena::Scope. Once the arena has grown to the most
+    any piece of work needs, it stops asking the host for memory.
+
+    An arena is not thread safe, use one per thread, eg: with OFX::ImageEffect::getScratchArena.
+    */
+    class ScratchArena {
+    public :
+      /** @brief default alignment of allocations, enough for any SIMD type */
+      enum {kDefaultAlignment = 64};
+
+      /** @brief a point in the arena to rewind to */
+      struct Mark {
+        size_t block;  /**< @brief block being allocated from */
+        size_t used;   /**< @brief bytes used in it */
+        size_t inUse;  /**< @brief bytes allocated in all blocks */
+      };
+
+      /** @brief Rewinds the arena to where it was when the scope was opened, so anything
+      allocated through it is freed when it goes out of scope, eg:
+      @verbatim
+        OFX::Memory::ScratchArena::Scope scratch(_effect.getScratchArena());
+        float *row = scratch.allocateArray<float>(width * nComponents);
+      @endverbatim
+      */
+      class Scope {
+      protected :
+        ScratchArena &_arena;
+        Mark          _mark;
+
+      private :
+        Scope(const Scope &);
+        Scope &operator=(const Scope &);
+
+      public :
+        explicit Scope(ScratchArena &arena) : _arena(arena), _mark(arena.getMark()) {}
+        ~Scope() {_arena.rewind(_mark);}
+
+        /** @brief allocate from the arena, see ScratchArena::allocate */
+        void *allocate(size_t nBytes, size_t alignment = kDefaultAlignment) {return _arena.allocate(nBytes, alignment);}
+
+        /** @brief allocate an array from the arena, see ScratchArena::allocateArray */
+        template <class T>
+        T *allocateArray(size_t n) {return _arena.allocateArray<T>(n);}
+      };
+
+    protected :
+      /** @brief a block of memory from the host */
+      struct Block {
+        char   *data;
+        size_t  size;
+      };
+
+      ImageEffect       *_effect;     /**< @brief effect the memory is allocated against, or NULL */
+      size_t             _blockSize;  /**< @brief smallest block to ask the host for */
+      std::vector<Block> _blocks;     /**< @brief blocks allocated so far */
+      size_t             _block;      /**< @brief block being allocated from */
+      size_t             _used;       /**< @brief bytes used in it */
+      size_t             _inUse;      /**< @brief bytes allocated in all blocks */
+      size_t             _highWater;  /**< @brief most bytes ever allocated at once, including alignment */
+
+    private :
+      ScratchArena(const ScratchArena &);
+      ScratchArena &operator=(const ScratchArena &);
+
+    public :
+      /** @brief ctor, allocating against the given effect in blocks of at least blockSize bytes */
+      explicit ScratchArena(ImageEffect *effect = 0, size_t blockSize = 1024 * 1024);
+
+      /** @brief dtor, gives all memory back to the host */
+      ~ScratchArena();
+
+      /** @brief Allocate nBytes aligned to alignment, which must be a power of two. The memory
+      is valid until the arena is rewound past it, reset or released.
+
+      Succeeds or throws std::bad_alloc
+      */
+      void *allocate(size_t nBytes, size_t alignment = kDefaultAlignment);
+
+      /** @brief allocate an uninitialised array of n T's */
+      template <class T>
+      T *allocateArray(size_t n)
+      {
+        return static_cast<T *>(allocate(n * sizeof(T), alignof(T) > kDefaultAlignment ? alignof(T) : size_t(kDefaultAlignment)));
+      }
+
+      /** @brief where the arena is now */
+      Mark getMark(void) const;
+
+      /** @brief Free everything allocated since the mark was got. Rewinding to the start of an
+      arena that had to grow over several blocks swaps them for a single one big enough for all
+      of it. */
+      void rewind(const Mark &mark);
+
+      /** @brief free everything allocated, but keep the memory for reuse */
+      void reset(void);
+
+      /** @brief give all memory back to the host */
+      void release(void);
+
+      /** @brief bytes currently allocated */
+      size_t getBytesInUse(void) const {return _inUse;}
+
+      /** @brief bytes held from the host */
+      size_t getBytesReserved(void) const;
+    };
   };
 
 };
@@ -38,6 +38,10 @@ England
 
 #include <cassert>
 #include <algorithm>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <sstream>
 
 #include "ofxsImageEffect.h"
 #include "ofxsMultiThread.h"
@@ -51,6 +55,85 @@ specific image processing algorithms.
 
 namespace OFX {
 
+    ////////////////////////////////////////////////////////////////////////////////
+    /** @brief where the time went in an ImageProcessor::process call, filled in when profiling is on
+
+    Stats from several calls, eg: over a sequence, can be summed with add.
+    */
+    struct ProcessorStats {
+        std::string         path;               /**< @brief "CPU", "OpenCL", "CUDA" or "Metal" */
+        unsigned int        nCalls;             /**< @brief number of process calls summed in here */
+        double              pixels;             /**< @brief pixels in the render windows */
+        double              preProcessSecs;     /**< @brief wall time in preProcess */
+        double              processSecs;        /**< @brief wall time in the threaded or GPU pass */
+        double              postProcessSecs;    /**< @brief wall time in postProcess */
+        double              totalSecs;          /**< @brief wall time in process */
+        std::vector<double> threadBusySecs;     /**< @brief time each thread spent in multiThreadProcessImages, CPU path only */
+
+        /** @brief ctor */
+        ProcessorStats() { reset(); }
+
+        /** @brief clear it all */
+        void reset(void)
+        {
+            path.clear();
+            nCalls = 0;
+            pixels = preProcessSecs = processSecs = postProcessSecs = totalSecs = 0;
+            threadBusySecs.clear();
+        }
+
+        /** @brief sum in the stats of another call */
+        void add(const ProcessorStats &other)
+        {
+            if(path.empty())
+                path = other.path;
+            nCalls += other.nCalls;
+            pixels += other.pixels;
+            preProcessSecs += other.preProcessSecs;
+            processSecs += other.processSecs;
+            postProcessSecs += other.postProcessSecs;
+            totalSecs += other.totalSecs;
+            if(threadBusySecs.size() < other.threadBusySecs.size())
+                threadBusySecs.resize(other.threadBusySecs.size(), 0.);
+            for(size_t i = 0; i < other.threadBusySecs.size(); ++i)
+                threadBusySecs[i] += other.threadBusySecs[i];
+        }
+
+        /** @brief pixels processed per second of the whole process call */
+        double getPixelsPerSecond(void) const { return totalSecs > 0 ? pixels / totalSecs : 0.; }
+
+        /** @brief The busiest thread's time over the mean thread's time, 1 is a perfect
+            balance, 2 means one thread took twice as long as the average. 0 if there
+            were no threads.
+        */
+        double getLoadImbalance(void) const
+        {
+            if(threadBusySecs.empty())
+                return 0.;
+            double sum = 0, most = 0;
+            for(size_t i = 0; i < threadBusySecs.size(); ++i) {
+                sum += threadBusySecs[i];
+                most = std::max(most, threadBusySecs[i]);
+            }
+            return sum > 0 ? most * threadBusySecs.size() / sum : 0.;
+        }
+
+        /** @brief a single line summary, times in milliseconds */
+        std::string toString(void) const
+        {
+            std::ostringstream os;
+            os << path << " " << nCalls << " call(s), " << pixels << " pixels"
+               << ", pre " << preProcessSecs * 1000. << "ms"
+               << ", process " << processSecs * 1000. << "ms"
+               << ", post " << postProcessSecs * 1000. << "ms"
+               << ", total " << totalSecs * 1000. << "ms"
+               << ", " << getPixelsPerSecond() / 1e6 << " Mpixels/s";
+            if(!threadBusySecs.empty())
+                os << ", " << threadBusySecs.size() << " threads, imbalance " << getLoadImbalance();
+            return os.str();
+        }
+    };
+
     ////////////////////////////////////////////////////////////////////////////////
     // base class to process images with
     class ImageProcessor : public OFX::MultiThread::Processor {
@@ -64,6 +147,17 @@ namespace OFX {
         void*            _pOpenCLCmdQ;           /**< @brief OpenCL Command Queue Handle */
         void*            _pCudaStream;           /**< @brief Cuda Stream Handle */
         void*            _pMetalCmdQ;           /**< @brief Metal Command Queue Handle */
+        bool             _profile;               /**< @brief time the phases of process */
+        bool             _logProfile;            /**< @brief send the times to the host as a log message */
+        ProcessorStats   _stats;                 /**< @brief times of the last process call */
+
+        typedef std::chrono::steady_clock ProfileClock;
+
+        /** @brief seconds since start */
+        static double secondsSince(ProfileClock::time_point start)
+        {
+            return std::chrono::duration<double>(ProfileClock::now() - start).count();
+        }
 
     public :
         /** @brief ctor */
@@ -76,6 +170,8 @@ namespace OFX {
           , _pOpenCLCmdQ(NULL)
           , _pCudaStream(NULL)
           , _pMetalCmdQ(NULL)
+          , _profile(false)
+          , _logProfile(false)
         {
             _renderWindow.x1 = _renderWindow.y1 = _renderWindow.x2 = _renderWindow.y2 = 0;
         }
@@ -107,6 +203,20 @@ namespace OFX {
         /** @brief reset the render window */
         void setRenderWindow(OfxRectI rect) {_renderWindow = rect;}
 
+        /** @brief Turn on timing of each phase of process and of each thread. This costs a
+            couple of clock reads per phase and thread, so can be left on in shipping
+            plugins. If logToHost is set, each process call's stats are also sent to the
+            host's message suite as a log message.
+        */
+        void setProfiling(bool enabled, bool logToHost = false)
+        {
+            _profile = enabled;
+            _logProfile = enabled && logToHost;
+        }
+
+        /** @brief the stats of the last process call, empty unless profiling is on */
+        const ProcessorStats &getStats(void) const {return _stats;}
+
         /** @brief overridden from OFX::MultiThread::Processor. This function is called once on each SMP thread by the base class */
         void multiThreadFunction(unsigned int threadId, unsigned int nThreads)
         {
@@ -131,7 +241,15 @@ namespace OFX {
             win.y1 = y1; win.y2 = y2;
 
             // and render that thread on each
-            multiThreadProcessImages(win);
+            if(_profile && threadId < _stats.threadBusySecs.size()) {
+                // each thread has its own slot, so no need to lock
+                ProfileClock::time_point start = ProfileClock::now();
+                multiThreadProcessImages(win);
+                _stats.threadBusySecs[threadId] = secondsSince(start);
+            }
+            else {
+                multiThreadProcessImages(win);
+            }
         }
 
         /** @brief called before any MP is done */
@@ -186,22 +304,38 @@ namespace OFX {
                 }
             }
 
+            _stats.reset();
+            ProfileClock::time_point start, phaseStart;
+            if(_profile) {
+                _stats.nCalls = 1;
+                _stats.pixels = double(_renderWindow.x2 - _renderWindow.x1) * double(_renderWindow.y2 - _renderWindow.y1);
+                start = phaseStart = ProfileClock::now();
+            }
+
             // call the pre MP pass
             preProcess();
 
+            if(_profile) {
+                _stats.preProcessSecs = secondsSince(phaseStart);
+                phaseStart = ProfileClock::now();
+            }
+
             if (_isEnabledOpenCLRender)
             {
               OFX::Log::print("processing via OpenCL");
+                _stats.path = "OpenCL";
                 processImagesOpenCL();
             }
             else if (_isEnabledCudaRender)
             {
               OFX::Log::print("processing via CUDA");
+                _stats.path = "CUDA";
                 processImagesCuda();
             }
             else if (_isEnabledMetalRender)
             {
               OFX::Log::print("processing via Metal");
+                _stats.path = "Metal";
                 processImagesMetal();
             }
             else // is CPU
@@ -213,12 +347,28 @@ namespace OFX {
                 // make sure the number of CPUs is valid (and use at least 1 CPU)
                 nCPUs = std::max(1u, std::min(nCPUs, OFX::MultiThread::getNumCPUs()));
 
+                _stats.path = "CPU";
+                if(_profile)
+                    _stats.threadBusySecs.assign(nCPUs, 0.);
+
                 // call the base multi threading code, should put a pre & post thread calls in too
                 multiThread(nCPUs);
             }
 
+            if(_profile) {
+                _stats.processSecs = secondsSince(phaseStart);
+                phaseStart = ProfileClock::now();
+            }
+
             // call the post MP pass
             postProcess();
+
+            if(_profile) {
+                _stats.postProcessSecs = secondsSince(phaseStart);
+                _stats.totalSecs = secondsSince(start);
+                if(_logProfile)
+                    _effect.sendMessage(OFX::Message::eMessageLog, "", _stats.toString());
+            }
         }
 
     };